@@ -0,0 +1,362 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "request.h"
+#include "chunkstore.h"
+
+//
+//	CHUNKSTORE.CPP
+//
+//	A track payload is cut into variable sized chunks at content defined
+//	boundaries, so identical or partly edited tracks share most of their chunks.
+//	Each chunk is named by the SHA-1 digest of its bytes and kept once in the
+//	store directory. The server and the engines cut with the same gear table,
+//	so both sides agree on the chunk list for the same payload.
+//
+
+static unsigned long long gear[256];
+
+#define ROL(x,n)	(((x) << (n)) | ((x) >> (32 - (n))))
+
+static void sha1_block( unsigned int *h, const unsigned char *p ) {
+
+	unsigned int w[80], a, b, c, d, e, f, k, t;
+	int i;
+
+	for( i = 0; i < 16; i++, p += 4 )
+		w[i] = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+	for( ; i < 80; i++ )
+		w[i] = ROL( w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1 );
+
+	a = h[0]; b = h[1]; c = h[2]; d = h[3]; e = h[4];
+	for( i = 0; i < 80; i++ ) {
+		if( i < 20 ) 		{ f = (b & c) | (~b & d);			k = 0x5a827999; }
+		else if( i < 40 )	{ f = b ^ c ^ d;					k = 0x6ed9eba1; }
+		else if( i < 60 )	{ f = (b & c) | (b & d) | (c & d);	k = 0x8f1bbcdc; }
+		else				{ f = b ^ c ^ d;					k = 0xca62c1d6; }
+		t = ROL( a, 5 ) + f + e + k + w[i];
+		e = d; d = c; c = ROL( b, 30 ); b = a; a = t;
+	}
+	h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+}
+
+void ChunkStore::digest( const unsigned char *p, unsigned len, unsigned char *out ) {
+
+	unsigned int h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+	unsigned long long bits = (unsigned long long)len * 8;
+	unsigned char block[64];
+	unsigned n = len;
+	int i;
+
+	while( n >= 64 ) {
+		sha1_block( h, p );
+		p += 64;
+		n -= 64;
+	}
+	// pad out the last block with the bit length
+	memcpy( block, p, n );
+	block[n++] = 0x80;
+	if( n > 56 ) {
+		memset( block + n, 0, 64 - n );
+		sha1_block( h, block );
+		n = 0;
+	}
+	memset( block + n, 0, 56 - n );
+	for( i = 0; i < 8; i++ )
+		block[63-i] = (unsigned char)(bits >> (8 * i));
+	sha1_block( h, block );
+
+	for( i = 0; i < 5; i++ ) {
+		out[4*i]   = h[i] >> 24;
+		out[4*i+1] = h[i] >> 16;
+		out[4*i+2] = h[i] >> 8;
+		out[4*i+3] = h[i];
+	}
+}
+
+static unsigned find_cut( const unsigned char *p, unsigned n ) {
+	//
+	// return the length of the next chunk in a window of n bytes.
+	// the gear hash only depends on the last 64 bytes, and we test its top bits
+	//
+	unsigned long long hash = 0;
+	unsigned i;
+
+	if( n <= CHUNK_MIN ) return n;
+	if( n > CHUNK_MAX ) n = CHUNK_MAX;
+
+	for( i = CHUNK_MIN - 64; i < n; i++ ) {
+		hash = (hash << 1) + gear[p[i]];
+		if( i >= CHUNK_MIN && (hash >> (64 - CHUNK_AVG_BITS)) == 0 )
+			return i + 1;
+	}
+	return n;
+}
+
+ChunkStore::ChunkStore(const char *d) {
+
+	// fill the gear table from a fixed seed (splitmix64)
+	unsigned long long x = 0x6c6f6f7052ULL, z;
+	for( int i = 0; i < 256; i++ ) {
+		z = (x += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		gear[i] = z ^ (z >> 31);
+	}
+
+	dir = new char[strlen(d)+1];
+	strcpy( dir, d );
+	if( mkdir( dir, 0770 ) < 0 && errno != EEXIST )
+		perror("ChunkStore mkdir");
+}
+
+ChunkStore::~ChunkStore() {
+
+	delete[] dir;
+}
+
+void ChunkStore::path( const unsigned char *digest, char *buf ) {
+
+	int n = sprintf( buf, "%s/", dir );
+	for( int i = 0; i < CHUNK_DIGEST_LEN; i++ )
+		n += sprintf( buf + n, "%02x", digest[i] );
+}
+
+bool ChunkStore::have( struct chunk_ref *ref ) {
+
+	char name[256];
+	path( ref->digest, name );
+	return access( name, R_OK ) == 0;
+}
+
+bool ChunkStore::verify( struct chunk_ref *ref, unsigned char *data ) {
+
+	unsigned char d[CHUNK_DIGEST_LEN];
+	digest( data, ref->length, d );
+	return memcmp( d, ref->digest, CHUNK_DIGEST_LEN ) == 0;
+}
+
+int ChunkStore::store( struct chunk_ref *ref, unsigned char *data ) {
+	//
+	// write a chunk unless we have it already. Written under a temporary
+	// name and renamed, so a concurrent reader never sees a partial chunk
+	//
+	char name[256], tmpname[256+8];
+	int fd;
+
+	if( have( ref ) ) return 0;
+
+	path( ref->digest, name );
+	sprintf( tmpname, "%s.XXXXXX", name );
+	if( (fd = mkstemp( tmpname )) < 0 ) {
+		perror("ChunkStore::store mkstemp");
+		return 1;
+	}
+	if( write( fd, data, ref->length ) != (int)ref->length ) {
+		perror("ChunkStore::store write");
+		close( fd );
+		unlink( tmpname );
+		return 1;
+	}
+	close( fd );
+	if( rename( tmpname, name ) < 0 ) {
+		perror("ChunkStore::store rename");
+		unlink( tmpname );
+		return 1;
+	}
+	return 0;
+}
+
+int ChunkStore::fetch( struct chunk_ref *ref, unsigned char *data ) {
+	//
+	// read a chunk into data ( at least CHUNK_MAX bytes ) and set its length.
+	// return the length, or -1 if we don't have it
+	//
+	char name[256];
+	int fd, readcnt, len = 0;
+
+	path( ref->digest, name );
+	if( (fd = open( name, O_RDONLY )) < 0 ) return -1;
+	while( len < CHUNK_MAX && (readcnt = read( fd, data + len, CHUNK_MAX - len )) > 0 )
+		len += readcnt;
+	// the modification time marks the last use for trim()
+	futimens( fd, NULL );
+	close( fd );
+
+	ref->length = len;
+	return len;
+}
+
+int ChunkStore::split( int fd, struct chunk_ref **refs, bool keep ) {
+	//
+	// cut everything readable from fd into chunks, returning the count and
+	// a new[]'ed list of references. With keep, also store each chunk
+	//
+	unsigned char *buf = new unsigned char[CHUNK_MAX];
+	struct chunk_ref *list, *grow;
+	unsigned fill = 0, cut;
+	int readcnt, count = 0, alloc = 64;
+	bool eof = false;
+
+	list = new struct chunk_ref[alloc];
+
+	while( !eof || fill ) {
+		// top up the window
+		while( !eof && fill < CHUNK_MAX ) {
+			readcnt = read( fd, buf + fill, CHUNK_MAX - fill );
+			if( readcnt < 0 ) {
+				perror("ChunkStore::split read");
+				delete[] buf;
+				delete[] list;
+				return -1;
+			}
+			if( readcnt == 0 ) eof = true;
+			else fill += readcnt;
+		}
+		if( fill == 0 ) break;
+
+		if( count == alloc ) {
+			grow = new struct chunk_ref[alloc * 2];
+			memcpy( grow, list, sizeof(struct chunk_ref) * alloc );
+			delete[] list;
+			list = grow;
+			alloc *= 2;
+		}
+
+		cut = find_cut( buf, fill );
+		list[count].length = cut;
+		digest( buf, cut, list[count].digest );
+		if( keep && store( &list[count], buf ) ) {
+			delete[] buf;
+			delete[] list;
+			return -1;
+		}
+		count++;
+
+		memmove( buf, buf + cut, fill - cut );
+		fill -= cut;
+	}
+
+	delete[] buf;
+	*refs = list;
+	return count;
+}
+
+int ChunkStore::assemble( struct chunk_ref *refs, int count, int fd ) {
+	//
+	// write the chunks in order to fd, returning the total byte count
+	//
+	unsigned char *buf = new unsigned char[CHUNK_MAX];
+	struct chunk_ref ref;
+	long int total = 0;
+
+	for( int i = 0; i < count; i++ ) {
+		ref = refs[i];
+		if( fetch( &ref, buf ) != (int)refs[i].length ) {
+			fprintf(stderr, "ChunkStore::assemble: missing chunk %d\n", i );
+			delete[] buf;
+			return -1;
+		}
+		write( fd, buf, ref.length );
+		total += ref.length;
+	}
+
+	delete[] buf;
+	return total;
+}
+
+struct stored_chunk {
+	struct timespec used;
+	long int size;
+	char name[CHUNK_DIGEST_LEN * 2 + 1];
+};
+
+static int used_first( const void *a, const void *b ) {
+
+	struct timespec *x = &((struct stored_chunk *)a)->used, *y = &((struct stored_chunk *)b)->used;
+	if( x->tv_sec != y->tv_sec ) return x->tv_sec < y->tv_sec ? -1 : 1;
+	return x->tv_nsec < y->tv_nsec ? -1 : x->tv_nsec > y->tv_nsec;
+}
+
+int ChunkStore::trim( long int max ) {
+	//
+	// remove the chunks used longest ago until the store holds no more than
+	// max bytes, return how many went or -1
+	//
+	struct stored_chunk *list, *grow;
+	struct dirent *entry;
+	struct stat st;
+	char *name;
+	int count = 0, alloc = 256, removed = 0, i;
+	long int total = 0;
+	DIR *d;
+
+	if( (d = opendir( dir )) == NULL ) {
+		perror("ChunkStore::trim opendir");
+		return -1;
+	}
+	// the directory, a slash and a chunk's name
+	name = new char[strlen( dir ) + CHUNK_DIGEST_LEN * 2 + 2];
+	list = new struct stored_chunk[alloc];
+	while( (entry = readdir( d )) != NULL ) {
+		// whole chunks only, a chunk being stored has a longer name
+		if( strlen( entry->d_name ) != CHUNK_DIGEST_LEN * 2 ) continue;
+		sprintf( name, "%s/%s", dir, entry->d_name );
+		if( stat( name, &st ) < 0 ) continue;
+
+		if( count == alloc ) {
+			grow = new struct stored_chunk[alloc * 2];
+			memcpy( grow, list, sizeof(struct stored_chunk) * alloc );
+			delete[] list;
+			list = grow;
+			alloc *= 2;
+		}
+		list[count].used = st.st_mtim;
+		list[count].size = st.st_size;
+		strcpy( list[count].name, entry->d_name );
+		total += st.st_size;
+		count++;
+	}
+	closedir( d );
+
+	if( total > max ) {
+		qsort( list, count, sizeof(struct stored_chunk), used_first );
+		for( i = 0; i < count && total > max; i++ ) {
+			sprintf( name, "%s/%s", dir, list[i].name );
+			if( unlink( name ) == 0 ) removed++;
+			total -= list[i].size;
+		}
+	}
+	delete[] list;
+	delete[] name;
+	return removed;
+}
@@ -0,0 +1,61 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+//
+// class CHUNKSTORE
+//
+// content addressed storage of track payloads, shared by the server and engines
+//
+#define CHUNK_DIR		"chunks"
+#define CHUNK_MIN		2048
+#define CHUNK_MAX		65536
+#define CHUNK_AVG_BITS	13			// boundaries every 8k bytes on average
+#define CHUNK_TRACK_MAX	(1L << 30)	// the largest track payload taken
+#define CHUNK_COUNT_MAX	(int)(CHUNK_TRACK_MAX / CHUNK_MIN + 1)	// so the most chunks in a list
+
+#define MANIFEST_MAGIC	0x464d526c	// "lRMF"
+
+//
+// header of a stored track manifest, followed by count chunk_refs
+//
+struct chunk_manifest {
+	unsigned int magic, count;
+	long int length;
+};
+
+class ChunkStore {
+
+	char *dir;
+
+	void path(const unsigned char *, char *);
+
+public:
+
+	ChunkStore(const char *);
+	~ChunkStore();
+
+	bool have(struct chunk_ref *), verify(struct chunk_ref *, unsigned char *);
+	int store(struct chunk_ref *, unsigned char *), fetch(struct chunk_ref *, unsigned char *),
+		split(int, struct chunk_ref **, bool), assemble(struct chunk_ref *, int, int), trim(long);
+
+	static void digest(const unsigned char *, unsigned, unsigned char *);
+};
@@ -0,0 +1,394 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+#include "network.h"
+#include "control.h"
+
+//
+//	CONTROL.CPP
+//
+//	A datagram is the header followed by count commands. Each command is
+//	its code byte followed by its arguments as the schema gives them, little
+//	endian, with a string sent as a length byte and its characters.
+//
+//	An acknowledgement is a header with the CONTROL_ACK flag, the sequence
+//	it answers and count status bytes, one for each command in that datagram.
+//
+
+static const char *control_args[] = {
+	"",
+#define X(code, args, key) args,
+	CONTROL_SCHEMA
+#undef X
+};
+
+static const int control_keys[] = {
+	-1,
+#define X(code, args, key) key,
+	CONTROL_SCHEMA
+#undef X
+};
+
+static const char *control_names[] = {
+	"CTL_NONE",
+#define X(code, args, key) #code,
+	CONTROL_SCHEMA
+#undef X
+};
+
+const char *control_name(int code) {
+
+	if( code <= CTL_NONE || code >= CTL_COUNT ) return control_names[CTL_NONE];
+	return control_names[code];
+}
+
+static long now_ms() {
+
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static unsigned char *put_header( unsigned char *p, struct control_header *h ) {
+
+	*p++ = h->magic & 0xff;		*p++ = h->magic >> 8;
+	*p++ = h->version;			*p++ = h->flags;
+	for( int i = 0; i < 32; i += 8 ) *p++ = h->client >> i;
+	for( int i = 0; i < 32; i += 8 ) *p++ = h->sequence >> i;
+	*p++ = h->count & 0xff;		*p++ = h->count >> 8;
+	return p;
+}
+
+static int get_header( unsigned char *p, int length, struct control_header *h ) {
+
+	if( length < CONTROL_HEADER ) return -1;
+
+	h->magic = p[0] | (p[1] << 8);
+	h->version = p[2];
+	h->flags = p[3];
+	h->client = p[4] | (p[5] << 8) | (p[6] << 16) | ((unsigned int)p[7] << 24);
+	h->sequence = p[8] | (p[9] << 8) | (p[10] << 16) | ((unsigned int)p[11] << 24);
+	h->count = p[12] | (p[13] << 8);
+
+	if( h->magic != CONTROL_MAGIC || h->version != CONTROL_VERSION ) return -1;
+	return 0;
+}
+
+//
+// decode one command at p, returns the byte past it or NULL when malformed
+//
+static unsigned char *get_command( unsigned char *p, unsigned char *end, struct control_command *c ) {
+
+	int n = 0, len;
+	const char *a;
+
+	if( p >= end ) return NULL;
+	c->code = *p++;
+	c->text[0] = '\0';
+	if( c->code <= CTL_NONE || c->code >= CTL_COUNT ) return NULL;
+
+	for( a = control_args[c->code]; *a; a++, n++ ) switch( *a ) {
+		case 'b':
+			if( end - p < 1 ) return NULL;
+			c->arg[n] = *p++;
+			break;
+		case 'h':
+			if( end - p < 2 ) return NULL;
+			c->arg[n] = (short)(p[0] | (p[1] << 8));
+			p += 2;
+			break;
+		case 'i':
+			if( end - p < 4 ) return NULL;
+			c->arg[n] = (int)(p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24));
+			p += 4;
+			break;
+		case 's':
+			if( end - p < 1 ) return NULL;
+			len = *p++;
+			if( len > CONTROL_TEXT_MAX || end - p < len ) return NULL;
+			memcpy( c->text, p, len );
+			c->text[len] = '\0';
+			c->arg[n] = len;
+			p += len;
+			break;
+	}
+	return p;
+}
+
+//
+// ControlEncoder
+//
+
+ControlEncoder::ControlEncoder(Network *n) {
+
+	network = n;
+	srand( time(NULL) ^ getpid() );
+	client = rand();
+	sequence = 0;
+	length = CONTROL_HEADER;
+	count = 0;
+	for( int i = 0; i < CONTROL_WINDOW; i++ )
+		pending[i].length = 0;
+}
+
+int ControlEncoder::add(int code, ...) {
+	//
+	// append a command to the batch, arguments as the schema gives them
+	//
+	unsigned char command[CONTROL_DATAGRAM], *p = command, *q;
+	const char *a, *s;
+	int n, v, keylen = 0;
+	va_list ap;
+
+	if( code <= CTL_NONE || code >= CTL_COUNT ) {
+		fprintf(stderr, "control: unknown command %d\n", code);
+		return -1;
+	}
+
+	*p++ = code;
+	va_start( ap, code );
+	for( a = control_args[code], n = 0; *a; a++, n++ ) {
+		if( n == control_keys[code] ) keylen = p - command;
+		switch( *a ) {
+			case 'b':
+				*p++ = va_arg( ap, int );
+				break;
+			case 'h':
+				v = va_arg( ap, int );
+				*p++ = v & 0xff;	*p++ = (v >> 8) & 0xff;
+				break;
+			case 'i':
+				v = va_arg( ap, int );
+				for( int i = 0; i < 32; i += 8 ) *p++ = (v >> i) & 0xff;
+				break;
+			case 's':
+				s = va_arg( ap, const char * );
+				v = strlen( s );
+				if( v > CONTROL_TEXT_MAX ) v = CONTROL_TEXT_MAX;
+				*p++ = v;
+				memcpy( p, s, v );
+				p += v;
+				break;
+		}
+	}
+	va_end( ap );
+	if( n == control_keys[code] ) keylen = p - command;
+
+	// a later setting replaces an earlier one with the same key where it
+	// stands in the batch, so the commands around it keep their order
+	if( control_keys[code] >= 0 ) for( n = 0; n < count; n++ ) {
+		q = batch + offsets[n];
+		if( memcmp( q, command, keylen ) != 0 ) continue;
+
+		int end = n + 1 < count ? offsets[n+1] : length, grown = (p - command) - (end - offsets[n]);
+		if( length + grown > CONTROL_DATAGRAM ) break;
+		if( grown ) {
+			memmove( batch + end + grown, batch + end, length - end );
+			for( int i = n + 1; i < count; i++ )
+				offsets[i] += grown;
+			length += grown;
+		}
+		memcpy( q, command, p - command );
+		return 0;
+	}
+
+	if( count == CONTROL_MAX_BATCH || length + (p - command) > CONTROL_DATAGRAM )
+		flush();
+
+	offsets[count++] = length;
+	memcpy( batch + length, command, p - command );
+	length += p - command;
+	return 0;
+}
+
+int ControlEncoder::flush() {
+	//
+	// send the batch, keeping a copy until it is acknowledged
+	//
+	struct control_header header;
+	int i, oldest = 0;
+
+	if( count == 0 ) return 0;
+
+	for( i = 0; i < CONTROL_WINDOW; i++ ) {
+		if( pending[i].length == 0 ) break;
+		if( pending[i].sequence - pending[oldest].sequence > 0x80000000u ) oldest = i;
+	}
+	if( i == CONTROL_WINDOW ) {
+		fprintf(stderr, "control: datagram %u not acknowledged, dropped\n", pending[oldest].sequence);
+		i = oldest;
+	}
+
+	header.magic = CONTROL_MAGIC;
+	header.version = CONTROL_VERSION;
+	header.flags = 0;
+	header.client = client;
+	header.sequence = ++sequence;
+	header.count = count;
+	put_header( batch, &header );
+
+	memcpy( pending[i].data, batch, length );
+	pending[i].sequence = sequence;
+	pending[i].length = length;
+	pending[i].retries = 0;
+	pending[i].sent = now_ms();
+
+	network->talk( batch, length );
+
+	length = CONTROL_HEADER;
+	count = 0;
+	return 1;
+}
+
+int ControlEncoder::resend() {
+	//
+	// send again any datagram that has waited too long for its acknowledgement
+	//
+	long now = now_ms();
+	int sent = 0;
+
+	for( int i = 0; i < CONTROL_WINDOW; i++ ) {
+		if( pending[i].length == 0 || now - pending[i].sent < CONTROL_RESEND_MS ) continue;
+		if( pending[i].retries == CONTROL_RETRIES ) {
+			fprintf(stderr, "control: datagram %u not acknowledged, dropped\n", pending[i].sequence);
+			pending[i].length = 0;
+			continue;
+		}
+		network->talk( pending[i].data, pending[i].length );
+		pending[i].retries++;
+		pending[i].sent = now;
+		sent++;
+	}
+	return sent;
+}
+
+int ControlEncoder::acknowledge(unsigned char *buf, int numbytes) {
+	//
+	// retire the datagram this answers and report any command that failed
+	//
+	struct control_header header;
+	struct control_command command;
+	unsigned char *p, *end;
+	int i;
+
+	if( get_header( buf, numbytes, &header ) < 0 || !(header.flags & CONTROL_ACK) ||
+			header.client != client || numbytes < CONTROL_HEADER + header.count )
+		return -1;
+
+	for( i = 0; i < CONTROL_WINDOW; i++ )
+		if( pending[i].length && pending[i].sequence == header.sequence ) break;
+	if( i == CONTROL_WINDOW ) return 0;
+
+	p = pending[i].data + CONTROL_HEADER;
+	end = pending[i].data + pending[i].length;
+	for( int n = 0; n < header.count && p; n++ ) {
+		p = get_command( p, end, &command );
+		int status = buf[CONTROL_HEADER+n];
+		if( status != CONTROL_OK && status != CONTROL_DUPLICATE )
+			fprintf(stderr, "control: %s rejected (%d)\n", control_name(command.code), status);
+	}
+
+	pending[i].length = 0;
+	return 1;
+}
+
+//
+// ControlDecoder
+//
+
+ControlDecoder::ControlDecoder() {
+
+	memset( windows, 0, sizeof windows );
+	nextwindow = 0;
+}
+
+int ControlDecoder::decode(unsigned char *buf, int numbytes, struct control_header *header, 
+		struct control_command *commands) {
+	//
+	// decode a datagram, returns the command count or -1 when the datagram is invalid.
+	// A command that cannot be decoded, and every one after it, is left as CTL_NONE
+	//
+	unsigned char *p = buf + CONTROL_HEADER, *end = buf + numbytes;
+
+	if( get_header( buf, numbytes, header ) < 0 || (header->flags & CONTROL_ACK) ||
+			header->count > CONTROL_MAX_BATCH )
+		return -1;
+
+	for( int n = 0; n < header->count; n++ ) {
+		if( p ) p = get_command( p, end, &commands[n] );
+		if( p == NULL ) commands[n].code = CTL_NONE;
+	}
+	return header->count;
+}
+
+bool ControlDecoder::fresh(struct control_header *header) {
+	//
+	// true the first time a sequence arrives from a client, a window of the
+	// last 64 sequences seen catches resent datagrams
+	//
+	int i;
+
+	for( i = 0; i < CONTROL_CLIENTS; i++ )
+		if( windows[i].top && windows[i].client == header->client ) break;
+
+	if( i == CONTROL_CLIENTS ) {
+		i = nextwindow;
+		nextwindow = (nextwindow + 1) % CONTROL_CLIENTS;
+		windows[i].client = header->client;
+		windows[i].top = header->sequence;
+		windows[i].seen = 1;
+		return true;
+	}
+
+	unsigned int diff = header->sequence - windows[i].top;
+	if( diff != 0 && diff < 0x80000000u ) {
+		windows[i].seen = diff >= 64 ? 1 : (windows[i].seen << diff) | 1;
+		windows[i].top = header->sequence;
+		return true;
+	}
+
+	diff = windows[i].top - header->sequence;
+	if( diff >= 64 || (windows[i].seen & (1ULL << diff)) ) return false;
+	windows[i].seen |= 1ULL << diff;
+	return true;
+}
+
+int ControlDecoder::acknowledge(struct control_header *header, unsigned char *status, unsigned char *buf) {
+	//
+	// build the acknowledgement for a datagram, returns its length
+	//
+	struct control_header ack = *header;
+
+	ack.flags = CONTROL_ACK;
+	put_header( buf, &ack );
+	memcpy( buf + CONTROL_HEADER, status, header->count );
+	return CONTROL_HEADER + header->count;
+}
@@ -0,0 +1,167 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+//
+// CONTROL
+//
+// the binary control protocol from client to engine. A datagram carries a
+// header and a batch of commands. The engine acknowledges every datagram with
+// a status per command, and the client resends datagrams not acknowledged.
+//
+#define CONTROL_MAGIC		0x6c43		// "lC"
+#define CONTROL_VERSION		1
+#define CONTROL_DATAGRAM	1024
+#define CONTROL_MAX_BATCH	128			// commands in one datagram
+#define CONTROL_TEXT_MAX	63
+#define CONTROL_WINDOW		16			// datagrams awaiting acknowledgement
+#define CONTROL_RESEND_MS	100
+#define CONTROL_RETRIES		10
+#define CONTROL_CLIENTS		16			// clients the engine keeps a window for
+#define CONTROL_HEADER		14			// header bytes on the wire
+
+#define CONTROL_ACK			0x01		// header flag
+
+// per command status returned in the acknowledgement
+#define CONTROL_OK			0
+#define CONTROL_BAD_TARGET	1
+#define CONTROL_BAD_VALUE	2
+#define CONTROL_BAD_COMMAND	3
+#define CONTROL_DUPLICATE	4
+
+//
+// the schema. Arguments are b (byte), h (short), i (int), s (string).
+// A command with a key count of zero or more replaces an earlier command in
+// the same batch with the same code and key arguments, so a dragged slider
+// sends only its last value. A key of -1 never coalesces.
+//
+//	code					arguments	key
+#define CONTROL_SCHEMA \
+	X( CTL_QUIT,				"",			-1 ) \
+	X( CTL_FLUSH,				"",			-1 ) \
+	X( CTL_LOAD,				"",			-1 ) \
+	X( CTL_CLEAR,				"",			-1 ) \
+	X( CTL_REWIND,				"",			-1 ) \
+	X( CTL_BACK,				"",			-1 ) \
+	X( CTL_FORWARD,				"",			-1 ) \
+	X( CTL_STOP,				"",			-1 ) \
+	X( CTL_PLAY,				"",			-1 ) \
+	X( CTL_RECORD,				"",			-1 ) \
+	X( CTL_CONFIG,				"bbb",		0 ) \
+	X( CTL_LONG_RECORD,			"b",		-1 ) \
+	X( CTL_REC_LEFT,			"b",		0 ) \
+	X( CTL_REC_RIGHT,			"b",		0 ) \
+	X( CTL_REC_MIDI,			"b",		0 ) \
+	X( CTL_CLICK,				"b",		0 ) \
+	X( CTL_COUPLE,				"b",		0 ) \
+	X( CTL_BPM_MODE,			"b",		0 ) \
+	X( CTL_SECTIONS,			"b",		-1 ) \
+	X( CTL_TEMPO_STEP,			"b",		-1 ) \
+	X( CTL_TEMPO_SET,			"h",		0 ) \
+	X( CTL_DIVISIONS,			"b",		-1 ) \
+	X( CTL_BEATS,				"b",		-1 ) \
+	X( CTL_PROGRAM,				"hh",		-1 ) \
+	X( CTL_VOLUME,				"bh",		1 ) \
+	X( CTL_NAME,				"s",		0 ) \
+	X( CTL_SECTION_NEXT_PART,	"h",		-1 ) \
+	X( CTL_SECTION_PART,		"hh",		1 ) \
+	X( CTL_TRACK_MUTE,			"ib",		1 ) \
+	X( CTL_TRACK_SOLO,			"ib",		1 ) \
+	X( CTL_TRACK_VOLUME,		"ihhh",		1 ) \
+	X( CTL_TRACK_PROGRAM,		"ihh",		1 ) \
+	X( CTL_TRACK_NAME,			"is",		-1 ) \
+	X( CTL_TRACK_PART,			"ih",		1 ) \
+	X( CTL_TRACK_CHANNEL,		"ih",		1 ) \
+	X( CTL_TRACK_DELETE,		"i",		-1 ) \
+	X( CTL_TRACK_RESAMPLE,		"i",		-1 ) \
+	X( CTL_TRACK_REVERSE,		"i",		-1 ) \
+	X( CTL_TRACK_UPLOAD,		"i",		-1 ) \
+	X( CTL_TRACK_START,			"i",		-1 ) \
+	X( CTL_SUBSCRIBE,			"hbb",		0 ) \
+	X( CTL_UNSUBSCRIBE,			"h",		-1 ) \
+	X( CTL_TRACK_STRETCH,		"ib",		1 ) \
+	X( CTL_TRACK_EFFECT,		"ibbs",		2 ) \
+	X( CTL_MASTER_EFFECT,		"bbs",		1 ) \
+	X( CTL_REVERB,				"s",		0 ) \
+	X( CTL_TRACK_BUS,			"ib",		1 ) \
+	X( CTL_REC_INPUT,			"bb",		1 )
+
+enum control_code {
+	CTL_NONE = 0,
+#define X(code, args, key) code,
+	CONTROL_SCHEMA
+#undef X
+	CTL_COUNT
+};
+
+struct control_header {
+	unsigned short magic;
+	unsigned char version, flags;
+	unsigned int client, sequence;
+	unsigned short count;
+};
+
+//
+// a decoded command, arguments in schema order with strings in text
+//
+struct control_command {
+	int code, arg[4];
+	char text[CONTROL_TEXT_MAX+1];
+};
+
+class ControlEncoder {
+
+	Network *network;
+
+	struct pending_datagram {
+		unsigned int sequence;
+		int length, retries;
+		long sent;
+		unsigned char data[CONTROL_DATAGRAM];
+	} pending[CONTROL_WINDOW];
+
+	unsigned char batch[CONTROL_DATAGRAM];
+	int length, count, offsets[CONTROL_MAX_BATCH];
+	unsigned int client, sequence;
+
+public:
+
+	ControlEncoder(Network *);
+	int add(int, ...), flush(), resend(), acknowledge(unsigned char *, int);
+};
+
+class ControlDecoder {
+
+	struct {
+		unsigned int client, top;
+		unsigned long long seen;
+	} windows[CONTROL_CLIENTS];
+	int nextwindow;
+
+public:
+
+	ControlDecoder();
+	int decode(unsigned char *, int, struct control_header *, struct control_command *);
+	bool fresh(struct control_header *);
+	int acknowledge(struct control_header *, unsigned char *, unsigned char *);
+};
+
+const char *control_name(int);
@@ -0,0 +1,339 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "logger.h"
+
+//
+//	LOGGER.CPP
+//
+//	The ring is a bounded queue of records each carrying a sequence
+//	number. A record is free to be claimed at position pos when its
+//	sequence is pos, and ready to be written out when it is pos + 1.
+//	The writer hands it back for the next lap of the ring with
+//	pos + LOG_RECORDS.
+//
+//	A format may use the d i u x X o c e f g p and s conversions, with
+//	flags, width, precision and the h l z modifiers, but not *. The message
+//	stops short at a conversion past LOG_ARGS.
+//
+
+#define LOG_FLAGS	"-+ #0123456789."
+
+Logger logger;
+
+static const char *level_names[] = { "error", "warning", "info", "debug" };
+
+Logger::Logger() {
+
+	for( unsigned int i = 0; i < LOG_RECORDS; i++ )
+		ring[i].seq = i;
+	head = tail = 0;
+	dropped = 0;
+	memset( limits, 0, sizeof limits );
+	running = stopping = false;
+	level = LOG_INFO;
+	pthread_mutex_init( &mut, NULL );
+}
+
+Logger::~Logger() {
+
+	// whichever way main returned, what is left in the ring is written out
+	stop();
+	pthread_mutex_destroy( &mut );
+}
+
+int Logger::start() {
+	//
+	// write the messages out on a thread of our own from now on
+	//
+	if( running ) return 0;
+	stopping = false;
+	running = true;
+	if( pthread_create( &thread_id, NULL, thread, this ) ) {
+		running = false;
+		perror("Logger::start pthread_create");
+		return 1;
+	}
+	return 0;
+}
+
+int Logger::stop() {
+	//
+	// back to writing them out as they come, after what is in the ring
+	//
+	if( !running ) return 0;
+	stopping = true;
+	pthread_join( thread_id, NULL );
+	running = false;
+	pthread_mutex_lock( &mut );
+	drain();
+	stopping = false;
+	pthread_mutex_unlock( &mut );
+	return 0;
+}
+
+int Logger::level_named(const char *name) {
+
+	for( int i = LOG_ERROR; i <= LOG_DEBUG; i++ )
+		if( strcmp( name, level_names[i] ) == 0 ) return i;
+	return -1;
+}
+
+void Logger::put(int lvl, const char *fmt, ...) {
+	//
+	// keep a message, taking the arguments as the format says. Nothing here
+	// blocks, a message that finds the ring full is counted and dropped
+	//
+	struct log_record *r;
+	union log_arg *a;
+	unsigned int pos;
+	int diff, t = 0, n;
+	const char *f, *s;
+	char mod;
+	va_list ap;
+
+	if( lvl > level ) return;
+
+	pos = head;
+	for( ;; ) {
+		r = &ring[pos & (LOG_RECORDS - 1)];
+		diff = (int)(r->seq - pos);
+		if( diff == 0 ) {
+			if( __sync_bool_compare_and_swap( &head, pos, pos + 1 ) ) break;
+		} else if( diff < 0 ) {
+			__sync_fetch_and_add( &dropped, 1 );
+			return;
+		}
+		pos = head;
+	}
+
+	r->level = lvl;
+	r->format = fmt;
+	r->nargs = 0;
+	clock_gettime( CLOCK_REALTIME, &r->when );
+
+	va_start( ap, fmt );
+	for( f = fmt; *f; f++ ) {
+		if( *f != '%' ) continue;
+		if( *++f == '%' ) continue;
+		while( *f && strchr( LOG_FLAGS, *f ) ) f++;
+		for( mod = 0; *f == 'h' || *f == 'l' || *f == 'z'; f++ ) 
+			mod = *f;
+		if( *f == '\0' || r->nargs == LOG_ARGS ) break;
+
+		a = &r->args[r->nargs++];
+		switch( *f ) {
+			case 'd': case 'i': case 'c':
+				if( mod == 'l' ) a->l = va_arg( ap, long );
+				else if( mod == 'z' ) a->l = va_arg( ap, size_t );
+				else a->l = va_arg( ap, int );
+				break;
+			case 'u': case 'x': case 'X': case 'o':
+				if( mod == 'l' ) a->l = va_arg( ap, unsigned long );
+				else if( mod == 'z' ) a->l = va_arg( ap, size_t );
+				else a->l = va_arg( ap, unsigned int );
+				break;
+			case 'e': case 'f': case 'g': case 'E': case 'G':
+				a->d = va_arg( ap, double );
+				break;
+			case 'p':
+				a->l = (long)va_arg( ap, void * );
+				break;
+			case 's':
+				// copied in, the string may be gone by the time it is written
+				if( (s = va_arg( ap, const char * )) == NULL ) s = "(null)";
+				if( t >= LOG_TEXT ) {
+					a->l = -1;
+					break;
+				}
+				n = strlen( s );
+				if( n > LOG_TEXT - 1 - t ) n = LOG_TEXT - 1 - t;
+				memcpy( r->text + t, s, n );
+				r->text[t + n] = '\0';
+				a->l = t;
+				t += n + 1;
+				break;
+			default:
+				r->nargs--;
+		}
+	}
+	va_end( ap );
+
+	__sync_synchronize();
+	r->seq = pos + 1;
+
+	if( !running ) {
+		pthread_mutex_lock( &mut );
+		drain();
+		pthread_mutex_unlock( &mut );
+	}
+}
+
+void Logger::format(struct log_record *r, char *out, int size) {
+	//
+	// the message of a record, each conversion done on its own with the
+	// argument as it was kept
+	//
+	char spec[24], conv, *o = out, *end = out + size - 1;
+	union log_arg *a;
+	const char *f = r->format;
+	int k, n, arg = 0;
+
+	while( *f && o < end ) {
+		if( *f != '%' ) {
+			*o++ = *f++;
+			continue;
+		}
+		if( f[1] == '%' ) {
+			*o++ = '%';
+			f += 2;
+			continue;
+		}
+		// the spec without its length modifier, one for the way it was kept goes back in
+		k = 0;
+		spec[k++] = *f++;
+		while( *f && strchr( LOG_FLAGS, *f ) ) 
+			if( k < 16 ) spec[k++] = *f++;
+			else f++;
+		while( *f == 'h' || *f == 'l' || *f == 'z' ) f++;
+		if( *f == '\0' || arg == r->nargs ) break;
+		conv = *f++;
+
+		a = &r->args[arg];
+		switch( conv ) {
+			case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+				spec[k++] = 'l';
+				spec[k++] = conv;
+				spec[k] = '\0';
+				n = snprintf( o, end - o + 1, spec, a->l );
+				break;
+			case 'c': case 'p':
+				spec[k++] = conv;
+				spec[k] = '\0';
+				if( conv == 'c' ) n = snprintf( o, end - o + 1, spec, (int)a->l );
+				else n = snprintf( o, end - o + 1, spec, (void *)a->l );
+				break;
+			case 'e': case 'f': case 'g': case 'E': case 'G':
+				spec[k++] = conv;
+				spec[k] = '\0';
+				n = snprintf( o, end - o + 1, spec, a->d );
+				break;
+			case 's':
+				spec[k++] = conv;
+				spec[k] = '\0';
+				n = snprintf( o, end - o + 1, spec, a->l < 0 ? "..." : r->text + a->l );
+				break;
+			default:
+				continue;
+		}
+		arg++;
+		if( n > 0 ) o += n < end - o ? n : end - o;
+	}
+	*o = '\0';
+}
+
+bool Logger::allow(struct log_record *r) {
+	//
+	// true while a message has not come too often this second
+	//
+	struct limit *l = &limits[((unsigned long)r->format >> 3) % LOG_LIMITS];
+
+	if( l->format != r->format || l->second != r->when.tv_sec ) {
+		if( l->suppressed ) 
+			fprintf(stderr, "(%d more of \"%.*s\")\n", l->suppressed, 
+				(int)strcspn( l->format, "\n" ), l->format );
+		l->format = r->format;
+		l->second = r->when.tv_sec;
+		l->count = l->suppressed = 0;
+	}
+	if( ++l->count <= LOG_BURST ) return true;
+	l->suppressed++;
+	return false;
+}
+
+void Logger::write(struct log_record *r) {
+
+	char message[256];
+	struct tm tm;
+	int n;
+
+	if( !allow( r ) ) return;
+	format( r, message, sizeof message );
+
+	// the line ends here whether the message did or not
+	n = strlen( message );
+	if( n && message[n - 1] == '\n' ) message[n - 1] = '\0';
+
+	localtime_r( &r->when.tv_sec, &tm );
+	fprintf(stderr, "%02d:%02d:%02d.%03ld %s: %s\n", tm.tm_hour, tm.tm_min, tm.tm_sec,
+		r->when.tv_nsec / 1000000, level_names[r->level], message );
+}
+
+void Logger::drain() {
+	//
+	// write out what is ready in the ring, and what was held back or lost
+	//
+	struct log_record *r;
+	unsigned int lost;
+	time_t now = time(NULL);
+	int i;
+
+	for( ;; ) {
+		r = &ring[tail & (LOG_RECORDS - 1)];
+		if( r->seq != tail + 1 ) break;
+		__sync_synchronize();
+		write( r );
+		__sync_synchronize();
+		r->seq = tail + LOG_RECORDS;
+		tail++;
+	}
+
+	for( i = 0; i < LOG_LIMITS; i++ ) 
+		if( limits[i].suppressed && (limits[i].second < now || stopping) ) {
+			fprintf(stderr, "(%d more of \"%.*s\")\n", limits[i].suppressed, 
+				(int)strcspn( limits[i].format, "\n" ), limits[i].format );
+			limits[i].suppressed = 0;
+		}
+
+	if( dropped && (lost = __sync_lock_test_and_set( &dropped, 0 )) ) 
+		fprintf(stderr, "(%u messages lost, the log was full)\n", lost );
+}
+
+void *Logger::thread(void *p) {
+
+	Logger *logger = (Logger *)p;
+	struct timespec wait = { 0, LOG_WAIT * 1000000L };
+
+	while( !logger->stopping ) {
+		logger->drain();
+		nanosleep( &wait, NULL );
+	}
+	logger->drain();
+	return NULL;
+}
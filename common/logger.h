@@ -0,0 +1,91 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+//
+// class LOGGER
+//
+// logging any thread can do, the realtime ones included. A message is a
+// fixed size record put in a ring without locks: its printf format, the
+// arguments taken as the format says and any strings copied in. A writer
+// thread formats them with a timestamp and level and rate limits a
+// message that repeats. Without the thread, as in the server, the one
+// putting a message writes it out itself.
+//
+#define LOG_RECORDS		256			// a power of two, more are dropped and counted
+#define LOG_ARGS		6
+#define LOG_TEXT		48			// room for the strings of a message
+#define LOG_BURST		20			// times a message is written in a second
+#define LOG_LIMITS		64			// messages rate limited at once
+#define LOG_WAIT		20			// msecs the writer sleeps when the ring is empty
+
+#define LOG_ERROR		0
+#define LOG_WARNING		1
+#define LOG_INFO		2
+#define LOG_DEBUG		3
+
+union log_arg {
+	long l;
+	double d;
+};
+
+struct log_record {
+	volatile unsigned int seq;
+	unsigned char level, nargs;
+	const char *format;
+	struct timespec when;
+	union log_arg args[LOG_ARGS];
+	char text[LOG_TEXT];
+};
+
+class Logger {
+
+	struct log_record ring[LOG_RECORDS];
+	volatile unsigned int head;
+	unsigned int tail;
+	volatile unsigned int dropped;
+
+	struct limit {
+		const char *format;
+		time_t second;
+		int count, suppressed;
+	} limits[LOG_LIMITS];
+
+	pthread_t thread_id;
+	pthread_mutex_t mut;
+	volatile bool running, stopping;
+
+	void drain(), write(struct log_record *), format(struct log_record *, char *, int);
+	bool allow(struct log_record *);
+	static void *thread(void *);
+
+public:
+
+	volatile int level;		// messages above it are not kept
+
+	Logger();
+	~Logger();
+	int start(), stop();
+	void put(int, const char *, ...) __attribute__((format(printf, 3, 4)));
+	static int level_named(const char *);
+};
+
+extern Logger logger;
@@ -26,6 +26,7 @@ SOFTWARE.
 #include <errno.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/time.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -33,6 +34,7 @@ SOFTWARE.
 
 #include "network.h"
 #include "request.h"
+#include "chunkstore.h"
 
 //
 //	NETWORK.CPP
@@ -50,6 +52,19 @@ void *get_in_addr(struct sockaddr *sa)
     return &(((struct sockaddr_in6*)sa)->sin6_addr);
 }
 
+// read until count bytes arrive, a stream socket may return less
+int read_complete(int fd, void *p, int count)
+{
+	int readcnt, total = 0;
+
+	while( total < count ) {
+		if( (readcnt = read( fd, (char *)p + total, count - total )) <= 0 )
+			break;
+		total += readcnt;
+	}
+	return total;
+}
+
 Network::Network() {
 
 }
@@ -143,7 +158,8 @@ int Network::listen(void *p, int bytes) {
     addr_len = sizeof their_addr;
     if ((numbytes = recvfrom(in_sockfd, p, bytes, 0,
         (struct sockaddr *)&their_addr, &addr_len)) == -1) {
-        perror("Network::listen recvfrom");
+        if( errno != EAGAIN && errno != EWOULDBLOCK )
+            perror("Network::listen recvfrom");
         return -1;
     }
 
@@ -159,6 +175,53 @@ int Network::listen(void *p, int bytes) {
     return numbytes;
 }
 
+//
+// listen and keep the sender address so that we can reply to it
+//
+int Network::listen(void *p, int bytes, struct sockaddr_storage *from, socklen_t *fromlen) {
+
+    int numbytes;
+
+    *fromlen = sizeof *from;
+    if ((numbytes = recvfrom(in_sockfd, p, bytes, 0,
+        (struct sockaddr *)from, fromlen)) == -1) {
+        perror("Network::listen recvfrom");
+        return -1;
+    }
+
+    return numbytes;
+}
+
+int Network::reply(void *p, int bytes, struct sockaddr_storage *to, socklen_t tolen) {
+
+    int numbytes;
+
+    if ((numbytes = sendto(in_sockfd, p, bytes, 0,
+             (struct sockaddr *)to, tolen)) == -1) {
+        perror("Network::reply sendto");
+        return -1;
+    }
+
+    return numbytes;
+}
+
+//
+// give up waiting in listen after ms milliseconds
+//
+int Network::listener_timeout(int ms) {
+
+    struct timeval tv;
+
+    tv.tv_sec = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+    if (setsockopt(in_sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv) == -1) {
+        perror("Network::listener_timeout setsockopt");
+        return -1;
+    }
+
+    return 0;
+}
+
 int Network::listener_close() {
 
     if( listener_closed ) return 0;
@@ -252,6 +315,47 @@ int Network::talk(void *p, int bytes ) {
     return numbytes;
 }
 
+//
+// send a batch of datagrams, each to its own address, from the talker socket
+//
+int Network::talk_many(struct mmsghdr *msgs, int count) {
+
+    int numbytes, sent = 0;
+
+    while( sent < count ) {
+        if ((numbytes = sendmmsg(out_sockfd, msgs + sent, count - sent, 0)) == -1) {
+            perror("Network::talk_many sendmmsg");
+            return -1;
+        }
+        sent += numbytes;
+    }
+
+    return sent;
+}
+
+int Network::talker_address(struct sockaddr_storage *addr, socklen_t *addrlen) {
+
+    memcpy(addr, talker_addr->ai_addr, talker_addr->ai_addrlen);
+    *addrlen = talker_addr->ai_addrlen;
+    return 0;
+}
+
+//
+// collect a reply to the talker without blocking, -1 when there is none
+//
+int Network::hear(void *p, int bytes) {
+
+    int numbytes;
+
+    if ((numbytes = recv(out_sockfd, p, bytes, MSG_DONTWAIT)) == -1) {
+        if( errno != EAGAIN && errno != EWOULDBLOCK )
+            perror("Network::hear recv");
+        return -1;
+    }
+
+    return numbytes;
+}
+
 int Network::talker_close() {
 
     close(out_sockfd);
@@ -446,12 +550,92 @@ int Network::start_get(unsigned id, long int *size) {
 	return get_sockfd;	
 }
 
+int Network::put_have(struct chunk_ref *refs, int count, unsigned char *flags) {
+	//
+	// ask the server which of these chunks it holds, flags are set to 1 for those
+	//
+	struct upload_request request;
+
+	memset( &request, 0, sizeof request );
+	request.type = REQ_HAVE;
+	request.bytecount = count;
+	write( put_sockfd, &request, sizeof( request));
+	write( put_sockfd, refs, sizeof( struct chunk_ref ) * count );
+	if( read_complete( put_sockfd, flags, count ) < count ) return 1;
+
+	return 0;
+}
+
+int Network::start_put_chunked(struct chunk_ref *refs, int count, unsigned char *flags) {
+	//
+	// send a track as its chunk list. The caller then writes the bytes of every
+	// chunk flagged 1, in order, and finishes with end_put()
+	//
+	struct upload_request request;
+
+	memset( &request, 0, sizeof request );
+	request.type = REQ_CHUNKTRACK;
+	request.bytecount = count;
+	write( put_sockfd, &request, sizeof( request));
+	write( put_sockfd, refs, sizeof( struct chunk_ref ) * count );
+	write( put_sockfd, flags, count );
+
+	return put_sockfd;
+}
+
 int Network::end_put( unsigned int *id ) {
 
 	read( put_sockfd, id, sizeof( unsigned int) );
 	return 0;
 }
 
+int Network::get_manifest(unsigned id, struct chunk_ref **refs, long int *size) {
+	//
+	// fetch the chunk list of a track, return the chunk count or -1
+	//
+	struct download_request request;
+	struct chunk_manifest manifest;
+
+	memset( &request, 0, sizeof request );
+	request.type = REQ_MANIFEST;
+	request.ident = id;
+	write( get_sockfd, &request, sizeof( request));
+	if( read_complete( get_sockfd, &manifest, sizeof manifest ) < (int) sizeof manifest ||
+		manifest.magic != MANIFEST_MAGIC || manifest.count > (unsigned)CHUNK_COUNT_MAX ||
+		manifest.length < 0 || manifest.length > CHUNK_TRACK_MAX ) {
+		fprintf(stderr, "Network::get_manifest: bad manifest for %d\n", id );
+		return -1;
+	}
+	*refs = new struct chunk_ref[manifest.count];
+	if( read_complete( get_sockfd, *refs, sizeof( struct chunk_ref ) * manifest.count ) < 
+			(int)( sizeof( struct chunk_ref ) * manifest.count ) ) {
+		fprintf(stderr, "Network::get_manifest: short chunk list for %d\n", id );
+		delete[] *refs;
+		*refs = NULL;
+		return -1;
+	}
+	*size = manifest.length;
+
+	return manifest.count;
+}
+
+int Network::get_chunk(struct chunk_ref *ref, unsigned char *dst) {
+	//
+	// fetch one chunk by digest into dst, return its length
+	//
+	struct download_request request;
+	unsigned int length;
+
+	memset( &request, 0, sizeof request );
+	request.type = REQ_CHUNK;
+	memcpy( request.digest, ref->digest, CHUNK_DIGEST_LEN );
+	write( get_sockfd, &request, sizeof( request));
+	if( read_complete( get_sockfd, &length, sizeof length ) < (int) sizeof length ||
+		length > CHUNK_MAX ) return -1;
+
+	return read_complete( get_sockfd, dst, length );
+}
+
 int Network::putter_close() {
 	
 #if 0
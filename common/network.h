@@ -39,14 +39,21 @@ public:
 	Network();
 	~Network();
 
-	int listener_init(const char *), listen(char *, int), listen(void *, int), listener_close();
+	int listener_init(const char *), listen(char *, int), listen(void *, int), 
+		listen(void *, int, struct sockaddr_storage *, socklen_t *), reply(void *, int, struct sockaddr_storage *, socklen_t),
+		listener_timeout(int), listener_close();
 
-	int talker_init(const char *, const char *), talk(char *), talk(const char *), talk(void *, int), talker_close();
+	int talker_init(const char *, const char *), talk(char *), talk(const char *), talk(void *, int), hear(void *, int),
+		talk_many(struct mmsghdr *, int), talker_address(struct sockaddr_storage *, socklen_t *), talker_close();
 	
 	int putter_init(const char *, const char *), putter_connect(), put_complete(void *src, bool, bool, bool, int), 
-		start_put(long int), end_put(unsigned int *), putter_disconnect(), putter_close();
+		start_put(long int), end_put(unsigned int *), putter_disconnect(), putter_close(),
+		put_have(struct chunk_ref *, int, unsigned char *), start_put_chunked(struct chunk_ref *, int, unsigned char *);
 		
 	int getter_init(const char *, const char *), get_complete(void *dst, bool, bool, bool, long int), 
-		start_get(unsigned int, long int *), get_maxids(unsigned int *, unsigned int *), getter_close();
+		start_get(unsigned int, long int *), get_maxids(unsigned int *, unsigned int *), getter_close(),
+		get_manifest(unsigned int, struct chunk_ref **, long int *), get_chunk(struct chunk_ref *, unsigned char *);
 	
 };
+
+int read_complete(int, void *, int);
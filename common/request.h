@@ -25,6 +25,20 @@ SOFTWARE.
 #define REQ_SECTIONS	3
 #define REQ_TRACK		4
 #define REQ_CHAT		5
+#define REQ_HAVE		6	// upload: which of these chunks does the server hold
+#define REQ_CHUNKTRACK	7	// upload: track as a chunk list plus missing chunks
+#define REQ_MANIFEST	8	// download: chunk list for a track ident
+#define REQ_CHUNK		9	// download: one chunk by digest
+
+#define CHUNK_DIGEST_LEN	20	// SHA-1
+
+//
+// a chunk reference as sent on the wire and kept in manifests
+//
+struct chunk_ref {
+	unsigned char digest[CHUNK_DIGEST_LEN];
+	unsigned int length;
+};
 
 struct upload_request {
 	bool close;
@@ -36,4 +50,5 @@ struct download_request {
 	bool close;
 	int type;
 	unsigned int ident;
+	unsigned char digest[CHUNK_DIGEST_LEN];
 };
@@ -0,0 +1,517 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <limits.h>
+
+#include "udpstruct.h"
+#include "telemetry.h"
+
+//
+//	TELEMETRY.CPP
+//
+//	An update is a list of records:
+//
+//	TOP_STATE		offset, length, bytes		a changed run of the Statebuf
+//	TOP_SECTIONS	count, count parts			the section part numbers
+//	TOP_TRACKCOUNT	count						number of tracks
+//	TOP_TRACK		index, field mask, fields	changed fields of one track
+//	TOP_STATS		offset, length, bytes		a changed run of the Statsbuf
+//
+//	A keyframe is encoded as a delta from an all zero image, so the decoder
+//	clears its image before applying one.
+//
+
+#define TOP_STATE		1
+#define TOP_SECTIONS	2
+#define TOP_TRACKCOUNT	3
+#define TOP_TRACK		4
+#define TOP_STATS		5
+
+// track fields in mask bit order
+#define TF_NAME			0x001
+#define TF_FLAGS		0x800
+
+static const int track_shorts[] = {
+	offsetof(Trackbuf, part), offsetof(Trackbuf, channel), offsetof(Trackbuf, bank),
+	offsetof(Trackbuf, program), offsetof(Trackbuf, vol_left), offsetof(Trackbuf, vol_right),
+	offsetof(Trackbuf, vol_midi), offsetof(Trackbuf, peak_left), offsetof(Trackbuf, peak_right),
+	offsetof(Trackbuf, peak_midi) };
+
+#define TRACK_SHORTS	10
+
+static unsigned char *put_varint( unsigned char *p, unsigned int v ) {
+	while( v >= 0x80 ) {
+		*p++ = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	*p++ = v;
+	return p;
+}
+
+static unsigned char *get_varint( unsigned char *p, unsigned char *end, unsigned int *v ) {
+	int shift = 0;
+	*v = 0;
+	while( p < end && shift < 35 ) {
+		*v |= (*p & 0x7f) << shift;
+		if( !(*p++ & 0x80) ) return p;
+		shift += 7;
+	}
+	return NULL;
+}
+
+static unsigned char *put_runs( unsigned char *p, int op, unsigned char *a, unsigned char *b, int size ) {
+	//
+	// the changed runs of a struct under 256 bytes, joining runs separated by small gaps
+	//
+	int i = 0, j, run;
+
+	while( i < size ) {
+		if( a[i] == b[i] ) { i++; continue; }
+		run = 1;
+		for( j = i + 1; j < size && j - (i + run) < 4; j++ )
+			if( a[j] != b[j] ) run = j - i + 1;
+		*p++ = op;
+		*p++ = i;
+		*p++ = run;
+		memcpy( p, a + i, run );
+		p += run;
+		i += run;
+	}
+	return p;
+}
+
+static unsigned char *get_run( unsigned char *p, unsigned char *end, unsigned char *to, int size ) {
+
+	int offset, run;
+
+	if( end - p < 2 ) return NULL;
+	offset = *p++;
+	run = *p++;
+	if( offset + run > size || end - p < run ) return NULL;
+	memcpy( to + offset, p, run );
+	return p + run;
+}
+
+static unsigned char track_flags( Trackbuf *t ) {
+	return t->mute | (t->solo << 1) | (t->longtrack << 2) | (t->active << 3) | (t->stretch << 4) | (t->reversed << 5);
+}
+
+//
+// TelemetryImage
+//
+
+TelemetryImage::TelemetryImage() {
+
+	tracks = NULL;
+	capacity = 0;
+	clear();
+}
+
+TelemetryImage::~TelemetryImage() {
+
+	delete[] tracks;
+}
+
+void TelemetryImage::clear() {
+
+	memset( &state, 0, sizeof state );
+	memset( &stats, 0, sizeof stats );
+	memset( parts, 0, sizeof parts );
+	if( capacity )
+		memset( tracks, 0, sizeof(Trackbuf) * capacity );
+	trackcount = 0;
+}
+
+void TelemetryImage::reserve(int n) {
+	//
+	// make room for n tracks, new slots are zeroed
+	//
+	if( n <= capacity ) return;
+
+	int newcap = capacity ? capacity : 64;
+	while( newcap < n && newcap <= INT_MAX / 2 ) newcap *= 2;
+	if( newcap < n ) newcap = n;
+
+	Trackbuf *t = new Trackbuf[newcap];
+	memset( t, 0, sizeof(Trackbuf) * newcap );
+	if( capacity ) 
+		memcpy( t, tracks, sizeof(Trackbuf) * capacity );
+	delete[] tracks;
+	tracks = t;
+	capacity = newcap;
+}
+
+void TelemetryImage::resize(int n) {
+
+	if( n < 0 ) n = 0;
+	reserve( n );
+	// tracks dropping off the end are forgotten
+	if( n < trackcount )
+		memset( tracks + n, 0, sizeof(Trackbuf) * (trackcount - n) );
+	trackcount = n;
+}
+
+void TelemetryImage::copy(TelemetryImage *src, int fields) {
+	//
+	// take only the fields wanted from src, the rest stay zero and so are never sent
+	//
+	clear();
+
+	if( fields & TELE_FIELD_STATE ) {
+		state = src->state;
+		memcpy( parts, src->parts, sizeof parts );
+		if( !(fields & TELE_FIELD_METERS) ) {
+			state.audio_L_level_in = state.audio_R_level_in = 0;
+			state.audio_L_level_out = state.audio_R_level_out = 0;
+			state.midi_level_in = state.midi_level_out = 0;
+		}
+	}
+	else if( fields & TELE_FIELD_METERS ) {
+		state.audio_L_level_in = src->state.audio_L_level_in;
+		state.audio_R_level_in = src->state.audio_R_level_in;
+		state.audio_L_level_out = src->state.audio_L_level_out;
+		state.audio_R_level_out = src->state.audio_R_level_out;
+		state.midi_level_in = src->state.midi_level_in;
+		state.midi_level_out = src->state.midi_level_out;
+	}
+
+	if( fields & TELE_FIELD_STATS ) 
+		stats = src->stats;
+
+	if( !(fields & (TELE_FIELD_TRACKS | TELE_FIELD_METERS)) ) return;
+
+	resize( src->trackcount );
+	for( int i = 0; i < trackcount; i++ ) {
+		Trackbuf *t = &tracks[i], *s = &src->tracks[i];
+		if( fields & TELE_FIELD_TRACKS ) *t = *s;
+		else t->number = s->number;
+		if( fields & TELE_FIELD_METERS ) {
+			t->peak_left = s->peak_left;
+			t->peak_right = s->peak_right;
+			t->peak_midi = s->peak_midi;
+		} else
+			t->peak_left = t->peak_right = t->peak_midi = 0;
+	}
+}
+
+//
+// TelemetryEncoder
+//
+
+TelemetryEncoder::TelemetryEncoder() {
+
+	buffer = NULL;
+	buffersize = 0;
+	sequence = 0;
+	length = 0;
+	full = true;
+	since_keyframe = TELEMETRY_KEYFRAME;	// start with a keyframe
+}
+
+TelemetryEncoder::~TelemetryEncoder() {
+
+	delete[] buffer;
+}
+
+void TelemetryEncoder::keyframe() {
+
+	since_keyframe = TELEMETRY_KEYFRAME;
+}
+
+int TelemetryEncoder::encode(bool full) {
+	//
+	// encode image against last into buffer, then remember image as last.
+	// return the encoded length
+	//
+	unsigned char *p;
+	int i, j, need;
+
+	if( full ) last.clear();
+
+	// worst case is every field of every track
+	need = sizeof(Statebuf) * 2 + sizeof(Statsbuf) * 2 + MAX_SECTIONS + 16 + image.trackcount * (sizeof(Trackbuf) + 16);
+	if( need > buffersize ) {
+		delete[] buffer;
+		buffer = new unsigned char[need];
+		buffersize = need;
+	}
+	p = buffer;
+
+	// changed runs of the state and stats buffers, both well under 256 bytes
+	p = put_runs( p, TOP_STATE, (unsigned char *)&image.state, (unsigned char *)&last.state, sizeof(Statebuf) );
+	p = put_runs( p, TOP_STATS, (unsigned char *)&image.stats, (unsigned char *)&last.stats, sizeof(Statsbuf) );
+
+	// section parts
+	bool parts_changed = image.state.sections != last.state.sections;
+	for( i = 0; i < image.state.sections && !parts_changed; i++ )
+		if( image.parts[i] != last.parts[i] ) parts_changed = true;
+	if( parts_changed ) {
+		*p++ = TOP_SECTIONS;
+		*p++ = image.state.sections;
+		for( i = 0; i < image.state.sections; i++ )
+			*p++ = image.parts[i];
+	}
+
+	// track count, then the changed fields of each track
+	if( image.trackcount != last.trackcount ) {
+		*p++ = TOP_TRACKCOUNT;
+		p = put_varint( p, image.trackcount );
+		last.resize( image.trackcount );
+	}
+
+	for( i = 0; i < image.trackcount; i++ ) {
+		Trackbuf *t = &image.tracks[i], *l = &last.tracks[i];
+		unsigned short mask = 0;
+		unsigned char *q;
+
+		if( strncmp( t->name, l->name, TRACK_NAME_MAX ) ) mask |= TF_NAME;
+		for( j = 0; j < TRACK_SHORTS; j++ )
+			if( *(short *)((char *)t + track_shorts[j]) != *(short *)((char *)l + track_shorts[j]) )
+				mask |= 0x002 << j;
+		if( track_flags( t ) != track_flags( l ) ) mask |= TF_FLAGS;
+		if( mask == 0 ) continue;
+
+		*p++ = TOP_TRACK;
+		p = put_varint( p, i );
+		memcpy( p, &mask, sizeof mask );
+		p += sizeof mask;
+		if( mask & TF_NAME ) {
+			q = p++;
+			for( j = 0; j < TRACK_NAME_MAX && t->name[j]; j++ )
+				*p++ = t->name[j];
+			*q = j;
+		}
+		for( j = 0; j < TRACK_SHORTS; j++ )
+			if( mask & (0x002 << j) ) {
+				memcpy( p, (char *)t + track_shorts[j], sizeof(short) );
+				p += sizeof(short);
+			}
+		if( mask & TF_FLAGS ) *p++ = track_flags( t );
+
+		*l = *t;
+	}
+
+	last.state = image.state;
+	last.stats = image.stats;
+	memcpy( last.parts, image.parts, sizeof(int) * MAX_SECTIONS );
+
+	return p - buffer;
+}
+
+int TelemetryEncoder::prepare() {
+	//
+	// encode the next update from image, return the number of datagrams it takes
+	//
+	full = since_keyframe >= TELEMETRY_KEYFRAME;
+	if( full ) since_keyframe = 0;
+	since_keyframe++;
+
+	length = encode( full );
+	sequence++;
+	return length ? (length + TELEMETRY_PAYLOAD - 1) / TELEMETRY_PAYLOAD : 1;
+}
+
+int TelemetryEncoder::fragment(int n, unsigned char *datagram) {
+	//
+	// build datagram n of the prepared update, return its length
+	//
+	struct telemetry_header header;
+	int offset = n * TELEMETRY_PAYLOAD, chunk = length - offset;
+
+	if( chunk > TELEMETRY_PAYLOAD ) chunk = TELEMETRY_PAYLOAD;
+	if( chunk < 0 ) chunk = 0;
+
+	header.magic = TELEMETRY_MAGIC;
+	header.version = TELEMETRY_VERSION;
+	header.type = full ? TELE_KEYFRAME : TELE_DELTA;
+	header.base = sequence - 1;
+	header.sequence = sequence;
+	header.fragment = n;
+	header.fragments = length ? (length + TELEMETRY_PAYLOAD - 1) / TELEMETRY_PAYLOAD : 1;
+
+	memcpy( datagram, &header, sizeof header );
+	memcpy( datagram + sizeof header, buffer + offset, chunk );
+	return sizeof header + chunk;
+}
+
+//
+// TelemetryDecoder
+//
+
+TelemetryDecoder::TelemetryDecoder() {
+
+	assembly = received = NULL;
+	assembly_size = assembly_length = fragments = fragments_in = 0;
+	memset( &current, 0, sizeof current );
+	sequence = 0;
+	synced = false;
+}
+
+TelemetryDecoder::~TelemetryDecoder() {
+
+	delete[] assembly;
+	delete[] received;
+}
+
+int TelemetryDecoder::receive(unsigned char *datagram, int length) {
+	//
+	// take in one datagram. Return 1 when an update was completed and applied
+	//
+	struct telemetry_header header;
+	int size;
+
+	if( length < (int)sizeof header ) return 0;
+	memcpy( &header, datagram, sizeof header );
+	if( header.magic != TELEMETRY_MAGIC || header.version != TELEMETRY_VERSION ) {
+		fprintf(stderr, "telemetry: dropping packet with unknown version\n");
+		return 0;
+	}
+	if( header.fragment >= header.fragments ) return 0;
+	if( header.fragments > TELEMETRY_FRAGMENTS ) {
+		fprintf(stderr, "telemetry: dropping update of %d fragments\n", header.fragments );
+		return 0;
+	}
+
+	// a fragment fills its share of the assembly, only the last may be short
+	length -= sizeof header;
+	if( length > TELEMETRY_PAYLOAD ||
+		(header.fragment < header.fragments - 1 && length < TELEMETRY_PAYLOAD) ) {
+		fprintf(stderr, "telemetry: dropping fragment of %d bytes\n", length );
+		return 0;
+	}
+
+	if( header.sequence != current.sequence || fragments_in == 0 ) {
+		// a new update begins, anything partial is abandoned
+		current = header;
+		fragments = header.fragments;
+		fragments_in = 0;
+		assembly_length = 0;
+		size = fragments * TELEMETRY_PAYLOAD;
+		if( size > assembly_size ) {
+			delete[] assembly;
+			delete[] received;
+			assembly = new unsigned char[size];
+			received = new unsigned char[fragments];
+			assembly_size = size;
+		}
+		memset( received, 0, fragments );
+	}
+	if( header.fragments != fragments || received[header.fragment] ) return 0;
+
+	memcpy( assembly + header.fragment * TELEMETRY_PAYLOAD, datagram + sizeof header, length );
+	received[header.fragment] = 1;
+	if( header.fragment == fragments - 1 )
+		assembly_length = header.fragment * TELEMETRY_PAYLOAD + length;
+	if( ++fragments_in < fragments ) return 0;
+	fragments_in = 0;
+
+	if( current.type == TELE_KEYFRAME ) {
+		image.clear();
+		synced = true;
+	} else if( !synced || current.base != sequence ) {
+		// we missed an update, wait for the next keyframe
+		synced = false;
+		return 0;
+	}
+
+	if( apply( assembly, assembly_length ) ) {
+		synced = false;
+		return 0;
+	}
+	sequence = current.sequence;
+	return 1;
+}
+
+int TelemetryDecoder::apply(unsigned char *p, int length) {
+	//
+	// apply the records of an update to the image, return nonzero on a bad update
+	//
+	unsigned char *end = p + length;
+	unsigned int index, count;
+	unsigned short mask;
+	int i, run;
+
+	while( p < end ) {
+		switch( *p++ ) {
+			case TOP_STATE:
+				if( (p = get_run( p, end, (unsigned char *)&image.state, sizeof(Statebuf) )) == NULL ) return 1;
+				break;
+
+			case TOP_STATS:
+				if( (p = get_run( p, end, (unsigned char *)&image.stats, sizeof(Statsbuf) )) == NULL ) return 1;
+				break;
+
+			case TOP_SECTIONS:
+				if( p == end || *p > MAX_SECTIONS || end - p < *p + 1 ) return 1;
+				count = *p++;
+				for( i = 0; i < (int)count; i++ )
+					image.parts[i] = *p++;
+				break;
+
+			case TOP_TRACKCOUNT:
+				if( (p = get_varint( p, end, &count )) == NULL || count > TELEMETRY_MAX_TRACKS ) return 1;
+				image.resize( count );
+				break;
+
+			case TOP_TRACK: {
+				if( (p = get_varint( p, end, &index )) == NULL || 
+					index >= (unsigned)image.trackcount || end - p < 2 ) return 1;
+				Trackbuf *t = &image.tracks[index];
+				memcpy( &mask, p, sizeof mask );
+				p += sizeof mask;
+				t->number = index;
+				if( mask & TF_NAME ) {
+					if( p == end || *p > TRACK_NAME_MAX || end - p < *p + 1 ) return 1;
+					run = *p++;
+					memcpy( t->name, p, run );
+					t->name[run] = '\0';
+					p += run;
+				}
+				for( i = 0; i < TRACK_SHORTS; i++ )
+					if( mask & (0x002 << i) ) {
+						if( end - p < (int)sizeof(short) ) return 1;
+						memcpy( (char *)t + track_shorts[i], p, sizeof(short) );
+						p += sizeof(short);
+					}
+				if( mask & TF_FLAGS ) {
+					if( p == end ) return 1;
+					t->mute = *p & 1;
+					t->solo = (*p >> 1) & 1;
+					t->longtrack = (*p >> 2) & 1;
+					t->active = (*p >> 3) & 1;
+					t->stretch = (*p >> 4) & 1;
+					t->reversed = (*p >> 5) & 1;
+					p++;
+				}
+				break;
+			}
+
+			default:
+				return 1;
+		}
+	}
+	return 0;
+}
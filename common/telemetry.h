@@ -0,0 +1,111 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+//
+// TELEMETRY
+//
+// the sequenced state feed from engine to client. Each update is either a
+// keyframe, carrying the whole state, or a delta against the previous update
+// carrying only what changed. An update larger than one datagram is split
+// into fragments and reassembled by the receiver.
+//
+#define TELEMETRY_MAGIC		0x6c54		// "lT"
+#define TELEMETRY_VERSION	2
+#define TELEMETRY_DATAGRAM	1200		// max bytes sent per datagram
+#define TELEMETRY_KEYFRAME	48			// updates between keyframes, about 1 sec
+#define TELEMETRY_FRAGMENTS	4096		// the most datagrams in an update, about 5 MB
+#define TELEMETRY_MAX_TRACKS	65536	// the most tracks in the table, every field of each fits the above
+
+#define TELE_KEYFRAME	1
+#define TELE_DELTA		2
+
+// field sets a subscriber can ask for
+#define TELE_FIELD_STATE	0x01		// transport, settings and section parts
+#define TELE_FIELD_METERS	0x02		// input, output and track levels
+#define TELE_FIELD_TRACKS	0x04		// the track table
+#define TELE_FIELD_STATS	0x08		// how the engine keeps up, callback times and xruns
+#define TELE_FIELD_ALL		0x0f
+
+struct telemetry_header {
+	unsigned short magic;
+	unsigned char version, type;
+	unsigned int sequence, base;		// a delta applies on top of update 'base'
+	unsigned short fragment, fragments;
+};
+
+#define TELEMETRY_PAYLOAD	(TELEMETRY_DATAGRAM - (int)sizeof(struct telemetry_header))
+
+//
+// the state image shared by both ends: state, section parts, the tracks and
+// the engine's performance. The track table can be shorter than the state's
+// trackcount for an update while the engine makes room for more tracks
+//
+class TelemetryImage {
+public:
+	struct Statebuf state;
+	struct Statsbuf stats;
+	int parts[MAX_SECTIONS];
+	struct Trackbuf *tracks;
+	int trackcount, capacity;
+
+	TelemetryImage();
+	~TelemetryImage();
+	void clear(), reserve(int), resize(int), copy(TelemetryImage *, int);
+};
+
+class TelemetryEncoder {
+
+	TelemetryImage last;
+	unsigned char *buffer;
+	int buffersize, since_keyframe, length;
+	unsigned int sequence;
+	bool full;
+
+	int encode(bool);
+
+public:
+	// the caller fills this in before calling prepare()
+	TelemetryImage image;
+
+	TelemetryEncoder();
+	~TelemetryEncoder();
+	int prepare(), fragment(int, unsigned char *);
+	void keyframe();
+};
+
+class TelemetryDecoder {
+
+	unsigned char *assembly, *received;
+	int assembly_size, assembly_length, fragments, fragments_in;
+	struct telemetry_header current;
+	unsigned int sequence;
+	bool synced;
+
+	int apply(unsigned char *, int);
+
+public:
+	TelemetryImage image;
+
+	TelemetryDecoder();
+	~TelemetryDecoder();
+	int receive(unsigned char *, int);
+};
@@ -70,5 +70,34 @@ struct Trackbuf {
 	char name[TRACK_NAME_MAX+1];
 	short int number, part, channel, bank, program;
 	short int vol_left, vol_right, vol_midi, peak_left, peak_right, peak_midi;
-	bool mute, solo, longtrack, active;
+	bool mute, solo, longtrack, active, stretch, reversed;
+};
+
+//
+// STATSBUF
+// how well the engine's process callback keeps up with jack
+//
+#define STATS_BUCKETS	11		// tenths of the period a callback took, the last one over it
+
+// the stages of a period timed apart
+#define STAGE_CONTROL	0		// requests, rewinds, sync and the transport
+#define STAGE_RECORD	1
+#define STAGE_TRACKS	2		// the removal pass and the track index
+#define STAGE_MIX		3
+#define STAGE_EFFECTS	4		// reverb, master inserts, the buses and outputs
+#define STAGE_CLICK		5		// metronome and midi clock
+#define STAGE_METERS	6
+#define STAGE_TELEMETRY	7
+#define STATS_STAGES	8
+
+struct Statsbuf {
+	unsigned int periods, xruns;				// since the engine started
+	unsigned int xrun_usecs;					// how late the last xrun was
+	unsigned int period_nsecs;					// the time there is for a callback
+	unsigned int average_nsecs, worst_nsecs;	// of the callbacks since the last update
+	float load, jack_load;						// percent of the period we take, and jack's own
+	unsigned int stage_nsecs[STATS_STAGES];		// average per callback since the last update
+	unsigned int histogram[STATS_BUCKETS];		// callbacks since the start by tenth of the period taken
+	unsigned int chunks, huge_chunks, blocks;	// the track audio arena
+	unsigned int minor_faults, major_faults;	// taken on the process thread
 };
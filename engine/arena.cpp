@@ -0,0 +1,329 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "../common/logger.h"
+#include "arena.h"
+
+//
+//	ARENA.CPP
+//
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED	1
+#endif
+
+#define GRAINS	(ARENA_CHUNK / ARENA_GRAIN)
+
+Arena::Arena() {
+
+	nchunks = huge = 0;
+	for( int i = 0; i < ARENA_SLOTS; i++ ) 
+		slots[i] = NULL;
+	for( int i = 0; i < ARENA_CLASSES; i++ ) {
+		free_list[i] = 0;
+		spare[i] = 0;
+		wanted[i] = false;
+	}
+	blocks = fallbacks = 0;
+	node = -1;
+	asked = 0;
+	locked = running = stopping = false;
+	pthread_mutex_init( &mut, NULL );
+	sem_init( &wakeup, 0, 0 );
+}
+
+Arena::~Arena() {
+
+	sem_destroy( &wakeup );
+	pthread_mutex_destroy( &mut );
+}
+
+int Arena::start() {
+	//
+	// the thread that maps the chunks, sizes asked for already are got ready
+	//
+	stopping = false;
+	if( pthread_create( &thread_id, NULL, thread, this ) ) {
+		perror("Arena::start pthread_create");
+		return 1;
+	}
+	running = true;
+	ask();
+	return 0;
+}
+
+int Arena::stop() {
+
+	if( !running ) return 0;
+	stopping = true;
+	sem_post( &wakeup );
+	pthread_join( thread_id, NULL );
+	running = false;
+	return 0;
+}
+
+void *Arena::thread(void *arg) {
+
+	Arena *a = (Arena *)arg;
+
+	while( 1 ) {
+		sem_wait( &a->wakeup );
+		if( a->stopping ) break;
+		a->asked = 0;
+		a->fill();
+	}
+	return NULL;
+}
+
+void Arena::ask() {
+	//
+	// wake the arena thread, only once until it has been round
+	//
+	if( running && __sync_bool_compare_and_swap( &asked, 0, 1 ) ) 
+		sem_post( &wakeup );
+}
+
+void Arena::fill() {
+	//
+	// on the arena thread, top up the lists of the sizes in use
+	//
+	pthread_mutex_lock( &mut );
+	for( int c = 0; c < ARENA_CLASSES; c++ ) 
+		while( wanted[c] && spare[c] < ARENA_SPARE && nchunks < ARENA_CHUNKS && carve( c ) == 0 ) 
+			;
+	pthread_mutex_unlock( &mut );
+}
+
+char *Arena::map_chunk() {
+	//
+	// a chunk on huge pages if there are any set aside, otherwise aligned to
+	// one so the kernel can make it a transparent huge page
+	//
+	char *p, *base;
+	bool hugetlb = true;
+	unsigned long mask;
+	int i, h;
+
+	p = (char *)mmap( NULL, ARENA_CHUNK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+	if( p == MAP_FAILED ) {
+		hugetlb = false;
+		p = (char *)mmap( NULL, 2 * ARENA_CHUNK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+		if( p == MAP_FAILED ) {
+			logger.put( LOG_ERROR, "Arena::map_chunk mmap: %s\n", strerror( errno ) );
+			return NULL;
+		}
+		base = (char *)(((uintptr_t)p + ARENA_CHUNK - 1) & ~(uintptr_t)(ARENA_CHUNK - 1));
+		if( base > p ) munmap( p, base - p );
+		munmap( base + ARENA_CHUNK, p + ARENA_CHUNK - base );
+		p = base;
+		madvise( p, ARENA_CHUNK, MADV_HUGEPAGE );
+	}
+	if( hugetlb ) huge++;
+
+	// nothing is touched yet, so the pages will come from the mixing node
+	if( node >= 0 && node < (int)sizeof mask * 8 ) {
+		mask = 1UL << node;
+		syscall( SYS_mbind, p, ARENA_CHUNK, MPOL_PREFERRED, &mask, sizeof mask * 8, 0 );
+	}
+	if( locked && mlock( p, ARENA_CHUNK ) ) 
+		logger.put( LOG_WARNING, "Arena::map_chunk mlock: %s\n", strerror( errno ) );
+
+	// the chunks keep their numbers, and the table finding one from its
+	// address only grows, so it is read without the lock
+	i = nchunks;
+	chunks[i] = p;
+	for( h = ((uintptr_t)p / ARENA_CHUNK) & (ARENA_SLOTS - 1); slots[h]; h = (h + 1) & (ARENA_SLOTS - 1) ) 
+		;
+	slot_chunk[h] = i;
+	__sync_synchronize();
+	slots[h] = p;
+	nchunks = i + 1;
+	return p;
+}
+
+unsigned int Arena::number(void *p) {
+	//
+	// one more than the place of the block in the arena, 0 if it is not ours
+	//
+	char *base = (char *)((uintptr_t)p & ~(uintptr_t)(ARENA_CHUNK - 1)), *s;
+	int h = ((uintptr_t)base / ARENA_CHUNK) & (ARENA_SLOTS - 1);
+
+	while( (s = slots[h]) ) {
+		if( s == base ) 
+			return slot_chunk[h] * GRAINS + ((char *)p - base) / ARENA_GRAIN + 1;
+		h = (h + 1) & (ARENA_SLOTS - 1);
+	}
+	return 0;
+}
+
+char *Arena::block(unsigned int n) {
+
+	n--;
+	return chunks[n / GRAINS] + (n % GRAINS) * ARENA_GRAIN;
+}
+
+//
+// the free lists hold the number of the top block with a count that moves on
+// at every change, so a list that has been popped and pushed back to the same
+// top meanwhile is not taken for unchanged. Each block holds the next number
+//
+
+void Arena::push(int c, void *first, void *last, unsigned int n) {
+	//
+	// put the blocks first to last, already linked, on top of list c
+	//
+	unsigned long long top;
+
+	do {
+		top = free_list[c];
+		*(volatile unsigned int *)last = (unsigned int)top;
+	} while( !__sync_bool_compare_and_swap( &free_list[c], top, ((top >> 32) + 1) << 32 | n ) );
+}
+
+void *Arena::pop(int c) {
+
+	unsigned long long top, next;
+	char *p;
+
+	do {
+		top = free_list[c];
+		if( (unsigned int)top == 0 ) return NULL;
+		p = block( (unsigned int)top );
+		// if another thread has taken it since, the count has moved and we go again
+		next = ((top >> 32) + 1) << 32 | *(volatile unsigned int *)p;
+	} while( !__sync_bool_compare_and_swap( &free_list[c], top, next ) );
+	return p;
+}
+
+int Arena::carve(int c) {
+	//
+	// map a chunk and put the whole of it on list c. Linking the blocks
+	// touches every page, so the faults are taken here too
+	//
+	size_t size = (c + 1) * ARENA_GRAIN;
+	int count = ARENA_CHUNK / size, i;
+	char *p = map_chunk();
+	unsigned int n;
+
+	if( p == NULL ) return 1;
+	n = number( p );
+	for( i = 0; i < count - 1; i++ ) 
+		*(unsigned int *)(p + i * size) = n + (i + 1) * (c + 1);
+	push( c, p, p + i * size, n );
+	__sync_fetch_and_add( &spare[c], count * size );
+	return 0;
+}
+
+void *Arena::get(size_t size) {
+	//
+	// a block of at least size bytes, never waits on a lock or the kernel
+	//
+	int c = (size + ARENA_GRAIN - 1) / ARENA_GRAIN - 1;
+	void *p;
+
+	if( size == 0 || c >= ARENA_CLASSES ) {
+		__sync_fetch_and_add( &fallbacks, 1 );
+		return malloc( size );
+	}
+	size = (c + 1) * ARENA_GRAIN;
+
+	if( (p = pop( c )) == NULL ) {
+		// none ready, the arena thread keeps some of this size from now on
+		wanted[c] = true;
+		ask();
+		__sync_fetch_and_add( &fallbacks, 1 );
+		return malloc( size );
+	}
+	__sync_fetch_and_add( &blocks, 1 );
+	if( __sync_sub_and_fetch( &spare[c], size ) < ARENA_SPARE / 2 ) 
+		ask();
+	return p;
+}
+
+void Arena::put(void *p, size_t size) {
+
+	int c = (size + ARENA_GRAIN - 1) / ARENA_GRAIN - 1;
+	unsigned int n;
+
+	if( p == NULL ) return;
+
+	if( size == 0 || c >= ARENA_CLASSES || (n = number( p )) == 0 ) {
+		// it came from malloc
+		__sync_fetch_and_sub( &fallbacks, 1 );
+		free( p );
+		return;
+	}
+	push( c, p, p, n );
+	__sync_fetch_and_sub( &blocks, 1 );
+	__sync_fetch_and_add( &spare[c], (c + 1) * ARENA_GRAIN );
+}
+
+void Arena::home() {
+	//
+	// called on the process thread, the chunks mapped from now on are kept on its node
+	//
+	unsigned cpu, n;
+
+	if( syscall( SYS_getcpu, &cpu, &n, NULL ) == 0 ) {
+		node = n;
+		logger.put( LOG_INFO, "track audio kept on memory node %d\n", node );
+	}
+	ask();
+}
+
+int Arena::lock() {
+	//
+	// keep the track audio in memory, the chunks there are and those to come
+	//
+	int i, err = 0;
+
+	pthread_mutex_lock( &mut );
+	locked = true;
+	for( i = 0; i < nchunks; i++ ) 
+		if( mlock( chunks[i], ARENA_CHUNK ) ) err = 1;
+	pthread_mutex_unlock( &mut );
+	if( err ) perror("Arena::lock mlock");
+	return err;
+}
+
+void Arena::stats(struct arena_stats *s) {
+	//
+	// each count as it stands, without the lock, process reads them for telemetry
+	//
+	s->chunks = __atomic_load_n( &nchunks, __ATOMIC_RELAXED );
+	s->huge = __atomic_load_n( &huge, __ATOMIC_RELAXED );
+	s->node = __atomic_load_n( &node, __ATOMIC_RELAXED );
+	s->blocks = __atomic_load_n( &blocks, __ATOMIC_RELAXED );
+	s->fallbacks = __atomic_load_n( &fallbacks, __ATOMIC_RELAXED );
+}
@@ -0,0 +1,86 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+//
+// ARENA
+//
+// the audio of the tracks in blocks carved out of 2 MB chunks. A chunk is
+// backed by huge pages where the kernel gives them and is placed on the
+// memory node of the process thread that mixes it, not on the node of the
+// thread that happened to record or download the track. Each block size
+// has a list of free blocks that any thread takes from and gives back to
+// without a lock. The arena's own thread maps the chunks and carves them
+// up whenever a list in use runs low, so process never waits on mmap.
+// The chunks stay until the engine exits.
+//
+#define ARENA_CHUNK		(2 * 1024 * 1024)
+#define ARENA_CHUNKS	4096		// 8 GB of track audio, then it comes from malloc
+#define ARENA_GRAIN		1024		// block sizes round up to this
+#define ARENA_CLASSES	4			// the largest block holds a collection of floats
+#define ARENA_SPARE		(2 * ARENA_CHUNK)	// bytes kept free of each size in use
+#define ARENA_SLOTS		(2 * ARENA_CHUNKS)	// to find a block's chunk
+
+struct arena_stats {
+	int chunks, huge, node;			// chunks mapped, how many on huge pages, and where
+	long blocks, fallbacks;			// blocks out now, and larger ones from malloc
+};
+
+class Arena {
+
+	char *chunks[ARENA_CHUNKS];
+	char * volatile slots[ARENA_SLOTS];
+	int slot_chunk[ARENA_SLOTS];
+	volatile int nchunks, huge;
+	volatile unsigned long long free_list[ARENA_CLASSES];	// a count, and the top block's number
+	volatile long spare[ARENA_CLASSES];
+	volatile bool wanted[ARENA_CLASSES];
+	volatile long blocks, fallbacks;
+	volatile int node, asked;
+	bool locked;
+	volatile bool running, stopping;
+	pthread_mutex_t mut;
+	sem_t wakeup;
+	pthread_t thread_id;
+
+	char *map_chunk();
+	unsigned int number(void *);
+	char *block(unsigned int);
+	void push(int, void *, void *, unsigned int);
+	void *pop(int);
+	int carve(int);
+	void fill();
+	void ask();
+	static void *thread(void *);
+
+public:
+
+	Arena();
+	~Arena();
+	int start(), stop();
+	void *get(size_t);
+	void put(void *, size_t);
+	void home();
+	int lock();
+	void stats(struct arena_stats *);
+};
+
+extern Arena arena;
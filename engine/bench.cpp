@@ -0,0 +1,490 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+//
+//	bench
+//
+//	times the engine's hot paths, each as the work of one period of so many
+//	frames for so many tracks. A figure is the median of a few rounds, each
+//	long enough to time well, on signals made up the same way every run.
+//	The results go to stdout a line each, tab separated:
+//
+//		name	ns_period	ns_track	frames	tracks
+//
+//	The compression lines give the nsecs for a period's worth of frames and
+//	for a whole track, the telemetry line is for an update, and process runs
+//	the whole engine through filejack with the tracks playing, at the
+//	precision and on the mixing threads of the config.
+//
+#include <stdio.h>
+#include <unistd.h> 
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#include "../common/network.h"
+#include "../common/udpstruct.h"
+#include "../common/telemetry.h"
+#include "framecollection.h"
+#include "internalclick.h"
+#include "state.h"
+#include "section.h"
+#include "track.h"
+#include "config.h"
+#include "core.h"
+#include "filejack.h"
+
+#define BENCH_ROUNDS		7
+#define BENCH_ROUNDS_MAX	31
+#define BENCH_ROUND_NSECS	20000000L	// the least a round runs
+#define BENCH_SECONDS		10			// of audio in a track
+#define BENCH_EVENTS		8			// midi events for a track in a collection or period
+
+extern int find_peak_audio(jack_default_audio_sample_t *, jack_nframes_t);
+extern jack_client_t *client;
+
+jack_nframes_t frames = 256, rate = 48000;
+int ntracks = 16, rounds = BENCH_ROUNDS, nameseq = 0, nwanted = 0;
+char **wanted;
+
+// what the benchmarks work on
+Track **tracks;
+jack_default_audio_sample_t *signal;
+TelemetryImage *status;
+TelemetryEncoder *encoder;
+unsigned char datagram[TELEMETRY_DATAGRAM];
+unsigned int seed = 1;
+int scratch_fd = -1, saved_stderr = -1;
+
+static long now() {
+
+	struct timespec t;
+
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return t.tv_sec * 1000000000L + t.tv_nsec;
+}
+
+static float noise() {
+
+	seed = seed * 1664525 + 1013904223;
+	return (seed >> 8) * (1.0f / 8388608.0f) - 1.0f;
+}
+
+static double measure( void (*work)() ) {
+	//
+	// the median nsecs a call of work takes. The calls finding how many
+	// make up a round warm the caches up
+	//
+	double times[BENCH_ROUNDS_MAX], t;
+	long begin, took, n = 1, i;
+	int r, j;
+
+	for( ;; ) {
+		begin = now();
+		for( i = 0; i < n; i++ ) work();
+		took = now() - begin;
+		if( took >= BENCH_ROUND_NSECS / 4 ) break;
+		n *= 2;
+	}
+	n = n * BENCH_ROUND_NSECS / (took > 0 ? took : 1) + 1;
+
+	for( r = 0; r < rounds; r++ ) {
+		begin = now();
+		for( i = 0; i < n; i++ ) work();
+		t = (double)(now() - begin) / n;
+		for( j = r; j > 0 && times[j - 1] > t; j-- ) 
+			times[j] = times[j - 1];
+		times[j] = t;
+	}
+	return times[rounds / 2];
+}
+
+static bool want( const char *name ) {
+
+	if( nwanted == 0 ) return true;
+	for( int i = 0; i < nwanted; i++ )
+		if( strcmp( wanted[i], name ) == 0 ) return true;
+	return false;
+}
+
+static void report( const char *name, double ns_period, double ns_track, int count ) {
+
+	printf( "%s\t%.0f\t%.0f\t%d\t%d\n", name, ns_period, ns_track, frames, count );
+	fflush( stdout );
+}
+
+static void quiet( bool on ) {
+	//
+	// writing and reading a track tell of every call on stderr
+	//
+	int fd;
+
+	fflush( stderr );
+	if( on ) {
+		saved_stderr = dup( 2 );
+		fd = open( "/dev/null", O_WRONLY );
+		dup2( fd, 2 );
+		close( fd );
+	} else {
+		dup2( saved_stderr, 2 );
+		close( saved_stderr );
+	}
+}
+
+static Track *make_track( bool left, bool right, bool midi ) {
+	//
+	// a loop of BENCH_SECONDS, tones with a little noise and a few notes to
+	// each collection, finished like a recording at the current precision
+	//
+	Track *track = new Track( 0, nameseq++ );
+	int count = COLLECTIONS( BENCH_SECONDS * rate ), c, i;
+	jack_midi_data_t data[3];
+	jack_midi_event_t e;
+
+	for( c = 0; c < count; c++ ) {
+		FrameCollection *fc = new FrameCollection( NFRAMES, left, right );
+		float *l = fc->get_frames_left(), *r = fc->get_frames_right();
+
+		for( i = 0; i < NFRAMES; i++ ) {
+			float t = (float)(c * NFRAMES + i) / rate;
+			if( l ) l[i] = 0.3f * sinf( 2.0f * (float)M_PI * 220.0f * t ) + 0.01f * noise();
+			if( r ) r[i] = 0.3f * sinf( 2.0f * (float)M_PI * 330.0f * t ) + 0.01f * noise();
+		}
+		for( i = 0; midi && i < BENCH_EVENTS; i++ ) {
+			data[0] = i & 1 ? 0x80 : 0x90;
+			data[1] = 60 + i / 2;
+			data[2] = 100;
+			e.time = i * NFRAMES / BENCH_EVENTS;
+			e.size = 3;
+			e.buffer = data;
+			fc->insert_midi_event( &e, 0, 1.0f );
+		}
+		fc->squeeze();
+		fc->append( &track->head, &track->tail );
+	}
+	track->collcount = track->loadcount = count;
+	track->length = count * NFRAMES;
+	track->use_left = left;
+	track->use_right = right;
+	track->use_midi = midi;
+	track->rewind();
+	return track;
+}
+
+static void make_tracks( bool left, bool right, bool midi, int precision ) {
+
+	FrameCollection::precision = precision;
+	for( int i = 0; i < ntracks; i++ ) 
+		tracks[i] = make_track( left, right, midi );
+	FrameCollection::precision = PRECISION_F32;
+}
+
+static void free_tracks() {
+
+	for( int i = 0; i < ntracks; i++ ) 
+		delete tracks[i];
+}
+
+//
+// the work timed
+//
+
+static void sum_tracks() {
+	//
+	// as a period sums them, into a new collection
+	//
+	FrameCollection *sum = new FrameCollection( frames, true, true );
+
+	sum->zero();
+	for( int i = 0; i < ntracks; i++ ) 
+		tracks[i]->sum( sum, 0, frames, 1.0f, 1.0f, 1.0f );
+	delete sum;
+}
+
+static void insert_events() {
+	//
+	// the events of the tracks going into a period's collection, out of order
+	//
+	FrameCollection *fc = new FrameCollection( frames, false, false );
+	jack_midi_data_t data[3] = { 0x90, 60, 100 };
+	jack_midi_event_t e;
+
+	e.size = 3;
+	e.buffer = data;
+	for( int i = 0; i < ntracks * BENCH_EVENTS; i++ ) {
+		e.time = (i * 7919) % frames;
+		fc->insert_midi_event( &e, i % 16, 1.0f );
+	}
+	delete fc;
+}
+
+static void find_peak() {
+
+	find_peak_audio( signal, frames );
+}
+
+static void compress() {
+
+	lseek( scratch_fd, 0, SEEK_SET );
+	if( ftruncate( scratch_fd, 0 ) ) return;
+	tracks[0]->write_left( scratch_fd );
+}
+
+static void decompress() {
+
+	Track *track = new Track( 0, 0 );
+
+	track->collcount = tracks[0]->collcount;
+	lseek( scratch_fd, 0, SEEK_SET );
+	track->read_left( scratch_fd, false );
+	delete track;
+}
+
+static void build_status() {
+	//
+	// the image filled in as process does it, then encoded and cut up as the
+	// publisher does for a subscriber
+	//
+	Trackbuf *trackbuf;
+	int i, n;
+
+	state.fill( &status->state );
+	status->resize( ntracks );
+	for( i = 0; i < ntracks; i++ ) {
+		Track *t = tracks[i];
+		trackbuf = &status->tracks[i];
+		trackbuf->number = i;
+		strcpy( trackbuf->name, t->name );
+		trackbuf->part = t->part;
+		trackbuf->channel = t->channel;
+		trackbuf->bank = t->bank;
+		trackbuf->program = t->program;
+		trackbuf->vol_left = (int) ( 100 * t->volume_left );
+		trackbuf->vol_right = (int) ( 100 * t->volume_right );
+		trackbuf->vol_midi = (int) ( 100 * t->volume_midi );
+		// the meters move every update
+		trackbuf->peak_left = noise() * 50.0f + 50.0f;
+		trackbuf->peak_right = noise() * 50.0f + 50.0f;
+		trackbuf->peak_midi = t->peak_midi;
+		trackbuf->mute = t->mute;
+		trackbuf->solo = t->solo;
+		trackbuf->longtrack = t->longtrack;
+		trackbuf->stretch = t->stretch;
+		trackbuf->reversed = t->reversed;
+		trackbuf->active = true;
+	}
+
+	encoder->image.copy( status, TELE_FIELD_ALL );
+	n = encoder->prepare();
+	for( i = 0; i < n; i++ ) 
+		encoder->fragment( i, datagram );
+}
+
+static void cycle() {
+
+	filejack_cycle( frames );
+}
+
+//
+// the benchmarks
+//
+
+static void bench_sum( const char *name, bool left, bool right, bool midi, int precision ) {
+
+	if( !want( name ) ) return;
+	make_tracks( left, right, midi, precision );
+	double ns = measure( sum_tracks );
+	report( name, ns, ns / ntracks, ntracks );
+	free_tracks();
+}
+
+static void bench_insert() {
+
+	if( !want( "insert_midi_event" ) ) return;
+	double ns = measure( insert_events );
+	report( "insert_midi_event", ns, ns / ntracks, ntracks );
+}
+
+static void bench_peak() {
+
+	if( !want( "find_peak_audio" ) ) return;
+	signal = new jack_default_audio_sample_t[frames];
+	for( jack_nframes_t i = 0; i < frames; i++ ) 
+		signal[i] = 0.5f * noise();
+	double ns = measure( find_peak );
+	report( "find_peak_audio", ns, ns, 1 );
+	delete[] signal;
+}
+
+static void bench_compression() {
+	//
+	// a track of one channel written out and read back, the figures for a
+	// period's worth and for the whole of it
+	//
+	char name[] = "/tmp/loopR-bench-XXXXXX";
+	double ns, periods;
+
+	if( !want( "write_left" ) && !want( "read_left" ) ) return;
+	if( (scratch_fd = mkstemp( name )) < 0 ) {
+		perror( name );
+		return;
+	}
+	unlink( name );
+
+	int keep = ntracks;
+	ntracks = 1;
+	make_tracks( true, false, false, PRECISION_F32 );
+	periods = (double)tracks[0]->length / frames;
+
+	quiet( true );
+	ns = measure( compress );
+	quiet( false );
+	if( want( "write_left" ) ) report( "write_left", ns / periods, ns, 1 );
+
+	compress();
+	quiet( true );
+	ns = measure( decompress );
+	quiet( false );
+	if( want( "read_left" ) ) report( "read_left", ns / periods, ns, 1 );
+
+	free_tracks();
+	ntracks = keep;
+	close( scratch_fd );
+}
+
+static void bench_telemetry() {
+
+	if( !want( "telemetry" ) ) return;
+	make_tracks( true, true, false, PRECISION_F32 );
+	status = new TelemetryImage();
+	encoder = new TelemetryEncoder();
+	double ns = measure( build_status );
+	report( "telemetry", ns, ns / ntracks, ntracks );
+	delete encoder;
+	delete status;
+	free_tracks();
+}
+
+static void bench_process() {
+	//
+	// the tracks playing in the current part, through the whole engine
+	//
+	int i;
+
+	if( !want( "process" ) ) return;
+	if( filejack_setup( rate, frames ) ) {
+		fprintf(stderr, "bench: no rate or period\n");
+		return;
+	}
+	network.talker_init(config.outhost, config.outport);
+	if( !jack_init() ) {
+		fprintf(stderr, "bench: engine initialization failure\n");
+		return;
+	}
+
+	for( i = 0; i < ntracks; i++ ) {
+		Track *track = make_track( true, true, false );
+		track->part = sections[state.current_section].part;
+		if( TrackTail == NULL ) {
+			TrackTail = TrackHead = track;
+			track->next = track->prev = NULL;
+		}
+		else {
+			track->prev = TrackTail;
+			track->next = NULL;
+			TrackTail->next = track;
+			TrackTail = track;
+		}
+		state.trackcount++;
+	}
+	tracks_changed = true;
+
+	jack_startstop( 1 );
+	double ns = measure( cycle );
+	report( "process", ns, ns / ntracks, ntracks );
+	jack_startstop( 0 );
+	jack_close();
+}
+
+static int handleargs( int argc, char **argv ) {
+
+	wanted = new char *[argc];
+	for( int i = 1; i < argc; i++ ) {
+		if( argv[i][0] != '-' ) {
+			wanted[nwanted++] = argv[i];
+			continue;
+		}
+		switch( argv[i][1] ) {
+			case 'p': frames = atoi( &argv[i][2] ); break;
+			case 't': ntracks = atoi( &argv[i][2] ); break;
+			case 'n': rounds = atoi( &argv[i][2] ); break;
+			default:
+				fprintf(stderr, "usage: bench [-pFRAMES] [-tTRACKS] [-nROUNDS] [name ...]\n" );
+				fprintf(stderr, "the names are sum_stereo sum_mono sum_midi sum_stereo_f16 sum_stereo_s24\n" );
+				fprintf(stderr, "insert_midi_event find_peak_audio write_left read_left telemetry process\n" );
+				return 1;
+		}
+	}
+	if( frames < 1 ) frames = 1;
+	if( ntracks < 1 ) ntracks = 1;
+	if( rounds < 1 ) rounds = 1;
+	if( rounds > BENCH_ROUNDS_MAX ) rounds = BENCH_ROUNDS_MAX;
+	return 0;
+}
+
+int main( int argc, char **argv ) {
+
+	core_init();
+
+	if( handleargs( argc, argv ) ) return 1;
+	tracks = new Track *[ntracks];
+
+	printf( "# frames %d rate %d tracks %d rounds %d precision %s mixthreads %d\n",
+		frames, rate, ntracks, rounds, config.precision, config.mixthreads );
+	printf( "# name\tns_period\tns_track\tframes\ttracks\n" );
+
+	bench_sum( "sum_stereo", true, true, false, PRECISION_F32 );
+	bench_sum( "sum_mono", true, false, false, PRECISION_F32 );
+	bench_sum( "sum_midi", false, false, true, PRECISION_F32 );
+	bench_sum( "sum_stereo_f16", true, true, false, PRECISION_F16 );
+	bench_sum( "sum_stereo_s24", true, true, false, PRECISION_S24 );
+	bench_insert();
+	bench_peak();
+	bench_compression();
+	bench_telemetry();
+	bench_process();
+
+	delete[] tracks;
+	delete[] wanted;
+	return 0;
+}
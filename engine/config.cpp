@@ -53,13 +53,32 @@ Config::Config() {
 	client = new char[strlen(CLIENT)+1];
 	strcpy( client, CLIENT );
 
+	syncmode = new char[strlen(SYNCMODE)+1];
+	strcpy( syncmode, SYNCMODE );
+	syncgroup = new char[strlen(SYNCGROUP)+1];
+	strcpy( syncgroup, SYNCGROUP );
+	syncport = new char[strlen(SYNCPORT)+1];
+	strcpy( syncport, SYNCPORT );
+	precision = new char[strlen(PRECISION)+1];
+	strcpy( precision, PRECISION );
+	loglevel = new char[strlen(LOGLEVEL)+1];
+	strcpy( loglevel, LOGLEVEL );
+
 	cinternal = CINTERNAL;
 	autoupload = AUTOUPLOAD;
 	longtracks = LONGTRACKS;
+	midiclock = MIDICLOCK;
+	mlock = MLOCK;
 	downbeat = DOWNBEAT;
 	fill = FILL;
 	click = CLICK;
 	velocity = VELOCITY;
+	latency = LATENCY;
+	xfade = XFADE;
+	buses = BUSES;
+	inputs = INPUTS;
+	mixthreads = MIXTHREADS;
+	chunkcache = CHUNKCACHE;
 
 	char filename[BUFFER_LEN], *p, *q;
 	strcpy( filename, getenv("HOME")) ;
@@ -129,6 +148,31 @@ Config::Config() {
 			client = new char[strlen(value)+1];
 			strcpy(client, value );
 		} else
+		if( strcmp( parameter, "SYNC" ) == 0 ) {
+			delete syncmode;
+			syncmode = new char[strlen(value)+1];
+			strcpy(syncmode, value );
+		} else
+		if( strcmp( parameter, "SYNCGROUP" ) == 0 ) {
+			delete syncgroup;
+			syncgroup = new char[strlen(value)+1];
+			strcpy(syncgroup, value );
+		} else
+		if( strcmp( parameter, "SYNCPORT" ) == 0 ) {
+			delete syncport;
+			syncport = new char[strlen(value)+1];
+			strcpy(syncport, value );
+		} else
+		if( strcmp( parameter, "PRECISION" ) == 0 ) {
+			delete precision;
+			precision = new char[strlen(value)+1];
+			strcpy(precision, value );
+		} else
+		if( strcmp( parameter, "LOGLEVEL" ) == 0 ) {
+			delete loglevel;
+			loglevel = new char[strlen(value)+1];
+			strcpy(loglevel, value );
+		} else
 		if( strcmp( parameter, "CINTERNAL" ) == 0 ) {
 			if( strcmp( value, "true") == 0 )
 				cinternal = true;
@@ -148,6 +192,20 @@ Config::Config() {
 				longtracks = false;			
 		}
 		else
+		if( strcmp( parameter, "MIDICLOCK" ) == 0 ) {
+			if( strcmp( value, "true") == 0 )
+				midiclock = true;
+			if( strcmp( value, "false") == 0 )
+				midiclock = false;			
+		}
+		else
+		if( strcmp( parameter, "MLOCK" ) == 0 ) {
+			if( strcmp( value, "true") == 0 )
+				mlock = true;
+			if( strcmp( value, "false") == 0 )
+				mlock = false;			
+		}
+		else
 		if( strcmp( parameter, "DOWNBEAT" ) == 0 ) 
 			downbeat = atoi(value);
 		else
@@ -159,6 +217,24 @@ Config::Config() {
 		else
 		if( strcmp( parameter, "VELOCITY" ) == 0 )
 			velocity = atoi(value);	
+		else
+		if( strcmp( parameter, "LATENCY" ) == 0 )
+			latency = atoi(value);	
+		else
+		if( strcmp( parameter, "XFADE" ) == 0 )
+			xfade = atoi(value);	
+		else
+		if( strcmp( parameter, "BUSES" ) == 0 )
+			buses = atoi(value);	
+		else
+		if( strcmp( parameter, "INPUTS" ) == 0 )
+			inputs = atoi(value);	
+		else
+		if( strcmp( parameter, "MIXTHREADS" ) == 0 )
+			mixthreads = atoi(value);	
+		else
+		if( strcmp( parameter, "CHUNKCACHE" ) == 0 )
+			chunkcache = atoi(value);	
 	}
 
 	fclose( fd );
@@ -179,14 +255,22 @@ Config::~Config() {
 	fprintf(fd, "INPORT=%s\nOUTPORT=%s\nOUTHOST=%s\n", inport, outport, outhost );
 	fprintf(fd, "TRACKPUT=%s\nTRACKGET=%s\nTRACKHOST=%s\n", trackput, trackget, trackhost );
 	fprintf(fd, "CLIENT=%s\n", client );
+	fprintf(fd, "SYNC=%s\nSYNCGROUP=%s\nSYNCPORT=%s\n", syncmode, syncgroup, syncport );
+	fprintf(fd, "PRECISION=%s\nLOGLEVEL=%s\n", precision, loglevel );
 	if( cinternal ) fprintf(fd, "CINTERNAL=true\n");
 	else			fprintf(fd, "CINTERNAL=false\n");
 	if( autoupload ) fprintf(fd, "AUTOUPLOAD=true\n");
 	else			fprintf(fd, "AUTOUPLOAD=false\n");
 	if( longtracks ) fprintf(fd, "LONGTRACKS=true\n");
 	else			fprintf(fd, "LONGTRACKS=false\n");
+	if( midiclock ) fprintf(fd, "MIDICLOCK=true\n");
+	else			fprintf(fd, "MIDICLOCK=false\n");
+	if( mlock ) fprintf(fd, "MLOCK=true\n");
+	else			fprintf(fd, "MLOCK=false\n");
 	fprintf(fd, "DOWNBEAT=%d\nFILL=%d\nCLICK=%d\nVELOCITY=%d\n",
 		downbeat, fill, click, velocity );
+	fprintf(fd, "LATENCY=%d\nXFADE=%d\nBUSES=%d\nINPUTS=%d\nMIXTHREADS=%d\n", latency, xfade, buses, inputs, mixthreads );
+	fprintf(fd, "CHUNKCACHE=%d\n", chunkcache );
 
 	fclose( fd );
 }
@@ -34,17 +34,33 @@ SOFTWARE.
 #define CINTERNAL 	true
 #define AUTOUPLOAD	true
 #define LONGTRACKS	true
+#define MIDICLOCK	false
+#define MLOCK		false	// lock the track audio in memory
 #define DOWNBEAT	36
 #define FILL		46
 #define CLICK		42
 #define VELOCITY	111
+#define LATENCY		0		// frames added to the latency jack reports
+#define XFADE		5		// milliseconds of crossfade at a loop seam
+#define BUSES		0		// output buses opened besides the main outputs
+#define INPUTS		0		// stereo inputs opened besides the main inputs
+#define MIXTHREADS	0		// threads sharing the mixing with process
+#define CHUNKCACHE	1024	// megabytes of track chunks kept locally, 0 for no limit
+#define SYNCMODE	"off"
+#define SYNCGROUP	"239.255.76.82"
+#define SYNCPORT	"4960"
+#define PRECISION	"f32"		// how recorded frames are kept, f32, f16 or s24
+#define LOGLEVEL	"info"		// messages logged, error, warning, info or debug
 
 class Config {
 public:
 	char *inport, *outport, *outhost, *trackput, *trackget, *trackhost;
 	char *client;
-	bool cinternal, autoupload, longtracks;
+	char *syncmode, *syncgroup, *syncport;
+	char *precision, *loglevel;
+	bool cinternal, autoupload, longtracks, midiclock, mlock;
 	unsigned char downbeat, fill, click, velocity;
+	int latency, xfade, buses, inputs, mixthreads, chunkcache;
 
 	Config();
 	~Config();
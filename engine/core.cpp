@@ -24,20 +24,29 @@ SOFTWARE.
 #include <unistd.h> 
 #include <string.h>
 #include <ctype.h>
+#include <math.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <pthread.h>
+#include <semaphore.h>
 //#include <sys/stat.h> 
 #include <fcntl.h> 
+#include <time.h>
+#include <sys/resource.h>
 #include <zlib.h>
 
 #include <jack/jack.h>
 #include <jack/midiport.h>
+#include <jack/thread.h>
+#include <jack/statistics.h>
 #include "../common/network.h"
 #include "../common/udpstruct.h"
+#include "../common/telemetry.h"
+#include "../common/control.h"
+#include "../common/logger.h"
 #include "config.h"
 #include "framecollection.h"
 #include "internalclick.h"
@@ -45,9 +54,20 @@ SOFTWARE.
 #include "section.h"
 #include "track.h"
 #include "service.h"
+#include "publisher.h"
+#include "sync.h"
+#include "stretch.h"
+#include "midiclock.h"
+#include "effects.h"
+#include "mixer.h"
+#include "arena.h"
+#include "stats.h"
 #include "core.h"
 
 #define NAMEBUFLEN  64
+#define MAX_BUSES	8		// output buses including the main outputs
+#define MAX_INPUTS	16		// stereo inputs including the main inputs
+#define XFADE_MAX	4096	// longest crossfade at a loop seam
 
 //
 // keep our "globals" here, the ones that don't need to be in Statebuf
@@ -56,6 +76,38 @@ Config config;
 
 Network network;
 
+ControlDecoder control;
+
+Publisher publisher;
+
+TransportSync transport_sync;
+
+Stretcher stretcher;
+
+MidiClock midi_clock;
+
+EffectQueue effects;
+
+EffectChain master_effects;
+
+MixPool mixpool;
+
+Arena arena;
+
+EngineStats stats;
+
+// opens the ports of an output bus, below with the jack code
+int add_bus(int b);
+
+// the stereo inputs opened, and those after the main pair armed for
+// recording, a bit each from input 1. The main pair goes by the rec flags in state
+int inputs = 1;
+volatile unsigned int rec_inputs = 0;
+
+bool armed();
+
+int sync_mode = SYNC_OFF;
+
 InternalClick internal_click;
 
 pthread_mutex_t append_track_mut;
@@ -64,6 +116,9 @@ State state;
 
 Track *TrackHead = NULL, *TrackTail = NULL;
 
+// set whenever the track list or what decides where a track plays changes
+volatile bool tracks_changed = true;
+
 //struct Statebuf *statebuffer;
 
 int /*sections[MAX_SECTIONS],*/ last_channel = 1;
@@ -78,7 +133,24 @@ void core_init() {
 	//
 	// perform any global sequencer initializations here
 	//
+	int level;
+
 	trackname[0] = clientname[0] = '\0';
+
+	// from here on the messages are written out on the logger's thread
+	if( (level = Logger::level_named( config.loglevel )) < 0 )
+		fprintf(stderr, "unknown log level %s, keeping info\n", config.loglevel );
+	else logger.level = level;
+	logger.start();
+}
+
+static bool tracks_busy() {
+	//
+	// true while any track has a resample thread working on it
+	//
+	for( Track *t = TrackHead; t; t = t->next ) 
+		if( t->busy ) return true;
+	return false;
 }
 
 int load_sequencer(bool loadtracks) {
@@ -88,6 +160,11 @@ int load_sequencer(bool loadtracks) {
 	int fd;
 	unsigned int bytes;
 	
+	if( tracks_busy() ) {
+		fprintf(stderr, "tracks are being resampled, not loading\n");
+		return 0;
+	}
+
 	// remove any existing tracks
 	if( state.trackcount ) {		
 		Track *t, *track = TrackTail;
@@ -98,6 +175,7 @@ int load_sequencer(bool loadtracks) {
 		}
 		state.trackcount = 0;
 	}
+	TrackHead = TrackTail = NULL;
 
 	fd = open("seq-state",  O_RDONLY );
 	if( fd < 0 ) {
@@ -106,20 +184,33 @@ int load_sequencer(bool loadtracks) {
 	}
 
 	bytes = read( fd, &state, sizeof( State ) );
-	if( bytes < sizeof(State)) return 0;
+	if( bytes < sizeof(State)) {
+		close( fd );
+		return 0;
+	}
 
 	bytes = read( fd, sections, sizeof(Section) * state.sections );
-	if( bytes < sizeof(int) * state.sections ) return 0;
+	if( bytes < sizeof(int) * state.sections ) {
+		state.trackcount = 0;
+		close( fd );
+		return 0;
+	}
 
 	int count = state.trackcount;
 	Track *track, *ptr;
+	state.trackcount = 0;
 	while( count-- ) {
 
 		track = new Track();
-		bytes = read( fd, track, sizeof(Track) );
-		if( bytes < sizeof(Track)) return 0;
+		if( track->read_record( fd ) < 0 ) {
+			// keep the tracks read whole, the rest of the file is no use
+			fprintf(stderr, "seq-state file ends after %d tracks\n", state.trackcount );
+			delete track;
+			break;
+		}
+		state.trackcount++;
 
-		track->loadcount = 0;	// keeps track of whether collections are created yet
+		track->loaded();	// keeps track of whether collections are created yet
 
 		if( TrackHead == NULL ) {
 			TrackHead = TrackTail = track;
@@ -134,6 +225,7 @@ int load_sequencer(bool loadtracks) {
 			TrackTail = track;
 		}
 	}
+	tracks_changed = true;
 
 	fprintf(stderr, "read seq-state file\n");
 	close( fd );
@@ -166,7 +258,7 @@ int load_sequencer(bool loadtracks) {
 		}
 
 		// the playback pointers need resetting
-		track->playback = track->head;		
+		track->rewind();
 
 		fprintf(stderr, "read track sequence %d name %s\n", sequence, track->name );
 		track = track->next;
@@ -194,7 +286,7 @@ int flush_sequencer(bool writetracks) {
 	Track *track = TrackHead;
 	while( track ) {
 
-		write( fd, track, sizeof( Track ) );	
+		track->write_record( fd );
 		track = track->next;
 	}
 	fprintf(stderr, "wrote seq-state file\n");
@@ -235,245 +327,10 @@ int flush_sequencer(bool writetracks) {
 
 }
 
-void extend_command( int numb, char *buffer ) {
-
-	// commands for track and section with number preceding
-
-	//fprintf(stderr, "track/division command (%d)%s\n", numb, buffer);
-	int trackdivnum, n;
-	char *p = buffer, digits[128];
-	
-	// strip any trailing newline
-	if( buffer[numb-1] == '\n' ) {
-		fprintf(stderr, "<stripping newline>\n");
-		if( --numb == 0 ) {
-			fprintf(stderr, "--invalid command - no data\n");
-			return;
-		}
-	}
-	
-	n = 0;
-	while( n < numb && isdigit( *p ) ) digits[n++] = *p++;
-	if( n == numb ) {
-		fprintf(stderr, "--invalid command, too short\n" );
-		return;
-	}
-	digits[n] = '\0';
-	trackdivnum = atoi(digits);
-	numb = numb - n;
-		
-	if( *p == 'a' ) {
-		
-		// section increase command, check range
-		if( trackdivnum >= state.sections ) {
-			fprintf(stderr, "--invalid section number\n");
-			return;
-		}
-		sections[trackdivnum].part++;
-		if( sections[trackdivnum].part > state.sections )
-				sections[trackdivnum].part = 0;
-		fprintf(stderr, "section: part now %d\n", sections[trackdivnum].part);
-	}		
-	else if( *p == 'A' ) {
-		
-		// section set command, check range
-		if( trackdivnum >= state.sections ) {
-			fprintf(stderr, "--invalid section number\n");
-			return;
-		}
-		numb--;	p++;
-		n = 0;
-		while( n < numb && isdigit( *p ) ) digits[n++] = *p++;
-		digits[n] = '\0';
-		sections[trackdivnum].part = atoi( digits );
-		fprintf(stderr, "section: part now %d\n", sections[trackdivnum].part);
-	}		
-	else {
-		
-		// track command, locate track		
-		Track *trk = TrackHead;
-		while( trackdivnum-- && trk) trk = trk->next;
-		if( trk == NULL ) {
-			fprintf(stderr, "--invalid track number\n");
-			return;
-		}
-		// perform function on track
-		switch( *p ) {
-			case 'm':
-				if( numb < 2 ) { 
-					fprintf(stderr, "--invalid mute command\n");
-					return;
-				}
-				if( *(p+1) == '0' ) trk->mute = false;
-				else trk->mute = true;
-				break;
-
-			case 's':
-				if( numb < 2 ) { 
-					fprintf(stderr, "--invalid solo command\n");
-					return;
-				}
-				if( *(p+1) == '0' ) trk->solo = false;
-				else trk->solo = true;
-				break;
-				
-			case 'v':
-				int volleft, volright, volmidi;
-				numb--; p++;
-
-				n = 0;
-				while( n < numb && isdigit( *p ) ) digits[n++] = *p++;
-				if( n == numb ) {
-					fprintf(stderr, "--invalid command, too short\n" );
-					return;
-				}
-				digits[n] = '\0';
-				volleft = atoi(digits);
-				numb = numb - n;
-
-				if( numb > 0 ) {
-					numb--; p++; 
-				}
-				else {
-					fprintf(stderr, "--invalid command, too short\n" );
-					return;
-				}
-					
-				n = 0;
-				while( n < numb && isdigit( *p ) ) digits[n++] = *p++;
-				if( n == numb ) {
-					fprintf(stderr, "--invalid command, too short\n" );
-					return;
-				}
-				digits[n] = '\0';
-				volright = atoi(digits);
-				numb = numb - n;
-
-				if( numb > 0 ) {
-					numb--; p++; 
-				}
-				else {
-					fprintf(stderr, "--invalid command, too short\n" );
-					return;
-				}
-					
-				n = 0;
-				while( n < numb && isdigit( *p ) ) digits[n++] = *p++;
-				digits[n] = '\0';
-				volmidi = atoi(digits);
-				numb = numb - n;
-
-				trk->volume_left = (float)volleft / 100.0f;
-				trk->volume_right = (float)volright / 100.0f;
-				trk->volume_midi = (float)volmidi / 100.0f;
-				fprintf(stderr, "--volume: %d %d %d | %f %f %f\n", 
-					volleft, volright, volmidi,  trk->volume_left, trk->volume_right, trk->volume_midi );
-				break;
-				
-			case 'b':
-				int bank, program;
-				numb--; p++;
-
-				n = 0;
-				while( n < numb && isdigit( *p ) ) digits[n++] = *p++;
-				if( n == numb ) {
-					fprintf(stderr, "--invalid command, too short\n" );
-					return;
-				}
-				digits[n] = '\0';
-				bank = atoi(digits);
-				numb = numb - n;
-
-				if( numb > 0 ) {
-					numb--; p++; 
-				}
-				else {
-					fprintf(stderr, "--invalid command, too short\n" );
-					return;
-				}
-					
-				n = 0;
-				while( n < numb && isdigit( *p ) ) digits[n++] = *p++;
-				digits[n] = '\0';
-				program = atoi(digits);
-				numb = numb - n;
-
-				trk->bank = bank;
-				trk->program = program;
-				fprintf(stderr, "--bank/program %d / %d\n", bank, program );
-				break;
-				
-			case 'n':
-				numb--; p++;
-				char namebuf[NAMEBUFLEN];
-				n = 0;
-				while( n < numb && n < NAMEBUFLEN-1 )
-					namebuf[n++] = *p++;
-				namebuf[n] = '\0';
-
-				fprintf(stderr, "--name: %s\n", namebuf );
-				strncpy(trk->name, namebuf, TRACK_NAME_MAX );
-				break;
-				
-			case 'p':
-				numb--; p++;
-				if( *p == '-' && *(p+1) == '1') {
-					trk->part = -1;
-					fprintf(stderr, "--part: %d\n", trk->part );
-					break;
-				}
-				n = 0;
-				while( n < numb && isdigit( *p ) ) digits[n++] = *p++;
-				digits[n] = '\0';
-				trk->part = atoi(digits);
-				fprintf(stderr, "--part: %d\n", trk->part );
-				break;
-				
-			case 'c':
-				numb--; p++;
-				n = 0;
-				while( n < numb && isdigit( *p ) ) digits[n++] = *p++;
-				digits[n] = '\0';
-				trk->channel = atoi(digits);
-				fprintf(stderr, "--channel: %d\n", trk->channel );
-				break;
-				
-			case 'd':
-				// flag track for deletion
-				trk->remove = true;
-				break;
-
-			case 'r':
-				trk->resample();
-				break;
-
-			case 'R':
-				trk->reverse();
-				break;
-
-			case 'u':
-				// upload track to server if this hasn't already occurred
-				if( track_hosting && trk->unique_ident == 0 ) {
-					pthread_t thread_id;	// this is quite wrong being here
-					pthread_create( &thread_id, NULL, service_upload_thread, trk );
-				}
-				break;
-
-			case 'S':
-				// start track - for long tracks, flag track for play
-				if( trk->longtrack && trk->playback == NULL ) {
-					if( !state.playing && state.framecount == 0 && state.current_section == 0 )
-						trk->playback = trk->head;
-					else
-						trk->start = true;
-				}
-				break;
-		}
-	}
-}
-
 void tempo(int n) {
 	
+	// stretched tracks are checked against the new length
+	tracks_changed = true;
 	if( !state.coupled ) {
 		sections[state.current_section].tempo(n);
 		return;
@@ -483,19 +340,21 @@ void tempo(int n) {
 		sections[i].tempo(n);
 }
 
-void settempo(char *s) {
+void settempo(int percent) {
 	
+	tracks_changed = true;
 	if( !state.coupled ) {
-		sections[state.current_section].settempo(s);
+		sections[state.current_section].settempo(percent);
 		return;
 	}
 	
 	for(int i = 0; i < state.sections; i++)
-		sections[i].settempo(s);
+		sections[i].settempo(percent);
 }
 
 void adj_divisions(int n) {
 	
+	tracks_changed = true;
 	if( !state.coupled ) {
 		sections[state.current_section].adj_divisions(n, state.bpm_mode);
 		return;
@@ -507,6 +366,7 @@ void adj_divisions(int n) {
 
 void adj_beats(int n) {
 	
+	tracks_changed = true;
 	if( !state.coupled ) {
 		sections[state.current_section].adj_beats(n);
 		return;
@@ -516,179 +376,321 @@ void adj_beats(int n) {
 		sections[i].adj_beats(n);
 }
 
+int track_command( struct control_command *c ) {
+
+	// commands for a track, the first argument is the track number
+	Track *trk = TrackHead;
+	int trackdivnum = c->arg[0];
+	
+	if( trackdivnum < 0 ) trk = NULL;
+	while( trackdivnum-- > 0 && trk ) trk = trk->next;
+	if( trk == NULL ) {
+		fprintf(stderr, "--invalid track number %d\n", c->arg[0]);
+		return CONTROL_BAD_TARGET;
+	}
+
+	// perform function on track
+	switch( c->code ) {
+		case CTL_TRACK_MUTE:
+			trk->mute = c->arg[1] != 0;
+			break;
+
+		case CTL_TRACK_SOLO:
+			trk->solo = c->arg[1] != 0;
+			tracks_changed = true;
+			break;
+			
+		case CTL_TRACK_VOLUME:
+			trk->volume_left = (float)c->arg[1] / 100.0f;
+			trk->volume_right = (float)c->arg[2] / 100.0f;
+			trk->volume_midi = (float)c->arg[3] / 100.0f;
+			fprintf(stderr, "--volume: %d %d %d | %f %f %f\n", 
+				c->arg[1], c->arg[2], c->arg[3], trk->volume_left, trk->volume_right, trk->volume_midi );
+			break;
+			
+		case CTL_TRACK_PROGRAM:
+			trk->bank = c->arg[1];
+			trk->program = c->arg[2];
+			fprintf(stderr, "--bank/program %d / %d\n", trk->bank, trk->program );
+			break;
+			
+		case CTL_TRACK_NAME:
+			fprintf(stderr, "--name: %s\n", c->text );
+			strncpy(trk->name, c->text, TRACK_NAME_MAX );
+			trk->name[TRACK_NAME_MAX] = '\0';
+			break;
+			
+		case CTL_TRACK_PART:
+			if( c->arg[1] < -1 || c->arg[1] >= MAX_SECTIONS ) return CONTROL_BAD_VALUE;
+			trk->part = c->arg[1];
+			tracks_changed = true;
+			fprintf(stderr, "--part: %d\n", trk->part );
+			break;
+			
+		case CTL_TRACK_CHANNEL:
+			trk->channel = c->arg[1];
+			fprintf(stderr, "--channel: %d\n", trk->channel );
+			break;
+			
+		case CTL_TRACK_DELETE:
+			// flag track for deletion
+			trk->remove = true;
+			tracks_changed = true;
+			break;
+
+		case CTL_TRACK_RESAMPLE:
+			trk->resample();
+			break;
+
+		case CTL_TRACK_REVERSE:
+			trk->reverse();
+			break;
+
+		case CTL_TRACK_EFFECT: {
+			// the effect's parameters come as text, there are more than the arguments hold
+			float p[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			sscanf( c->text, "%f %f %f %f", &p[0], &p[1], &p[2], &p[3] );
+			if( effects.post( trk->effects, c->arg[1], c->arg[2], p ) ) return CONTROL_BAD_VALUE;
+			break;
+		}
+
+		case CTL_TRACK_BUS:
+			// the bus's ports are opened here, process picks the track up once they are
+			if( c->arg[1] < 0 || c->arg[1] >= MAX_BUSES || ( c->arg[1] && add_bus( c->arg[1] ) ) ) return CONTROL_BAD_VALUE;
+			trk->bus = c->arg[1];
+			tracks_changed = true;
+			fprintf(stderr, "--bus: %d\n", trk->bus );
+			break;
+
+		case CTL_TRACK_STRETCH:
+			// process hands the track to the stretcher when its length no longer fits
+			if( trk->longtrack ) return CONTROL_BAD_TARGET;
+			trk->stretch = c->arg[1] != 0;
+			tracks_changed = true;
+			fprintf(stderr, "--stretch: %d\n", trk->stretch );
+			break;
+
+		case CTL_TRACK_UPLOAD:
+			// upload track to server if this hasn't already occurred,
+			// a reversed track goes up the way it sounds
+			if( track_hosting && trk->unique_ident == 0 && trk->reversed ) 
+				trk->materialize( true );
+			else if( track_hosting && trk->unique_ident == 0 ) {
+				pthread_t thread_id;	// this is quite wrong being here
+				pthread_create( &thread_id, NULL, service_upload_thread, trk );
+			}
+			break;
+
+		case CTL_TRACK_START:
+			// start track - for long tracks, flag track for play
+			if( trk->longtrack && trk->playback == NULL ) {
+				if( !state.playing && state.framecount == 0 && state.current_section == 0 )
+					trk->rewind();
+				else
+					trk->start = true;
+			}
+			break;
+	}
+	return CONTROL_OK;
+}
+
+void set_port( struct sockaddr_storage *addr, int port ) {
+
+	if( addr->ss_family == AF_INET6 )
+		((struct sockaddr_in6 *)addr)->sin6_port = htons( port );
+	else
+		((struct sockaddr_in *)addr)->sin_port = htons( port );
+}
+
+int execute_command( struct control_command *c, struct sockaddr_storage *from, socklen_t fromlen ) {
+
+	struct sockaddr_storage subscriber;
+	unsigned char message[2];
+
+	switch( c->code ) {
+		case CTL_QUIT: running = false; break;
+		case CTL_FLUSH: flush_sequencer(true); break;
+		case CTL_LOAD: load_sequencer(true); break;
+		case CTL_CLEAR: jack_clear_tracks(); break;
+		case CTL_REWIND: 
+			if( track_hosting && state.framecount == 0 && state.current_section == 0 ) 
+				download_state_request = true;
+			jack_rewind();			
+			break;
+		case CTL_BACK: state.back(); break;
+		case CTL_FORWARD: state.forward(); break;
+		case CTL_STOP: state.playing = false;
+			jack_startstop(0);
+			break;
+		case CTL_PLAY: state.playing = true; 
+			jack_startstop(1);
+			break;
+		case CTL_RECORD: state.record( armed() ); break;
+		case CTL_CONFIG:
+			config.cinternal = c->arg[0] != 0;
+			config.autoupload = c->arg[1] != 0;
+			config.longtracks = c->arg[2] != 0;
+			break;
+		case CTL_LONG_RECORD:
+			if( !c->arg[0] ) 							
+				record_mode = state.stagerecord = false;
+			else if( armed() ) {
+				record_mode = true;
+				state.long_record(config.longtracks);
+			}							
+			break;
+		case CTL_REC_LEFT: state.rec_left = c->arg[0] != 0; break;
+		case CTL_REC_RIGHT: state.rec_right = c->arg[0] != 0; break;
+		case CTL_REC_MIDI: state.rec_midi = c->arg[0] != 0; break;
+		case CTL_REC_INPUT:
+			// input 0 is the main pair and goes by the left and right flags
+			if( c->arg[0] >= inputs ) return CONTROL_BAD_VALUE;
+			if( c->arg[0] == 0 ) 
+				state.rec_left = state.rec_right = c->arg[1] != 0;
+			else if( c->arg[1] ) 
+				rec_inputs |= 1 << c->arg[0];
+			else
+				rec_inputs &= ~(1 << c->arg[0]);
+			break;
+		case CTL_CLICK: state.use_click = c->arg[0] != 0; break;
+		case CTL_COUPLE: state.coupled = c->arg[0] != 0; break;
+		case CTL_BPM_MODE: state.bpm_mode = c->arg[0] != 0; break;
+		case CTL_SECTIONS: state.adj_sections(c->arg[0] ? 1 : 0); break;
+		case CTL_TEMPO_STEP: tempo(c->arg[0] ? 1 : 0); break;
+		case CTL_TEMPO_SET:
+			if( c->arg[0] < 0 || c->arg[0] > 100 ) return CONTROL_BAD_VALUE;
+			settempo(c->arg[0]);
+			break;
+		case CTL_DIVISIONS: adj_divisions(c->arg[0] ? 1 : 0); break;
+		case CTL_BEATS: adj_beats(c->arg[0] ? 1 : 0); break;
+		case CTL_PROGRAM:
+			state.bank = c->arg[0];
+			state.program = c->arg[1];
+			fprintf(stderr, "--global bank/program %d / %d\n", state.bank, state.program );
+	
+			// flag our program change so that next midi track wil get a new channel
+			program_change = true;
+
+			// schedule a program message on channel 1
+			message[0] = 0xc0;
+			message[1] = state.program;
+			jack_send_midi( 2, message );
+			jack_write_midi();
+			break;
+			
+		case CTL_VOLUME:
+			switch( c->arg[0] ) {
+				case 'l':	state.volume_left = (float)c->arg[1] / 100.00;
+					break;
+				case 'r':	state.volume_right = (float)c->arg[1] / 100.00;
+					break;
+				case 'm':	state.volume_midi = (float)c->arg[1] / 100.00;
+					break;
+				default:
+					return CONTROL_BAD_VALUE;
+			}
+			fprintf(stderr, "volume %c = %d\n", c->arg[0], c->arg[1] );
+			break;
+			
+		case CTL_NAME:
+			fprintf(stderr, "--name: %s\n", c->text );
+			strncpy( trackname, c->text, TRACK_NAME_MAX );
+			trackname[TRACK_NAME_MAX] = '\0';
+			break;
+			
+		case CTL_SECTION_NEXT_PART:
+			// section increase command, check range
+			if( c->arg[0] < 0 || c->arg[0] >= state.sections ) {
+				fprintf(stderr, "--invalid section number\n");
+				return CONTROL_BAD_TARGET;
+			}
+			sections[c->arg[0]].part++;
+			if( sections[c->arg[0]].part > state.sections )
+					sections[c->arg[0]].part = 0;
+			fprintf(stderr, "section: part now %d\n", sections[c->arg[0]].part);
+			break;
+		
+		case CTL_SECTION_PART:
+			// section set command, check range
+			if( c->arg[0] < 0 || c->arg[0] >= state.sections ) {
+				fprintf(stderr, "--invalid section number\n");
+				return CONTROL_BAD_TARGET;
+			}
+			if( c->arg[1] < 0 || c->arg[1] >= MAX_SECTIONS ) return CONTROL_BAD_VALUE;
+			sections[c->arg[0]].part = c->arg[1];
+			fprintf(stderr, "section: part now %d\n", sections[c->arg[0]].part);
+			break;
+
+		case CTL_MASTER_EFFECT: {
+			float p[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			sscanf( c->text, "%f %f %f %f", &p[0], &p[1], &p[2], &p[3] );
+			if( effects.post( &master_effects, c->arg[0], c->arg[1], p ) ) return CONTROL_BAD_VALUE;
+			break;
+		}
+
+		case CTL_REVERB: {
+			float p[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			sscanf( c->text, "%f %f %f", &p[0], &p[1], &p[2] );
+			if( effects.post( NULL, 0, EFFECT_REVERB, p ) ) return CONTROL_BAD_VALUE;
+			break;
+		}
+
+		case CTL_SUBSCRIBE:
+			// the subscriber listens on the port given at the address the command came from
+			subscriber = *from;
+			set_port( &subscriber, c->arg[0] );
+			if( publisher.subscribe( &subscriber, fromlen, c->arg[1], c->arg[2], false ) )
+				return CONTROL_BAD_VALUE;
+			break;
+
+		case CTL_UNSUBSCRIBE:
+			subscriber = *from;
+			set_port( &subscriber, c->arg[0] );
+			publisher.unsubscribe( &subscriber, fromlen );
+			break;
+
+		case CTL_NONE:
+			return CONTROL_BAD_COMMAND;
+
+		default:
+			return track_command( c );
+	}
+	return CONTROL_OK;
+}
+
 void do_commands() {
 
-	int numbytes, n;
-	char *p, buffer[256], digits[128];
+	static unsigned char buffer[CONTROL_DATAGRAM], ack[CONTROL_HEADER+CONTROL_MAX_BATCH];
+	static unsigned char status[CONTROL_MAX_BATCH];
+	static struct control_command commands[CONTROL_MAX_BATCH];
+	struct control_header header;
+	struct sockaddr_storage from;
+	socklen_t fromlen;
+	int numbytes, count;
+	bool fresh;
 	
 	while( running ) {
-		numbytes = network.listen(buffer,128);
+		numbytes = network.listen(buffer, CONTROL_DATAGRAM, &from, &fromlen);
 		if( numbytes < 0 ) continue;
-		buffer[numbytes] = '\0';
-		fprintf(stderr, "command(%d): %s\n", numbytes, buffer);
-		// assume at least one byte arrived
-		switch( buffer[0] ) {
-			case 'q': running = false; break;
-			case 'f': flush_sequencer(true); break;
-			case 'L': load_sequencer(true); break;
-			case 'x': jack_clear_tracks(); break;
-			case 'w': 
-				if( track_hosting && state.framecount == 0 && state.current_section == 0 ) 
-					download_state_request = true;
-				jack_rewind();			
-				break;
-			case '<': state.back(); break;
-			case '>': state.forward(); break;
-			case '.': state.playing = false;
-				jack_startstop(0);
-				break;
-			case ',': state.playing = true; 
-				jack_startstop(1);
-				break;
-			case 'r': state.record(); break;
-			// these need at least two bytes
-			case '=': if(buffer[1] == '1') config.cinternal = true;
-					  else config.cinternal = false;
-					  if(buffer[2] == '1') config.autoupload = true;
-					  else config.autoupload = false;
-					  if(buffer[3] == '1') config.longtracks = true;
-					  else config.longtracks = false;
-				break;
-			case 'R': if( numbytes > 1 ) {
-						if( buffer[1] == '0' ) 							
-							record_mode = state.stagerecord = false;
-						else if( buffer[1] == '1' && 
-								(state.rec_left || state.rec_right || state.rec_midi)) {
-							record_mode = true;
-							state.long_record(config.longtracks);
-						}							
-					} break;
-			case 'l': if( numbytes > 1 ) {
-						if( buffer[1] == '0' ) state.rec_left = false; 
-						else if( buffer[1] == '1' ) state.rec_left = true;
-					} break;
-			case 'a': if( numbytes > 1 ) {
-						if( buffer[1] == '0' ) state.rec_right = false; 
-						else if( buffer[1] == '1' ) state.rec_right = true;
-					} break;
-			case 'm': if( numbytes > 1 ) {
-						if( buffer[1] == '0' ) state.rec_midi = false; 
-						else if( buffer[1] == '1' ) state.rec_midi = true;
-					} break;
-			case 'c': if( numbytes > 1 ) {
-						if( buffer[1] == '0' ) state.use_click = false; 
-						else if( buffer[1] == '1' ) state.use_click = true;
-					} break;
-			case 'C': if( numbytes > 1 ) {
-						if( buffer[1] == '0' ) state.coupled = false; 
-						else if( buffer[1] == '1' ) state.coupled = true;
-					} break;
-			case 'M': if( numbytes > 1 ) {
-						if( buffer[1] == '0' ) state.bpm_mode = false; 
-						else if( buffer[1] == '1' ) state.bpm_mode = true;
-					} break;
-			case 'e': if( numbytes > 1 && buffer[1] == '+' ) state.adj_sections(1); 
-					  else state.adj_sections(0); break;
-			case 't': if( numbytes > 1 ) {
-						if( buffer[1] == '+' )		tempo(1); 
-						else if( buffer[1] == '-' ) tempo(0);
-						else if( numbytes > 3 ) 	settempo(&buffer[1]);
-					} break;
-			case 'd': if( numbytes > 1 && buffer[1] == '+' ) adj_divisions(1); 
-					  else adj_divisions(0);
-					  break;
-			case 'b': if( numbytes > 1 && buffer[1] == '+' ) adj_beats(1);
-					  else adj_beats(0); 
-					  break;
-			case 'g':
-				numbytes--; p = &buffer[1];
-				n = 0;
-				while( n < numbytes && isdigit( *p ) ) digits[n++] = *p++;
-				if( n == numbytes ) {
-					fprintf(stderr, "--invalid command, too short\n" );
-					return;
-				}
-				digits[n] = '\0';
-				state.bank = atoi(digits);
-				numbytes = numbytes - n;
 
-				if( numbytes > 0 ) {
-					numbytes--; p++; 
-				}
-				else {
-					fprintf(stderr, "--invalid command, too short\n" );
-					return;
-				}
-					
-				n = 0;
-				while( n < numbytes && isdigit( *p ) ) digits[n++] = *p++;
-				digits[n] = '\0';
-				state.program = atoi(digits);
-				numbytes = numbytes - n;
-
-				fprintf(stderr, "--global bank/program %d / %d\n", state.bank, state.program );
-					unsigned char message[2];
-	
-				// flag our program change so that next midi track wil get a new channel
-				program_change = true;
-
-				// schedule a program message on channel 1
-				message[0] = 0xc0;
-				message[1] = state.program;
-				jack_send_midi( 2, message );
-				jack_write_midi();
-				break;
-				
-			case 'v':
-				int volume;
-				numbytes--;
-				if( numbytes < 2 ) {
-					fprintf(stderr, "--invalid command, too short\n" );
-					return;
-				}
-				numbytes--;
-				p = &buffer[2];
-				n = 0;
-				while( n < numbytes && (*p == ' ' || isdigit( *p )) ) digits[n++] = *p++;
-				digits[n] = '\0';
-				volume = atoi(digits);
-				switch( buffer[1] ) {
-					case 'l':	state.volume_left = (float)volume / 100.00;
-						break;
-					case 'r':	state.volume_right = (float)volume / 100.00;
-						break;
-					case 'm':	state.volume_midi = (float)volume / 100.00;
-						break;
-				}
-				fprintf(stderr, "volume %c = %d\n", buffer[1], volume );
-				break;
-				
-			case 'n':
-				numbytes--;
-				if( numbytes < 1 ) {
-					fprintf(stderr, "--invalid command, too short\n" );
-					return;
-				}
-				char namebuf[NAMEBUFLEN];
-				n = 0;
-				while( n < numbytes && n < NAMEBUFLEN-1 ) {
-					namebuf[n] = buffer[n+1];
-					n++;
-				}
-				namebuf[n] = '\0';
-
-				fprintf(stderr, "--name: %s\n", namebuf );
-				strncpy( trackname, namebuf, TRACK_NAME_MAX );
-				break;
-				
-			default:
-				// look for a digit, if so assume this is a track or section command
-				if( isdigit(buffer[0]) ) extend_command( numbytes, buffer );
-				else
-					// don't know what this is
-					fprintf(stderr, "unknown command %s\n", buffer);
-				break;
+		count = control.decode(buffer, numbytes, &header, commands);
+		if( count < 0 ) {
+			fprintf(stderr, "--invalid control datagram, %d bytes\n", numbytes);
+			continue;
+		}
+
+		// a resent datagram is acknowledged again but not executed again
+		fresh = control.fresh(&header);
+		for( int i = 0; i < count; i++ ) {
+			if( !fresh ) status[i] = CONTROL_DUPLICATE;
+			else {
+				fprintf(stderr, "command: %s\n", control_name(commands[i].code));
+				status[i] = execute_command( &commands[i], &from, fromlen );
+			}
 		}
+
+		numbytes = control.acknowledge(&header, status, ack);
+		network.reply(ack, numbytes, &from, fromlen);
 	}
 }
 
@@ -702,16 +704,42 @@ void do_commands() {
 
 // jack related ports and jack client, sample rate
 
-jack_port_t *input_port_left, *input_port_right, *input_port_midi;
+// the stereo inputs, 0 is the main pair that also has the midi in
+jack_port_t *input_port_left[MAX_INPUTS], *input_port_right[MAX_INPUTS], *input_port_midi;
 jack_port_t *output_port_left, *output_port_right, *output_port_midi;
+
+// the stems, bus 0 is the main outputs above
+jack_port_t * volatile bus_port_left[MAX_BUSES], * volatile bus_port_right[MAX_BUSES];
 jack_client_t *client;
 jack_nframes_t sample_rate;
 
-// during recording we create collections of frames
-// and string them together in a link list
+// during recording each armed input gets a take, collections of frames
+// strung together in a link list. Each holds NFRAMES whatever the period
+// size, rec_frames counts what has been recorded and collcount the
+// collections, the same for every take
+
+struct take {
+	jack_default_audio_sample_t *in_left, *in_right;	// this period's input
+	bool left, right, midi;		// what is recorded, fixed when the take starts
+	FrameCollection *head, *tail;
+	float preroll_left[XFADE_MAX], preroll_right[XFADE_MAX];
+	float take_left[XFADE_MAX], take_right[XFADE_MAX];
+} takes[MAX_INPUTS];
 
 int collcount = 0;
-FrameCollection	*RecHead = NULL, *RecTail = NULL;
+unsigned int rec_frames = 0;
+
+// what is played reaches the input rec_latency frames later, so recording
+// starts and stops that long after the wrap. rec_wrap_due counts down to it
+volatile jack_nframes_t rec_latency = 0;
+jack_nframes_t rec_wrap_due = 0;
+int rec_wrap_part, rec_wrap_section;
+
+// the input just before a take starts is crossfaded into its end, so the
+// loop seam joins up the way it was played. The pre-roll goes round in
+// each take above
+jack_nframes_t xfade_frames = 0;
+unsigned int preroll_pos = 0;
 
 // various functions requested from control
 // must be done in process() function
@@ -743,6 +771,110 @@ struct midi_event {
 int midi_buffer_len = 0;
 bool midi_buffer_flush = false;
 
+/**************************************************************
+ * song_position()
+ *
+ * Frames from the start of the first section, a framecount running
+ * past the end of its section carries on into the next one
+ */
+
+long song_position(int section, unsigned int framecount)
+{
+	long position = framecount;
+	for( int i = 0; i < section && i < state.sections; i++ )
+		position += sections[i].maxframes;
+	return position;
+}
+
+/**************************************************************
+ * seek_tracks()
+ *
+ * Move the playback cursors of the loop tracks to framecount
+ */
+
+void seek_tracks(unsigned int framecount)
+{
+	Track *track = TrackHead;
+	while( track ) {
+		if( !track->longtrack && track->head ) 
+			track->seek( framecount );
+		track = track->next;
+	}
+}
+
+/**************************************************************
+ * check_stretch()
+ *
+ * Hand any stretched track whose length no longer fits its section to
+ * the stretcher, and any track no longer stretched back to its original.
+ * Called from index_tracks(), so only after something has changed
+ */
+
+void check_stretch()
+{
+	for( Track *track = TrackHead; track; track = track->next ) {
+		if( track->busy || track->longtrack || !track->head ) continue;
+		if( track->stretch ? 
+				track->length != (unsigned)track->section_frames() : 
+				track->orig_head != NULL ) {
+			track->busy = true;
+			if( !stretcher.post( track ) ) {
+				// the queue is full, look again next period
+				track->busy = false;
+				tracks_changed = true;
+			}
+		}
+	}
+}
+
+/**************************************************************
+ * follow_master()
+ *
+ * As a sync follower, compare our position with the master's at the
+ * start of this cycle. Returns the frames the tracks slip this cycle to 
+ * slew onto it, or moves us outright when we are too far away to slew
+ */
+
+bool start_requested = false;
+
+int follow_master(jack_time_t now, jack_nframes_t nframes)
+{
+	unsigned int framecount;
+	int section;
+	bool playing;
+
+	if( !transport_sync.target( now, &framecount, &section, &playing ) ) return 0;
+
+	if( playing != state.playing ) {
+		// start or stop with the master, the position is caught up once rolling
+		if( !start_requested ) jack_startstop( playing );
+		start_requested = true;
+		return 0;
+	}
+	start_requested = false;
+	if( !playing || section >= state.sections ) return 0;
+
+	long length = song_position( state.sections, 0 );
+	if( length <= 0 ) return 0;
+	long target = song_position( section, framecount ) % length;
+	long error = ( target - song_position( state.current_section, state.framecount ) ) % length;
+	if( error > length / 2 ) error -= length;
+	if( error < -length / 2 ) error += length;
+
+	if( error > SYNC_JUMP || error < -SYNC_JUMP ) {
+		section = 0;
+		while( target >= (long)sections[section].maxframes ) 
+			target -= sections[section++].maxframes;
+		state.current_section = section;
+		state.framecount = target;
+		seek_tracks( target );
+		midi_clock.locate();
+		transport_sync.reset();
+		return 0;
+	}
+	return transport_sync.slew( error );
+}
+
 /**************************************************************
  * find_peak_midi() 
  */
@@ -784,73 +916,812 @@ int find_peak_audio(jack_default_audio_sample_t *in, jack_nframes_t nframes)
 } 
 
 
-/**************************************************************
- * save_recording()
- * 
- * After creating a list of FrameCollections during the
- * recording process, call this procedure when the sequencer
- * returns to frame zero after the sample period is over, to
- * save off the list into a proper Track.
- */
+/**************************************************************
+ * armed()
+ * 
+ * Whether anything is set to record, on any input
+ */
+
+bool armed()
+{
+	return state.rec_left || state.rec_right || state.rec_midi || rec_inputs;
+}
+
+/**************************************************************
+ * preroll_frames(), start_takes()
+ * 
+ * Keep the last XFADE_MAX frames of each armed input going round, and
+ * when a take starts fix what it records and take a copy of them in order
+ */
+
+void preroll_frames(jack_nframes_t at, jack_nframes_t count)
+{
+	jack_nframes_t n;
+	int i;
+
+	if( count > XFADE_MAX ) {
+		at += count - XFADE_MAX;
+		count = XFADE_MAX;
+	}
+	while( count ) {
+		n = XFADE_MAX - preroll_pos;
+		if( n > count ) n = count;
+		for( i = 0; i < inputs; i++ ) {
+			if( i ? !(rec_inputs & 1 << i) : !(state.rec_left || state.rec_right) ) continue;
+			memcpy( takes[i].preroll_left + preroll_pos, takes[i].in_left + at, n * sizeof(float) );
+			memcpy( takes[i].preroll_right + preroll_pos, takes[i].in_right + at, n * sizeof(float) );
+		}
+		preroll_pos = (preroll_pos + n) % XFADE_MAX;
+		at += n;
+		count -= n;
+	}
+}
+
+void start_takes()
+{
+	unsigned int n = XFADE_MAX - preroll_pos;
+	struct take *t;
+
+	for( int i = 0; i < inputs; i++ ) {
+		t = &takes[i];
+		if( i == 0 ) {
+			t->left = state.rec_left;
+			t->right = state.rec_right;
+			t->midi = state.rec_midi;
+		} else {
+			t->left = t->right = (rec_inputs & 1 << i) != 0;
+			t->midi = false;
+		}
+		if( !t->left && !t->right ) continue;
+
+		memcpy( t->take_left, t->preroll_left + preroll_pos, n * sizeof(float) );
+		memcpy( t->take_left + n, t->preroll_left, preroll_pos * sizeof(float) );
+		memcpy( t->take_right, t->preroll_right + preroll_pos, n * sizeof(float) );
+		memcpy( t->take_right + n, t->preroll_right, preroll_pos * sizeof(float) );
+	}
+}
+
+/**************************************************************
+ * seam_recording()
+ * 
+ * Crossfade the end of a take into the input from just before it 
+ * started, the last frame of the loop then leads into the first the way
+ * it did when it was played. A long take doesn't loop, it fades in and
+ * out where it was punched in and out.
+ */
+
+void seam_recording( struct take *tk, bool longtrack )
+{
+	unsigned int i, frames = xfade_frames, start, at;
+	float t, out, in, *left, *right;
+	FrameCollection *fc;
+
+	if( frames > rec_frames / 2 ) frames = rec_frames / 2;
+	if( frames == 0 || !tk->head ) return;
+
+	if( longtrack ) {
+		for( fc = tk->head, i = 0; i < frames; i++ ) {
+			if( i && i % NFRAMES == 0 ) {
+				fc->squeeze();
+				fc = fc->get_next();
+			}
+			if( i % NFRAMES == 0 ) fc->expand();
+			t = (float)(i + 1) / (frames + 1);
+			if( (left = fc->get_frames_left()) ) left[i % NFRAMES] *= t;
+			if( (right = fc->get_frames_right()) ) right[i % NFRAMES] *= t;
+		}
+		fc->squeeze();
+	}
+
+	// find the collection holding the start of the fade, the take is whole collections
+	at = rec_frames - frames;
+	start = (collcount - 1) * NFRAMES;
+	for( fc = tk->tail; start > at; start -= NFRAMES ) 
+		fc = fc->get_prev();
+	fc->expand();
+
+	for( i = 0; i < frames; i++, at++ ) {
+		if( at - start == NFRAMES ) {
+			fc->squeeze();
+			fc = fc->get_next();
+			fc->expand();
+			start += NFRAMES;
+		}
+		t = (float)(i + 1) / (frames + 1);
+		if( longtrack ) {
+			out = 1.0f - t;
+			in = 0.0f;
+		} else {
+			// the two sides aren't correlated, keep the power constant
+			out = cosf( t * (float)M_PI / 2 );
+			in = sinf( t * (float)M_PI / 2 );
+		}
+		// the preroll ends at the frame before the take
+		if( (left = fc->get_frames_left()) ) 
+			left[at - start] = left[at - start] * out + tk->take_left[XFADE_MAX - frames + i] * in;
+		if( (right = fc->get_frames_right()) ) 
+			right[at - start] = right[at - start] * out + tk->take_right[XFADE_MAX - frames + i] * in;
+	}
+	// packed again, or let go if the fade left it silent
+	fc->squeeze();
+}
+
+/**************************************************************
+ * save_recording()
+ * 
+ * After creating a list of FrameCollections during the
+ * recording process, call this procedure when the sequencer
+ * returns to frame zero after the sample period is over, to
+ * save off the list into a proper Track. Each take makes a track
+ * of its own, put at frame at of the section
+ */
+
+void save_recording( bool longtrack, int part, jack_nframes_t at )
+{ 
+	//
+	// create a new track for part out of each take's collection list and 
+	// add it to the link list of tracks
+	//
+	Track *track;
+	struct take *tk;
+
+	for( int i = 0; i < inputs; i++ ) {
+		tk = &takes[i];
+		if( !collcount || !tk->tail ) continue;
+
+		seam_recording( tk, longtrack );
+
+		logger.put( LOG_INFO, "new track in part %d from input %d\n", part, i );
+		track = new Track( part, new_track_num++ );
+		track->head = tk->head;
+		track->tail = tk->tail;
+		track->collcount = track->loadcount = collcount;
+		track->length = rec_frames;
+		track->longtrack = longtrack;
+		track->use_left = tk->left;
+		track->use_right = tk->right;
+		track->use_midi = tk->midi;
+		// the section is already under way, catch the track up with it
+		if( at ) track->seek( at );
+		
+		// lock before append track to list
+		if( track_hosting ) pthread_mutex_lock( &append_track_mut );
+		if( TrackTail == NULL ) {
+			TrackTail = TrackHead = track;
+			track->next = track->prev = NULL;
+		}
+		else {
+			track->prev = TrackTail;
+			track->next = NULL;
+			TrackTail->next = track;
+			TrackTail = track;
+		}
+		state.trackcount++;
+		tracks_changed = true;
+		if( track_hosting ) pthread_mutex_unlock( &append_track_mut );
+
+		//
+		// watch for a program change that should occur when using midi
+		//
+		if( program_change && track->use_midi ) {
+			// last_channel found in control.h
+			last_channel++;
+			if( last_channel == 9 ) last_channel++;
+			track->channel = last_channel;
+			// must prep this channel for the correct program voice
+			track->send_channel_midi();
+			midi_buffer_flush = true;
+			program_change = false;
+		}
+		
+		// when using track hosting, maybe start a upload thread for this track
+		if( track_hosting && config.autoupload ) {
+			pthread_t thread_id;	// this is quite wrong being here
+			pthread_create( &thread_id, NULL, service_upload_thread, track );
+		}
+	}
+
+	//
+	// zero out the collection lists
+	//
+	for( int i = 0; i < inputs; i++ ) 
+		takes[i].head = takes[i].tail = NULL;
+	collcount = 0;
+	rec_frames = 0;
+}
+
+/**************************************************************
+ * record_frames()
+ * 
+ * Record count frames of this period's input, from frame at, onto
+ * the end of each take's collection list
+ */
+
+void record_frames(void *in_midi, jack_nframes_t at, jack_nframes_t count)
+{
+	jack_nframes_t n, fill, e, events = jack_midi_get_event_count( in_midi );
+	jack_midi_event_t event;
+	struct take *tk;
+	int i;
+
+	if( rec_frames == 0 ) 
+		start_takes();
+
+	while( count ) {
+		fill = rec_frames % NFRAMES;
+		if( fill == 0 ) {
+			// start new collections, silent where nothing gets recorded
+			for( i = 0; i < inputs; i++ ) {
+				tk = &takes[i];
+				if( !tk->left && !tk->right && !tk->midi ) continue;
+				FrameCollection *fc = new FrameCollection(NFRAMES, tk->left, tk->right);
+				fc->zero();
+				fc->append(&tk->head, &tk->tail);
+			}
+			collcount++;
+		}
+		n = NFRAMES - fill;
+		if( n > count ) n = count;
+
+		for( i = 0; i < inputs; i++ ) {
+			tk = &takes[i];
+			if( tk->left ) 
+				memcpy( tk->tail->get_frames_left() + fill, tk->in_left + at, n * sizeof(jack_default_audio_sample_t) );
+			if( tk->right ) 
+				memcpy( tk->tail->get_frames_right() + fill, tk->in_right + at, n * sizeof(jack_default_audio_sample_t) );
+			// a full collection that came in silent keeps no frames
+			if( fill + n == NFRAMES && (tk->left || tk->right) ) 
+				tk->tail->squeeze();
+		}
+
+		if( takes[0].midi ) 
+			for( e = 0; e < events; e++ ) {
+				jack_midi_event_get( &event, in_midi, e );
+				if( event.time < at || event.time >= at + n ) continue;
+				event.time = fill + event.time - at;
+				takes[0].tail->insert_midi_event( &event, 0, 1.0f );
+			}
+
+		rec_frames += n;
+		at += n;
+		count -= n;
+	}
+}
+
+/**************************************************************
+ * record_wrap()
+ * 
+ * The input has reached the end of the section, save what was recorded
+ * and start any recording staged for the next section
+ */
+
+void record_wrap()
+{
+	rec_wrap_due = 0;
+
+	if( state.recording ) {
+		//
+		// if recording, save the recorded frames into a new track
+		//
+		save_recording( false, rec_wrap_part, state.framecount );
+		// if not in record mode, stop recording now
+		if( !record_mode )
+			state.recording = false;
+	}
+
+	if( state.stagerecord ) {
+		//
+		// we were staged, now go to record mode if any channel is set to record
+		//
+		state.stagerecord = false;
+
+		if( armed() ) {
+			if( record_mode && config.longtracks && rec_wrap_section == 0 )
+				state.longrecording = true;
+			else
+				state.recording = true;
+			
+		}
+	}
+}
+
+/**************************************************************
+ * section_wrap()
+ * 
+ * The current section has played all its frames, wrap round to the
+ * start of the next one
+ */
+
+void section_wrap()
+{
+	//
+	// reached max frames, reset sequencer to beginning
+	//
+	state.framecount = 0;
+
+	// don't increment current_section yet because we need to save tracks with correct value
+	// but we need to know what the next section will be
+	int nextsection = state.current_section + 1;
+	if( nextsection >= state.sections )
+		nextsection = 0;
+
+	//
+	// recording turns over rec_latency frames from now, when the input has
+	// caught up with what was played
+	//
+	if( rec_wrap_due ) 
+		record_wrap();
+	rec_wrap_part = sections[state.current_section].part;
+	rec_wrap_section = nextsection;
+	if( rec_latency ) 
+		rec_wrap_due = rec_latency;
+	else 
+		record_wrap();
+
+	//
+	// reset playback pointers and send note of messages in all active tracks 
+	//
+	Track *track = TrackHead;
+	while( track ) {
+		if( track->swap_pending ) 
+			track->swap();
+		if( !track->longtrack || (nextsection == 0 && track->start) ) {
+			track->rewind();
+			if( track->use_midi )
+				track->send_notesoff_midi();
+			if( track->longtrack ) track->start = false;
+		}
+		track = track->next;
+	}
+	midi_buffer_flush = true;
+
+	// a track plays the length of its part's section, check them again
+	// when the next section is another length or part
+	if( sections[nextsection].maxframes != sections[state.current_section].maxframes ||
+			sections[nextsection].part != sections[state.current_section].part ) 
+		tracks_changed = true;
+
+	// increment section counter now
+	state.current_section++;
+	if( state.current_section >= state.sections )
+		state.current_section = 0;
+}
+
+/**************************************************************
+ * index_tracks(), part_tracks()
+ * 
+ * Which tracks play in each part, so a period only looks at the ones
+ * it can hear. Anything that adds, removes or solos a track, or moves it 
+ * to another part or bus sets tracks_changed and the index is made again
+ * before the next tracks are mixed. Removal and the stretch check are done
+ * then too, so a change of section length or stretch sets it as well and
+ * the whole list is only walked after a change
+ */
+
+
+// the tracks of each bus in the order they were added, and the tracks of
+// each part strung on part_next in bus order. Those playing in every part
+// have a list of their own, merged with a part's as it is walked, so the
+// index is kept in the tracks themselves and nothing is allocated for it
+Track *bus_head[MAX_BUSES];
+Track *part_head[MAX_SECTIONS], *every_head = NULL;
+int solo_count = 0;
+
+// where a walk of a part's tracks has got to in each list
+struct part_cursor {
+	Track *own, *every;
+};
+
+void index_tracks()
+{
+	Track *track, *next, *bus_tail[MAX_BUSES], *part_tail[MAX_SECTIONS], *every_tail = NULL;
+	int b, p, tracknum = 0;
+
+	tracks_changed = false;
+	__sync_synchronize();
+
+	for( b = 0; b < MAX_BUSES; b++ ) 
+		bus_head[b] = bus_tail[b] = NULL;
+	solo_count = 0;
+
+	for( track = TrackHead; track; track = next ) {
+		next = track->next;
+
+		if( track->remove ) {
+			if( !track->busy ) {
+				if( track->prev ) track->prev->next = next;
+				else TrackHead = next;
+				if( next ) next->prev = track->prev;
+				else TrackTail = track->prev;
+				effects.forget( track->effects );
+				delete track;
+				state.trackcount--;
+				logger.put( LOG_INFO, "track %d removed\n", tracknum );
+				continue;
+			}
+			// a resample thread has it, it plays on till the next look
+			tracks_changed = true;
+		}
+
+		if( track->solo ) solo_count++;
+
+		// a bus without ports yet plays through the main outputs
+		b = track->bus > 0 && track->bus < MAX_BUSES && bus_port_left[track->bus] ? track->bus : 0;
+		track->mix_bus = b;
+		track->bus_next = NULL;
+		if( bus_tail[b] ) bus_tail[b]->bus_next = track;
+		else bus_head[b] = track;
+		bus_tail[b] = track;
+
+		tracknum++;
+	}
+
+	// a track of a part no section can have plays nowhere
+	for( p = 0; p < MAX_SECTIONS; p++ ) 
+		part_head[p] = part_tail[p] = NULL;
+	every_head = NULL;
+	tracknum = 0;
+	for( b = 0; b < MAX_BUSES; b++ ) 
+	for( track = bus_head[b]; track; track = track->bus_next ) {
+		track->part_order = tracknum++;
+		track->part_next = NULL;
+		if( track->longtrack || track->part == -1 ) {
+			if( every_tail ) every_tail->part_next = track;
+			else every_head = track;
+			every_tail = track;
+		}
+		else if( track->part >= 0 && track->part < MAX_SECTIONS ) {
+			p = track->part;
+			if( part_tail[p] ) part_tail[p]->part_next = track;
+			else part_head[p] = track;
+			part_tail[p] = track;
+		}
+	}
+
+	check_stretch();
+}
+
+void part_tracks(int part, struct part_cursor *c)
+{
+	// a part out of range only hears the tracks playing in every part
+	c->own = part >= 0 && part < MAX_SECTIONS ? part_head[part] : NULL;
+	c->every = every_head;
+}
+
+Track *next_part_track(struct part_cursor *c)
+{
+	Track *track;
+
+	if( c->every && (c->own == NULL || c->every->part_order < c->own->part_order) ) {
+		track = c->every;
+		c->every = track->part_next;
+	}
+	else if( (track = c->own) ) 
+		c->own = track->part_next;
+	return track;
+}
+
+/**************************************************************
+ * sum_track(), mix_tracks()
+ * 
+ * The tracks of a period are shared out between the mixing threads, 
+ * the process thread's share being 0. Each share sums into buses of its
+ * own that are added up at the end, share 0's are the real ones and it
+ * has every midi track since only it may touch the midi in the sum. 
+ */
+
+struct mix_share {
+	Track *head, *tail;		// its tracks, strung on mix_next in bus order
+	long load;				// what they cost last time round
+	FrameCollection *bus[MAX_BUSES], *inserts, *sends, *slip;
+	bool summed[MAX_BUSES], sending;	// buffers summed into this period
+} shares[MIX_THREADS + 1];
+
+int nshares = 1;
+jack_nframes_t mixing_frames, share_frames = 0;
+pthread_mutex_t shares_mut = PTHREAD_MUTEX_INITIALIZER;
+
+//
+// the shares' buffers last from period to period, big enough for the
+// largest period. They are made before process runs, when the period 
+// grows and when a bus opens, never on the realtime threads. Share 0
+// sums the main outputs straight into the period's sum
+//
+static void share_buffer(FrameCollection **fc, jack_nframes_t nframes)
+{
+	delete *fc;
+	*fc = new FrameCollection(nframes, true, true);
+}
+
+void size_shares(jack_nframes_t nframes)
+{
+	pthread_mutex_lock( &shares_mut );
+	if( nframes > share_frames ) {
+		for( int s = 0; s < mixpool.size(); s++ ) {
+			for( int b = s ? 0 : 1; b < MAX_BUSES; b++ ) 
+				if( b == 0 || bus_port_left[b] ) share_buffer( &shares[s].bus[b], nframes );
+			share_buffer( &shares[s].inserts, nframes );
+			share_buffer( &shares[s].sends, nframes );
+			share_buffer( &shares[s].slip, nframes );
+		}
+		share_frames = nframes;
+	}
+	pthread_mutex_unlock( &shares_mut );
+}
+
+void free_shares()
+{
+	for( int s = 0; s <= MIX_THREADS; s++ ) {
+		for( int b = s ? 0 : 1; b < MAX_BUSES; b++ ) {
+			delete shares[s].bus[b];
+			shares[s].bus[b] = NULL;
+		}
+		delete shares[s].inserts;
+		delete shares[s].sends;
+		delete shares[s].slip;
+		shares[s].inserts = shares[s].sends = shares[s].slip = NULL;
+	}
+	share_frames = 0;
+}
+
+static void clear_buffer(FrameCollection *fc, jack_nframes_t nframes)
+{
+	memset( fc->get_frames_left(), 0, nframes * sizeof(float) );
+	memset( fc->get_frames_right(), 0, nframes * sizeof(float) );
+}
+
+//
+// add one buffer into another, or copy it when the other holds nothing yet
+//
+static void add_buffer(FrameCollection *to, FrameCollection *from, bool copy, jack_nframes_t nframes)
+{
+	float *t = to->get_frames_left(), *f = from->get_frames_left();
+
+	for( int c = 0; c < 2; c++ ) {
+		if( copy ) memcpy( t, f, nframes * sizeof(float) );
+		else for( jack_nframes_t i = 0; i < nframes; i++ ) t[i] += f[i];
+		t = to->get_frames_right();
+		f = from->get_frames_right();
+	}
+}
+
+// the piece of the period being mixed, and the frames the tracks slip in it
+struct {
+	jack_nframes_t at, count;
+	int slip;
+	bool soloing;
+} mixing;
+
+//
+// sum count frames of a track into to from frame at. Slewing onto a sync
+// master the tracks play count + slip frames in the piece, summed into the
+// share's slip buffer and read between the frames from there, so they run
+// a frame fast or slow instead of jumping. The midi moves to where its 
+// frame now plays
+//
+static void slip_track(Track *track, struct mix_share *share, FrameCollection *to, FrameCollection *midi, 
+	jack_nframes_t at, jack_nframes_t count, float factor_left, float factor_right, float factor_midi)
+{
+	if( !mixing.slip ) {
+		track->sum( to, at, count, factor_left, factor_right, factor_midi, midi );
+		return;
+	}
+
+	FrameCollection *v = share->slip;
+	jack_nframes_t from = count + mixing.slip;
+	v->zero();
+	track->sum( v, at, from, factor_left, factor_right, factor_midi, v );
+
+	float *t = to->get_frames_left() + at, *f = v->get_frames_left() + at;
+	for( int c = 0; c < 2; c++ ) {
+		for( jack_nframes_t i = 0; i < count; i++ ) {
+			jack_nframes_t j = ( (unsigned long long) i * from ) / count;
+			float x = (float) ( i * from - j * count ) / count;
+			float a = f[j], b = j + 1 < from ? f[j + 1] : a;
+			t[i] += a + ( b - a ) * x;
+		}
+		t = to->get_frames_right() + at;
+		f = v->get_frames_right() + at;
+	}
+
+	jack_midi_event_t *events = v->get_events(), ev;
+	for( jack_nframes_t n = 0; n < v->get_nevents(); n++ ) {
+		ev = events[n];
+		ev.time = at + ( (unsigned long long) (ev.time - at) * count ) / from;
+		( midi ? midi : to )->insert_midi_event( &ev, 0, 1.0f );
+	}
+}
+
+//
+// sum count frames of a track into its share's bus from frame at, its midi 
+// goes to midi. A track with insert effects is summed on its own into the
+// share's inserts first, run through them and then added
+//
+void sum_track(Track *track, struct mix_share *share, FrameCollection *midi, jack_nframes_t at, jack_nframes_t count,
+	float factor_left, float factor_right, float factor_midi)
+{
+	// a buffer is cleared when the first track of the period sums into it
+	FrameCollection *bus = share->bus[track->mix_bus];
+	if( !share->summed[track->mix_bus] ) {
+		clear_buffer( bus, mixing_frames );
+		share->summed[track->mix_bus] = true;
+	}
+
+	if( !track->effects->active ) {
+		slip_track( track, share, bus, midi, at, count, factor_left, factor_right, factor_midi );
+		return;
+	}
+
+	if( !share->sending && effects.reverb.active ) {
+		clear_buffer( share->sends, mixing_frames );
+		share->sending = true;
+	}
+
+	FrameCollection *inserts = share->inserts, *sends = share->sending ? share->sends : NULL;
+	float *left = inserts->get_frames_left() + at, *right = inserts->get_frames_right() + at;
+	memset( left, 0, count * sizeof(float) );
+	memset( right, 0, count * sizeof(float) );
+	slip_track( track, share, inserts, midi, at, count, factor_left, factor_right, factor_midi );
+	track->effects->run( left, right, count, 
+		sends ? sends->get_frames_left() + at : NULL, sends ? sends->get_frames_right() + at : NULL );
+
+	float *bus_left = bus->get_frames_left() + at, *bus_right = bus->get_frames_right() + at;
+	for( jack_nframes_t i = 0; i < count; i++ ) {
+		bus_left[i] += left[i];
+		bus_right[i] += right[i];
+	}
+}
+
+//
+// the job of a mixing thread. Every track of the share is summed at its
+// playback cursor, depending on whether we are soloing and the track is 
+// muted. A silent track keeps its place. What a track costs is kept when
+// there are other threads to share the work with
+//
+void mix_tracks(int s, void *midi)
+{
+	struct mix_share *share = &shares[s];
+	struct timespec start, end;
+	bool timed = mixpool.size() > 1;
+	jack_nframes_t at = mixing.at, n = mixing.count;
+	FrameCollection *m = s ? NULL : (FrameCollection *)midi;
+
+	for( Track *track = share->head; track; track = track->mix_next ) {
+	
+		if( !track->playback ) continue;
+
+		if( timed ) clock_gettime( CLOCK_MONOTONIC, &start );
+		if( mixing.soloing ) {
+			if( track->solo ) 
+				sum_track( track, share, m, at, n, 1.0f, 1.0f, 1.0f );
+			else
+				track->skip( n + mixing.slip );
+		} else { 
+			if( !track->mute ) 
+				sum_track( track, share, m, at, n, state.volume_left, state.volume_right, state.volume_midi ); 
+			else
+				track->skip( n + mixing.slip );
+		}
+		if( timed ) {
+			clock_gettime( CLOCK_MONOTONIC, &end );
+			long took = (end.tv_sec - start.tv_sec) * 1000000000L + end.tv_nsec - start.tv_nsec;
+			track->mix_cost += (took * MIX_COST_FRAMES / (long)n - track->mix_cost) / 8;
+		}
+	}
+}
+
+//
+// at the start of a period, nothing summed by any share yet
+//
+void clear_shares(FrameCollection *sum, jack_nframes_t nframes)
+{
+	for( int s = 0; s < mixpool.size(); s++ ) {
+		for( int b = 0; b < MAX_BUSES; b++ ) 
+			shares[s].summed[b] = false;
+		shares[s].sending = false;
+	}
+	shares[0].bus[0] = sum;
+	shares[0].summed[0] = true;
+	mixing_frames = nframes;
+}
 
-void save_recording( bool longtrack )
-{ 
-	//
-	// create a new track out of the collection list and 
-	// add it to the link list of tracks
-	//
+//
+// share the tracks playing in this segment out. Each goes to the share 
+// that has cost least so far, a midi track to the process thread. The 
+// work is only shared when there is enough of it to pay for waking the
+// threads
+//
+void share_tracks(struct part_cursor *heard)
+{
+	struct part_cursor c = *heard;
 	Track *track;
+	long total = 0;
+	int s, least;
 
-	if( collcount && RecTail ) {
+	while( (track = next_part_track( &c )) ) 
+		total += track->mix_cost;
+	nshares = mixpool.size() > 1 && total * (long)mixing_frames / MIX_COST_FRAMES >= MIX_MIN_COST ? 
+		mixpool.size() : 1;
 
-		fprintf(stderr, "new track in part %d\n", sections[state.current_section].part );
-		track = new Track( sections[state.current_section].part, new_track_num++ );
-		track->head = RecHead;
-		track->tail = RecTail;
-		track->collcount = track->loadcount = collcount;
-		track->longtrack = longtrack;
-		
-		// lock before append track to list
-		if( track_hosting ) pthread_mutex_lock( &append_track_mut );
-		if( TrackTail == NULL ) {
-			TrackTail = TrackHead = track;
-			track->next = track->prev = NULL;
-		}
-		else {
-			track->prev = TrackTail;
-			track->next = NULL;
-			TrackTail->next = track;
-			TrackTail = track;
-		}
-		state.trackcount++;
-		if( track_hosting ) pthread_mutex_unlock( &append_track_mut );
+	for( s = 0; s < nshares; s++ ) {
+		shares[s].head = shares[s].tail = NULL;
+		shares[s].load = 0;
+	}
 
-		//
-		// watch for a program change that should occur when using midi
-		//
-		if( program_change && track->use_midi ) {
-			// last_channel found in control.h
-			last_channel++;
-			if( last_channel == 9 ) last_channel++;
-			track->channel = last_channel;
-			// must prep this channel for the correct program voice
-			track->send_channel_midi();
-			midi_buffer_flush = true;
-			program_change = false;
+	c = *heard;
+	while( (track = next_part_track( &c )) ) {
+		least = 0;
+		if( !track->use_midi ) 
+			for( s = 1; s < nshares; s++ ) 
+				if( shares[s].load < shares[least].load ) least = s;
+		track->mix_next = NULL;
+		if( shares[least].tail ) shares[least].tail->mix_next = track;
+		else shares[least].head = track;
+		shares[least].tail = track;
+		// a track not timed yet still counts for something
+		shares[least].load += track->mix_cost + 1;
+	}
+}
+
+//
+// add the other shares' buses and reverb sends into the process thread's
+//
+void gather_shares()
+{
+	struct mix_share *share, *first = &shares[0];
+
+	for( int s = 1; s < mixpool.size(); s++ ) {
+		share = &shares[s];
+		for( int b = 0; b < MAX_BUSES; b++ ) {
+			if( !share->summed[b] ) continue;
+			add_buffer( first->bus[b], share->bus[b], !first->summed[b], mixing_frames );
+			first->summed[b] = true;
 		}
-		
-		// when using track hosting, maybe start a upload thread for this track
-		if( track_hosting && config.autoupload ) {
-			pthread_t thread_id;	// this is quite wrong being here
-			pthread_create( &thread_id, NULL, service_upload_thread, track );
+		if( share->sending ) {
+			add_buffer( first->sends, share->sends, !first->sending, mixing_frames );
+			first->sending = true;
 		}
 	}
+}
 
-	//
-	// zero out the collection list
-	//
-	RecTail = RecHead = NULL;
-	collcount = 0;
+/**************************************************************
+ * add_bus()
+ * 
+ * Open the jack ports of an output bus, from the control thread. Process
+ * mixes a bus once its ports are there, until then its tracks go to the
+ * main outputs
+ */
+
+int add_bus(int b)
+{
+	char name[NAMEBUFLEN];
+	jack_port_t *left, *right;
+
+	if( b <= 0 || b >= MAX_BUSES ) return 1;
+	if( bus_port_left[b] ) return 0;
+
+	// the shares' buffers for it are there before process can sum into it
+	pthread_mutex_lock( &shares_mut );
+	for( int s = 0; s < mixpool.size() && share_frames; s++ ) 
+		if( shares[s].bus[b] == NULL ) share_buffer( &shares[s].bus[b], share_frames );
+	pthread_mutex_unlock( &shares_mut );
+
+	snprintf( name, NAMEBUFLEN, "bus%d_left", b );
+	left = jack_port_register( client, name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0 );
+	snprintf( name, NAMEBUFLEN, "bus%d_right", b );
+	right = jack_port_register( client, name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0 );
+	if( left == NULL || right == NULL ) {
+		fprintf(stderr, "no more JACK audio ports available for bus %d\n", b);
+		if( left ) jack_port_unregister( client, left );
+		if( right ) jack_port_unregister( client, right );
+		return 1;
+	}
+	bus_port_right[b] = right;
+	__sync_synchronize();
+	bus_port_left[b] = left;
+	tracks_changed = true;
+	fprintf(stderr, "output bus %d open\n", b);
+	return 0;
 }
 
 /***********************************************************************
@@ -867,31 +1738,46 @@ int process (jack_nframes_t nframes, void *arg)
 	jack_default_audio_sample_t *in_left, *in_right, *out_left, *out_right;
 	void *in_midi, *out_midi;
 
+	stats.begin();
+
 	// get our four pointers to the jack audio port buffers
-	in_left = (jack_default_audio_sample_t*) jack_port_get_buffer (input_port_left, nframes);
-	in_right = (jack_default_audio_sample_t*) jack_port_get_buffer (input_port_right, nframes);
+	in_left = (jack_default_audio_sample_t*) jack_port_get_buffer (input_port_left[0], nframes);
+	in_right = (jack_default_audio_sample_t*) jack_port_get_buffer (input_port_right[0], nframes);
 	out_left = (jack_default_audio_sample_t*) jack_port_get_buffer (output_port_left, nframes);
 	out_right = (jack_default_audio_sample_t*) jack_port_get_buffer (output_port_right, nframes);
 
+	// and the other inputs, only looked at when they are recorded
+	takes[0].in_left = in_left;
+	takes[0].in_right = in_right;
+	for( int i = 1; i < inputs; i++ ) {
+		takes[i].in_left = (jack_default_audio_sample_t*) jack_port_get_buffer (input_port_left[i], nframes);
+		takes[i].in_right = (jack_default_audio_sample_t*) jack_port_get_buffer (input_port_right[i], nframes);
+	}
+
 	// get our two pointers to the jack midi port buffers
 	in_midi = (void*) jack_port_get_buffer (input_port_midi, nframes);
 	out_midi = (void*) jack_port_get_buffer (output_port_midi, nframes);
 
-	// keep track of soloing and reseting of long tracks
-	bool soloing = false, resettracks = false;
+	// keep track of reseting of long tracks
+	bool resettracks = false;
+
+	// effect settings from the control thread
+	effects.apply();
 
 	// first look for a request to clear all tracks
-	if( clear_tracks ) {
+	if( clear_tracks && !tracks_busy() ) {
 		
 		Track *a, *p = TrackTail;
 		while( p ) {
 			a = p->prev;
+			effects.forget( p->effects );
 			delete p;
 			p = a;
 		}
 
 		TrackHead = TrackTail = NULL;
 		state.trackcount = 0;
+		tracks_changed = true;
 		// force rewind to rewind sections as well
 		state.framecount = 0;
 		rewind_request = true;
@@ -913,306 +1799,231 @@ int process (jack_nframes_t nframes, void *arg)
 		
 		current_div = -1;
 		beat_count = 0;
+		rec_wrap_due = 0;
 		clear_collections = true;
 		rewind_request = false;
+		midi_clock.locate();
 	}
 
 	// next look for request to clear collections
 	if( clear_collections ) {
-		if( collcount ) {
-			FrameCollection *q, *p = RecTail;
+		for( int i = 0; collcount && i < inputs; i++ ) {
+			FrameCollection *q, *p = takes[i].tail;
 			while( p ) {
 				q = p->get_prev();
 				delete p;
 				p = q;
 			}
-			collcount = 0;
-			RecHead = RecTail = NULL;
+			takes[i].head = takes[i].tail = NULL;
 		}
+		collcount = 0;
+		rec_frames = 0;
 		clear_collections = false;
 	}
 	
+	// keep our transport with the other engines
+	jack_time_t cycle_time = jack_frames_to_time( client, jack_last_frame_time( client ) );
+	int sync_slip = 0;
+	if( transport_sync.mode == SYNC_MASTER )
+		transport_sync.publish( cycle_time, state.framecount, state.current_section, state.playing );
+	else if( transport_sync.mode == SYNC_FOLLOWER )
+		sync_slip = follow_master( cycle_time, nframes );
+	stats.lap( STAGE_CONTROL );
+
 	// ok - on with the main business at hand
 	
 	if( state.playing ) {
 		//
-		// Playing. 
-		// 1. Check for maxframes reached, which means the sample period is over
-		// 2. Check for recording, where we save off the port buffer data
-		// 3. Sum track samples from recorded tracks for these frame periods
-		// 4. Check for metronome activity, then send out summed samples
+		// Playing. The period is played in segments, split wherever a section 
+		// ends or a division begins, so both land on their exact frame
+		// 1. At the end of the section, wrap round to the next one
+		// 2. At the start of a division, sound any click
+		// 3. Record the input frames, make the track index again if the tracks
+		//    changed and sum the tracks of the section's part for the segment
+		// 4. Send out the summed samples
+		//
+		FrameCollection *sum = new FrameCollection(nframes, true, true ) ;
+		sum->zero();
+
+		//
+		// Clear jack midi buffer before possibly outputting any midi events
 		//
-		if( state.framecount > sections[state.current_section].maxframes ) {
+		jack_midi_clear_buffer(out_midi);
+	
+		// no share has summed anything yet
+		clear_shares( sum, nframes );
+
+		state.midi_level_in = find_peak_midi( in_midi, nframes);
+
+		// start the outboard gear or tell it where we jumped to
+		midi_clock.transport( sum, 0 );
+		stats.lap( STAGE_CLICK );
+
+		jack_nframes_t done = 0, n;
+		while( done < nframes ) {
+
+			if( state.framecount >= sections[state.current_section].maxframes ) 
+				section_wrap();
+			
+			// look for any long tracks to save off
+			if( state.longrecording && !record_mode ) {
+				// 
+				// stop long recording. Save the collections to a track
+				//
+				save_recording( true, sections[state.current_section].part, 0 );
+				state.longrecording = false;			
+			}
+			stats.lap( STAGE_RECORD );
+
 			//
-			// reached max frames, reset sequencer to beginning
+			// play up to the end of the section or the start of the next 
+			// division, whichever comes first
 			//
-			state.framecount = 0;
+			unsigned int maxframes = sections[state.current_section].maxframes;
+			unsigned int divisions = sections[state.current_section].divisions;
+			int newdiv = ( (unsigned long long) divisions * state.framecount ) / maxframes;
+			unsigned int nextdiv = ( (unsigned long long) (newdiv + 1) * maxframes + divisions - 1 ) / divisions;
 
-			// don't increment current_section yet because we need to save tracks with correct value
-			// but we need to know what the next section will be
-			int nextsection = state.current_section + 1;
-			if( nextsection >= state.sections )
-				nextsection = 0;
+			n = nframes - done;
+			if( n > nextdiv - state.framecount ) n = nextdiv - state.framecount;
+			if( n > maxframes - state.framecount ) n = maxframes - state.framecount;
+			if( rec_wrap_due && n > rec_wrap_due ) n = rec_wrap_due;
 
-			if( state.recording ) {
-				//
-				// if recording, save the recorded frames into a new track
-				//
-				save_recording( false );
-				// if not in record mode, stop recording now
-				if( !record_mode )
-					state.recording = false;
+			//
+			// following a sync master the section moves a frame more or less
+			// than the period in the first piece long enough to spread it over.
+			// A frame more must still end inside the period and the section
+			//
+			int slip = 0;
+			if( sync_slip && n >= SYNC_SLIP_FRAMES ) {
+				slip = sync_slip;
+				sync_slip = 0;
+				if( slip > 0 && ( done + n == nframes || state.framecount + n == nextdiv || 
+					state.framecount + n == maxframes ) ) 
+					n--;
 			}
 
-			if( state.stagerecord ) {
+			if( newdiv != current_div ) {
 				//
-				// we were staged, now go to record mode if any channel is set to record
+				// flag the beat and process any click output 
 				//
-				state.stagerecord = false;
-
-				if (state.rec_left || state.rec_right || state.rec_midi ) {
-					if( record_mode && config.longtracks && nextsection == 0 )
-						state.longrecording = true;
-					else
-						state.recording = true;
-					
-				}
-			}
-			//
-			// reset playback pointers and send note of messages in all active tracks 
-			//
-			Track *track = TrackHead;
-			while( track ) {
-				if( !track->longtrack || (nextsection == 0 && track->start) ) {
-					track->playback = track->head;
-					if( track->use_midi )
-						track->send_notesoff_midi();
-					if( track->longtrack ) track->start = false;
+				if( state.use_click ) {
+					if( config.cinternal ) {
+						// use the internal click for metronome
+						if( beat_count == 0 ) internal_click.begin_down();
+						else if( beat_count == sections[state.current_section].beats - 1 )
+							internal_click.begin_fill();
+						else internal_click.begin_beat();
+					} else {
+						// use the midi output to create metronome click
+						if( beat_count == 0 ) 
+							midi_clock.click( sum, done, config.downbeat );
+						else if( beat_count == sections[state.current_section].beats - 1 ) 
+							midi_clock.click( sum, done, config.fill );
+						else 
+							midi_clock.click( sum, done, config.click );
+					}
 				}
-				track = track->next;
+				current_div = newdiv;
+
+				// increment the beat counter and possible reset to zero
+				if( ++beat_count >= sections[state.current_section].beats ) beat_count = 0;
 			}
-			midi_buffer_flush = true;
 
-			// increment section counter now
-			state.current_section++;
-			if( state.current_section >= state.sections )
-				state.current_section = 0;
-				
-		}
-		
-		// look for any long tracks to save off
-		if( state.longrecording && !record_mode ) {
-			// 
-			// stop long recording. Save the collections to a track
-			//
-			save_recording( true );
-			state.longrecording = false;			
-		}
-		
-		// now see about recording anything from this call to process
-		if( state.recording || state.longrecording ) {
 			//
-			// record this set of input frames into a collection
+			// look for any midi events buffered from control functions ready to be flushed,
+			// they go out ahead of the tracks' events at this frame
 			//
-			FrameCollection *fc;
-			fc = new FrameCollection(nframes, state.rec_left, state.rec_right);
-			
-			if( state.rec_left ) 
-				fc->copyin_left( in_left, nframes);
-			if( state.rec_right ) 
-				fc->copyin_right( in_right, nframes);
+			if( midi_buffer_flush ) {
 
-			if( state.rec_midi )
-				state.midi_level_in = fc->copyin_midi( in_midi, nframes);
-			else 
-				state.midi_level_in = find_peak_midi( in_midi, nframes);
-				
-			fc->append(&RecHead, &RecTail);
-			collcount++;
-		} else
-			state.midi_level_in = find_peak_midi( in_midi, nframes);
+				for( int i = 0; i < midi_buffer_len; i++ ) {
 
-		//
-		// playback all active tracks in this section by summing the frames
-		// at the playback pointer
-		//
-		FrameCollection *sum = new FrameCollection(nframes, true, true ) ;
-		sum->zero();
-	
-		Track *track, *next, *prev;
-		int tracknum = 0;
-		
-		//
-		// first pass: process any track remove request and look for track soloing
-		//
-		track = TrackHead;
-		while( track ) {	// for all tracks
-
-			if( track->remove ) {
-				if( track == TrackHead ) {
-					// we are the head
-					if( track == TrackTail ) {
-						// we are the only track
-						delete track;
-						track = NULL;
-						TrackHead = TrackTail = NULL;
-						state.trackcount--;
-					} else { // are not the only track		
-						next = track->next;
-						if( next ) next->prev = NULL;
-						delete track;
-						TrackHead = next;
-						state.trackcount--;
-						track = next;
-					}
-				} else if( track == TrackTail ) {
-					// we are the tail
-					prev = track->prev;
-					if( prev ) prev->next = NULL;
-					delete track;
-					TrackTail = prev;
-					state.trackcount--;
-					track = NULL;
-				} else {
-					next = track->next;
-					prev = track->prev;
-					delete track;
-					if( next ) next->prev = prev;
-					if( prev ) prev->next = next;
-					state.trackcount--;
-					track = next;
-				}
-				fprintf(stderr, "track %d removed\n", tracknum );
+					jack_midi_event_t event;
+					event.time = done;
+					event.size = midi_event_buffer[i].len;
+					event.buffer = midi_event_buffer[i].buf;
+					sum->insert_midi_event( &event, 0, 1.0f );
+					delete[] midi_event_buffer[i].buf;
 
-			} else {
-				if( track->solo ) soloing = true;
-				track = track->next;
-				tracknum++;
-			}
-		}
-				
-		//
-		// second pass: go thru the track list and get any samples to play back for this part
-		//
-		track = TrackHead;
-		while( track ) {
-		
-			if( track->playback && 
-				( track->longtrack || track->part == -1 || track->part == sections[state.current_section].part )) {
-				//
-				// there is something at the playback pointer and in our part as defined by section	
-				//
-				// sum the frame collection at the playback pointer, 
-				// depending on whether we are soloing and the track is muted
-				//
-				if( soloing ) {
-					if( track->solo ) 
-						track->sum( sum, nframes, 1.0f, 1.0f, 1.0f );
-				} else { 
-					if( !track->mute ) 
-						track->sum( sum, nframes, state.volume_left, state.volume_right, state.volume_midi ); 
 				}
-				//
-				// advance the playback pointer for this track
-				//	
-				track->advance();
+				midi_buffer_len = 0;
+				midi_buffer_flush = false;
 			}
-			track = track->next;
-		}
 
-		//
-		// Clear jack midi buffer before possibly outputting any midi events
-		//
-		jack_midi_clear_buffer(out_midi);
-		
-		//
-		// check for beat activity and any metronome activity to output
-		//
-		
-		// we are looking ahead to the next call to process, so we can begin the ticks
-		// ahead of time to compensate for real events starting ahead of the beat
- 
-		int lookdiv = ( sections[state.current_section].divisions * (state.framecount + nframes) ) / sections[state.current_section].maxframes;
-		int newdiv = ( sections[state.current_section].divisions * (state.framecount ) ) / sections[state.current_section].maxframes;
+			// midi clocks and the end of a metronome note
+			midi_clock.run( sum, done, n + slip );
+			stats.lap( STAGE_CLICK );
+
+			// now see about recording anything from this segment
+			if( state.recording || state.longrecording ) 
+				record_frames( in_midi, done, n );
+			preroll_frames( done, n );
+			if( rec_wrap_due && (rec_wrap_due -= n) == 0 ) 
+				record_wrap();
+			stats.lap( STAGE_RECORD );
 
-		if( lookdiv != current_div ) {
 			//
-			// process any click output 
+			// playback the tracks of this section's part by summing the frames
+			// at their playback cursors, shared out between the mixing threads
 			//
-			if( state.use_click ) {
-				if( config.cinternal ) {
-					// use the internal click for metronome
-					if( beat_count == 0 ) internal_click.begin_down();
-					else if( beat_count == sections[state.current_section].beats - 1 )
-						internal_click.begin_fill();
-					else internal_click.begin_beat();
-				} else {
-					// use the midi output to create metronome click
-					// this is presently done in one process() callback
-					// and we do it here
-					unsigned char buf[3];			
-					if( beat_count == 0 ) {
-						// output the downbeat
-						buf[0] = 0x99;
-						buf[1] = config.downbeat;
-						buf[2] = config.velocity;
-						jack_midi_event_write( out_midi, 0L, buf, 3);
-						buf[0] = 0x89;
-						jack_midi_event_write( out_midi, 0L, buf, 3);
-					} else if( beat_count == sections[state.current_section].beats - 1 ) {
-						// output the fill
-						buf[0] = 0x99;
-						buf[1] = config.fill;
-						buf[2] = config.velocity;
-						jack_midi_event_write( out_midi, 0L, buf, 3);
-						buf[0] = 0x89;
-						jack_midi_event_write( out_midi, 0L, buf, 3);				
-					} else {
-						// output a beat click
-						buf[0] = 0x99;
-						buf[1] = config.click;
-						buf[2] = config.velocity;
-						jack_midi_event_write( out_midi, 0L, buf, 3);
-						buf[0] = 0x89;
-						jack_midi_event_write( out_midi, 0L, buf, 3);
-					}
-				}
-			}
-		}
-		
-		if( newdiv != current_div ) {
+			if( tracks_changed ) 
+				index_tracks();
+			struct part_cursor heard;
+			part_tracks( sections[state.current_section].part, &heard );
+			stats.lap( STAGE_TRACKS );
+			share_tracks( &heard );
+			mixing.at = done;
+			mixing.count = n;
+			mixing.slip = slip;
+			mixing.soloing = solo_count > 0;
+			if( nshares > 1 ) 
+				mixpool.run( mix_tracks, sum );
+			else
+				mix_tracks( 0, sum );
+			stats.lap( STAGE_MIX );
+
 			//
-			// flag the beat and process any click output 
+			// check for any samples to play from the internal click
 			//
-			current_div = newdiv;
+			if( config.cinternal && internal_click.remaining ) 
+				internal_click.sum( sum, done, n );
+			stats.lap( STAGE_CLICK );
 
-			// increment the beat counter and possible reset to zero
-			if( ++beat_count >= sections[state.current_section].beats ) beat_count = 0;
+			state.framecount += n + slip;
+			done += n;
 		}
 		
 		//
-		// look for any midi events buffered from control functions ready to be flushed
+		// the reverb of what the tracks sent, then the master inserts
 		//
-		if( midi_buffer_flush ) {
-
-			for( int i = 0; i < midi_buffer_len; i++ ) {
-
-				jack_midi_event_write( out_midi, 0L, midi_event_buffer[i].buf,  midi_event_buffer[i].len );
-				delete[] midi_event_buffer[i].buf;
-
-			}
-			midi_buffer_len = 0;
-			midi_buffer_flush = false;
+		gather_shares();
+		stats.lap( STAGE_MIX );
+		if( shares[0].sending ) {
+			FrameCollection *sends = shares[0].sends;
+			effects.reverb.run( sends->get_frames_left(), sends->get_frames_right(), 
+				sum->get_frames_left(), sum->get_frames_right(), nframes );
 		}
-		
+		if( master_effects.active ) 
+			master_effects.run( sum->get_frames_left(), sum->get_frames_right(), nframes, NULL, NULL );
+
 		//
-		// check for any samples to play from the internal click
+		// the stems go straight out, a bus with nothing routed to it is silent
 		//
-		if( config.cinternal && internal_click.playcount ) {
-			internal_click.sum( sum, nframes );
-			internal_click.advance();
+		for( int b = 1; b < MAX_BUSES; b++ ) {
+			FrameCollection *bus = shares[0].bus[b];
+			if( !bus_port_left[b] ) continue;
+			jack_default_audio_sample_t *bus_left, *bus_right;
+			bus_left = (jack_default_audio_sample_t*) jack_port_get_buffer (bus_port_left[b], nframes);
+			bus_right = (jack_default_audio_sample_t*) jack_port_get_buffer (bus_port_right[b], nframes);
+			if( shares[0].summed[b] ) {
+				bus->copyout_left( bus_left, nframes);
+				bus->copyout_right( bus_right, nframes);
+			} else {
+				memset (bus_left, 0, sizeof (jack_default_audio_sample_t) * nframes);
+				memset (bus_right, 0, sizeof (jack_default_audio_sample_t) * nframes);
+			}
 		}
-		
+
 		//
 		// now send out the summed samples to the output buffers
 		//
@@ -1220,12 +2031,13 @@ int process (jack_nframes_t nframes, void *arg)
 		sum->copyout_right( out_right, nframes);
 		state.midi_level_out  = sum->copyout_midi( out_midi, nframes);
 		
+		// delete the sample summer 
+		delete sum;
+		stats.lap( STAGE_EFFECTS );
+
 		// get the peak values for audio output
 		state.audio_L_level_out = find_peak_audio( out_left, nframes);
 		state.audio_R_level_out = find_peak_audio( out_right, nframes);
-
-		// delete the sample summer 
-		delete sum;
 	}	
 	else {
 		//
@@ -1235,7 +2047,16 @@ int process (jack_nframes_t nframes, void *arg)
 		//
 		memset (out_left, 0, sizeof (jack_default_audio_sample_t) * nframes);
 		memset (out_right, 0, sizeof (jack_default_audio_sample_t) * nframes);
+		for( int b = 1; b < MAX_BUSES; b++ ) 
+			if( bus_port_left[b] ) {
+				memset (jack_port_get_buffer (bus_port_left[b], nframes), 0, sizeof (jack_default_audio_sample_t) * nframes);
+				memset (jack_port_get_buffer (bus_port_right[b], nframes), 0, sizeof (jack_default_audio_sample_t) * nframes);
+			}
 		
+		if( tracks_changed ) 
+			index_tracks();
+		midi_clock.stop();
+
 		if( resettracks ) {
 			// resetting everyback to zero, start normal tracks and
 			// shut down long tracks
@@ -1245,7 +2066,9 @@ int process (jack_nframes_t nframes, void *arg)
 					track->playback = NULL;
 					track->start = false;
 				} else {
-					track->playback = track->head;
+					if( track->swap_pending ) 
+						track->swap();
+					track->rewind();
 					if( track->use_midi ) {
 						track->send_notesoff_midi();
 						midi_buffer_flush = true;
@@ -1271,6 +2094,8 @@ int process (jack_nframes_t nframes, void *arg)
 			midi_buffer_len = 0;
 			midi_buffer_flush = false;
 		}
+		stats.lap( STAGE_CONTROL );
+
 		// read the midi input events for peak value
 		state.midi_level_in = find_peak_midi( in_midi, nframes);		
 	}
@@ -1282,6 +2107,7 @@ int process (jack_nframes_t nframes, void *arg)
 	state.audio_R_level_in = find_peak_audio( in_right, nframes);
 
 	state.bpm = (int)( (10.0f * 60.0f * sections[state.current_section].divisions)  / ( (float)sections[state.current_section].maxframes / (float)sample_rate) );
+	stats.lap( STAGE_METERS );
 	//
 	// Playing or not, see if it's time to send the udp packet containing
 	//
@@ -1292,93 +2118,90 @@ int process (jack_nframes_t nframes, void *arg)
 	// out the network port 
 	//
 	frame_count += nframes;
-	if( frame_count >= MAX_FRAME_COUNT ) {
+	if( frame_count >= MAX_FRAME_COUNT && publisher.claim() ) {
 		frame_count = 0;
 		
-		unsigned char * bptr, *buffer;
-		struct Statebuf statebuf;
-		int sectionparts[MAX_SECTIONS];
-		
-		// create a buffer large enough to hold statebuf, sections and tracks 
-		bptr = buffer = new unsigned char[ sizeof(Statebuf) + sizeof(int)*state.sections 
-			+ sizeof(Trackbuf)*state.trackcount ];
-			
-		// copy state buffer any other data to buffer
-		state.fill( &statebuf );
-		statebuf.maxframes = sections[state.current_section].maxframes;
-		statebuf.divisions = sections[state.current_section].divisions;
-		statebuf.beats = sections[state.current_section].beats;
-		statebuf.cinternal = config.cinternal;
-		statebuf.autoupload = config.autoupload;
-		statebuf.longtracks = config.longtracks;
-
-		memcpy( bptr, &statebuf, sizeof(Statebuf) );
-		bptr = bptr + sizeof(Statebuf);
+		//
+		// fill out the publisher image, the publisher thread sends each
+		// subscriber only what changed since its last update
+		//
+		TelemetryImage *image = &publisher.image;
+
+		state.fill( &image->state );
+		image->state.maxframes = sections[state.current_section].maxframes;
+		image->state.divisions = sections[state.current_section].divisions;
+		image->state.beats = sections[state.current_section].beats;
+		image->state.cinternal = config.cinternal;
+		image->state.autoupload = config.autoupload;
+		image->state.longtracks = config.longtracks;
 		
-		// copy the sections part numbers into an array
-		// then copy this array to buffer
+		// the sections part numbers
 		for(int i = 0; i < state.sections; i++) 
-			sectionparts[i] = sections[i].part;
-		memcpy( bptr, sectionparts, sizeof(int) * state.sections );
-		bptr = bptr + sizeof(int) * state.sections;
+			image->parts[i] = sections[i].part;
 		
 		//
-		// copy all tracks  with simplified information 
+		// all tracks with simplified information 
 		//
-		Trackbuf trackbuf;
+		Trackbuf *trackbuf;
 		int count = 0, tc = state.trackcount;
 		Track *tptr = TrackHead;
-		while(tptr && tc--) {
+		// the publisher grows the table off this thread, until then the
+		// client sees state.trackcount run ahead of it
+		if( tc > image->capacity ) tc = image->capacity;
+		if( tc > TELEMETRY_MAX_TRACKS ) tc = TELEMETRY_MAX_TRACKS;
+		image->resize( tc );
+		while(tptr && count < tc) {
 			
 			//
 			// fill out the Trackbuf
 			//
-			trackbuf.number = count++;
-			strcpy(trackbuf.name, tptr->name );
-			trackbuf.part = tptr->part;
-			trackbuf.channel = tptr->channel;
-			trackbuf.bank = tptr->bank;
-			trackbuf.program = tptr->program;
-			trackbuf.vol_left = (int) ( 100 * tptr->volume_left );
-			trackbuf.vol_right = (int) ( 100 * tptr->volume_right );
-			trackbuf.vol_midi = (int) ( 100 * tptr->volume_midi );
-			trackbuf.peak_left = tptr->peak_left;
-			trackbuf.peak_right = tptr->peak_right;
-			trackbuf.peak_midi = tptr->peak_midi;
-			trackbuf.mute = tptr->mute;
-			trackbuf.solo = tptr->solo;
-			trackbuf.longtrack = tptr->longtrack;
+			trackbuf = &image->tracks[count];
+			trackbuf->number = count++;
+			strcpy(trackbuf->name, tptr->name );
+			trackbuf->part = tptr->part;
+			trackbuf->channel = tptr->channel;
+			trackbuf->bank = tptr->bank;
+			trackbuf->program = tptr->program;
+			trackbuf->vol_left = (int) ( 100 * tptr->volume_left );
+			trackbuf->vol_right = (int) ( 100 * tptr->volume_right );
+			trackbuf->vol_midi = (int) ( 100 * tptr->volume_midi );
+			trackbuf->peak_left = tptr->peak_left;
+			trackbuf->peak_right = tptr->peak_right;
+			trackbuf->peak_midi = tptr->peak_midi;
+			trackbuf->mute = tptr->mute;
+			trackbuf->solo = tptr->solo;
+			trackbuf->longtrack = tptr->longtrack;
+			trackbuf->stretch = tptr->stretch;
+			trackbuf->reversed = tptr->reversed;
 			if( tptr->longtrack )
-				if( tptr->playback ) trackbuf.active = true;
-				else 				 trackbuf.active = false;
+				if( tptr->playback ) trackbuf->active = true;
+				else 				 trackbuf->active = false;
 			else 
-				if( tptr->part == sections[state.current_section].part) trackbuf.active = true;
-				else trackbuf.active = false;
-			//
-			// copy to buffer
-			//
-			memcpy( bptr, &trackbuf, sizeof(Trackbuf) );
-			bptr = bptr + sizeof(Trackbuf);
+				if( tptr->part == sections[state.current_section].part) trackbuf->active = true;
+				else trackbuf->active = false;
 			tptr = tptr->next; 
 			
 		}
+		image->resize( count );
 
 		//
-		// send out all data out network port
+		// how we are keeping up, the arena's counts are read without its lock
 		//
-		network.talk(buffer, sizeof(Statebuf) + sizeof(int)*state.sections + 
-			sizeof(Trackbuf)*state.trackcount);
-		
-		delete[] buffer;
-		
+		struct arena_stats as;
+		stats.fill( &image->stats, nframes, sample_rate );
+		image->stats.jack_load = jack_cpu_load( client );
+		arena.stats( &as );
+		image->stats.chunks = as.chunks;
+		image->stats.huge_chunks = as.huge;
+		image->stats.blocks = as.blocks;
+
+		//
+		// hand the update to the publisher thread
+		//
+		publisher.post();
 	}
+	stats.lap( STAGE_TELEMETRY );
 		
-	//
-	// if we are playing then increase the frame counter
-	//
-	if( state.playing )
-		state.framecount = state.framecount + nframes;
-
 	// finally, check the transport for any changes 
 	jack_transport_state_t transport_state = jack_transport_query( client, NULL );
 	if( transport_state == JackTransportStopped && state.playing )
@@ -1386,6 +2209,8 @@ int process (jack_nframes_t nframes, void *arg)
 	if( transport_state == JackTransportRolling && !state.playing )
 		state.playing = true;
 
+	stats.lap( STAGE_CONTROL );
+	stats.end( nframes, sample_rate );
 	return 0;
 }
 
@@ -1398,6 +2223,70 @@ void jack_shutdown (void *arg)
 	exit (1);
 }
 
+/*******************************************************************
+ * JACK calls this on the threads it starts for us before they run,
+ * the process thread's memory node is where the track audio goes.
+ */
+void jack_thread_init (void *arg)
+{
+	arena.home();
+}
+
+/*******************************************************************
+ * JACK calls this buffer_size_callback when the period changes, while
+ * process is not running. The mixing buffers grow to fit it.
+ */
+int jack_buffer_size (jack_nframes_t nframes, void *arg)
+{
+	size_shares( nframes );
+	return 0;
+}
+
+/*******************************************************************
+ * JACK calls this xrun_callback when a period was missed, by us or 
+ * any other client
+ */
+int jack_xrun (void *arg)
+{
+	stats.xrun( jack_get_xrun_delayed_usecs( client ) );
+	return 0;
+}
+
+/*******************************************************************
+ * JACK calls this latency_callback when the latencies in the graph
+ * change. What we play takes the playback latency to be heard, and
+ * what is played along with it the capture latency to come back in.
+ */
+void jack_latency (jack_latency_callback_mode_t mode, void *arg)
+{
+	jack_latency_range_t range;
+	jack_nframes_t capture, playback;
+	long latency;
+
+	capture = 0;
+	for( int i = 0; i < inputs; i++ ) {
+		jack_port_get_latency_range( input_port_left[i], JackCaptureLatency, &range );
+		if( range.max > capture ) capture = range.max;
+		jack_port_get_latency_range( input_port_right[i], JackCaptureLatency, &range );
+		if( range.max > capture ) capture = range.max;
+	}
+	jack_port_get_latency_range( output_port_left, JackPlaybackLatency, &range );
+	playback = range.max;
+	jack_port_get_latency_range( output_port_right, JackPlaybackLatency, &range );
+	if( range.max > playback ) playback = range.max;
+
+	// the configured offset covers what jack can't see, like a converter
+	latency = (long)capture + playback + config.latency;
+	if( latency < 0 ) latency = 0;
+	if( latency >= MIN_FRAMES / 2 ) latency = MIN_FRAMES / 2 - 1;
+
+	if( (jack_nframes_t)latency != rec_latency ) {
+		rec_latency = latency;
+		fprintf(stderr, "recording latency %ld frames (capture %d playback %d)\n", 
+			latency, capture, playback );
+	}
+}
+
 /********************************************************************
  * jack_init()
  * 
@@ -1444,6 +2333,22 @@ int jack_init() {
 
 	jack_on_shutdown (client, jack_shutdown, 0);
 
+	/* and `jack_latency()' to line recordings up with what was heard */
+
+	jack_set_latency_callback (client, jack_latency, 0);
+
+	/* and `jack_xrun()' when a period is missed */
+
+	jack_set_xrun_callback (client, jack_xrun, 0);
+
+	/* and `jack_buffer_size()' when the period changes */
+
+	jack_set_buffer_size_callback (client, jack_buffer_size, 0);
+
+	/* and `jack_thread_init()' on its threads, before process() */
+
+	jack_set_thread_init_callback (client, jack_thread_init, 0);
+
 	/* display and save the current sample rate. 
 	 */
 
@@ -1452,10 +2357,10 @@ int jack_init() {
 
 	/* create four audio ports */
 
-	input_port_left = jack_port_register (client, "input_left",
+	input_port_left[0] = jack_port_register (client, "input_left",
 					 JACK_DEFAULT_AUDIO_TYPE,
 					 JackPortIsInput, 0);
-	input_port_right = jack_port_register (client, "input_right",
+	input_port_right[0] = jack_port_register (client, "input_right",
 					 JACK_DEFAULT_AUDIO_TYPE,
 					 JackPortIsInput, 0);
 	output_port_left = jack_port_register (client, "output_left",
@@ -1465,12 +2370,28 @@ int jack_init() {
 					  JACK_DEFAULT_AUDIO_TYPE,
 					  JackPortIsOutput, 0);
 
-	if ((input_port_left == NULL) || (input_port_right == NULL) ||
+	if ((input_port_left[0] == NULL) || (input_port_right[0] == NULL) ||
 		(output_port_left == NULL) || (output_port_right == NULL)) {
 		fprintf(stderr, "no more JACK audio ports available\n");
 		return(0);
 	}
 
+	/* and a pair for each of the other inputs in the config */
+
+	for( ; inputs <= config.inputs && inputs < MAX_INPUTS; inputs++ ) {
+		char name[NAMEBUFLEN];
+		snprintf( name, NAMEBUFLEN, "input%d_left", inputs );
+		input_port_left[inputs] = jack_port_register (client, name,
+					 JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+		snprintf( name, NAMEBUFLEN, "input%d_right", inputs );
+		input_port_right[inputs] = jack_port_register (client, name,
+					 JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+		if ((input_port_left[inputs] == NULL) || (input_port_right[inputs] == NULL)) {
+			fprintf(stderr, "no more JACK audio ports available for input %d\n", inputs);
+			return(0);
+		}
+	}
+
 	/* create two midi ports */
 
 	input_port_midi = jack_port_register (client, "in",
@@ -1485,6 +2406,44 @@ int jack_init() {
 		return(0);
 	}
 
+	/* the crossfade at a loop seam */
+	xfade_frames = config.xfade > 0 ? config.xfade * sample_rate / 1000 : 0;
+	if( xfade_frames > XFADE_MAX ) xfade_frames = XFADE_MAX;
+
+	/* the stems asked for in the config, more open when a track is routed to them */
+	for( int b = 1; b <= config.buses && b < MAX_BUSES; b++ ) 
+		add_bus( b );
+
+	/* how finished collections keep their frames */
+	if( strcmp( config.precision, "f16" ) == 0 ) FrameCollection::precision = PRECISION_F16;
+	else if( strcmp( config.precision, "s24" ) == 0 ) FrameCollection::precision = PRECISION_S24;
+	else if( strcmp( config.precision, "f32" ) ) 
+		fprintf(stderr, "unknown precision %s, keeping 32 bit floats\n", config.precision );
+
+	/* the threads that share the mixing with process */
+	mixpool.start( client, config.mixthreads );
+	size_shares( jack_get_buffer_size( client ) );
+
+	/* the track audio stays in memory if there is leave to lock it */
+	if( config.mlock ) arena.lock();
+
+	/* and its chunks are mapped off the process thread */
+	arena.start();
+
+	/* the effects work out their coefficients for our rate */
+	effects.init( sample_rate );
+
+	/* the clicks are made up at our sample rate when there are no files */
+	internal_click.load( sample_rate );
+
+	/* the state feed goes out about once every MAX_FRAME_COUNT frames */
+	publisher.start( &network, sample_rate / MAX_FRAME_COUNT );
+	stretcher.start();
+
+	/* join the other engines if we are syncing */
+	if( sync_mode != SYNC_OFF )
+		transport_sync.start( sync_mode, config.syncgroup, config.syncport, sample_rate );
+
 	/* Tell the JACK server that we are ready to roll.  Our
 	 * process() callback will start running now. */
 
@@ -1509,13 +2468,21 @@ int jack_init() {
 		return(0);
 	}
 
-	if (jack_connect (client, ports[0], jack_port_name (input_port_left))) {
+	if (jack_connect (client, ports[0], jack_port_name (input_port_left[0]))) {
 		fprintf (stderr, "cannot connect input_left ports\n");
 	}
-	if (jack_connect (client, ports[1], jack_port_name (input_port_right))) {
+	if (jack_connect (client, ports[1], jack_port_name (input_port_right[0]))) {
 		fprintf (stderr, "cannot connect input_right ports\n");
 	}
 
+	/* the other inputs take the capture ports after, as far as they go */
+	for( int i = 1, p = 2; i < inputs && ports[p] && ports[p + 1]; i++, p += 2 ) {
+		if (jack_connect (client, ports[p], jack_port_name (input_port_left[i])) ||
+			jack_connect (client, ports[p + 1], jack_port_name (input_port_right[i]))) {
+			fprintf (stderr, "cannot connect input%d ports\n", i);
+		}
+	}
+
 	free (ports);
 	
 	/* need two playback ports for left and right */
@@ -1574,7 +2541,22 @@ int jack_init() {
  */
 int jack_close() {
 
+	struct arena_stats as;
+	struct rusage usage;
+
 	jack_client_close (client);
+	mixpool.stop();
+	free_shares();
+	publisher.stop();
+	transport_sync.stop();
+	stretcher.stop();
+	arena.stop();
+
+	arena.stats( &as );
+	getrusage( RUSAGE_SELF, &usage );
+	fprintf(stderr, "track audio: %d chunks, %d on huge pages, %ld blocks, %ld from malloc, "
+		"%ld minor and %ld major page faults\n", as.chunks, as.huge, as.blocks, as.fallbacks,
+		usage.ru_minflt, usage.ru_majflt );
 
 	return 0;
 }
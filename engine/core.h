@@ -33,9 +33,11 @@ extern State state;
 
 extern Track *TrackHead, *TrackTail;
 
+extern volatile bool tracks_changed;
+
 //extern struct Statebuf *statebuffer;
 
-extern int /* sections[],*/ last_channel;
+extern int /* sections[],*/ last_channel, sync_mode;
 
 extern Section sections[];
 
@@ -47,6 +49,8 @@ extern int load_sequencer(bool), flush_sequencer(bool);
 
 extern void core_init(), do_commands();
 
+extern int execute_command(struct control_command *, struct sockaddr_storage *, socklen_t);
+
 /***************************************************************************
  *   Copyright (C) 2016 by John Derry   *
  *   johndderry@yahoo.com   *
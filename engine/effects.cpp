@@ -0,0 +1,387 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <jack/jack.h>
+#include "effects.h"
+
+//
+//	EFFECTS.CPP
+//
+//	The EQ is the biquad of the Audio EQ Cookbook. The reverb is Freeverb:
+//	eight damped combs in parallel then four allpasses in series for each
+//	channel, the right channel's lines a little longer than the left's.
+//
+
+static const unsigned int comb_tuning[REVERB_COMBS] = { 1116, 1188, 1277, 1356, 1422, 1491, 1557, 1617 };
+static const unsigned int allpass_tuning[REVERB_ALLPASSES] = { 556, 441, 341, 225 };
+#define REVERB_SPREAD		23
+#define REVERB_INPUT		0.015f
+#define REVERB_WET			3.0f
+
+static float clamp( float x, float lo, float hi ) {
+	return x < lo ? lo : x > hi ? hi : x;
+}
+
+//
+// EffectChain
+//
+
+EffectChain::EffectChain() {
+
+	memset( slot, 0, sizeof slot );
+	active = false;
+}
+
+EffectChain::~EffectChain() {
+
+	for( int i = 0; i < EFFECT_SLOTS; i++ )
+		delete[] slot[i].line;
+}
+
+void EffectChain::run(float *left, float *right, unsigned int count, float *send_left, float *send_right) {
+	//
+	// run the slots in order over count frames, in place. A send adds to
+	// the send buffers when there are any
+	//
+	unsigned int i, n;
+
+	for( int s = 0; s < EFFECT_SLOTS; s++ ) {
+		struct effect *e = &slot[s];
+
+		switch( e->type ) {
+		case EFFECT_EQ: {
+			float b0 = e->b0, b1 = e->b1, b2 = e->b2, a1 = e->a1, a2 = e->a2;
+			float zl0 = e->z[0][0], zl1 = e->z[0][1], zr0 = e->z[1][0], zr1 = e->z[1][1];
+
+			for( i = 0; i < count; i++ ) {
+				float l = left[i], r = right[i];
+				float yl = b0 * l + zl0, yr = b0 * r + zr0;
+				zl0 = b1 * l - a1 * yl + zl1;
+				zr0 = b1 * r - a1 * yr + zr1;
+				zl1 = b2 * l - a2 * yl;
+				zr1 = b2 * r - a2 * yr;
+				left[i] = yl;
+				right[i] = yr;
+			}
+			e->z[0][0] = zl0; e->z[0][1] = zl1; e->z[1][0] = zr0; e->z[1][1] = zr1;
+			break;
+		}
+		case EFFECT_COMPRESSOR: {
+			float env = e->envelope, gain = e->gain, target, step, level;
+
+			for( i = 0; i < count; i += n ) {
+				// a new gain for each block, ramped to from the last
+				float db = 20.0f * log10f( env + 1e-9f ) - e->threshold;
+				target = db > 0.0f ? powf( 10.0f, -db * e->slope / 20.0f ) : 1.0f;
+				n = count - i < COMPRESSOR_BLOCK ? count - i : COMPRESSOR_BLOCK;
+				step = (target - gain) / n;
+
+				for( unsigned int j = i; j < i + n; j++ ) {
+					level = fabsf( left[j] ) > fabsf( right[j] ) ? fabsf( left[j] ) : fabsf( right[j] );
+					if( level > env ) env = e->attack * env + (1.0f - e->attack) * level;
+					else env = e->release * env + (1.0f - e->release) * level;
+					gain += step;
+					left[j] *= gain;
+					right[j] *= gain;
+				}
+			}
+			e->envelope = env;
+			e->gain = gain;
+			break;
+		}
+		case EFFECT_DELAY: {
+			float *line = e->line, d;
+			unsigned int pos = e->pos;
+
+			for( i = 0; i < count; i++ ) {
+				d = line[pos * 2];
+				line[pos * 2] = left[i] + e->feedback * d;
+				left[i] += e->wet * d;
+				d = line[pos * 2 + 1];
+				line[pos * 2 + 1] = right[i] + e->feedback * d;
+				right[i] += e->wet * d;
+				if( ++pos == e->delay ) pos = 0;
+			}
+			e->pos = pos;
+			break;
+		}
+		case EFFECT_SEND:
+			if( send_left == NULL ) break;
+			for( i = 0; i < count; i++ ) {
+				send_left[i] += left[i] * e->send;
+				send_right[i] += right[i] * e->send;
+			}
+			break;
+		}
+	}
+}
+
+//
+// Reverb
+//
+
+Reverb::Reverb() {
+
+	memset( comb, 0, sizeof comb );
+	memset( allpass, 0, sizeof allpass );
+	feedback = damp = wet = 0.0f;
+	active = false;
+}
+
+Reverb::~Reverb() {
+
+	for( int c = 0; c < 2; c++ ) {
+		for( int i = 0; i < REVERB_COMBS; i++ ) delete[] comb[c][i];
+		for( int i = 0; i < REVERB_ALLPASSES; i++ ) delete[] allpass[c][i];
+	}
+}
+
+void Reverb::init(jack_nframes_t sample_rate) {
+	//
+	// the tunings are for 44.1kHz, scale the lines to our rate
+	//
+	for( int c = 0; c < 2; c++ ) {
+		for( int i = 0; i < REVERB_COMBS; i++ ) {
+			comblen[c][i] = (comb_tuning[i] + c * REVERB_SPREAD) * (unsigned long long)sample_rate / 44100;
+			comb[c][i] = new float[comblen[c][i]];
+			memset( comb[c][i], 0, comblen[c][i] * sizeof(float) );
+			combpos[c][i] = 0;
+			store[c][i] = 0.0f;
+		}
+		for( int i = 0; i < REVERB_ALLPASSES; i++ ) {
+			allpasslen[c][i] = (allpass_tuning[i] + c * REVERB_SPREAD) * (unsigned long long)sample_rate / 44100;
+			allpass[c][i] = new float[allpasslen[c][i]];
+			memset( allpass[c][i], 0, allpasslen[c][i] * sizeof(float) );
+			allpasspos[c][i] = 0;
+		}
+	}
+}
+
+void Reverb::set(float *p) {
+	//
+	// room size, damping and wet level, each 0 to 1
+	//
+	feedback = clamp( p[0], 0.0f, 1.0f ) * 0.28f + 0.7f;
+	damp = clamp( p[1], 0.0f, 1.0f ) * 0.4f;
+	wet = clamp( p[2], 0.0f, 1.0f ) * REVERB_WET;
+	active = wet > 0.0f && comb[0][0];
+}
+
+void Reverb::run(float *in_left, float *in_right, float *out_left, float *out_right, unsigned int count) {
+	//
+	// the reverb of count frames of the sends, added to the output
+	//
+	for( int c = 0; c < 2; c++ ) {
+		float *out = c ? out_right : out_left;
+
+		for( unsigned int i = 0; i < count; i++ ) {
+			float input = (in_left[i] + in_right[i]) * REVERB_INPUT, y = 0.0f, b;
+
+			for( int k = 0; k < REVERB_COMBS; k++ ) {
+				unsigned int pos = combpos[c][k];
+				b = comb[c][k][pos];
+				store[c][k] = b * (1.0f - damp) + store[c][k] * damp;
+				comb[c][k][pos] = input + store[c][k] * feedback;
+				if( ++pos == comblen[c][k] ) pos = 0;
+				combpos[c][k] = pos;
+				y += b;
+			}
+			for( int k = 0; k < REVERB_ALLPASSES; k++ ) {
+				unsigned int pos = allpasspos[c][k];
+				b = allpass[c][k][pos];
+				allpass[c][k][pos] = y + b * 0.5f;
+				y = b - y;
+				if( ++pos == allpasslen[c][k] ) pos = 0;
+				allpasspos[c][k] = pos;
+			}
+			out[i] += y * wet;
+		}
+	}
+}
+
+//
+// EffectQueue
+//
+
+EffectQueue::EffectQueue() {
+
+	queue_in = queue_out = retired_in = retired_out = 0;
+	sample_rate = 48000;
+}
+
+void EffectQueue::init(jack_nframes_t rate) {
+
+	sample_rate = rate;
+	reverb.init( rate );
+}
+
+int EffectQueue::post(EffectChain *chain, int slot, int type, float *p) {
+	//
+	// control thread: make up the slot, or the reverb settings when chain
+	// is NULL, and queue it for process. Frees the delay lines process 
+	// has finished with
+	//
+	struct effect_message *m;
+	struct effect *e;
+
+	while( retired_out != retired_in ) {
+		__sync_synchronize();
+		delete[] retired[retired_out];
+		retired_out = (retired_out + 1) % EFFECT_QUEUE;
+	}
+
+	if( chain && (slot < 0 || slot >= EFFECT_SLOTS || type < EFFECT_NONE || type >= EFFECT_REVERB) ) return 1;
+	if( chain == NULL && type != EFFECT_REVERB ) return 1;
+	if( (queue_in + 1) % EFFECT_QUEUE == queue_out ) {
+		fprintf(stderr, "effects: queue full\n");
+		return 1;
+	}
+
+	m = &queue[queue_in];
+	m->chain = chain;
+	m->slot = slot;
+	e = &m->e;
+	memset( e, 0, sizeof *e );
+	e->type = type;
+	memcpy( e->p, p, sizeof e->p );
+
+	switch( type ) {
+	case EFFECT_EQ: {
+		int shape = (int)clamp( p[0], 0.0f, 2.0f );
+		float f = clamp( p[1], 20.0f, sample_rate * 0.45f );
+		float A = powf( 10.0f, clamp( p[2], -24.0f, 24.0f ) / 40.0f );
+		float w = 2.0f * (float)M_PI * f / sample_rate, cw = cosf( w );
+		float alpha = sinf( w ) / (2.0f * clamp( p[3], 0.1f, 20.0f ));
+		float sa = 2.0f * sqrtf( A ) * alpha, a0;
+
+		if( shape == 0 ) {
+			e->b0 = A * ((A + 1) - (A - 1) * cw + sa);
+			e->b1 = 2 * A * ((A - 1) - (A + 1) * cw);
+			e->b2 = A * ((A + 1) - (A - 1) * cw - sa);
+			a0 = (A + 1) + (A - 1) * cw + sa;
+			e->a1 = -2 * ((A - 1) + (A + 1) * cw);
+			e->a2 = (A + 1) + (A - 1) * cw - sa;
+		} else if( shape == 1 ) {
+			e->b0 = 1 + alpha * A;
+			e->b1 = -2 * cw;
+			e->b2 = 1 - alpha * A;
+			a0 = 1 + alpha / A;
+			e->a1 = -2 * cw;
+			e->a2 = 1 - alpha / A;
+		} else {
+			e->b0 = A * ((A + 1) + (A - 1) * cw + sa);
+			e->b1 = -2 * A * ((A - 1) + (A + 1) * cw);
+			e->b2 = A * ((A + 1) + (A - 1) * cw - sa);
+			a0 = (A + 1) - (A - 1) * cw + sa;
+			e->a1 = 2 * ((A - 1) - (A + 1) * cw);
+			e->a2 = (A + 1) - (A - 1) * cw - sa;
+		}
+		e->b0 /= a0; e->b1 /= a0; e->b2 /= a0; e->a1 /= a0; e->a2 /= a0;
+		break;
+	}
+	case EFFECT_COMPRESSOR:
+		e->threshold = clamp( p[0], -60.0f, 0.0f );
+		e->slope = 1.0f - 1.0f / clamp( p[1], 1.0f, 20.0f );
+		e->attack = expf( -1000.0f / (clamp( p[2], 0.1f, 500.0f ) * sample_rate) );
+		e->release = expf( -1000.0f / (clamp( p[3], 1.0f, 5000.0f ) * sample_rate) );
+		e->gain = 1.0f;
+		break;
+
+	case EFFECT_DELAY:
+		e->delay = clamp( p[0], 1.0f, DELAY_MAX_MS ) * sample_rate / 1000;
+		if( e->delay == 0 ) e->delay = 1;
+		e->feedback = clamp( p[1], 0.0f, 0.95f );
+		e->wet = clamp( p[2], 0.0f, 1.0f );
+		e->linelen = e->delay;
+		e->line = new float[e->linelen * 2];
+		memset( e->line, 0, e->linelen * 2 * sizeof(float) );
+		break;
+
+	case EFFECT_SEND:
+		e->send = clamp( p[0], 0.0f, 1.0f );
+		break;
+	}
+
+	__sync_synchronize();
+	queue_in = (queue_in + 1) % EFFECT_QUEUE;
+	return 0;
+}
+
+void EffectQueue::apply() {
+	//
+	// process thread: put the queued slots in place. A slot changed to
+	// the same type keeps its state, so a parameter moved while playing
+	// doesn't click, and a delay of the same length keeps its line
+	//
+	while( queue_out != queue_in ) {
+		__sync_synchronize();
+		struct effect_message *m = &queue[queue_out];
+		float *drop = NULL;
+
+		if( m->chain == NULL ) 
+			reverb.set( m->e.p );
+		else if( m->slot >= 0 ) {
+			struct effect *old = &m->chain->slot[m->slot], *e = &m->e;
+
+			drop = old->line;
+			if( old->type == e->type ) {
+				memcpy( e->z, old->z, sizeof e->z );
+				e->envelope = old->envelope;
+				e->gain = old->gain;
+				if( old->line && old->linelen == e->linelen ) {
+					drop = e->line;
+					e->line = old->line;
+					e->pos = old->pos;
+				}
+			}
+			*old = *e;
+
+			m->chain->active = false;
+			for( int i = 0; i < EFFECT_SLOTS; i++ ) 
+				if( m->chain->slot[i].type != EFFECT_NONE ) m->chain->active = true;
+		} else 
+			drop = m->e.line;
+
+		if( drop ) {
+			if( (retired_in + 1) % EFFECT_QUEUE == retired_out ) 
+				delete[] drop;
+			else {
+				retired[retired_in] = drop;
+				__sync_synchronize();
+				retired_in = (retired_in + 1) % EFFECT_QUEUE;
+			}
+		}
+		queue_out = (queue_out + 1) % EFFECT_QUEUE;
+	}
+}
+
+void EffectQueue::forget(EffectChain *chain) {
+	//
+	// process thread: the chain is going away, drop anything queued for it
+	//
+	for( unsigned int i = queue_out; i != queue_in; i = (i + 1) % EFFECT_QUEUE ) 
+		if( queue[i].chain == chain ) queue[i].slot = -1;
+}
@@ -0,0 +1,116 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+//
+// EFFECTS
+//
+// insert effects for each track and for the master, and a reverb the tracks
+// send to. A chain is a fixed row of slots, each an EQ band, compressor,
+// delay or reverb send, run in order over a block of frames. Nothing is
+// allocated or computed on the process thread but the audio itself: the
+// control thread works out coefficients and allocates delay lines, and
+// posts the finished slot through a queue process drains each period.
+// Delay lines replaced there go back through a second queue to be freed.
+//
+#define EFFECT_SLOTS		4			// inserts in a chain
+#define EFFECT_QUEUE		64
+
+#define EFFECT_NONE			0
+#define EFFECT_EQ			1			// shape (0 low shelf, 1 peak, 2 high shelf), Hz, dB, Q
+#define EFFECT_COMPRESSOR	2			// threshold dB, ratio, attack ms, release ms
+#define EFFECT_DELAY		3			// ms, feedback, wet
+#define EFFECT_SEND			4			// level sent to the reverb
+#define EFFECT_REVERB		5			// room, damping, wet: the reverb itself, not a slot
+#define EFFECT_TYPES		6
+
+#define DELAY_MAX_MS		2000
+#define COMPRESSOR_BLOCK	16			// frames between gain computations
+
+#define REVERB_COMBS		8
+#define REVERB_ALLPASSES	4
+
+struct effect {
+	int type;
+	float p[4];							// as set, see the types
+
+	// EQ, a biquad in transposed direct form II for each channel
+	float b0, b1, b2, a1, a2, z[2][2];
+
+	// compressor, a stereo linked peak follower
+	float threshold, slope, attack, release, envelope, gain;
+
+	// delay, a line of interleaved left and right frames
+	float *line, feedback, wet;
+	unsigned int linelen, delay, pos;
+
+	// reverb send
+	float send;
+};
+
+class EffectChain {
+public:
+	struct effect slot[EFFECT_SLOTS];
+	bool active;						// any slot in use
+
+	EffectChain();
+	~EffectChain();
+	void run(float *, float *, unsigned int, float *, float *);
+};
+
+class Reverb {
+
+	float *comb[2][REVERB_COMBS], *allpass[2][REVERB_ALLPASSES], store[2][REVERB_COMBS];
+	unsigned int comblen[2][REVERB_COMBS], allpasslen[2][REVERB_ALLPASSES];
+	unsigned int combpos[2][REVERB_COMBS], allpasspos[2][REVERB_ALLPASSES];
+	float feedback, damp, wet;
+
+public:
+	bool active;
+
+	Reverb();
+	~Reverb();
+	void init(jack_nframes_t);
+	void set(float *);
+	void run(float *, float *, float *, float *, unsigned int);
+};
+
+class EffectQueue {
+
+	struct effect_message {
+		EffectChain *chain;				// NULL for the reverb
+		int slot;
+		struct effect e;
+	} queue[EFFECT_QUEUE];
+	volatile unsigned int queue_in, queue_out;
+	float *retired[EFFECT_QUEUE];
+	volatile unsigned int retired_in, retired_out;
+	jack_nframes_t sample_rate;
+
+public:
+	Reverb reverb;
+
+	EffectQueue();
+	void init(jack_nframes_t);
+	int post(EffectChain *, int, int, float *);
+	void apply();
+	void forget(EffectChain *);
+};
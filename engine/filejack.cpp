@@ -0,0 +1,415 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#include <jack/thread.h>
+#include <jack/statistics.h>
+#include "filejack.h"
+
+//
+//	FILEJACK.CPP
+//
+
+struct midi_buffer {
+	unsigned int count, used;
+	jack_midi_event_t events[FILEJACK_EVENTS];
+	jack_midi_data_t data[FILEJACK_MIDI_BYTES];
+};
+
+struct _jack_port {
+	char name[FILEJACK_NAME];
+	unsigned long flags;
+	bool used, midi;
+	void *buffer;
+};
+
+struct _jack_client {
+	char name[FILEJACK_NAME];
+	JackProcessCallback process;
+	void *process_arg;
+	JackThreadInitCallback thread_init;
+	void *thread_init_arg;
+	JackLatencyCallback latency;
+	void *latency_arg;
+	jack_transport_state_t transport;
+	jack_nframes_t frames;			// run before this period
+	bool active, started;
+	struct _jack_port ports[FILEJACK_PORTS];
+};
+
+static jack_client_t *the_client = NULL;
+static jack_nframes_t sample_rate = 48000, period = 1024;
+static char physical_names[2][FILEJACK_PHYSICAL][24];
+
+int filejack_setup(jack_nframes_t rate, jack_nframes_t frames) {
+	//
+	// the rate and the most frames in a period, before the client opens
+	//
+	if( the_client || rate == 0 || frames == 0 ) return 1;
+	sample_rate = rate;
+	period = frames;
+	return 0;
+}
+
+int filejack_cycle(jack_nframes_t nframes) {
+	//
+	// one period, the process thread being whichever thread calls this
+	//
+	jack_client_t *client = the_client;
+	int i, ret;
+
+	if( client == NULL || !client->active || client->process == NULL || nframes > period ) return -1;
+
+	if( !client->started ) {
+		if( client->thread_init ) client->thread_init( client->thread_init_arg );
+		client->started = true;
+	}
+
+	// what was sent out last period is gone
+	for( i = 0; i < FILEJACK_PORTS; i++ )
+		if( client->ports[i].used && client->ports[i].midi && (client->ports[i].flags & JackPortIsOutput) )
+			jack_midi_clear_buffer( client->ports[i].buffer );
+
+	ret = client->process( nframes, client->process_arg );
+	client->frames += nframes;
+	return ret;
+}
+
+//
+// the client
+//
+
+jack_client_t *jack_client_open(const char *client_name, jack_options_t options, jack_status_t *status, ...) {
+
+	if( status ) *status = (jack_status_t)0;
+	if( the_client ) {
+		if( status ) *status = JackServerFailed;
+		return NULL;
+	}
+	the_client = new jack_client_t;
+	memset( the_client, 0, sizeof *the_client );
+	strncpy( the_client->name, client_name, FILEJACK_NAME - 1 );
+	the_client->transport = JackTransportStopped;
+	return the_client;
+}
+
+int jack_client_close(jack_client_t *client) {
+
+	for( int i = 0; i < FILEJACK_PORTS; i++ )
+		if( client->ports[i].used ) jack_port_unregister( client, &client->ports[i] );
+	delete client;
+	the_client = NULL;
+	return 0;
+}
+
+char *jack_get_client_name(jack_client_t *client) {
+
+	return client->name;
+}
+
+int jack_set_process_callback(jack_client_t *client, JackProcessCallback callback, void *arg) {
+
+	client->process = callback;
+	client->process_arg = arg;
+	return 0;
+}
+
+int jack_set_thread_init_callback(jack_client_t *client, JackThreadInitCallback callback, void *arg) {
+
+	client->thread_init = callback;
+	client->thread_init_arg = arg;
+	return 0;
+}
+
+int jack_set_latency_callback(jack_client_t *client, JackLatencyCallback callback, void *arg) {
+
+	client->latency = callback;
+	client->latency_arg = arg;
+	return 0;
+}
+
+int jack_set_xrun_callback(jack_client_t *client, JackXRunCallback callback, void *arg) {
+	// nothing is ever late
+	return 0;
+}
+
+int jack_set_buffer_size_callback(jack_client_t *client, JackBufferSizeCallback callback, void *arg) {
+	// the period is set once before the client opens
+	return 0;
+}
+
+void jack_on_shutdown(jack_client_t *client, JackShutdownCallback callback, void *arg) {
+}
+
+int jack_activate(jack_client_t *client) {
+	//
+	// the latencies are known once the client is running, here they are all none
+	//
+	client->active = true;
+	if( client->latency ) {
+		client->latency( JackCaptureLatency, client->latency_arg );
+		client->latency( JackPlaybackLatency, client->latency_arg );
+	}
+	return 0;
+}
+
+jack_nframes_t jack_get_sample_rate(jack_client_t *client) {
+
+	return sample_rate;
+}
+
+jack_nframes_t jack_get_buffer_size(jack_client_t *client) {
+
+	return period;
+}
+
+float jack_cpu_load(jack_client_t *client) {
+
+	return 0.0f;
+}
+
+float jack_get_xrun_delayed_usecs(jack_client_t *client) {
+
+	return 0.0f;
+}
+
+//
+// ports
+//
+
+jack_port_t *jack_port_register(jack_client_t *client, const char *port_name, const char *port_type, 
+	unsigned long flags, unsigned long buffer_size) {
+
+	char name[FILEJACK_NAME];
+	jack_port_t *port = NULL;
+	int i;
+
+	if( snprintf( name, FILEJACK_NAME, "%s:%s", client->name, port_name ) >= FILEJACK_NAME ) return NULL;
+	for( i = 0; i < FILEJACK_PORTS; i++ ) {
+		if( !client->ports[i].used ) {
+			if( port == NULL ) port = &client->ports[i];
+		} else if( strcmp( client->ports[i].name, name ) == 0 ) return NULL;
+	}
+	if( port == NULL ) return NULL;
+
+	strcpy( port->name, name );
+	port->flags = flags;
+	port->midi = strcmp( port_type, JACK_DEFAULT_MIDI_TYPE ) == 0;
+	if( port->midi ) {
+		port->buffer = new struct midi_buffer;
+		jack_midi_clear_buffer( port->buffer );
+	} else {
+		port->buffer = new jack_default_audio_sample_t[period];
+		memset( port->buffer, 0, period * sizeof(jack_default_audio_sample_t) );
+	}
+	port->used = true;
+	return port;
+}
+
+int jack_port_unregister(jack_client_t *client, jack_port_t *port) {
+
+	if( !port->used ) return 1;
+	if( port->midi ) delete (struct midi_buffer *)port->buffer;
+	else delete[] (jack_default_audio_sample_t *)port->buffer;
+	port->buffer = NULL;
+	port->used = false;
+	return 0;
+}
+
+jack_port_t *jack_port_by_name(jack_client_t *client, const char *port_name) {
+	//
+	// by its full name or the one it was registered with
+	//
+	int n = strlen( client->name );
+
+	for( int i = 0; i < FILEJACK_PORTS; i++ ) {
+		if( !client->ports[i].used ) continue;
+		if( strcmp( client->ports[i].name, port_name ) == 0 || 
+			strcmp( client->ports[i].name + n + 1, port_name ) == 0 ) return &client->ports[i];
+	}
+	return NULL;
+}
+
+void *jack_port_get_buffer(jack_port_t *port, jack_nframes_t nframes) {
+
+	return port->buffer;
+}
+
+const char *jack_port_name(const jack_port_t *port) {
+
+	return port->name;
+}
+
+void jack_port_get_latency_range(jack_port_t *port, jack_latency_callback_mode_t mode, jack_latency_range_t *range) {
+
+	range->min = range->max = 0;
+}
+
+const char **jack_get_ports(jack_client_t *client, const char *port_name_pattern, const char *type_name_pattern, 
+	unsigned long flags) {
+	//
+	// only the system ports are asked for, as many as anyone would connect to
+	//
+	const char **ports;
+	int i, n = flags & JackPortIsInput ? 1 : 0;
+
+	if( !(flags & JackPortIsPhysical) ) return NULL;
+	ports = (const char **)malloc( (FILEJACK_PHYSICAL + 1) * sizeof(char *) );
+	for( i = 0; i < FILEJACK_PHYSICAL; i++ ) {
+		snprintf( physical_names[n][i], sizeof physical_names[n][i], 
+			n ? "system:playback_%d" : "system:capture_%d", i + 1 );
+		ports[i] = physical_names[n][i];
+	}
+	ports[i] = NULL;
+	return ports;
+}
+
+int jack_connect(jack_client_t *client, const char *source_port, const char *destination_port) {
+
+	return 0;
+}
+
+void jack_free(void *p) {
+
+	free( p );
+}
+
+//
+// midi buffers
+//
+
+uint32_t jack_midi_get_event_count(void *port_buffer) {
+
+	return ((struct midi_buffer *)port_buffer)->count;
+}
+
+int jack_midi_event_get(jack_midi_event_t *event, void *port_buffer, uint32_t event_index) {
+
+	struct midi_buffer *b = (struct midi_buffer *)port_buffer;
+
+	if( event_index >= b->count ) return ENODATA;
+	*event = b->events[event_index];
+	return 0;
+}
+
+void jack_midi_clear_buffer(void *port_buffer) {
+
+	struct midi_buffer *b = (struct midi_buffer *)port_buffer;
+
+	b->count = b->used = 0;
+}
+
+int jack_midi_event_write(void *port_buffer, jack_nframes_t time, const jack_midi_data_t *data, size_t data_size) {
+	//
+	// as JACK has it, the events of a period go in in order of time
+	//
+	struct midi_buffer *b = (struct midi_buffer *)port_buffer;
+	jack_midi_event_t *e;
+
+	if( time >= period || (b->count && time < b->events[b->count - 1].time) ) return EINVAL;
+	if( b->count == FILEJACK_EVENTS || b->used + data_size > FILEJACK_MIDI_BYTES ) return ENOBUFS;
+
+	e = &b->events[b->count++];
+	e->time = time;
+	e->size = data_size;
+	e->buffer = b->data + b->used;
+	memcpy( e->buffer, data, data_size );
+	b->used += data_size;
+	return 0;
+}
+
+//
+// time and transport, the time being the frames run so far
+//
+
+jack_time_t jack_frames_to_time(const jack_client_t *client, jack_nframes_t frames) {
+
+	return (jack_time_t)frames * 1000000 / sample_rate;
+}
+
+jack_nframes_t jack_last_frame_time(const jack_client_t *client) {
+
+	return client->frames;
+}
+
+jack_nframes_t jack_frame_time(const jack_client_t *client) {
+
+	return client->frames;
+}
+
+jack_time_t jack_get_time() {
+
+	return the_client ? jack_frames_to_time( the_client, the_client->frames ) : 0;
+}
+
+jack_transport_state_t jack_transport_query(const jack_client_t *client, jack_position_t *pos) {
+
+	if( pos ) {
+		memset( pos, 0, sizeof *pos );
+		pos->frame = client->frames;
+		pos->frame_rate = sample_rate;
+	}
+	return client->transport;
+}
+
+void jack_transport_start(jack_client_t *client) {
+
+	client->transport = JackTransportRolling;
+}
+
+void jack_transport_stop(jack_client_t *client) {
+
+	client->transport = JackTransportStopped;
+}
+
+//
+// threads, the mixing threads run like any others
+//
+
+int jack_client_real_time_priority(jack_client_t *client) {
+
+	return -1;
+}
+
+int jack_is_realtime(jack_client_t *client) {
+
+	return 0;
+}
+
+int jack_client_create_thread(jack_client_t *client, jack_native_thread_t *thread, int priority, int realtime, 
+	void *(*start_routine)(void *), void *arg) {
+
+	return pthread_create( thread, NULL, start_routine, arg );
+}
+
+int jack_client_stop_thread(jack_client_t *client, jack_native_thread_t thread) {
+
+	pthread_cancel( thread );
+	return pthread_join( thread, NULL );
+}
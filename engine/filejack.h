@@ -0,0 +1,39 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+//
+// FILEJACK
+//
+// the JACK client calls the engine makes, answered without a server so the
+// engine can be run from files. There is one client and no connections: a
+// port's buffer is filled and read with the usual calls, jack_port_by_name
+// finds the engine's ports, and filejack_cycle runs the process callback
+// for one period. The clock is the frames run so far, so a run repeats
+// exactly.
+//
+#define FILEJACK_PORTS		64
+#define FILEJACK_PHYSICAL	16			// system capture and playback ports offered
+#define FILEJACK_NAME		64
+#define FILEJACK_EVENTS		512			// midi events a port holds in a period
+#define FILEJACK_MIDI_BYTES	8192
+
+extern int filejack_setup(jack_nframes_t, jack_nframes_t), filejack_cycle(jack_nframes_t);
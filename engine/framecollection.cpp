@@ -23,12 +23,15 @@ SOFTWARE.
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h> 
+#include <pthread.h>
+#include <semaphore.h>
 
 #include <jack/jack.h>
 #include <jack/midiport.h>
 #include <zlib.h>
 
 #include "framecollection.h"
+#include "arena.h"
 
 //
 //	FRAMECOLLECTION
@@ -41,15 +44,186 @@ SOFTWARE.
 //	which will later become attached to a track.
 //
 
+// what every silent channel points at, never written
+static jack_default_audio_sample_t silence[SILENCE_FRAMES];
+
+// what squeeze packs the channels to, set from the config
+int FrameCollection::precision = PRECISION_F32;
+
+// the bytes a frame takes at each precision
+static const int packed_size[] = { 4, 2, 3 };
+
+static unsigned dither_seed = 1;
+
+static unsigned short float_to_half( float f ) {
+	//
+	// to the nearest 16 bit float, ties to even
+	//
+	union { float f; unsigned u; } v;
+	unsigned sign, mant, half, rest;
+	int e, shift;
+
+	v.f = f;
+	sign = v.u >> 16 & 0x8000;
+	mant = v.u & 0x7fffff;
+	e = (int)(v.u >> 23 & 0xff) - 127 + 15;
+
+	if( e == 0xff - 127 + 15 ) return sign | 0x7c00 | (mant ? 0x200 : 0);
+	if( e >= 31 ) return sign | 0x7c00;
+	if( e <= 0 ) {
+		// too quiet for the exponent, a denormal or nothing
+		if( e < -10 ) return sign;
+		mant |= 0x800000;
+		shift = 14 - e;
+		half = mant >> shift;
+		rest = mant & ((1 << shift) - 1);
+		if( rest > 1u << (shift - 1) || (rest == 1u << (shift - 1) && (half & 1)) ) half++;
+		return sign | half;
+	}
+	half = sign | e << 10 | mant >> 13;
+	rest = mant & 0x1fff;
+	// a carry out of the mantissa rounds up the exponent as it should
+	if( rest > 0x1000 || (rest == 0x1000 && (half & 1)) ) half++;
+	return half;
+}
+
+static float half_to_float( unsigned short h ) {
+
+	union { float f; unsigned u; } v;
+	unsigned sign = (h & 0x8000) << 16, e = h >> 10 & 0x1f, mant = h & 0x3ff;
+
+	if( e == 0x1f ) 
+		v.u = sign | 0x7f800000 | mant << 13;
+	else if( e ) 
+		v.u = sign | (e + 127 - 15) << 23 | mant << 13;
+	else {
+		v.f = mant * (1.0f / 16777216.0f);
+		v.u |= sign;
+	}
+	return v.f;
+}
+
+static void pack_frames( jack_default_audio_sample_t *f, int packing, jack_nframes_t nframes, unsigned char *p ) {
+	//
+	// 24 bit frames get a triangular dither of one step, 16 bit floats
+	// keep their error relative to the signal and are just rounded
+	//
+	unsigned short *h = (unsigned short *)p;
+	unsigned seed;
+	float x, d;
+	int s;
+
+	if( packing == PRECISION_F16 ) {
+		while( nframes-- ) *h++ = float_to_half( *f++ );
+		return;
+	}
+
+	seed = __sync_add_and_fetch( &dither_seed, 0x9e3779b9 );
+	while( nframes-- ) {
+		seed = seed * 1664525 + 1013904223;
+		d = (seed >> 8) * (1.0f / 16777216.0f);
+		seed = seed * 1664525 + 1013904223;
+		d -= (seed >> 8) * (1.0f / 16777216.0f);
+		x = *f++ * 8388608.0f + d;
+		s = (int)(x < 0.0f ? x - 0.5f : x + 0.5f);
+		if( x >= 8388607.0f ) s = 8388607;
+		if( x <= -8388608.0f ) s = -8388608;
+		*p++ = s;
+		*p++ = s >> 8;
+		*p++ = s >> 16;
+	}
+}
+
+static void unpack_frames( jack_default_audio_sample_t *frames, int packing, jack_nframes_t from, jack_nframes_t count, 
+		jack_default_audio_sample_t *out ) {
+	//
+	// count frames from frame from of a packed channel back into floats
+	//
+	unsigned short *h = (unsigned short *)frames + from;
+	unsigned char *p = (unsigned char *)frames + from * 3;
+
+	if( packing == PRECISION_F16 ) {
+		while( count-- ) *out++ = half_to_float( *h++ );
+		return;
+	}
+	while( count-- ) {
+		*out++ = (p[0] | p[1] << 8 | (signed char)p[2] << 16) * (1.0f / 8388608.0f);
+		p += 3;
+	}
+}
+
+//
+// the frames of every channel come from the arena, at the size they are packed to
+//
+static jack_default_audio_sample_t *new_channel( jack_nframes_t nframes, unsigned char packing ) {
+
+	return (jack_default_audio_sample_t *)arena.get( nframes * packed_size[packing] );
+}
+
+static void free_channel( jack_default_audio_sample_t *frames, unsigned char packing, jack_nframes_t nframes ) {
+
+	if( frames == NULL || frames == silence ) return;
+	arena.put( frames, nframes * packed_size[packing] );
+}
+
+static bool squeeze_channel( jack_default_audio_sample_t **frames, unsigned char *packing, jack_nframes_t nframes ) {
+	//
+	// let the buffer go if every frame is under the floor. True if it did
+	//
+	jack_default_audio_sample_t *f = *frames;
+	jack_nframes_t i;
+
+	if( f == NULL || f == silence || *packing != PRECISION_F32 || nframes > SILENCE_FRAMES ) return false;
+	for( i = 0; i < nframes; i++ ) 
+		if( f[i] > SILENCE_FLOOR || f[i] < -SILENCE_FLOOR ) return false;
+	free_channel( f, PRECISION_F32, nframes );
+	*frames = silence;
+	return true;
+}
+
+static void pack_channel( jack_default_audio_sample_t **frames, unsigned char *packing, jack_nframes_t nframes ) {
+	//
+	// keep the frames at the session's precision, once they are all there
+	//
+	jack_default_audio_sample_t *p;
+	int to = FrameCollection::precision;
+
+	if( *frames == NULL || *frames == silence || *packing != PRECISION_F32 || to == PRECISION_F32 ) return;
+	p = new_channel( nframes, to );
+	pack_frames( *frames, to, nframes, (unsigned char *)p );
+	free_channel( *frames, PRECISION_F32, nframes );
+	*frames = p;
+	*packing = to;
+}
+
+static void expand_channel( jack_default_audio_sample_t **frames, unsigned char *packing, jack_nframes_t nframes ) {
+	//
+	// floats of its own for a silent or packed channel
+	//
+	jack_default_audio_sample_t *f;
+
+	if( *frames == silence ) {
+		*frames = new_channel( nframes, PRECISION_F32 );
+		memset( *frames, 0, sizeof(jack_default_audio_sample_t) * nframes );
+	} else if( *frames && *packing != PRECISION_F32 ) {
+		f = new_channel( nframes, PRECISION_F32 );
+		unpack_frames( *frames, *packing, 0, nframes, f );
+		free_channel( *frames, *packing, nframes );
+		*frames = f;
+	}
+	*packing = PRECISION_F32;
+}
+
 FrameCollection::FrameCollection(jack_nframes_t	nf, bool createleft, bool createright) {
 	//
 	// possibly allocate space for sample buffers,  but don't initialize
 	//
-	frames_left = frames_right = NULL;
+	frames_left = frames_right = unpacked = NULL;
+	precision_left = precision_right = PRECISION_F32;
 	if( createleft ) 
-		frames_left = new jack_default_audio_sample_t[nf];
+		frames_left = new_channel( nf, PRECISION_F32 );
 	if( createright )
-		frames_right = new jack_default_audio_sample_t[nf];
+		frames_right = new_channel( nf, PRECISION_F32 );
 	nframes = nf;
 	next = prev = NULL;
 	events = NULL;
@@ -59,9 +233,10 @@ FrameCollection::FrameCollection(jack_nframes_t	nf, bool createleft, bool create
 FrameCollection::~FrameCollection() {
 
 	if( nframes ) {
-		if( frames_left ) delete[] frames_left;
-		if( frames_right) delete[] frames_right;
+		free_channel( frames_left, precision_left, nframes );
+		free_channel( frames_right, precision_right, nframes );
 	}
+	delete[] unpacked;
 
 	if( nevents ) {
 		jack_midi_event_t *e = events;
@@ -85,8 +260,9 @@ void FrameCollection::zero() {
 	while( count-- ) 
 		*framef_left++ = *framef_right++ = 0.0f;
 #else
-	if( frames_left ) 	memset(frames_left, 0, sizeof(jack_default_audio_sample_t) * nframes );
-	if( frames_right ) 	memset(frames_right, 0, sizeof(jack_default_audio_sample_t) * nframes );
+	// nothing packs to anything but zero bytes
+	if( frames_left && frames_left != silence ) 	memset(frames_left, 0, packed_size[precision_left] * nframes );
+	if( frames_right && frames_right != silence ) 	memset(frames_right, 0, packed_size[precision_right] * nframes );
 #endif
 
 	if( nevents ) {
@@ -102,6 +278,32 @@ void FrameCollection::zero() {
 	}
 }
 
+void FrameCollection::squeeze() {
+	//
+	// let go of any channel that is silent and pack the others, once it has all its frames
+	//
+	squeeze_channel( &frames_left, &precision_left, nframes );
+	squeeze_channel( &frames_right, &precision_right, nframes );
+	pack_channel( &frames_left, &precision_left, nframes );
+	pack_channel( &frames_right, &precision_right, nframes );
+}
+
+void FrameCollection::expand() {
+	//
+	// give a silent or packed channel its own floats again, before they are written to
+	//
+	expand_channel( &frames_left, &precision_left, nframes );
+	expand_channel( &frames_right, &precision_right, nframes );
+}
+
+bool FrameCollection::silent_left() {
+	return frames_left == silence;
+}
+
+bool FrameCollection::silent_right() {
+	return frames_right == silence;
+}
+
 //
 // these next set of functions copy audio and midi data in and out of the collection
 // they are passed the jack buffer pointers and number of frames in the sample
@@ -109,25 +311,33 @@ void FrameCollection::zero() {
 
 int FrameCollection::copyin_left(jack_default_audio_sample_t *in, jack_nframes_t nframes)
 {
+	expand_channel( &frames_left, &precision_left, this->nframes );
 	memcpy (frames_left, in, sizeof (jack_default_audio_sample_t) * nframes);
 	return 0;
 } 
 
 int FrameCollection::copyin_right(jack_default_audio_sample_t *in, jack_nframes_t nframes)
 {
+	expand_channel( &frames_right, &precision_right, this->nframes );
 	memcpy (frames_right, in, sizeof (jack_default_audio_sample_t) * nframes);
 	return 0;
 } 
 
 int FrameCollection::copyout_left(jack_default_audio_sample_t *out, jack_nframes_t nframes)
 {
-	memcpy (out, frames_left, sizeof (jack_default_audio_sample_t) * nframes);
+	if( precision_left != PRECISION_F32 ) 
+		unpack_frames( frames_left, precision_left, 0, nframes, out );
+	else
+		memcpy (out, frames_left, sizeof (jack_default_audio_sample_t) * nframes);
 	return 0;
 }
 
 int FrameCollection::copyout_right(jack_default_audio_sample_t *out, jack_nframes_t nframes)
 {
-	memcpy (out, frames_right, sizeof (jack_default_audio_sample_t) * nframes);
+	if( precision_right != PRECISION_F32 ) 
+		unpack_frames( frames_right, precision_right, 0, nframes, out );
+	else
+		memcpy (out, frames_right, sizeof (jack_default_audio_sample_t) * nframes);
 	return 0;
 }
 
@@ -220,6 +430,36 @@ jack_default_audio_sample_t *FrameCollection::get_frames_right() {
 	return frames_right;
 }
 
+jack_default_audio_sample_t *FrameCollection::peek_left( jack_default_audio_sample_t *scratch, jack_nframes_t from, jack_nframes_t count ) {
+	//
+	// count floats from frame from, unpacked into scratch if they have to be
+	//
+	if( frames_left == NULL || precision_left == PRECISION_F32 ) 
+		return frames_left ? frames_left + from : NULL;
+	unpack_frames( frames_left, precision_left, from, count, scratch );
+	return scratch;
+}
+
+jack_default_audio_sample_t *FrameCollection::peek_right( jack_default_audio_sample_t *scratch, jack_nframes_t from, jack_nframes_t count ) {
+
+	if( frames_right == NULL || precision_right == PRECISION_F32 ) 
+		return frames_right ? frames_right + from : NULL;
+	unpack_frames( frames_right, precision_right, from, count, scratch );
+	return scratch;
+}
+
+jack_default_audio_sample_t *FrameCollection::unpack_out( jack_default_audio_sample_t *frames, unsigned char packing ) {
+	//
+	// the floats of a channel to be written out, a packed one is unpacked
+	// into a buffer kept until the writing is done
+	//
+	if( packing == PRECISION_F32 ) return frames;
+	delete[] unpacked;
+	unpacked = new jack_default_audio_sample_t[nframes];
+	unpack_frames( frames, packing, 0, nframes, unpacked );
+	return unpacked;
+}
+
 jack_midi_event_t *FrameCollection::get_events() {
 	return events;
 }
@@ -228,10 +468,15 @@ jack_nframes_t FrameCollection::get_nevents() {
 	return nevents;
 }
 
+jack_nframes_t FrameCollection::get_nframes() {
+	return nframes;
+}
+
 void FrameCollection::insert_midi_event( jack_midi_event_t *e, int channel, float volume ) {
 	//
 	// insert a midi event into the midi event buffer of this collection.
-	// the buffer must be order by event offset for jack's sake.
+	// the buffer must be order by event offset for jack's sake, events at 
+	// the same offset stay in the order they were inserted.
 	//
 	// while we are at it, OR in the channel passed  to the midi event and apply the volume
 	//
@@ -259,7 +504,7 @@ void FrameCollection::insert_midi_event( jack_midi_event_t *e, int channel, floa
 	} else {
 		// look for place to insert
 		for( n=0; n<nevents; n++ ) 
-			if( events[n].time < e->time )
+			if( events[n].time <= e->time )
 				// copy the old event over
 				new_events[n] = events[n];
 			else {
@@ -306,12 +551,14 @@ void FrameCollection::insert_midi_event( jack_midi_event_t *e, int channel, floa
 int FrameCollection::write_left( z_stream *strm, bool continue_collection ) {
 
 	if( !continue_collection ) {			
-		strm->next_in = (unsigned char *)frames_left;
+		strm->next_in = (unsigned char *)unpack_out( frames_left, precision_left );
 		strm->avail_in = sizeof( jack_default_audio_sample_t ) * nframes;
 	}
 	//fprintf(stderr, "0: avail_in=%d avail_out=%d ", strm->avail_in, strm->avail_out );
 	if( deflate( strm, Z_NO_FLUSH ) == Z_STREAM_ERROR ) {
 		fprintf(stderr, "write_left: stream error\n" );
+		delete[] unpacked;
+		unpacked = NULL;
 		return 0;
 	}
 	//fprintf(stderr, "1: avail_in=%d avail_out=%d ", strm->avail_in, strm->avail_out );
@@ -319,29 +566,39 @@ int FrameCollection::write_left( z_stream *strm, bool continue_collection ) {
 		// call for a continuation of this collection
 		return -1;
 	}
+	// deflate has taken it all in
+	delete[] unpacked;
+	unpacked = NULL;
 	return 1;
 }
 
 int FrameCollection::write_right( z_stream *strm, bool continue_collection ) {
 
 	if( !continue_collection ) {			
-		strm->next_in = (unsigned char *)frames_right;
+		strm->next_in = (unsigned char *)unpack_out( frames_right, precision_right );
 		strm->avail_in = sizeof( jack_default_audio_sample_t ) * nframes;
 	}
 	if( deflate( strm, Z_NO_FLUSH ) == Z_STREAM_ERROR ) {
 		fprintf(stderr, "write_right: stream error\n" );
+		delete[] unpacked;
+		unpacked = NULL;
 		return 0;
 	}
 	if( strm->avail_in > 0 ) {
 		// call for a continuation of this collection
 		return -1;
 	}
+	// deflate has taken it all in
+	delete[] unpacked;
+	unpacked = NULL;
 	return 1;
 }
 
 int FrameCollection::write_left( int fd ) {
 
-	write( fd, frames_left, sizeof( jack_default_audio_sample_t ) * nframes );
+	write( fd, unpack_out( frames_left, precision_left ), sizeof( jack_default_audio_sample_t ) * nframes );
+	delete[] unpacked;
+	unpacked = NULL;
 
 	//fprintf(stderr, "wrote %d frames from collection" , nframes );
 	return 1;
@@ -349,7 +606,9 @@ int FrameCollection::write_left( int fd ) {
 
 int FrameCollection::write_right( int fd ) {
 
-	write( fd, frames_right, sizeof( jack_default_audio_sample_t ) * nframes );
+	write( fd, unpack_out( frames_right, precision_right ), sizeof( jack_default_audio_sample_t ) * nframes );
+	delete[] unpacked;
+	unpacked = NULL;
 
 	//fprintf(stderr, "wrote %d frames from collection" , nframes );
 	return 1;
@@ -357,6 +616,7 @@ int FrameCollection::write_right( int fd ) {
 
 int FrameCollection::read_left( z_stream *strm, unsigned *count ) {
 
+	expand_channel( &frames_left, &precision_left, nframes );
 	strm->next_out = (unsigned char *)frames_left;
 	strm->avail_out = sizeof(jack_default_audio_sample_t) * nframes;
 	
@@ -373,6 +633,8 @@ int FrameCollection::read_left( z_stream *strm, unsigned *count ) {
 				fprintf(stderr, "read_left: failure to read complete collection\n");
 			if( count ) 
 				*count = sizeof(jack_default_audio_sample_t) * nframes - strm->avail_out;
+			if( !squeeze_channel( &frames_left, &precision_left, nframes ) ) 
+				pack_channel( &frames_left, &precision_left, nframes );
 			return 2;
 	}
 
@@ -381,12 +643,15 @@ int FrameCollection::read_left( z_stream *strm, unsigned *count ) {
 		
 	if( count ) 
 		*count = sizeof(jack_default_audio_sample_t) * nframes - strm->avail_out;
-	
+
+	if( !squeeze_channel( &frames_left, &precision_left, nframes ) ) 
+		pack_channel( &frames_left, &precision_left, nframes );
 	return 1;
 }
 
 int FrameCollection::read_right( z_stream *strm, unsigned *count ) {
 
+	expand_channel( &frames_right, &precision_right, nframes );
 	strm->next_out = (unsigned char *)frames_right;
 	strm->avail_out = sizeof(jack_default_audio_sample_t) * nframes;
 	
@@ -403,6 +668,8 @@ int FrameCollection::read_right( z_stream *strm, unsigned *count ) {
 				fprintf(stderr, "read_right: failure to read complete collection\n");
 			if( count ) 
 				*count = sizeof(jack_default_audio_sample_t) * nframes - strm->avail_out;
+			if( !squeeze_channel( &frames_right, &precision_right, nframes ) ) 
+				pack_channel( &frames_right, &precision_right, nframes );
 			return 2;
 	}
 
@@ -411,12 +678,15 @@ int FrameCollection::read_right( z_stream *strm, unsigned *count ) {
 
 	if( count ) 
 		*count = sizeof(jack_default_audio_sample_t) * nframes - strm->avail_out;
-			
+
+	if( !squeeze_channel( &frames_right, &precision_right, nframes ) ) 
+		pack_channel( &frames_right, &precision_right, nframes );
 	return 1;
 }
 
 int FrameCollection::read_left( int fd, unsigned *count ) {
 
+	expand_channel( &frames_left, &precision_left, nframes );
 	int readcnt = read( fd, frames_left, sizeof( jack_default_audio_sample_t ) * nframes );
 	if( count ) *count = readcnt;
 	
@@ -429,6 +699,7 @@ int FrameCollection::read_left( int fd, unsigned *count ) {
 
 int FrameCollection::read_right( int fd, unsigned *count ) {
 
+	expand_channel( &frames_right, &precision_right, nframes );
 	int readcnt = read( fd, frames_right, sizeof( jack_default_audio_sample_t ) * nframes );
 	if( count ) *count = readcnt;
 
@@ -27,6 +27,22 @@ SOFTWARE.
 //  Created and filled as an element of a linked list during the recording process,
 //  this linked list is maintained in class Track.
 //
+//	A channel found silent is let go and shares one block of zeros, it is
+//	read and written like any other but costs nothing to keep or mix.
+//
+#define SILENCE_FLOOR	0.00001f	// -100 dB, under any converter's noise
+#define SILENCE_FRAMES	1024		// the longest collection that can be silent
+
+//
+//	A finished channel may also be packed to the session's precision, 16 bit
+//	float or 24 bit integer, and is unpacked a block at a time to be mixed. 
+//	A packed channel's frames are not floats, it has to be read through
+//	peek or copyout, or expanded before it is written to.
+//
+#define PRECISION_F32	0
+#define PRECISION_F16	1
+#define PRECISION_S24	2
+
 struct disk_midi_event {
 	unsigned int collection, time;
 	unsigned char size;
@@ -38,16 +54,24 @@ class FrameCollection {
 	FrameCollection	*next, *prev; 
 	jack_nframes_t nframes, nevents;
 	jack_default_audio_sample_t *frames_left, *frames_right;
+	jack_default_audio_sample_t *unpacked;	// a packed channel being written out
+	unsigned char precision_left, precision_right;
 	jack_midi_event_t *events;
 
+	jack_default_audio_sample_t *unpack_out(jack_default_audio_sample_t*, unsigned char);
+
 public:
 
+	static int precision;	// what squeeze packs to
+
 	FrameCollection(jack_nframes_t, bool, bool);
 	~FrameCollection();
 	FrameCollection *get_next(), *get_prev();
 	jack_default_audio_sample_t  *get_frames_left(), *get_frames_right();
+	jack_default_audio_sample_t  *peek_left(jack_default_audio_sample_t*, jack_nframes_t, jack_nframes_t),
+		*peek_right(jack_default_audio_sample_t*, jack_nframes_t, jack_nframes_t);
 	jack_midi_event_t *get_events();
-	jack_nframes_t get_nevents();
+	jack_nframes_t get_nevents(), get_nframes();
 	int copyin_left(jack_default_audio_sample_t*, jack_nframes_t),
 		copyin_right(jack_default_audio_sample_t*, jack_nframes_t);
 	int copyout_left(jack_default_audio_sample_t* , jack_nframes_t),
@@ -57,6 +81,8 @@ public:
 	void append(FrameCollection **, FrameCollection **);
 	void insert_midi_event(jack_midi_event_t *, int, float);
 	void zero();
+	void squeeze(), expand();
+	bool silent_left(), silent_right();
 	int write_left(int), write_right(int), 
 		write_left(z_stream*, bool), write_right(z_stream*, bool), write_midi(int,int), 
 		read_left(int,unsigned*), read_right(int,unsigned*), 
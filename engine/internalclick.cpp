@@ -21,11 +21,14 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <unistd.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
 #include <fcntl.h>
 #include <zlib.h>
 
@@ -43,262 +46,158 @@ SOFTWARE.
 
 #define BUFFER_LEN 256
 
-InternalClick::InternalClick() {
+//
+// inflate a whole compressed click file into one buffer of samples,
+// returns the number of frames or 0 when there is no usable file
+//
+static unsigned int read_click( const char *name, float **frames ) {
 
-	beathead = downhead = fillhead = beattail = downtail = filltail = playback = NULL;
-	beatcollcount = downcollcount = fillcollcount = playcount = 0;
-	
-	if( config.cinternal == false ) return;
-	
-	volume_left = volume_right = 1.0f;
-	
-	FrameCollection  *fc;
 	char filename[BUFFER_LEN];
-	bool stream_error = false;
-	int fd, cmpcount, uncmpcount = 0, readcnt, loadcount = 0;
-	unsigned cnt, count;
-
-	unsigned char *p, *q, in[ NFRAMES*sizeof( jack_default_audio_sample_t ) ];
+	unsigned char *in, *out = NULL;
+	unsigned int outsize = 0;
+	struct stat st;
 	z_stream s;
-	
+	int fd, ret = Z_OK;
+
+	*frames = NULL;
+	snprintf( filename, BUFFER_LEN, "%s/.loopR/%s", getenv("HOME"), name );
+	if( (fd = open( filename, O_RDONLY )) < 0 ) return 0;
+	if( fstat( fd, &st ) || st.st_size == 0 ) {
+		close( fd );
+		return 0;
+	}
+	in = new unsigned char[st.st_size];
+	if( read( fd, in, st.st_size ) != st.st_size ) {
+		perror( filename );
+		close( fd );
+		delete[] in;
+		return 0;
+	}
+	close( fd );
+
 	s.zalloc = Z_NULL;
 	s.zfree = Z_NULL;
 	s.opaque = Z_NULL;
-	
-	fprintf(stderr, "InternalClick() looking for compressed data files... " ); 
-
-	// read the beat compressed samples
-	s.avail_in = 0;
-	s.next_in = Z_NULL;
-	
-	if( inflateInit( &s ) != Z_OK ) return;
-	
-	strcpy( filename, getenv("HOME")) ;
-	strcat( filename, "/.loopR/beatclick.zz" );
-	fd = open( filename,  O_RDONLY);
-	if( fd > 0 ) {
-		// preload the input for inflate
-		fprintf(stderr, "found beatclick.zz\n" ); 
-		readcnt = read( fd, in, NFRAMES*sizeof( jack_default_audio_sample_t ));
-		s.next_in = in;
-		s.avail_in = readcnt;
-		cmpcount = readcnt;
+	s.next_in = in;
+	s.avail_in = st.st_size;
+	if( inflateInit( &s ) != Z_OK ) {
+		delete[] in;
+		return 0;
+	}
 
-		while( readcnt && !stream_error ) { 
-			fc = new FrameCollection(NFRAMES, true, false);
-			fc->append( &beathead, &beattail );			
-			switch( fc->read_left( &s, &count )) {
-				case  0: stream_error = true; break;
-				case  1: case 2:
-					loadcount++; 
-					uncmpcount += count /* NFRAMES * sizeof( jack_default_audio_sample_t ) */;
-					break;
-			}
-			if( s.avail_in < NFRAMES*sizeof( jack_default_audio_sample_t )) {
-				// relocate any leftover bytes to the front of buffer
-				if( (cnt = s.avail_in) > 0 ) {
-					//fprintf(stderr, "relocating %d bytes, ", cnt );
-					q = s.next_in;
-					p = in;
-					while( cnt-- )
-						*p++ = *q++;
-				}
-				s.next_in = in;
-				// fill out the input buffer for next pass			
-				readcnt = read( fd, in + s.avail_in, NFRAMES*sizeof( jack_default_audio_sample_t ) - s.avail_in );
-				//fprintf(stderr, "read %d additional bytes", readcnt );
-				s.avail_in += readcnt;
-				cmpcount += readcnt;
-			}
-		}
-		// make an adjustment to the last collection
-		if( count < NFRAMES * sizeof( jack_default_audio_sample_t )) {
-			fc->adjustframes( count/sizeof( jack_default_audio_sample_t ) );
-			fprintf(stderr, "adjusting last collection nframes to equal %d\n", 
-				(int) (count/sizeof( jack_default_audio_sample_t )) );
-		} 
-			
-		close( fd );
-		beatcollcount = loadcount;
+	// grow the output until the stream ends
+	while( ret == Z_OK ) {
+		unsigned int size = outsize ? outsize * 2 : NFRAMES * sizeof(float);
+		unsigned char *bigger = new unsigned char[size];
+		if( outsize ) memcpy( bigger, out, outsize );
+		delete[] out;
+		out = bigger;
+		s.next_out = out + s.total_out;
+		s.avail_out = size - s.total_out;
+		outsize = size;
+		ret = inflate( &s, Z_NO_FLUSH );
+		if( ret == Z_BUF_ERROR && s.avail_out == 0 ) ret = Z_OK;
 	}
+	inflateEnd( &s );
+	delete[] in;
 
-	// read the downbeat compressed samples
-	s.avail_in = 0;
-	s.next_in = Z_NULL;
-	
-	if( inflateInit( &s ) != Z_OK ) return;
-	
-	strcpy( filename, getenv("HOME")) ;
-	strcat( filename, "/.loopR/downclick.zz" );
-	loadcount = 0;
-	stream_error = false;
-	fd = open( filename,  O_RDONLY);
-	if( fd > 0 ) {
-		// preload the input for inflate
-		fprintf(stderr, "found downclick.zz\n" ); 
-		readcnt = read( fd, in, NFRAMES*sizeof( jack_default_audio_sample_t ));
-		s.next_in = in;
-		s.avail_in = readcnt;
-		cmpcount = readcnt;
+	if( ret != Z_STREAM_END || s.total_out < sizeof(float) ) {
+		fprintf(stderr, "InternalClick: %s is not a usable click\n", filename );
+		delete[] out;
+		return 0;
+	}
+	fprintf(stderr, "InternalClick: found %s\n", name );
+	*frames = (float *)out;
+	return s.total_out / sizeof(float);
+}
 
-		while( readcnt && !stream_error ) { 
-			fc = new FrameCollection(NFRAMES, true, false);
-			fc->append( &downhead, &downtail );			
-			switch( fc->read_left( &s, &count )) {
-				case  0: stream_error = true; break;
-				case  1: case 2:
-					loadcount++; 
-					uncmpcount += count /* NFRAMES * sizeof( jack_default_audio_sample_t ) */;
-					break;
-			}
-			if( s.avail_in < NFRAMES*sizeof( jack_default_audio_sample_t )) {
-				// relocate any leftover bytes to the front of buffer
-				if( (cnt = s.avail_in) > 0 ) {
-					//fprintf(stderr, "relocating %d bytes, ", cnt );
-					q = s.next_in;
-					p = in;
-					while( cnt-- )
-						*p++ = *q++;
-				}
-				s.next_in = in;
-				// fill out the input buffer for next pass			
-				readcnt = read( fd, in + s.avail_in, NFRAMES*sizeof( jack_default_audio_sample_t ) - s.avail_in );
-				//fprintf(stderr, "read %d additional bytes", readcnt );
-				s.avail_in += readcnt;
-				cmpcount += readcnt;
-			}
+//
+// make up a click: a decaying tone with a short burst of noise on the front
+//
+static unsigned int make_click( float **frames, jack_nframes_t sample_rate, float pitch, float level ) {
+
+	unsigned int n, nframes = sample_rate * CLICK_MILLISECONDS / 1000;
+	float decay = expf( -8.0f / nframes ), envelope = level;
+	unsigned int attack = sample_rate / 2000, seed = 1;
+
+	*frames = (float *) new unsigned char[nframes * sizeof(float)];
+	for( n = 0; n < nframes; n++ ) {
+		float x = sinf( 2.0f * (float)M_PI * pitch * n / sample_rate );
+		if( n < attack ) {
+			seed = seed * 1103515245 + 12345;
+			x += ((seed >> 16) & 0x7fff) / 16384.0f - 1.0f;
+			x *= 0.5f;
 		}
-		// make an adjustment to the last collection
-		if( count < NFRAMES * sizeof( jack_default_audio_sample_t )) {
-			fc->adjustframes( count/sizeof( jack_default_audio_sample_t ) );
-			fprintf(stderr, "adjusting last collection nframes to equal %d\n", 
-				(int)(count/sizeof( jack_default_audio_sample_t )) );
-		} 
-			
-		close( fd );
-		downcollcount = loadcount;
+		(*frames)[n] = x * envelope;
+		envelope *= decay;
 	}
+	return nframes;
+}
 
-	strcpy( filename, getenv("HOME")) ;
-	strcat( filename, "/.loopR/fillclick.zz" );
-	loadcount = 0;
-	stream_error = false;
-	fd = open( filename,  O_RDONLY);
-	if( fd > 0 ) {
-		// preload the input for inflate
-		fprintf(stderr, "found fillclick.zz\n" ); 
-		readcnt = read( fd, in, NFRAMES*sizeof( jack_default_audio_sample_t ));
-		s.next_in = in;
-		s.avail_in = readcnt;
-		cmpcount = readcnt;
+InternalClick::InternalClick() {
 
-		while( readcnt && !stream_error ) { 
-			fc = new FrameCollection(NFRAMES, true, false);
-			fc->append( &fillhead, &filltail );			
-			switch( fc->read_left( &s, &count )) {
-				case  0: stream_error = true; break;
-				case  1: case 2:
-					loadcount++; 
-					uncmpcount += count /* NFRAMES * sizeof( jack_default_audio_sample_t ) */;
-					break;
-			}
-			if( s.avail_in < NFRAMES*sizeof( jack_default_audio_sample_t )) {
-				// relocate any leftover bytes to the front of buffer
-				if( (cnt = s.avail_in) > 0 ) {
-					//fprintf(stderr, "relocating %d bytes, ", cnt );
-					q = s.next_in;
-					p = in;
-					while( cnt-- )
-						*p++ = *q++;
-				}
-				s.next_in = in;
-				// fill out the input buffer for next pass			
-				readcnt = read( fd, in + s.avail_in, NFRAMES*sizeof( jack_default_audio_sample_t ) - s.avail_in );
-				//fprintf(stderr, "read %d additional bytes", readcnt );
-				s.avail_in += readcnt;
-				cmpcount += readcnt;
-			}
-		}
-		// make an adjustment to the last collection
-		if( count < NFRAMES * sizeof( jack_default_audio_sample_t )) {
-			fc->adjustframes( count/sizeof( jack_default_audio_sample_t ) );
-			fprintf(stderr, "adjusting last collection nframes to equal %d\n", 
-				(int)(count/sizeof( jack_default_audio_sample_t )) );
-		} 
-			
-		close( fd );
-		fillcollcount = loadcount;
-	}
-	
-	fprintf(stderr, "InternalClick() beatcount=%d downcount=%d fillcount=%d\n", 
-		beatcollcount, downcollcount, fillcollcount ); 
+	beat.frames = down.frames = fill.frames = playback = NULL;
+	beat.nframes = down.nframes = fill.nframes = remaining = 0;
+	volume_left = volume_right = 1.0f;
 }
 
 InternalClick::~InternalClick() {
 	
-	FrameCollection *fc, *nextfc;
-	
-	fc = beathead;
-	while( fc && beatcollcount-- ) {
-		nextfc = fc->get_next();
-		delete fc;
-		fc = nextfc;
-	}
-	
-	fc = downhead;
-	while( fc && downcollcount-- ) {
-		nextfc = fc->get_next();
-		delete fc;
-		fc = nextfc;
-	}
+	delete[] (unsigned char *)beat.frames;
+	delete[] (unsigned char *)down.frames;
+	delete[] (unsigned char *)fill.frames;
+}
+
+int InternalClick::load( jack_nframes_t sample_rate ) {
+	//
+	// fill the click bank, once we know the sample rate to make up any
+	// click that has no file
+	//
+	if( !(beat.nframes = read_click( "beatclick.zz", &beat.frames )) )
+		beat.nframes = make_click( &beat.frames, sample_rate, 1000.0f, 0.5f );
+	if( !(down.nframes = read_click( "downclick.zz", &down.frames )) )
+		down.nframes = make_click( &down.frames, sample_rate, 1500.0f, 0.7f );
+	if( !(fill.nframes = read_click( "fillclick.zz", &fill.frames )) )
+		fill.nframes = make_click( &fill.frames, sample_rate, 1250.0f, 0.6f );
+
+	fprintf(stderr, "InternalClick() beat=%d down=%d fill=%d frames\n", 
+		beat.nframes, down.nframes, fill.nframes ); 
+	return 0;
+}
+
+void InternalClick::begin(struct click_sound *sound) {
+	playback = sound->frames;
+	remaining = sound->nframes;
 }
 
 void InternalClick::begin_beat() {
-	if( !beatcollcount ) return;
-	playback = beathead;
-	playcount = beatcollcount;
+	begin( &beat );
 }
 
 void InternalClick::begin_down() {
-	if( !downcollcount ) {
-		begin_beat();
-		return;
-	}
-	playback = downhead;
-	playcount = downcollcount;
+	begin( &down );
 }
 
 void InternalClick::begin_fill() {
-	if( !fillcollcount ) {
-		begin_beat();
-		return;
-	}
-	playback = fillhead;
-	playcount = fillcollcount;
+	begin( &fill );
 }
 
-void InternalClick::sum(FrameCollection *f, unsigned count) {
-	
-	// place channel in middle
-	float *sumf_left, *framef_left;
-	float *sumf_right;
-	int cnt = count;
+void InternalClick::sum(FrameCollection *f, unsigned at, unsigned count) {
+	//
+	// sum count frames of the click into f starting at frame at
+	//
+	float *sumf_left, *sumf_right;
 
-	// cast the frame buffers into floats so we can sum them
-	sumf_left = (float *) f->get_frames_left();
-	sumf_right = (float *) f->get_frames_right();
-	framef_left = (float *) playback->get_frames_left();
+	if( count > remaining ) count = remaining;
 
-	// sum all audio frames available while obtaining peak values
-	while( cnt-- && framef_left ) {
-		*sumf_left = *sumf_left + (*framef_left) * volume_left;
-		*sumf_right = *sumf_right + (*framef_left++) * volume_right;
+	// place channel in middle
+	sumf_left = (float *) f->get_frames_left() + at;
+	sumf_right = (float *) f->get_frames_right() + at;
 
-		sumf_left++; sumf_right++;
+	for( unsigned i = 0; i < count; i++ ) {
+		sumf_left[i] += playback[i] * volume_left;
+		sumf_right[i] += playback[i] * volume_right;
 	}
-}
-
-void InternalClick::advance() {
-	playback = playback->get_next();
-	playcount--;
+	playback += count;
+	remaining -= count;
 }
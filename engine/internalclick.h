@@ -23,19 +23,30 @@ SOFTWARE.
 //
 //  Defines an internal click generator
 //
+//  Each click sound is held in one contiguous buffer, loaded from ~/.loopR
+//  or made up when the file is missing, and mixed from a frame cursor so
+//  a click can start on any frame of the period
+//
+#define CLICK_MILLISECONDS	60	// length of a made up click
+
+struct click_sound {
+	float *frames;
+	unsigned int nframes;
+};
+
 class InternalClick {
-	FrameCollection *beathead, *downhead, *fillhead,
-					*beattail, *downtail, *filltail;
-	int beatcollcount, downcollcount, fillcollcount;
+	struct click_sound beat, down, fill;
 	float volume_left, volume_right;
 
+	void begin(struct click_sound *);
+
 public:
-	FrameCollection *playback;
-	int playcount;
+	float *playback;		// next frame of the sounding click
+	unsigned int remaining;	// frames of it still to play
 	InternalClick();
 	~InternalClick();
+	int load(jack_nframes_t);
 	void begin_beat(), begin_down(), begin_fill();
-	void advance();
-	void sum(FrameCollection *, unsigned );
+	void sum(FrameCollection *, unsigned, unsigned );
 	
 	};
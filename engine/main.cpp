@@ -52,6 +52,7 @@ SOFTWARE.
 #include "track.h"
 #include "config.h"
 #include "service.h"
+#include "sync.h"
 #include "core.h"
 
 void interupt_handler( int signal ) {
@@ -74,7 +75,7 @@ void interupt_handler( int signal ) {
 
 pthread_t download_thread_id, upload_thread_id;
 
-bool init_server_request = false;
+bool init_server_request = false, sync_arg = false;
 
 int handleargs(int argc, char *argv[]) {
 
@@ -85,7 +86,8 @@ int handleargs(int argc, char *argv[]) {
 		if( (*argv)[0] == '-' && (*argv)[1] == 'h' ) {
 
 			fprintf( stdout, 
-			"Usage:\n  loopR [-h][-l][-Hclientname][-f]\n  -h	help\n  -l	load files\n  -H	use hosting\n  -i	initialize server\n");
+			"Usage:\n  loopR [-h][-l][-Hclientname][-f][-Sm|-Sf|-So]\n  -h	help\n  -l	load files\n  -H	use hosting\n  -i	initialize server\n"
+			"  -S	sync transport as master (m), follower (f) or not at all (o)\n");
 			return 1;
 		}
 
@@ -97,6 +99,14 @@ int handleargs(int argc, char *argv[]) {
 
 			init_server_request = true;
 
+		if( (*argv)[0] == '-' && (*argv)[1] == 'S' ) {
+
+			if( (*argv)[2] == 'm' ) sync_mode = SYNC_MASTER;
+			else if( (*argv)[2] == 'f' ) sync_mode = SYNC_FOLLOWER;
+			else sync_mode = SYNC_OFF;
+			sync_arg = true;
+		}
+
 		if( (*argv)[0] == '-' && (*argv)[1] == 'H' ) {
 
 			track_hosting = true;
@@ -166,8 +176,15 @@ int main (int argc, char *argv[]) {
 	
 	if( handleargs( argc, argv ) ) return 0;
 
+	// the command line overrides the configured sync mode
+	if( !sync_arg ) {
+		if( strcmp( config.syncmode, "master" ) == 0 ) sync_mode = SYNC_MASTER;
+		else if( strcmp( config.syncmode, "follower" ) == 0 ) sync_mode = SYNC_FOLLOWER;
+	}
+
 	if( track_hosting ) {
 		
+		service_init();
 		if( init_server_request ) {
 			
 			network.putter_init(config.trackput, config.trackhost);
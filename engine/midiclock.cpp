@@ -0,0 +1,213 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <zlib.h>
+
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#include "../common/network.h"
+#include "../common/udpstruct.h"
+#include "framecollection.h"
+#include "internalclick.h"
+#include "state.h"
+#include "section.h"
+#include "track.h"
+#include "config.h"
+#include "core.h"
+#include "midiclock.h"
+
+//
+//	MIDICLOCK.CPP
+//
+//	Clock k of a section of T = divisions * 24 clocks falls on frame
+//
+//		ceil( k * maxframes / T )
+//
+//	the same rounding that starts a division, so clock 24d lands on the
+//	first frame of division d.
+//
+
+MidiClock::MidiClock() {
+
+	running = located = held = false;
+	hold = gate = 0;
+	note = 0;
+}
+
+void MidiClock::write(FrameCollection *f, unsigned int at, unsigned char *buf, int len) {
+
+	jack_midi_event_t event;
+
+	event.time = at;
+	event.size = len;
+	event.buffer = buf;
+	f->insert_midi_event( &event, 0, 1.0f );
+}
+
+void MidiClock::locate() {
+	//
+	// the position jumped, tell the outboard gear where we are now
+	//
+	if( running ) located = true;
+}
+
+void MidiClock::transport(FrameCollection *f, unsigned int at) {
+	//
+	// playing: start the outboard gear, or put it where we are after a jump.
+	// From anywhere but the top of the song, continue from the next sixteenth
+	// and hold back the clocks until then
+	//
+	unsigned char buf[3];
+	unsigned long long clocks;
+	unsigned int position = 0;
+
+	if( !config.midiclock || (running && !located) ) return;
+
+	if( located ) {
+		buf[0] = MIDI_STOP;
+		write( f, at, buf, 1 );
+	}
+	running = true;
+	located = false;
+	hold = 0;
+
+	if( state.current_section == 0 && state.framecount == 0 ) {
+		buf[0] = MIDI_START;
+		write( f, at, buf, 1 );
+		return;
+	}
+
+	for( int s = 0; s < state.current_section; s++ ) 
+		position += sections[s].divisions * CLOCKS_PER_DIVISION / CLOCKS_PER_POSITION;
+
+	// the first clock not before the frame count, rounded up to a sixteenth
+	Section *section = &sections[state.current_section];
+	clocks = ((unsigned long long) state.framecount * section->divisions * CLOCKS_PER_DIVISION 
+		+ section->maxframes - 1) / section->maxframes;
+	clocks = (clocks + CLOCKS_PER_POSITION - 1) / CLOCKS_PER_POSITION;
+	position += clocks;
+	clocks *= CLOCKS_PER_POSITION;
+	hold = (clocks * section->maxframes + section->divisions * CLOCKS_PER_DIVISION - 1) / 
+		(section->divisions * CLOCKS_PER_DIVISION) - state.framecount;
+
+	buf[0] = MIDI_SONG_POSITION;
+	buf[1] = position & 0x7f;
+	buf[2] = (position >> 7) & 0x7f;
+	write( f, at, buf, 3 );
+	buf[0] = MIDI_CONTINUE;
+	write( f, at, buf, 1 );
+}
+
+void MidiClock::stop() {
+	//
+	// stopped: let go of the metronome note and stop the outboard gear.
+	// There is no summed collection, these go out with the buffered midi
+	//
+	unsigned char buf[3];
+
+	if( held ) {
+		buf[0] = 0x89;
+		buf[1] = note;
+		buf[2] = 0;
+		jack_send_midi( 3, buf );
+		jack_write_midi();
+		held = false;
+	}
+	if( running ) {
+		buf[0] = MIDI_STOP;
+		jack_send_midi( 1, buf );
+		jack_write_midi();
+		running = located = false;
+	}
+}
+
+void MidiClock::click(FrameCollection *f, unsigned int at, unsigned char n) {
+	//
+	// sound the metronome note at frame at, it goes off a quarter division later
+	//
+	unsigned char buf[3];
+	Section *section = &sections[state.current_section];
+
+	if( held ) {
+		buf[0] = 0x89;
+		buf[1] = note;
+		buf[2] = 0;
+		write( f, at, buf, 3 );
+	}
+	note = n;
+	held = true;
+	buf[0] = 0x99;
+	buf[1] = note;
+	buf[2] = config.velocity;
+	write( f, at, buf, 3 );
+	gate = section->maxframes / section->divisions / CLICK_GATE;
+}
+
+void MidiClock::run(FrameCollection *f, unsigned int at, unsigned int count) {
+	//
+	// the clocks and any metronome note off due in the count frames from
+	// frame at, which play frames state.framecount on of the current section
+	//
+	unsigned char buf[3];
+
+	if( held ) {
+		if( gate < count ) {
+			buf[0] = 0x89;
+			buf[1] = note;
+			buf[2] = 0;
+			write( f, at + gate, buf, 3 );
+			held = false;
+		} else
+			gate -= count;
+	}
+
+	if( !running ) return;
+
+	// after a jump the clocks wait for the sixteenth the song position named
+	if( hold >= count ) {
+		hold -= count;
+		return;
+	}
+	Section *section = &sections[state.current_section];
+	unsigned long long clocks = section->divisions * CLOCKS_PER_DIVISION;
+	unsigned long long k, frame, first = state.framecount + hold;
+
+	at += hold;
+	count -= hold;
+	hold = 0;
+
+	// the first clock on or after the frame count
+	k = first ? ((first - 1) * clocks) / section->maxframes + 1 : 0;
+
+	buf[0] = MIDI_CLOCK;
+	while( k < clocks ) {
+		frame = (k * section->maxframes + clocks - 1) / clocks;
+		if( frame >= first + count ) break;
+		write( f, at + frame - first, buf, 1 );
+		k++;
+	}
+}
@@ -0,0 +1,58 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+//
+// MIDICLOCK
+//
+// times the midi that lets outboard gear follow us: 24 clocks to the
+// division, start, stop and continue with a song position, and the notes
+// of the midi metronome with a gate. Everything goes into the summed
+// collection of the period at its frame, jack gets it in time order.
+//
+#define MIDI_CLOCK			0xf8
+#define MIDI_START			0xfa
+#define MIDI_CONTINUE		0xfb
+#define MIDI_STOP			0xfc
+#define MIDI_SONG_POSITION	0xf2
+
+#define CLOCKS_PER_DIVISION	24
+#define CLOCKS_PER_POSITION	6		// a song position counts sixteenths
+#define CLICK_GATE			4		// the metronome note lasts a quarter division
+
+class MidiClock {
+	bool running;				// the outboard gear has been started
+	bool located;				// the song position jumped while running
+	bool held;					// the metronome note is sounding
+	unsigned int hold;			// frames to go before clocking resumes
+	unsigned int gate;			// frames until the metronome note goes off
+	unsigned char note;
+
+	void write(FrameCollection *, unsigned int, unsigned char *, int);
+
+public:
+	MidiClock();
+	void locate();
+	void transport(FrameCollection *, unsigned int);
+	void stop();
+	void click(FrameCollection *, unsigned int, unsigned char);
+	void run(FrameCollection *, unsigned int, unsigned int);
+};
@@ -0,0 +1,143 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <stdio.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include <jack/jack.h>
+#include <jack/thread.h>
+
+#include "mixer.h"
+
+//
+//	MIXER.CPP
+//
+
+MixPool::MixPool() {
+
+	threads = 0;
+	generation = 0;
+	pending = 0;
+	stopping = false;
+	job = NULL;
+	arg = NULL;
+}
+
+MixPool::~MixPool() {
+
+}
+
+int MixPool::start(jack_client_t *client, int n) {
+	//
+	// start n workers at the priority jack gives its clients' own threads
+	//
+	int priority = jack_client_real_time_priority( client ), realtime = jack_is_realtime( client );
+
+	if( n > MIX_THREADS ) n = MIX_THREADS;
+	stopping = false;
+	for( threads = 0; threads < n; threads++ ) {
+		struct worker *w = &workers[threads];
+		w->pool = this;
+		w->index = threads + 1;
+		w->seen = generation;
+		w->sleeping = 0;
+		sem_init( &w->wakeup, 0, 0 );
+		if( jack_client_create_thread( client, &w->thread_id, priority, realtime, thread, w ) ) {
+			fprintf(stderr, "MixPool::start can not start mixing thread %d\n", w->index );
+			sem_destroy( &w->wakeup );
+			break;
+		}
+	}
+	if( threads ) fprintf(stderr, "mixing on %d threads\n", threads + 1 );
+	return threads < n;
+}
+
+int MixPool::stop() {
+
+	int i;
+
+	if( threads == 0 ) return 0;
+	stopping = true;
+	__sync_synchronize();
+	generation++;
+	for( i = 0; i < threads; i++ ) 
+		sem_post( &workers[i].wakeup );
+	for( i = 0; i < threads; i++ ) {
+		pthread_join( workers[i].thread_id, NULL );
+		sem_destroy( &workers[i].wakeup );
+	}
+	threads = 0;
+	return 0;
+}
+
+int MixPool::size() {
+	return threads + 1;
+}
+
+void MixPool::run(mix_job j, void *a) {
+	//
+	// from process only, do job on every worker and return when they all have.
+	// A worker only needs waking if it has given up spinning
+	//
+	job = j;
+	arg = a;
+	pending = threads;
+	__sync_synchronize();
+	generation++;
+	for( int i = 0; i < threads; i++ ) 
+		if( __sync_bool_compare_and_swap( &workers[i].sleeping, 1, 0 ) ) 
+			sem_post( &workers[i].wakeup );
+
+	j( 0, a );
+	while( pending ) 
+		;
+	__sync_synchronize();
+}
+
+void *MixPool::thread(void *p) {
+
+	struct worker *w = (struct worker *)p;
+	MixPool *pool = w->pool;
+	int spin;
+
+	while( true ) {
+		for( spin = 0; w->seen == pool->generation && spin < MIX_SPIN; spin++ ) 
+			;
+		if( w->seen == pool->generation ) {
+			//
+			// go to sleep, unless a job turned up as we did. If run() saw
+			// us asleep first it posts and the post has to be taken
+			//
+			w->sleeping = 1;
+			__sync_synchronize();
+			if( w->seen == pool->generation || !__sync_bool_compare_and_swap( &w->sleeping, 1, 0 ) ) 
+				sem_wait( &w->wakeup );
+			continue;
+		}
+		w->seen = pool->generation;
+		if( pool->stopping ) break;
+		pool->job( w->index, pool->arg );
+		__sync_fetch_and_sub( &pool->pending, 1 );
+	}
+	return NULL;
+}
@@ -0,0 +1,65 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+//
+// MIXER
+//
+// a pool of realtime threads sharing out the mixing of a period. The
+// process thread hands every worker the same job, does its own share as
+// worker 0 and waits for the rest. The jobs come a few to the period, so
+// a worker spins a while looking for the next one before it sleeps.
+//
+#define MIX_THREADS		15			// most workers besides the process thread
+#define MIX_SPIN		20000		// looks for a job before sleeping
+#define MIX_MIN_COST	100000		// nsecs of mixing a period before it is shared out
+#define MIX_COST_FRAMES	1024		// a track's cost is nsecs to mix this many frames
+
+typedef void (*mix_job)(int, void *);
+
+class MixPool {
+
+	struct worker {
+		MixPool *pool;
+		int index;
+		jack_native_thread_t thread_id;
+		unsigned int seen;
+		volatile int sleeping;
+		sem_t wakeup;
+	} workers[MIX_THREADS];
+
+	int threads;
+	volatile unsigned int generation;
+	volatile int pending;
+	volatile bool stopping;
+	mix_job job;
+	void *arg;
+
+	static void *thread(void *);
+
+public:
+
+	MixPool();
+	~MixPool();
+	int start(jack_client_t *, int), stop();
+	int size();
+	void run(mix_job, void *);
+};
@@ -0,0 +1,503 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+//
+//	offline
+//
+//	runs the engine without a JACK server, for tests and measurements. The
+//	inputs come from files, as many periods as asked for run as fast as they
+//	go, and the main outputs are written to files, the audio bit for bit as
+//	32 bit floats.
+//
+//	A midi file here is text, an event to the line: the frame it falls on
+//	and its bytes in hex. A command file has a line for each control command,
+//	the period it is sent before, its name and its arguments, a string
+//	argument taking the rest of the line:
+//
+//		0 REC_LEFT 1
+//		0 PLAY
+//		16 RECORD
+//		400 TRACK_NAME 0 bass
+//
+//	make check runs the session in check/ and compares the output with the
+//	one kept there.
+//
+#include <stdio.h>
+#include <unistd.h> 
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#include "../common/network.h"
+#include "../common/udpstruct.h"
+#include "../common/control.h"
+#include "framecollection.h"
+#include "internalclick.h"
+#include "state.h"
+#include "section.h"
+#include "track.h"
+#include "config.h"
+#include "core.h"
+#include "filejack.h"
+
+#define OFFLINE_INPUTS		16
+#define OFFLINE_EVENT		16			// bytes of a midi event
+#define BUFFER_LEN			256
+
+struct wav_file {
+	FILE *fd;
+	int format, channels, bytes;		// format 1 is integer, 3 float
+	unsigned long frames;				// left to read, or written
+	unsigned char *buffer;
+};
+
+struct midi_line {
+	unsigned long frame;
+	int size;
+	unsigned char data[OFFLINE_EVENT];
+};
+
+struct script_line {
+	int period;
+	struct control_command c;
+};
+
+static const char *command_args[] = {
+	"",
+#define X(code, args, key) args,
+	CONTROL_SCHEMA
+#undef X
+};
+
+extern jack_client_t *client;
+
+const char *input_names[OFFLINE_INPUTS], *output_name = NULL, *midi_in_name = NULL, *midi_out_name = NULL;
+const char *script_name = NULL;
+int ninputs = 0, periods = 0;
+jack_nframes_t rate = 48000, period = 256;
+
+//
+// wav files
+//
+
+static unsigned int get16( unsigned char *p ) { return p[0] | (p[1] << 8); }
+static unsigned int get32( unsigned char *p ) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24); }
+static void put16( unsigned char *p, unsigned int v ) { p[0] = v; p[1] = v >> 8; }
+static void put32( unsigned char *p, unsigned int v ) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+
+int wav_open( const char *name, struct wav_file *w ) {
+	//
+	// find the format and the data of a wav file of 16, 24 or 32 bit integers or 32 bit floats
+	//
+	unsigned char chunk[40];
+	unsigned int size;
+	bool found = false;
+
+	if( (w->fd = fopen( name, "rb" )) == NULL ) {
+		perror( name );
+		return 1;
+	}
+	if( fread( chunk, 1, 12, w->fd ) != 12 || memcmp( chunk, "RIFF", 4 ) || memcmp( chunk + 8, "WAVE", 4 ) ) {
+		fprintf(stderr, "%s is not a wav file\n", name );
+		fclose( w->fd );
+		return 1;
+	}
+
+	w->format = 0;
+	while( fread( chunk, 1, 8, w->fd ) == 8 ) {
+		size = get32( chunk + 4 );
+		if( memcmp( chunk, "fmt ", 4 ) == 0 && size >= 16 && size <= sizeof chunk ) {
+			if( fread( chunk, 1, size, w->fd ) != size ) break;
+			w->format = get16( chunk );
+			// the extensible format has the real one in its sub format
+			if( w->format == 0xfffe && size >= 26 ) w->format = get16( chunk + 24 );
+			w->channels = get16( chunk + 2 );
+			w->bytes = get16( chunk + 14 ) / 8;
+			if( get32( chunk + 4 ) != rate ) 
+				fprintf(stderr, "%s is at %d, played at %d\n", name, get32( chunk + 4 ), rate );
+			if( size & 1 ) fseek( w->fd, 1, SEEK_CUR );
+		} else if( memcmp( chunk, "data", 4 ) == 0 ) {
+			found = true;
+			break;
+		} else 
+			fseek( w->fd, size + (size & 1), SEEK_CUR );
+	}
+
+	if( !found || w->channels < 1 || !((w->format == 1 && w->bytes >= 2 && w->bytes <= 4) || 
+			(w->format == 3 && w->bytes == 4)) ) {
+		fprintf(stderr, "%s is not a wav file we can read\n", name );
+		fclose( w->fd );
+		return 1;
+	}
+	w->frames = size / (w->channels * w->bytes);
+	w->buffer = new unsigned char[period * w->channels * w->bytes];
+	return 0;
+}
+
+static float get_sample( struct wav_file *w, unsigned char *p ) {
+
+	float f;
+
+	if( w->format == 3 ) {
+		memcpy( &f, p, 4 );
+		return f;
+	}
+	switch( w->bytes ) {
+		case 2: return (short)get16( p ) * (1.0f / 32768.0f);
+		case 3: return ((int)(p[0] << 8 | p[1] << 16 | (unsigned int)p[2] << 24) >> 8) * (1.0f / 8388608.0f);
+		default: return (int)get32( p ) * (1.0f / 2147483648.0f);
+	}
+}
+
+void wav_read( struct wav_file *w, float *left, float *right, jack_nframes_t nframes ) {
+	//
+	// the next frames, a mono file playing on both sides and silence after the end
+	//
+	jack_nframes_t i, n = nframes < w->frames ? nframes : w->frames;
+	int frame = w->channels * w->bytes;
+	unsigned char *p = w->buffer;
+
+	if( n && fread( w->buffer, frame, n, w->fd ) != n ) n = 0;
+	w->frames -= n;
+	for( i = 0; i < n; i++, p += frame ) {
+		left[i] = get_sample( w, p );
+		right[i] = w->channels > 1 ? get_sample( w, p + w->bytes ) : left[i];
+	}
+	for( ; i < nframes; i++ ) left[i] = right[i] = 0.0f;
+}
+
+int wav_create( const char *name, struct wav_file *w ) {
+
+	unsigned char header[44];
+
+	if( (w->fd = fopen( name, "wb" )) == NULL ) {
+		perror( name );
+		return 1;
+	}
+	w->format = 3;
+	w->channels = 2;
+	w->bytes = 4;
+	w->frames = 0;
+	w->buffer = new unsigned char[period * 8];
+
+	// the sizes go in when the file is closed
+	memset( header, 0, sizeof header );
+	memcpy( header, "RIFF", 4 );
+	memcpy( header + 8, "WAVEfmt ", 8 );
+	put32( header + 16, 16 );
+	put16( header + 20, 3 );
+	put16( header + 22, 2 );
+	put32( header + 24, rate );
+	put32( header + 28, rate * 8 );
+	put16( header + 32, 8 );
+	put16( header + 34, 32 );
+	memcpy( header + 36, "data", 4 );
+	fwrite( header, 1, sizeof header, w->fd );
+	return 0;
+}
+
+void wav_write( struct wav_file *w, float *left, float *right, jack_nframes_t nframes ) {
+
+	unsigned char *p = w->buffer;
+
+	for( jack_nframes_t i = 0; i < nframes; i++, p += 8 ) {
+		memcpy( p, &left[i], 4 );
+		memcpy( p + 4, &right[i], 4 );
+	}
+	fwrite( w->buffer, 8, nframes, w->fd );
+	w->frames += nframes;
+}
+
+void wav_close( struct wav_file *w, bool written ) {
+
+	unsigned char size[4];
+
+	if( written ) {
+		put32( size, 36 + w->frames * 8 );
+		fseek( w->fd, 4, SEEK_SET );
+		fwrite( size, 1, 4, w->fd );
+		put32( size, w->frames * 8 );
+		fseek( w->fd, 40, SEEK_SET );
+		fwrite( size, 1, 4, w->fd );
+	}
+	fclose( w->fd );
+	delete[] w->buffer;
+}
+
+//
+// midi and command files
+//
+
+int read_midi( const char *name, struct midi_line **lines ) {
+	//
+	// the events in order of frame, returns how many or -1
+	//
+	char line[BUFFER_LEN], *p, *q;
+	int count = 0, size = 0, n;
+	FILE *fd;
+
+	if( (fd = fopen( name, "r" )) == NULL ) {
+		perror( name );
+		return -1;
+	}
+	*lines = NULL;
+	while( fgets( line, BUFFER_LEN, fd ) ) {
+		struct midi_line m;
+		m.frame = strtoul( line, &p, 10 );
+		if( p == line ) continue;
+		for( n = 0; n < OFFLINE_EVENT; n++, p = q ) {
+			m.data[n] = strtoul( p, &q, 16 );
+			if( q == p ) break;
+		}
+		if( (m.size = n) == 0 ) continue;
+		if( count && m.frame < (*lines)[count - 1].frame ) {
+			fprintf(stderr, "%s: events out of order at frame %lu\n", name, m.frame );
+			break;
+		}
+		if( count == size ) {
+			struct midi_line *bigger = new struct midi_line[size = size ? size * 2 : 64];
+			if( count ) memcpy( bigger, *lines, count * sizeof m );
+			delete[] *lines;
+			*lines = bigger;
+		}
+		(*lines)[count++] = m;
+	}
+	fclose( fd );
+	return count;
+}
+
+static int command_code( const char *name ) {
+
+	for( int code = CTL_NONE + 1; code < CTL_COUNT; code++ )
+		if( strcmp( name, control_name( code ) ) == 0 || strcmp( name, control_name( code ) + 4 ) == 0 ) 
+			return code;
+	return CTL_NONE;
+}
+
+int read_script( const char *name, struct script_line **lines ) {
+	//
+	// the commands in order of period, returns how many or -1
+	//
+	char line[BUFFER_LEN], command[BUFFER_LEN], *p, *q;
+	int count = 0, size = 0, n, skip;
+	const char *a;
+	FILE *fd;
+
+	if( (fd = fopen( name, "r" )) == NULL ) {
+		perror( name );
+		return -1;
+	}
+	*lines = NULL;
+	while( fgets( line, BUFFER_LEN, fd ) ) {
+		struct script_line s;
+		memset( &s, 0, sizeof s );
+		if( sscanf( line, "%d %s%n", &s.period, command, &skip ) != 2 ) continue;
+		if( (s.c.code = command_code( command )) == CTL_NONE ) {
+			fprintf(stderr, "%s: no command %s\n", name, command );
+			continue;
+		}
+		p = line + skip;
+		for( a = command_args[s.c.code], n = 0; *a; a++, n++ ) {
+			if( *a == 's' ) {
+				while( *p == ' ' || *p == '\t' ) p++;
+				p[strcspn( p, "\r\n" )] = '\0';
+				strncpy( s.c.text, p, CONTROL_TEXT_MAX );
+				s.c.arg[n] = strlen( s.c.text );
+				break;
+			}
+			s.c.arg[n] = strtol( p, &q, 10 );
+			p = q;
+		}
+		if( count && s.period < (*lines)[count - 1].period ) {
+			fprintf(stderr, "%s: commands out of order at period %d\n", name, s.period );
+			break;
+		}
+		if( count == size ) {
+			struct script_line *bigger = new struct script_line[size = size ? size * 2 : 64];
+			if( count ) memcpy( bigger, *lines, count * sizeof s );
+			delete[] *lines;
+			*lines = bigger;
+		}
+		(*lines)[count++] = s;
+	}
+	fclose( fd );
+	return count;
+}
+
+int handleargs(int argc, char *argv[]) {
+
+	argv++;
+	
+	while( --argc ) {
+
+		if( (*argv)[0] != '-' || (*argv)[1] == 'h' ) {
+			fprintf( stdout, 
+			"Usage:\n  offline [-h][-l][-rRATE][-pFRAMES][-nPERIODS][-iIN.wav]..[-mIN.midi][-cCOMMANDS][-oOUT.wav][-MOUT.midi]\n"
+			"  -h	help\n  -l	load files\n  -r	sample rate, 48000\n  -p	frames in a period, 256\n"
+			"  -n	periods run, the length of the first input if not given\n"
+			"  -i	input, the main one then the others in turn\n  -m	midi input\n  -c	control commands\n"
+			"  -o	output\n  -M	midi output\n");
+			return 1;
+		}
+
+		switch( (*argv)[1] ) {
+			case 'l': load_sequencer(true); break;
+			case 'r': rate = atoi( *argv + 2 ); break;
+			case 'p': period = atoi( *argv + 2 ); break;
+			case 'n': periods = atoi( *argv + 2 ); break;
+			case 'i': if( ninputs < OFFLINE_INPUTS ) input_names[ninputs++] = *argv + 2; break;
+			case 'm': midi_in_name = *argv + 2; break;
+			case 'c': script_name = *argv + 2; break;
+			case 'o': output_name = *argv + 2; break;
+			case 'M': midi_out_name = *argv + 2; break;
+		}
+		argv++;
+	}
+	return 0;
+}
+
+int main (int argc, char *argv[]) {
+
+	struct wav_file inputs[OFFLINE_INPUTS], output;
+	struct midi_line *midi_lines = NULL;
+	struct script_line *script_lines = NULL;
+	jack_port_t *in_left[OFFLINE_INPUTS], *in_right[OFFLINE_INPUTS], *out_left, *out_right, *in_midi, *out_midi;
+	struct sockaddr_storage from;
+	socklen_t fromlen;
+	struct timespec begin, end;
+	char name[BUFFER_LEN];
+	int i, p, nmidi = 0, nscript = 0, nextmidi = 0, nextscript = 0, opened = 0;
+	unsigned long frame;
+	FILE *midi_out = NULL;
+	double seconds;
+
+	core_init();
+
+	if( handleargs( argc, argv ) ) return 0;
+	if( filejack_setup( rate, period ) ) {
+		fprintf(stderr, "no rate or period\n");
+		return 1;
+	}
+
+	for( ; opened < ninputs; opened++ ) 
+		if( wav_open( input_names[opened], &inputs[opened] ) ) break;
+	if( opened < ninputs ) return 1;
+	if( periods <= 0 && ninputs ) periods = (inputs[0].frames + period - 1) / period;
+	if( periods <= 0 ) {
+		fprintf(stderr, "nothing to run, give the periods or an input\n");
+		return 1;
+	}
+	if( midi_in_name && (nmidi = read_midi( midi_in_name, &midi_lines )) < 0 ) return 1;
+	if( script_name && (nscript = read_script( script_name, &script_lines )) < 0 ) return 1;
+
+	// the telemetry still goes out, and commands seem to come from where it goes
+	network.talker_init(config.outhost, config.outport);
+	network.talker_address( &from, &fromlen );
+
+	if( !jack_init() ) {
+		fprintf(stderr, "engine initialization failure\n");
+		return 1;
+	}
+
+	for( i = 0; i < ninputs; i++ ) {
+		if( i ) snprintf( name, BUFFER_LEN, "input%d_left", i );
+		else strcpy( name, "input_left" );
+		in_left[i] = jack_port_by_name( client, name );
+		if( i ) snprintf( name, BUFFER_LEN, "input%d_right", i );
+		else strcpy( name, "input_right" );
+		in_right[i] = jack_port_by_name( client, name );
+		if( in_left[i] == NULL || in_right[i] == NULL ) {
+			fprintf(stderr, "no input %d, INPUTS in the config is %d\n", i, config.inputs );
+			ninputs = i;
+			break;
+		}
+	}
+	out_left = jack_port_by_name( client, "output_left" );
+	out_right = jack_port_by_name( client, "output_right" );
+	in_midi = jack_port_by_name( client, "in" );
+	out_midi = jack_port_by_name( client, "out" );
+
+	if( output_name && wav_create( output_name, &output ) ) output_name = NULL;
+	if( midi_out_name && (midi_out = fopen( midi_out_name, "w" )) == NULL ) perror( midi_out_name );
+
+	clock_gettime( CLOCK_MONOTONIC, &begin );
+
+	for( p = 0; p < periods && running; p++ ) {
+
+		// the commands for this period, all taken before it runs
+		for( ; nextscript < nscript && script_lines[nextscript].period <= p; nextscript++ ) 
+			execute_command( &script_lines[nextscript].c, &from, fromlen );
+
+		for( i = 0; i < ninputs; i++ ) 
+			wav_read( &inputs[i], (float *)jack_port_get_buffer( in_left[i], period ),
+				(float *)jack_port_get_buffer( in_right[i], period ), period );
+
+		void *midi = jack_port_get_buffer( in_midi, period );
+		jack_midi_clear_buffer( midi );
+		frame = (unsigned long)p * period;
+		for( ; nextmidi < nmidi && midi_lines[nextmidi].frame < frame + period; nextmidi++ ) 
+			jack_midi_event_write( midi, midi_lines[nextmidi].frame - frame, 
+				midi_lines[nextmidi].data, midi_lines[nextmidi].size );
+
+		filejack_cycle( period );
+
+		if( output_name ) 
+			wav_write( &output, (float *)jack_port_get_buffer( out_left, period ),
+				(float *)jack_port_get_buffer( out_right, period ), period );
+
+		if( midi_out ) {
+			jack_midi_event_t event;
+			midi = jack_port_get_buffer( out_midi, period );
+			for( i = 0; jack_midi_event_get( &event, midi, i ) == 0; i++ ) {
+				fprintf( midi_out, "%lu", frame + event.time );
+				for( size_t b = 0; b < event.size; b++ ) 
+					fprintf( midi_out, " %02x", event.buffer[b] );
+				fprintf( midi_out, "\n" );
+			}
+		}
+	}
+
+	clock_gettime( CLOCK_MONOTONIC, &end );
+	seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+	fprintf(stderr, "ran %d periods of %d frames in %.3f seconds, %.1f times as fast as played\n",
+		p, period, seconds, seconds > 0.0 ? (double)p * period / rate / seconds : 0.0 );
+
+	jack_close();
+
+	if( output_name ) wav_close( &output, true );
+	if( midi_out ) fclose( midi_out );
+	for( i = 0; i < opened; i++ ) wav_close( &inputs[i], false );
+	delete[] midi_lines;
+	delete[] script_lines;
+
+	network.talker_close();
+	return 0;
+}
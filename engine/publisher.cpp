@@ -0,0 +1,314 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+
+#include "../common/network.h"
+#include "../common/udpstruct.h"
+#include "../common/telemetry.h"
+#include "publisher.h"
+
+//
+//	PUBLISHER.CPP
+//
+
+//
+// a subscriber reaching a dual stack socket over IPv4 shows up as a mapped
+// IPv6 address, turn that back into the IPv4 address we can send to
+//
+static void unmap_address( struct sockaddr_storage *addr, socklen_t *addrlen ) {
+
+	struct sockaddr_in6 *a6 = (struct sockaddr_in6 *)addr;
+	struct sockaddr_in a4;
+
+	if( addr->ss_family != AF_INET6 || !IN6_IS_ADDR_V4MAPPED( &a6->sin6_addr ) ) return;
+
+	memset( &a4, 0, sizeof a4 );
+	a4.sin_family = AF_INET;
+	a4.sin_port = a6->sin6_port;
+	memcpy( &a4.sin_addr, &a6->sin6_addr.s6_addr[12], 4 );
+	memcpy( addr, &a4, sizeof a4 );
+	*addrlen = sizeof a4;
+}
+
+static bool same_address( struct sockaddr_storage *a, struct sockaddr_storage *b ) {
+
+	if( a->ss_family != b->ss_family ) return false;
+	if( a->ss_family == AF_INET ) {
+		struct sockaddr_in *x = (struct sockaddr_in *)a, *y = (struct sockaddr_in *)b;
+		return x->sin_port == y->sin_port && x->sin_addr.s_addr == y->sin_addr.s_addr;
+	}
+	struct sockaddr_in6 *x = (struct sockaddr_in6 *)a, *y = (struct sockaddr_in6 *)b;
+	return x->sin6_port == y->sin6_port && !memcmp( &x->sin6_addr, &y->sin6_addr, sizeof x->sin6_addr );
+}
+
+Publisher::Publisher() {
+
+	subscribercount = 0;
+	for( int i = 0; i < MAX_GROUPS; i++ ) {
+		groups[i].members = groups[i].datagramsize = 0;
+		groups[i].datagrams = NULL;
+	}
+	network = NULL;
+	family = AF_UNSPEC;
+	rate = 1;
+	tick = 0;
+	ready = stopping = false;
+	pthread_mutex_init( &mut, NULL );
+	sem_init( &wakeup, 0, 0 );
+}
+
+Publisher::~Publisher() {
+
+	for( int i = 0; i < MAX_GROUPS; i++ )
+		delete[] groups[i].datagrams;
+	sem_destroy( &wakeup );
+	pthread_mutex_destroy( &mut );
+}
+
+int Publisher::start(Network *n, int updates_per_second) {
+	//
+	// begin publishing, the configured talker address is the first subscriber
+	//
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+
+	network = n;
+	rate = updates_per_second > 0 ? updates_per_second : 1;
+
+	// process fills the image in place, it is grown here and in publish()
+	image.reserve( PUBLISH_TRACK_ROOM );
+	network->talker_address( &addr, &addrlen );
+	family = addr.ss_family;
+	subscribe( &addr, addrlen, 0, TELE_FIELD_ALL, true );
+
+	if( pthread_create( &thread_id, NULL, thread, this ) ) {
+		perror("Publisher::start pthread_create");
+		return 1;
+	}
+	return 0;
+}
+
+int Publisher::stop() {
+
+	if( network == NULL ) return 0;
+	stopping = true;
+	sem_post( &wakeup );
+	pthread_join( thread_id, NULL );
+	network = NULL;
+	return 0;
+}
+
+int Publisher::find_subscriber(struct sockaddr_storage *addr) {
+
+	for( int i = 0; i < subscribercount; i++ )
+		if( same_address( &subscribers[i].addr, addr ) ) return i;
+	return -1;
+}
+
+int Publisher::find_group(int divisor, int fields) {
+	//
+	// the group sending these fields at this rate, or a free one
+	//
+	int i, empty = -1;
+
+	for( i = 0; i < MAX_GROUPS; i++ ) {
+		if( groups[i].members == 0 ) {
+			if( empty < 0 ) empty = i;
+			continue;
+		}
+		if( groups[i].divisor == divisor && groups[i].fields == fields ) return i;
+	}
+	if( empty >= 0 ) {
+		groups[empty].divisor = divisor;
+		groups[empty].fields = fields;
+	}
+	return empty;
+}
+
+void Publisher::drop(int n) {
+
+	groups[subscribers[n].group].members--;
+	subscribers[n] = subscribers[--subscribercount];
+}
+
+int Publisher::subscribe(struct sockaddr_storage *addr, socklen_t addrlen, int hz, int fields, bool permanent) {
+	//
+	// add or renew a subscriber, hz of zero asks for every update
+	//
+	int n, g, divisor;
+	bool added = false;
+
+	unmap_address( addr, &addrlen );
+	fields &= TELE_FIELD_ALL;
+	if( fields == 0 || addr->ss_family != family ) {
+		fprintf(stderr, "publisher: can not subscribe that address or field set\n");
+		return 1;
+	}
+	divisor = hz <= 0 || hz >= rate ? 1 : (rate + hz / 2) / hz;
+
+	pthread_mutex_lock( &mut );
+
+	n = find_subscriber( addr );
+	if( n < 0 && subscribercount == MAX_SUBSCRIBERS ) {
+		pthread_mutex_unlock( &mut );
+		fprintf(stderr, "publisher: too many subscribers\n");
+		return 1;
+	}
+
+	if( n < 0 || groups[subscribers[n].group].divisor != divisor || 
+			groups[subscribers[n].group].fields != fields ) {
+
+		if( n >= 0 ) groups[subscribers[n].group].members--;
+		if( (g = find_group( divisor, fields )) < 0 ) {
+			if( n >= 0 ) subscribers[n] = subscribers[--subscribercount];
+			pthread_mutex_unlock( &mut );
+			fprintf(stderr, "publisher: too many subscription groups\n");
+			return 1;
+		}
+		if( n < 0 ) {
+			n = subscribercount++;
+			memcpy( &subscribers[n].addr, addr, addrlen );
+			subscribers[n].addrlen = addrlen;
+			added = true;
+		}
+		subscribers[n].group = g;
+		groups[g].members++;
+
+		// the newcomer needs the whole state
+		groups[g].encoder.keyframe();
+		fprintf(stderr, "publisher: subscriber %d in group %d, every %d updates, fields %x\n",
+			n, g, divisor, fields );
+	}
+
+	// the configured subscriber never expires, the others have to renew
+	if( permanent ) subscribers[n].expires = 0;
+	else if( added || subscribers[n].expires ) subscribers[n].expires = time(NULL) + SUBSCRIPTION_TIMEOUT;
+	pthread_mutex_unlock( &mut );
+	return 0;
+}
+
+int Publisher::unsubscribe(struct sockaddr_storage *addr, socklen_t addrlen) {
+
+	int n;
+
+	unmap_address( addr, &addrlen );
+	pthread_mutex_lock( &mut );
+	if( (n = find_subscriber( addr )) >= 0 ) drop( n );
+	pthread_mutex_unlock( &mut );
+	return n < 0;
+}
+
+bool Publisher::claim() {
+	//
+	// true when the image is free to be filled, an update still being sent is not disturbed
+	//
+	return !ready;
+}
+
+void Publisher::post() {
+
+	__sync_synchronize();
+	ready = true;
+	sem_post( &wakeup );
+}
+
+void *Publisher::thread(void *p) {
+
+	Publisher *publisher = (Publisher *)p;
+
+	while( true ) {
+		sem_wait( &publisher->wakeup );
+		if( publisher->stopping ) break;
+		publisher->publish();
+		__sync_synchronize();
+		publisher->ready = false;
+	}
+	return NULL;
+}
+
+void Publisher::publish() {
+	//
+	// encode the image once per group due an update and send it to the members
+	//
+	struct mmsghdr msgs[PUBLISH_BATCH];
+	struct iovec iovs[PUBLISH_BATCH];
+	int g, f, n, fragments, count = 0, length;
+	time_t now = time(NULL);
+
+	pthread_mutex_lock( &mut );
+	tick++;
+
+	for( n = subscribercount - 1; n >= 0; n-- )
+		if( subscribers[n].expires && subscribers[n].expires < now ) {
+			fprintf(stderr, "publisher: subscriber %d expired\n", n);
+			drop( n );
+		}
+
+	for( g = 0; g < MAX_GROUPS; g++ ) {
+		struct group *gp = &groups[g];
+		if( gp->members == 0 || tick % gp->divisor ) continue;
+
+		gp->encoder.image.copy( &image, gp->fields );
+		fragments = gp->encoder.prepare();
+		if( fragments * TELEMETRY_DATAGRAM > gp->datagramsize ) {
+			delete[] gp->datagrams;
+			gp->datagramsize = fragments * TELEMETRY_DATAGRAM;
+			gp->datagrams = new unsigned char[gp->datagramsize];
+		}
+
+		for( f = 0; f < fragments; f++ ) {
+			unsigned char *datagram = gp->datagrams + f * TELEMETRY_DATAGRAM;
+			length = gp->encoder.fragment( f, datagram );
+
+			for( n = 0; n < subscribercount; n++ ) {
+				if( subscribers[n].group != g ) continue;
+				iovs[count].iov_base = datagram;
+				iovs[count].iov_len = length;
+				memset( &msgs[count], 0, sizeof msgs[count] );
+				msgs[count].msg_hdr.msg_name = &subscribers[n].addr;
+				msgs[count].msg_hdr.msg_namelen = subscribers[n].addrlen;
+				msgs[count].msg_hdr.msg_iov = &iovs[count];
+				msgs[count].msg_hdr.msg_iovlen = 1;
+				if( ++count == PUBLISH_BATCH ) {
+					network->talk_many( msgs, count );
+					count = 0;
+				}
+			}
+		}
+	}
+	if( count ) network->talk_many( msgs, count );
+
+	// make room for the tracks to come while process has let go of the image
+	if( image.state.trackcount + PUBLISH_TRACK_ROOM > (unsigned)image.capacity ) 
+		image.reserve( image.state.trackcount + PUBLISH_TRACK_ROOM );
+
+	pthread_mutex_unlock( &mut );
+}
@@ -0,0 +1,76 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+//
+// PUBLISHER
+//
+// fans the state feed out to every subscriber. Subscribers asking for the
+// same fields at the same rate share a group, and a group encodes each update
+// once for all its members. Encoding and sending happen on the publisher
+// thread, the process callback only fills in the image.
+//
+#define MAX_SUBSCRIBERS			32
+#define MAX_GROUPS				8
+#define PUBLISH_BATCH			64		// datagrams per sendmmsg
+#define SUBSCRIPTION_TIMEOUT	10		// seconds a subscription lasts unless renewed
+#define PUBLISH_TRACK_ROOM		64		// tracks the image has room for beyond the engine's
+
+class Publisher {
+
+	struct subscriber {
+		struct sockaddr_storage addr;
+		socklen_t addrlen;
+		int group;
+		time_t expires;				// zero for a subscription that never expires
+	} subscribers[MAX_SUBSCRIBERS];
+	int subscribercount;
+
+	struct group {
+		int divisor, fields, members, datagramsize;
+		unsigned char *datagrams;
+		TelemetryEncoder encoder;
+	} groups[MAX_GROUPS];
+
+	Network *network;
+	int family, rate;
+	unsigned int tick;
+	volatile bool ready, stopping;
+	pthread_mutex_t mut;
+	sem_t wakeup;
+	pthread_t thread_id;
+
+	int find_subscriber(struct sockaddr_storage *), find_group(int, int);
+	void drop(int), publish();
+	static void *thread(void *);
+
+public:
+	// filled in by the process callback between claim() and post()
+	TelemetryImage image;
+
+	Publisher();
+	~Publisher();
+	int start(Network *, int), stop(),
+		subscribe(struct sockaddr_storage *, socklen_t, int, int, bool), 
+		unsubscribe(struct sockaddr_storage *, socklen_t);
+	bool claim();
+	void post();
+};
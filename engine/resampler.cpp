@@ -0,0 +1,152 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "resampler.h"
+
+//
+//	RESAMPLER.CPP
+//
+//	Output sample j sits at input position x = j * step. With i = floor(x),
+//	the taps cover in[i - RESAMPLE_ZEROS + 1] to in[i + RESAMPLE_ZEROS] and
+//	the fractional part of x picks the kernel row.
+//
+
+static double bessel_i0( double x ) {
+
+	double sum = 1.0, term = 1.0;
+	for( int k = 1; k < 32; k++ ) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+//
+// the inner loop, four taps at a time where we have SSE. Filter the input
+// with two neighbouring kernel rows and interpolate the results by f
+//
+static inline float filter( const float *in, const float *a, const float *b, float f ) {
+
+#if defined(__SSE__)
+	// two sums per row keep the adds from waiting on each other
+	__m128 sa = _mm_setzero_ps(), sb = _mm_setzero_ps(), ta = _mm_setzero_ps(), tb = _mm_setzero_ps(), x, y;
+	for( int k = 0; k < RESAMPLE_TAPS; k += 8 ) {
+		x = _mm_loadu_ps( in + k );
+		y = _mm_loadu_ps( in + k + 4 );
+		sa = _mm_add_ps( sa, _mm_mul_ps( x, _mm_load_ps( a + k ) ) );
+		sb = _mm_add_ps( sb, _mm_mul_ps( x, _mm_load_ps( b + k ) ) );
+		ta = _mm_add_ps( ta, _mm_mul_ps( y, _mm_load_ps( a + k + 4 ) ) );
+		tb = _mm_add_ps( tb, _mm_mul_ps( y, _mm_load_ps( b + k + 4 ) ) );
+	}
+	sa = _mm_add_ps( sa, ta );
+	sb = _mm_add_ps( sb, tb );
+	sa = _mm_add_ps( sa, _mm_mul_ps( _mm_set1_ps( f ), _mm_sub_ps( sb, sa ) ) );
+	sa = _mm_add_ps( sa, _mm_movehl_ps( sa, sa ) );
+	sa = _mm_add_ss( sa, _mm_shuffle_ps( sa, sa, 1 ) );
+	return _mm_cvtss_f32( sa );
+#else
+	float sa = 0.0f, sb = 0.0f;
+	for( int k = 0; k < RESAMPLE_TAPS; k++ ) {
+		sa += in[k] * a[k];
+		sb += in[k] * b[k];
+	}
+	return sa + f * (sb - sa);
+#endif
+}
+
+Resampler::Resampler(int inlen, int outlen) {
+	//
+	// build the kernel table for turning inlen samples into outlen
+	//
+	double cutoff, t, w;
+
+	step = (double)inlen / outlen;
+
+	// when shrinking, filter below the new nyquist frequency
+	cutoff = step > 1.0 ? 0.97 / step : 0.97;
+
+	// aligned for the SSE loads, rows are a multiple of 16 bytes
+	table_mem = new float[(RESAMPLE_PHASES + 1) * RESAMPLE_TAPS + 4];
+	table = (float *)(((unsigned long)table_mem + 15) & ~15UL);
+	for( int p = 0; p <= RESAMPLE_PHASES; p++ ) 
+		for( int k = 0; k < RESAMPLE_TAPS; k++ ) {
+			// distance of tap k from the output position
+			t = (k - RESAMPLE_ZEROS + 1) - (double)p / RESAMPLE_PHASES;
+			w = t / RESAMPLE_ZEROS;
+			w = w * w < 1.0 ? bessel_i0( RESAMPLE_BETA * sqrt( 1.0 - w * w ) ) / bessel_i0( RESAMPLE_BETA ) : 0.0;
+			table[p * RESAMPLE_TAPS + k] = 
+				t == 0.0 ? cutoff : w * sin( M_PI * cutoff * t ) / (M_PI * t);
+		}
+}
+
+Resampler::~Resampler() {
+
+	delete[] table_mem;
+}
+
+static float *pad( const float *in, int inlen ) {
+	//
+	// lay the loop out with its ends wrapped around, so the taps never need a check
+	//
+	int j, lead = RESAMPLE_ZEROS - 1, length = inlen + RESAMPLE_TAPS + 2;
+	float *padded = new float[length];
+
+	memcpy( padded + lead, in, inlen * sizeof(float) );
+	for( j = 0; j < lead; j++ )
+		padded[j] = in[ ((j - lead) % inlen + inlen) % inlen ];
+	for( j = lead + inlen; j < length; j++ )
+		padded[j] = in[ (j - lead) % inlen ];
+	return padded;
+}
+
+void Resampler::run(const float *in_left, const float *in_right, int inlen, float *out_left, float *out_right, int outlen) {
+	//
+	// resample the loop in into out, either channel may be NULL
+	//
+	float *left = NULL, *right = NULL, *a, f;
+	int i, j, p;
+	double x;
+
+	if( in_left ) left = pad( in_left, inlen );
+	if( in_right ) right = pad( in_right, inlen );
+
+	for( j = 0; j < outlen; j++ ) {
+		x = j * step;
+		i = (int)x;
+		x = (x - i) * RESAMPLE_PHASES;
+		p = (int)x;
+		f = x - p;
+		a = table + p * RESAMPLE_TAPS;
+		if( left ) out_left[j] = filter( left + i, a, a + RESAMPLE_TAPS, f );
+		if( right ) out_right[j] = filter( right + i, a, a + RESAMPLE_TAPS, f );
+	}
+
+	delete[] left;
+	delete[] right;
+}
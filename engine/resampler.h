@@ -0,0 +1,46 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+//
+// RESAMPLER
+//
+// a windowed sinc resampler for looped audio. The kernel is tabulated at
+// RESAMPLE_PHASES fractional positions and interpolated between them, so
+// any ratio is handled the same way. The input is treated as a loop, the
+// samples before its start are taken from its end and the other way round.
+//
+#define RESAMPLE_ZEROS		16			// zero crossings each side, taps are twice this
+#define RESAMPLE_TAPS		(2 * RESAMPLE_ZEROS)
+#define RESAMPLE_PHASES		256
+#define RESAMPLE_BETA		8.0			// kaiser window
+
+class Resampler {
+
+	float *table, *table_mem;			// RESAMPLE_PHASES+1 rows of RESAMPLE_TAPS
+	double step;
+
+public:
+
+	Resampler(int, int);
+	~Resampler();
+	void run(const float *, const float *, int, float *, float *, int);
+};
@@ -61,18 +61,10 @@ void Section::tempo(int n) {
 		maxframes = MIN_FRAMES;
 }
 
-void Section::settempo(char *p) {
+void Section::settempo(int t) {
 	//
 	// set the maxframes according to the percentage passed - max tempo is minimum maxframes!
 	//
-	char digits[4];
-	digits[0] = *p++;
-	digits[1] = *p++;
-	digits[2] = *p++;
-	digits[3] = '\0';
-
-	int t = atoi(digits);
-	
 	maxframes = ( ( (MAX_FRAMES-MIN_FRAMES) * (100-t) ) / 100 ) + MIN_FRAMES;
 }
 
@@ -29,7 +29,7 @@ public:
 	
 	Section();
 	void tempo(int n);
-	void settempo(char *p);
+	void settempo(int);
 	void adj_divisions(int n, bool bpm_mode );
 	void adj_beats(int n);
 
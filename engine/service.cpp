@@ -30,6 +30,7 @@ SOFTWARE.
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <pthread.h>
+#include <time.h>
 //#include <sys/stat.h> 
 #include <fcntl.h>
 #include <zlib.h>
@@ -39,6 +40,8 @@ SOFTWARE.
 #include "../common/network.h"
 #include "../common/udpstruct.h"
 #include "../common/request.h"
+#include "../common/chunkstore.h"
+#include "../common/logger.h"
 #include "framecollection.h"
 #include "internalclick.h"
 #include "state.h"
@@ -55,107 +58,251 @@ char stemplate[64];
 
 bool download_state_request = true;
 
+// chunks of tracks we have uploaded or downloaded, by digest
+ChunkStore *chunk_cache = NULL;
+
+void service_init() {
+	// the chunk store lives in the directory we run from when hosting
+	chunk_cache = new ChunkStore( CHUNK_DIR );
+}
+
+static void trim_cache() {
+	// keep the chunk store within its configured size
+	int removed;
+	if( config.chunkcache <= 0 ) return;
+	if( (removed = chunk_cache->trim( config.chunkcache * 1048576L )) > 0 )
+		logger.put( LOG_INFO, "chunk store trimmed of %d chunks\n", removed );
+}
+
+int copy_fd(int from_fd, int to_fd) {
+	// copy the rest of one file to another, return bytes copied
+	int readcnt, total = 0;
+	while( (readcnt = read( from_fd, buffer, BUFFER_SIZE )) > 0 ) {
+		write( to_fd, buffer, readcnt );
+		total += readcnt;
+	}
+	return total;
+}
+
+int temp_fd() {
+	// an anonymous temporary file, gone when closed
+	int fd;
+	strcpy(stemplate, "loopR-XXXXXX");
+	if( (fd = mkstemp(stemplate)) >= 0 )
+		unlink(stemplate);
+	else
+		perror("temp_fd mkstemp");
+	return fd;
+}
+
+static void close_fd(int fd) {
+	// close a temporary file that may not have been opened
+	if( fd >= 0 ) close( fd );
+}
+
 int service_upload(Track *track) {
 	// upload the indicated track to server
-	int left_fd, right_fd, midi_fd, stream_fd;
-	int readcnt;
-	// first thing in the output stream is the track data from class instance
-	long cnt, streamlen = sizeof(Track);
+	int left_fd = -1, right_fd = -1, midi_fd = -1, payload_fd, stream_fd;
+	int i, count, sendcount;
+	long cnt, streamlen, sendlen;
+	struct chunk_ref *refs, ref;
+	unsigned char *flags, *chunk;
 	// reset these for our count
 	track->left_complen = track->right_complen = 0;
+
+	if( track->use_left ) left_fd = temp_fd();
+	if( track->use_right ) right_fd = temp_fd();
+	if( track->use_midi ) midi_fd = temp_fd();
+	payload_fd = temp_fd();
+	if( (track->use_left && left_fd < 0) || (track->use_right && right_fd < 0) ||
+		(track->use_midi && midi_fd < 0) || payload_fd < 0 ) {
+		logger.put( LOG_ERROR, "service_upload: no temporary files for track %s\n", track->name );
+		close_fd( left_fd );
+		close_fd( right_fd );
+		close_fd( midi_fd );
+		close_fd( payload_fd );
+		return 1;
+	}
+
 	// transfer the output channels to the temp files	
 	if( track->use_left ) {
-		strcpy(stemplate, "loopR-XXXXXX");
-		left_fd = mkstemp(stemplate);
 		track->write_left( left_fd );
 		cnt = lseek( left_fd, 0, SEEK_CUR );
-		streamlen += cnt;
 		track->left_complen = cnt;
 	}
 
 	if( track->use_right ) {
-		strcpy(stemplate, "loopR-XXXXXX");
-		right_fd = mkstemp(stemplate);
 		track->write_right( right_fd );
 		cnt = lseek( right_fd, 0, SEEK_CUR );
-		streamlen += cnt;
 		track->right_complen = cnt;
 	}
 
-	if( track->use_midi ) {
-		strcpy(stemplate, "loopR-XXXXXX");
-		midi_fd = mkstemp(stemplate);
+	if( track->use_midi ) 
 		track->write_midi( midi_fd );
-		streamlen += lseek( midi_fd, 0, SEEK_CUR );
-	}
 
-	// now that we know the total length, set up for the put transfer
-	network.putter_connect();
-	stream_fd = network.start_put( streamlen );
-	
-	// write the track data first
-	write( stream_fd, track, sizeof( Track ) );
+	// assemble the payload: first the track data from class instance, then the channels
+	track->write_record( payload_fd );
 	
 	if( track->use_left ) {
 		lseek( left_fd, 0, SEEK_SET );
-		while( (readcnt = read( left_fd, buffer, BUFFER_SIZE )) > 0 )
-			write( stream_fd, buffer, readcnt );
+		copy_fd( left_fd, payload_fd );
 		close( left_fd );
 	}
 	
 	if( track->use_right ) {
 		lseek( right_fd, 0, SEEK_SET );
-		while( (readcnt = read( right_fd, buffer, BUFFER_SIZE )) > 0 )
-			write( stream_fd, buffer, readcnt );
+		copy_fd( right_fd, payload_fd );
 		close( right_fd );
 	}
 	
 	if( track->use_midi ) {
 		lseek( midi_fd, 0, SEEK_SET );
-		while( (readcnt = read( midi_fd, buffer, BUFFER_SIZE )) > 0 )
-			write( stream_fd, buffer, readcnt );
+		copy_fd( midi_fd, payload_fd );
 		close( midi_fd );
 	}
+	streamlen = lseek( payload_fd, 0, SEEK_CUR );
+
+	// cut the payload into chunks, keeping them in our own store
+	lseek( payload_fd, 0, SEEK_SET );
+	count = chunk_cache->split( payload_fd, &refs, true );
+	close( payload_fd );
+	if( count < 0 ) {
+		logger.put( LOG_ERROR, "service_upload: failure to chunk track %s\n", track->name );
+		return 1;
+	}
+	if( count > CHUNK_COUNT_MAX ) {
+		logger.put( LOG_ERROR, "service_upload: track %s is too long to upload\n", track->name );
+		delete[] refs;
+		return 1;
+	}
+
+	// ask the server what it already has, then send only the missing chunks
+	flags = new unsigned char[count];
+	chunk = new unsigned char[CHUNK_MAX];
+	network.putter_connect();
+	if( network.put_have( refs, count, flags ) ) {
+		logger.put( LOG_ERROR, "service_upload: no chunk list back for track %s\n", track->name );
+		network.putter_disconnect();
+		delete[] refs;
+		delete[] flags;
+		delete[] chunk;
+		return 1;
+	}
+	sendcount = sendlen = 0;
+	for( i = 0; i < count; i++ ) {
+		flags[i] = !flags[i];
+		if( flags[i] ) {
+			sendcount++;
+			sendlen += refs[i].length;
+		}
+	}
+
+	stream_fd = network.start_put_chunked( refs, count, flags );
+	for( i = 0; i < count; i++ ) {
+		if( !flags[i] ) continue;
+		ref = refs[i];
+		if( chunk_cache->fetch( &ref, chunk ) != (int)refs[i].length ) {
+			// the server expects this chunk next, so cut the connection
+			// rather than let it take the following bytes for this one
+			logger.put( LOG_ERROR, "service_upload: lost chunk %d of track %s\n", i, track->name );
+			close( stream_fd );
+			delete[] refs;
+			delete[] flags;
+			delete[] chunk;
+			return 1;
+		}
+		write( stream_fd, chunk, refs[i].length );
+	}
 	
 	// finish the put by getting the id back and updating track
 	network.end_put( &track->unique_ident );
 	network.putter_disconnect();
 	
-	fprintf(stderr, "service_upload: sent track %s with %d bytes, unique_id=%d\n", 
-		track->name, (int)streamlen, track->unique_ident );
+	logger.put( LOG_INFO, "service_upload: sent track %s with %d bytes, %d of %d chunks (%d bytes) new, unique_id=%d\n", 
+		track->name, (int)streamlen, sendcount, count, (int)sendlen, track->unique_ident );
+
+	delete[] refs;
+	delete[] flags;
+	delete[] chunk;
+	trim_cache();
 	return 0;
 }
 
 int service_download(unsigned int id, Track *track) {
 	// dowload the indicated track from server
-	int left_fd, right_fd, midi_fd, stream_fd;
-	int readreq, readcnt, reqcnt;
+	int left_fd = -1, right_fd = -1, midi_fd = -1, stream_fd;
+	int i, count, fetchcount, readreq, readcnt, reqcnt;
 	long streamlen, streamcnt;
+	struct chunk_ref *refs;
+	unsigned char *chunk;
+	bool short_stream = false;
 	
-	// set up for the get transfer and receive the stream socket fd
-	stream_fd = network.start_get( id, &streamlen );
+	// get the chunk list, and fetch only the chunks we don't hold already
+	if( (count = network.get_manifest( id, &refs, &streamlen )) < 0 )
+		return 1;
+
+	if( (stream_fd = temp_fd()) < 0 ) {
+		delete[] refs;
+		return 1;
+	}
+	chunk = new unsigned char[CHUNK_MAX];
+	fetchcount = 0;
+	for( i = 0; i < count; i++ ) {
+		if( chunk_cache->fetch( &refs[i], chunk ) != (int)refs[i].length ) {
+			if( network.get_chunk( &refs[i], chunk ) != (int)refs[i].length ||
+				!chunk_cache->verify( &refs[i], chunk ) ) {
+				logger.put( LOG_ERROR, "service_download: bad chunk %d for track %d\n", i, id );
+				break;
+			}
+			chunk_cache->store( &refs[i], chunk );
+			fetchcount++;
+		}
+		write( stream_fd, chunk, refs[i].length );
+	}
+	delete[] chunk;
+	delete[] refs;
+	if( i < count ) {
+		close( stream_fd );
+		return 1;
+	}
+	lseek( stream_fd, 0, SEEK_SET );
 
 	// read the track data first
-	read( stream_fd, track, sizeof( Track ) );
-	streamcnt = streamlen - sizeof( Track );
+	if( (readcnt = track->read_record( stream_fd )) < 0 ) {
+		logger.put( LOG_ERROR, "service_download: no track data in track %d\n", id );
+		close( stream_fd );
+		return 1;
+	}
+	streamcnt = streamlen - readcnt;
 	
 	// update the ident value in the track itself and
 	// clear the loadcount
 	track->unique_ident = id;
-	track->loadcount = 0;
+	track->loaded();
+
+	if( track->use_left ) left_fd = temp_fd();
+	if( track->use_right ) right_fd = temp_fd();
+	if( track->use_midi ) midi_fd = temp_fd();
+	if( (track->use_left && left_fd < 0) || (track->use_right && right_fd < 0) ||
+		(track->use_midi && midi_fd < 0) ) {
+		logger.put( LOG_ERROR, "service_download: no temporary files for track %d\n", id );
+		close_fd( left_fd );
+		close_fd( right_fd );
+		close_fd( midi_fd );
+		close( stream_fd );
+		return 1;
+	}
 	
 	// now that we have the track data we know some things
 	if( track->use_left ) {
-		strcpy(stemplate, "loopR-XXXXXX");
-		left_fd = mkstemp(stemplate);
-		if( (reqcnt = track->left_complen) > streamcnt ) {
-			// error condition
-		}
-		while( reqcnt ) {
+		if( (reqcnt = track->left_complen) > streamcnt || reqcnt < 0 ) 
+			short_stream = true;
+		while( reqcnt && !short_stream ) {
 			readreq = ( reqcnt > BUFFER_SIZE) ? BUFFER_SIZE : reqcnt;
 			if( (readcnt = read( stream_fd, buffer, readreq )) <= 0 ) {
-				// error condition
-				}
+				short_stream = true;
+				break;
+			}
 			write( left_fd, buffer, readcnt );
 			reqcnt -= readcnt;
 			streamcnt -= readcnt;
@@ -163,16 +310,14 @@ int service_download(unsigned int id, Track *track) {
 	}
 	
 	if( track->use_right ) {
-		strcpy(stemplate, "loopR-XXXXXX");
-		right_fd = mkstemp(stemplate);
-		if( (reqcnt = track->left_complen) > streamcnt ) {
-			// error condition
-		}
-		while( reqcnt ) {
+		if( (reqcnt = track->right_complen) > streamcnt || reqcnt < 0 ) 
+			short_stream = true;
+		while( reqcnt && !short_stream ) {
 			readreq = ( reqcnt > BUFFER_SIZE) ? BUFFER_SIZE : reqcnt;
 			if( (readcnt = read( stream_fd, buffer, readreq )) <= 0 ) {
-				// error condition
-				}
+				short_stream = true;
+				break;
+			}
 			write( right_fd, buffer, readcnt );
 			reqcnt -= readcnt;
 			streamcnt -= readcnt;
@@ -180,22 +325,28 @@ int service_download(unsigned int id, Track *track) {
 	}
 	
 	if( track->use_midi ) {
-		strcpy(stemplate, "loopR-XXXXXX");
-		midi_fd = mkstemp(stemplate);
 		reqcnt = streamcnt;		// midi data occupies the rest of data stream
-		if( reqcnt <= 0 ) {
-			// error condition
-		}
-		while( reqcnt ) {
+		if( reqcnt <= 0 ) 
+			short_stream = true;
+		while( reqcnt > 0 && !short_stream ) {
 			readreq = ( reqcnt > BUFFER_SIZE) ? BUFFER_SIZE : reqcnt;
 			if( (readcnt = read( stream_fd, buffer, readreq )) <= 0 ) {
-				// error condition
-				}
+				short_stream = true;
+				break;
+			}
 			write( midi_fd, buffer, readcnt );
 			reqcnt -= readcnt;
 			streamcnt -= readcnt;
 		}
 	}
+	close( stream_fd );
+	if( short_stream ) {
+		logger.put( LOG_ERROR, "service_download: track %d is short of its channel data\n", id );
+		close_fd( left_fd );
+		close_fd( right_fd );
+		close_fd( midi_fd );
+		return 1;
+	}
 	
 	// ok, now read these back into the track
 	if( track->use_left ) {
@@ -205,21 +356,23 @@ int service_download(unsigned int id, Track *track) {
 	}
 
 	if( track->use_right ) {
-		lseek( left_fd, 0, SEEK_SET );
+		lseek( right_fd, 0, SEEK_SET );
 		track->read_right( right_fd );
 		close( right_fd );
 	}
 
 	if( track->use_midi ) {
-		lseek( left_fd, 0, SEEK_SET );
+		lseek( midi_fd, 0, SEEK_SET );
 		track->read_midi( midi_fd );
 		close( midi_fd );
 	}
 	
 	// any last adjustments
-	track->playback = track->head;
+	track->rewind();
 	
-	fprintf(stderr, "service_download: recieved track %s with %d bytes\n", track->name, (int)streamlen );
+	logger.put( LOG_INFO, "service_download: recieved track %s with %d bytes, %d of %d chunks fetched\n", 
+		track->name, (int)streamlen, fetchcount, count );
+	trim_cache();
 	return 0;
 }
 
@@ -229,7 +382,7 @@ int service_download(unsigned int id, Track *track) {
 void *service_upload_thread(void *arg) {
 	if( arg == NULL ) {
 		// upload the state and sections
-		fprintf(stderr, "upload thread, uploading state and section data\n" );
+		logger.put( LOG_INFO, "upload thread, uploading state and section data\n" );
 		
 		// precautionary, a client using hosting can't clear these anymore
 		state.framecount = 0;
@@ -245,7 +398,7 @@ void *service_upload_thread(void *arg) {
 		return NULL;
 	}
 	Track *track = (Track *)arg;
-	fprintf(stderr, "upload thread, uploading track %s\n", track->name );
+	logger.put( LOG_INFO, "upload thread, uploading track %s\n", track->name );
 	service_upload( track );
 	return NULL;
 }
@@ -256,7 +409,7 @@ void *service_download_thread( void *arg ) {
 	int trackcount;
 	bool *init_server_req = (bool*) arg;
 	
-	fprintf(stderr, "download thread, init_server_request=%d\n", *init_server_req );
+	logger.put( LOG_INFO, "download thread, init_server_request=%d\n", *init_server_req );
 	// normally we will read the state and sections from server right away and continue
 	if( *init_server_req )
 		download_state_request = false;
@@ -274,13 +427,13 @@ void *service_download_thread( void *arg ) {
 			// update the track count
 			state.trackcount = trackcount;
 			network.get_complete(sections, false, true, false, sizeof(Section) * MAX_SECTIONS );			
-			fprintf(stderr, "(service_download_task) fetched state and section data\n");
+			logger.put( LOG_INFO, "(service_download_task) fetched state and section data\n" );
 		}
 		
 		// fetch a fresh max ident
 		//fprintf(stderr, "(service_download_task) fetching max ident...");
 		network.get_maxids( &newtrackmax, &chatmax );
-		fprintf(stderr, " max ident(track/chat) = %d/%d\n", newtrackmax, chatmax);
+		logger.put( LOG_DEBUG, "(service_download_task) max ident(track/chat) = %d/%d\n", newtrackmax, chatmax );
 
 		// look thru the track list and get the max id we have
 		oldtrackmax = 0;
@@ -296,13 +449,18 @@ void *service_download_thread( void *arg ) {
 			// fetch any tracks we are lacking
 			while( oldtrackmax < newtrackmax ) {
 				track = new Track;
-				fprintf(stderr, "(service_download_task) requesting download\n");
-				service_download( ++oldtrackmax, track );
+				logger.put( LOG_DEBUG, "(service_download_task) requesting download\n" );
+				if( service_download( ++oldtrackmax, track ) ) {
+					// leave this one, try again on the next pass
+					delete track;
+					sleep(1);
+					break;
+				}
 				
 				// lock before append track to list
-				fprintf(stderr, "(service_download_task) acquiring lock...");
+				logger.put( LOG_DEBUG, "(service_download_task) acquiring lock\n" );
 				pthread_mutex_lock( &append_track_mut );
-				fprintf(stderr, "continuing\n");
+				logger.put( LOG_DEBUG, "(service_download_task) lock acquired\n" );
 				
 				if( TrackTail == NULL ) {
 					TrackTail = TrackHead = track;
@@ -315,7 +473,8 @@ void *service_download_thread( void *arg ) {
 					TrackTail = track;
 				}
 				state.trackcount++;
-				fprintf(stderr, "(service_download_task) freeing lock\n");
+				tracks_changed = true;
+				logger.put( LOG_DEBUG, "(service_download_task) freeing lock\n" );
 				pthread_mutex_unlock( &append_track_mut );
 			}
 			
@@ -323,6 +482,6 @@ void *service_download_thread( void *arg ) {
 			sleep(1);
 	}
 
-	fprintf(stderr, "(service_download_task) exiting\n");
+	logger.put( LOG_INFO, "(service_download_task) exiting\n" );
 	return NULL;
 }
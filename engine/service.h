@@ -23,6 +23,8 @@ SOFTWARE.
 
 extern bool download_state_request;
 
+void service_init();
+
 int service_upload(Track *track),
 	service_download(unsigned int, Track *track);
 	
@@ -104,7 +104,7 @@ void State::adj_sections(int n) {
 }
 
 
-void State::record() {
+void State::record(bool armed) {
 	if( stagerecord ) stagerecord = false;
 	else
 		if( playing || framecount > 0L) // stage the recording
@@ -114,7 +114,7 @@ void State::record() {
 			if( recording ) recording = false;
 			else
 				// don't stage, go right to recording if any channel is selected
-				if( rec_left || rec_right || rec_midi )	recording = true;
+				if( armed )	recording = true;
 		}
 
 }
@@ -35,7 +35,7 @@ public:
 	State();
 	~State();
 	void fill(struct Statebuf *);
-	void forward(), back(), record(), long_record(bool);
+	void forward(), back(), record(bool), long_record(bool);
 	void tempo(int n);
 	void settempo(char *p);
 	void adj_divisions(int n);
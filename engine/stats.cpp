@@ -0,0 +1,128 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <jack/jack.h>
+
+#include "../common/udpstruct.h"
+#include "stats.h"
+
+//
+//	STATS.CPP
+//
+
+static long nsecs( struct timespec *from, struct timespec *to ) {
+
+	return (to->tv_sec - from->tv_sec) * 1000000000L + to->tv_nsec - from->tv_nsec;
+}
+
+EngineStats::EngineStats() {
+
+	memset( stage, 0, sizeof stage );
+	memset( histogram, 0, sizeof histogram );
+	total = worst = 0;
+	periods = since = 0;
+	xruns = 0;
+	xrun_usecs = 0.0f;
+}
+
+void EngineStats::begin() {
+	//
+	// the callback starts
+	//
+	clock_gettime( CLOCK_MONOTONIC, &began );
+	mark = began;
+}
+
+void EngineStats::lap(int s) {
+	//
+	// what ran since the last lap was stage s
+	//
+	struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	stage[s] += nsecs( &mark, &now );
+	mark = now;
+}
+
+void EngineStats::end(jack_nframes_t nframes, jack_nframes_t rate) {
+	//
+	// the callback is done, file it by how much of the period it took
+	//
+	struct timespec now;
+	long took, period = (long)nframes * 1000000000L / (rate ? rate : 1);
+	int b;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	took = nsecs( &began, &now );
+	total += took;
+	if( took > worst ) worst = took;
+
+	b = period ? took * (STATS_BUCKETS - 1) / period : STATS_BUCKETS - 1;
+	if( b > STATS_BUCKETS - 1 ) b = STATS_BUCKETS - 1;
+	histogram[b]++;
+	periods++;
+	since++;
+}
+
+void EngineStats::xrun(float delayed) {
+	//
+	// from jack's xrun callback, on its own thread
+	//
+	xrun_usecs = delayed;
+	__sync_fetch_and_add( &xruns, 1 );
+}
+
+void EngineStats::fill(struct Statsbuf *s, jack_nframes_t nframes, jack_nframes_t rate) {
+	//
+	// on the process thread, the averages since the last fill, which start over.
+	// The fault counts are a quick syscall that takes no locks
+	//
+	struct rusage usage;
+	long period = (long)nframes * 1000000000L / (rate ? rate : 1);
+	int i;
+
+	s->periods = periods;
+	s->xruns = xruns;
+	s->xrun_usecs = (unsigned int)xrun_usecs;
+	s->period_nsecs = period;
+	s->average_nsecs = since ? total / since : 0;
+	s->worst_nsecs = worst;
+	s->load = period ? 100.0f * s->average_nsecs / period : 0.0f;
+	for( i = 0; i < STATS_STAGES; i++ ) 
+		s->stage_nsecs[i] = since ? stage[i] / since : 0;
+	memcpy( s->histogram, histogram, sizeof histogram );
+
+	if( getrusage( RUSAGE_THREAD, &usage ) == 0 ) {
+		s->minor_faults = usage.ru_minflt;
+		s->major_faults = usage.ru_majflt;
+	}
+
+	memset( stage, 0, sizeof stage );
+	total = worst = 0;
+	since = 0;
+}
@@ -0,0 +1,46 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+//
+// STATS
+//
+// how long the process callback and each stage of it take, kept on the
+// process thread without locks and handed to the telemetry with every
+// update. Only the xrun count comes in from another thread.
+//
+class EngineStats {
+
+	struct timespec began, mark;
+	long stage[STATS_STAGES];		// nsecs of each stage since the last fill
+	long total, worst;				// nsecs of the callbacks since the last fill
+	unsigned int periods, since;
+	unsigned int histogram[STATS_BUCKETS];
+	volatile unsigned int xruns;
+	volatile float xrun_usecs;
+
+public:
+
+	EngineStats();
+	void begin(), lap(int), end(jack_nframes_t, jack_nframes_t);
+	void xrun(float);
+	void fill(struct Statsbuf *, jack_nframes_t, jack_nframes_t);
+};
@@ -0,0 +1,321 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#include <zlib.h>
+
+#include "../common/network.h"
+#include "../common/udpstruct.h"
+#include "framecollection.h"
+#include "internalclick.h"
+#include "state.h"
+#include "section.h"
+#include "track.h"
+#include "config.h"
+#include "core.h"
+#include "stretch.h"
+
+//
+//	STRETCH.CPP
+//
+//	Output window k starts at frame k * STRETCH_HOP and is nominally taken from
+//	input frame k * STRETCH_HOP * inlen / outlen. Within STRETCH_TOLERANCE of
+//	that we take the spot that best matches what naturally followed window
+//	k-1 in the input, so the overlap adds in phase. The loop is treated as
+//	circular at both ends.
+//
+
+#define LEAD	(STRETCH_WINDOW + STRETCH_TOLERANCE)
+
+static float *wrap( const float *in, int inlen ) {
+	//
+	// copy the loop with its other end wrapped around on either side, a window
+	// that started LEAD frames early or late still reads inside
+	//
+	int j, length = inlen + 3 * LEAD;
+	float *p = new float[length];
+
+	memcpy( p + LEAD, in, inlen * sizeof(float) );
+	for( j = 0; j < LEAD; j++ )
+		p[j] = in[ ((j - LEAD) % inlen + inlen) % inlen ];
+	for( j = LEAD + inlen; j < length; j++ )
+		p[j] = in[ (j - LEAD) % inlen ];
+	return p;
+}
+
+static float correlate( const float *a, const float *b, int n ) {
+	//
+	// n is a multiple of 8
+	//
+#if defined(__SSE__)
+	__m128 s = _mm_setzero_ps(), t = _mm_setzero_ps();
+	for( int j = 0; j < n; j += 8 ) {
+		s = _mm_add_ps( s, _mm_mul_ps( _mm_loadu_ps( a + j ), _mm_loadu_ps( b + j ) ) );
+		t = _mm_add_ps( t, _mm_mul_ps( _mm_loadu_ps( a + j + 4 ), _mm_loadu_ps( b + j + 4 ) ) );
+	}
+	s = _mm_add_ps( s, t );
+	s = _mm_add_ps( s, _mm_movehl_ps( s, s ) );
+	s = _mm_add_ss( s, _mm_shuffle_ps( s, s, 1 ) );
+	return _mm_cvtss_f32( s );
+#else
+	float s = 0.0f;
+	for( int j = 0; j < n; j++ )
+		s += a[j] * b[j];
+	return s;
+#endif
+}
+
+TimeStretch::TimeStretch() {
+	//
+	// a periodic hann window, two of them half a window apart sum to one
+	//
+	window = new float[STRETCH_WINDOW];
+	for( int j = 0; j < STRETCH_WINDOW; j++ )
+		window[j] = 0.5 - 0.5 * cos( 2.0 * M_PI * j / STRETCH_WINDOW );
+}
+
+TimeStretch::~TimeStretch() {
+
+	delete[] window;
+}
+
+void TimeStretch::run(const float *in_left, const float *in_right, int inlen, float *out_left, float *out_right, int outlen) {
+	//
+	// stretch the loop in to outlen frames. Either channel may be NULL, both
+	// are cut at the same places
+	//
+	float *left = NULL, *right = NULL, *mono, *coarse, *weight, c, e, best;
+	int j, k, d, at, pos, prev = 0, natural, length = inlen + 3 * LEAD;
+	int span = STRETCH_HOP / STRETCH_DECIMATE, reach = STRETCH_TOLERANCE / STRETCH_DECIMATE;
+	double ratio = (double)inlen / outlen;
+
+	if( in_left ) left = wrap( in_left, inlen );
+	if( in_right ) right = wrap( in_right, inlen );
+
+	// line the windows up on the sum of the channels, and a coarse copy of it
+	mono = new float[length];
+	for( j = 0; j < length; j++ )
+		mono[j] = (left ? left[j] : 0.0f) + (right ? right[j] : 0.0f);
+	coarse = new float[length / STRETCH_DECIMATE];
+	for( j = 0; j < length / STRETCH_DECIMATE; j++ ) {
+		coarse[j] = 0.0f;
+		for( k = 0; k < STRETCH_DECIMATE; k++ )
+			coarse[j] += mono[j * STRETCH_DECIMATE + k];
+	}
+
+	if( out_left ) memset( out_left, 0, outlen * sizeof(float) );
+	if( out_right ) memset( out_right, 0, outlen * sizeof(float) );
+
+	// the windows only sum to one where outlen is a multiple of the hop, keep
+	// their sum so the seam can be evened out for any length
+	weight = new float[outlen];
+	memset( weight, 0, outlen * sizeof(float) );
+
+	for( k = 0; k * STRETCH_HOP < outlen; k++ ) {
+
+		pos = LEAD + (int)( (double)k * STRETCH_HOP * ratio );
+
+		if( k ) {
+			// coarse search, normalised by the energy under the candidate
+			natural = (prev + STRETCH_HOP) / STRETCH_DECIMATE;
+			at = pos / STRETCH_DECIMATE - reach;
+			e = correlate( coarse + at, coarse + at, span );
+			best = -1e30f;
+			j = at + reach;
+			for( d = -reach; d <= reach; d++, at++ ) {
+				c = correlate( coarse + natural, coarse + at, span ) / sqrtf( e + 1e-9f );
+				if( c > best ) { best = c; j = at; }
+				e += coarse[at + span] * coarse[at + span] - coarse[at] * coarse[at];
+				if( e < 0.0f ) e = 0.0f;
+			}
+
+			// then refine it at full rate
+			natural = prev + STRETCH_HOP;
+			at = j * STRETCH_DECIMATE;
+			best = -1e30f;
+			for( d = -STRETCH_DECIMATE; d <= STRETCH_DECIMATE; d++ ) {
+				e = correlate( mono + at + d, mono + at + d, STRETCH_HOP );
+				c = correlate( mono + natural, mono + at + d, STRETCH_HOP ) / sqrtf( e + 1e-9f );
+				if( c > best ) { best = c; pos = at + d; }
+			}
+		}
+
+		// overlap add the window, the end of the last one folds onto the start
+		at = k * STRETCH_HOP;
+		for( j = 0; j < STRETCH_WINDOW; j++, at++ ) {
+			if( at == outlen ) at = 0;
+			weight[at] += window[j];
+			if( left ) out_left[at] += window[j] * left[pos + j];
+			if( right ) out_right[at] += window[j] * right[pos + j];
+		}
+		prev = pos;
+	}
+
+	for( j = 0; j < outlen; j++ ) 
+		if( weight[j] > 0.0f && weight[j] != 1.0f ) {
+			if( out_left ) out_left[j] /= weight[j];
+			if( out_right ) out_right[j] /= weight[j];
+		}
+
+	delete[] weight;
+	delete[] coarse;
+	delete[] mono;
+	delete[] left;
+	delete[] right;
+}
+
+Stretcher::Stretcher() {
+
+	queue_in = queue_out = retiredcount = 0;
+	running = stopping = false;
+	sem_init( &wakeup, 0, 0 );
+}
+
+Stretcher::~Stretcher() {
+
+	sem_destroy( &wakeup );
+}
+
+int Stretcher::start() {
+
+	stopping = false;
+	if( pthread_create( &thread_id, NULL, thread, this ) ) {
+		perror("Stretcher::start pthread_create");
+		return 1;
+	}
+	running = true;
+	return 0;
+}
+
+int Stretcher::stop() {
+
+	if( !running ) return 0;
+	stopping = true;
+	sem_post( &wakeup );
+	pthread_join( thread_id, NULL );
+	running = false;
+	return 0;
+}
+
+bool Stretcher::post(Track *track) {
+	//
+	// called from process only, queue a track whose length no longer fits
+	//
+	int next = (queue_in + 1) % STRETCH_QUEUE;
+
+	if( !running || next == queue_out ) return false;
+	queue[queue_in] = track;
+	__sync_synchronize();
+	queue_in = next;
+	sem_post( &wakeup );
+	return true;
+}
+
+void Stretcher::stretch(Track *track) {
+	//
+	// build the track at its section length from the original recording,
+	// or go back to the original when stretching has been turned off
+	//
+	usleep( STRETCH_SETTLE * 1000 );
+
+	if( track->stretch ) {
+		track->pending_length = track->section_frames();
+		if( !track->orig_head ) {
+			if( track->pending_length == track->length ) {
+				// the section may have moved on while we settled
+				track->busy = false;
+				tracks_changed = true;
+				return;
+			}
+			track->orig_head = track->head;
+			track->orig_tail = track->tail;
+			track->orig_count = track->collcount;
+			track->orig_length = track->length;
+		}
+		track->rebuild( track->orig_head, track->orig_count, track->orig_length, REBUILD_STRETCH );
+	} else {
+		if( !track->orig_head ) {
+			track->busy = false;
+			tracks_changed = true;
+			return;
+		}
+		track->pending_head = track->orig_head;
+		track->pending_tail = track->orig_tail;
+		track->pending_count = track->orig_count;
+		track->pending_length = track->orig_length;
+		track->pending_flipped = false;
+		track->orig_head = track->orig_tail = NULL;
+		track->orig_count = track->orig_length = 0;
+	}
+
+	__sync_synchronize();
+	track->swap_pending = true;
+	retired[retiredcount++] = track;
+}
+
+void *Stretcher::thread(void *arg) {
+
+	Stretcher *s = (Stretcher *) arg;
+	struct timespec ts;
+	int i;
+
+	while( !s->stopping ) {
+
+		clock_gettime( CLOCK_REALTIME, &ts );
+		ts.tv_nsec += 50000000;
+		if( ts.tv_nsec >= 1000000000 ) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		sem_timedwait( &s->wakeup, &ts );
+
+		// take new work while there is room to keep it until it is swapped in
+		while( s->queue_out != s->queue_in && s->retiredcount < STRETCH_QUEUE && !s->stopping ) {
+			s->stretch( s->queue[s->queue_out] );
+			s->queue_out = (s->queue_out + 1) % STRETCH_QUEUE;
+		}
+
+		// free whatever process has swapped out
+		for( i = 0; i < s->retiredcount; )
+			if( !s->retired[i]->swap_pending ) {
+				s->retired[i]->release();
+				s->retired[i] = s->retired[--s->retiredcount];
+			} else
+				i++;
+	}
+	return NULL;
+}
@@ -0,0 +1,69 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+//
+// STRETCH
+//
+// tempo following for loops. TimeStretch changes the length of a loop
+// without changing its pitch, by overlap adding windows of the input taken
+// at the new rate. Each window is nudged to where it best continues the one
+// before it (WSOLA). The Stretcher thread keeps stretched tracks at the
+// length of their section, building the new version from the original
+// recording and leaving it for process to swap in at the loop boundary.
+//
+#define STRETCH_WINDOW		2048		// frames, windows overlap by half
+#define STRETCH_HOP			(STRETCH_WINDOW / 2)
+#define STRETCH_TOLERANCE	512			// frames a window may move to line up
+#define STRETCH_DECIMATE	4			// the coarse search looks at every 4th frame
+#define STRETCH_QUEUE		64
+#define STRETCH_SETTLE		200			// msec to let the tempo settle before stretching
+
+class TimeStretch {
+
+	float *window;
+
+public:
+
+	TimeStretch();
+	~TimeStretch();
+	void run(const float *, const float *, int, float *, float *, int);
+};
+
+class Stretcher {
+
+	Track *queue[STRETCH_QUEUE], *retired[STRETCH_QUEUE];
+	volatile int queue_in, queue_out;
+	int retiredcount;
+	volatile bool running, stopping;
+	sem_t wakeup;
+	pthread_t thread_id;
+
+	void stretch(Track *);
+	static void *thread(void *);
+
+public:
+
+	Stretcher();
+	~Stretcher();
+	int start(), stop();
+	bool post(Track *);
+};
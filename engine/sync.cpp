@@ -0,0 +1,352 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#include <jack/jack.h>
+#include "sync.h"
+
+//
+//	SYNC.CPP
+//
+//	Times are jack_get_time() microseconds. A position message carries the
+//	master time at the start of the cycle its framecount belongs to. A ping
+//	carries the follower time it was sent at, and the pong returns it with
+//	the master time it was answered at, so that
+//
+//		offset = master time - (ping time + round trip / 2)
+//
+
+TransportSync::TransportSync() {
+
+	mode = SYNC_OFF;
+	sockfd = pingfd = -1;
+	version = 0;
+	sequence = 0;
+	pings = 0;
+	have_master = have_offset = false;
+	offset = 0;
+	integral = carry = 0.0;
+	stopping = false;
+	memset( &shared, 0, sizeof shared );
+}
+
+int TransportSync::start(int m, const char *groupname, const char *port, int rate) {
+
+	struct addrinfo hints, *res;
+	int rv, yes = 1;
+	unsigned char ttl = 1;
+
+	memset( &hints, 0, sizeof hints );
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	if( (rv = getaddrinfo( groupname, port, &hints, &res )) != 0 ) {
+		fprintf(stderr, "sync: getaddrinfo %s\n", gai_strerror(rv));
+		return 1;
+	}
+	memcpy( &group, res->ai_addr, res->ai_addrlen );
+	grouplen = res->ai_addrlen;
+	freeaddrinfo( res );
+
+	struct sockaddr_in *g = (struct sockaddr_in *)&group;
+	bool multicast = IN_MULTICAST( ntohl( g->sin_addr.s_addr ) );
+
+	if( (sockfd = socket( AF_INET, SOCK_DGRAM, 0 )) == -1 ) {
+		perror("sync: socket");
+		return 1;
+	}
+
+	if( m == SYNC_MASTER ) {
+		if( multicast )
+			setsockopt( sockfd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof ttl );
+	} else {
+		// followers on one machine all bind the group port
+		struct sockaddr_in any;
+		memset( &any, 0, sizeof any );
+		any.sin_family = AF_INET;
+		any.sin_port = g->sin_port;
+		any.sin_addr.s_addr = htonl( INADDR_ANY );
+		setsockopt( sockfd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof yes );
+		if( bind( sockfd, (struct sockaddr *)&any, sizeof any ) == -1 ) {
+			perror("sync: bind");
+			close( sockfd );
+			return 1;
+		}
+		if( multicast ) {
+			struct ip_mreq mreq;
+			mreq.imr_multiaddr = g->sin_addr;
+			mreq.imr_interface.s_addr = htonl( INADDR_ANY );
+			if( setsockopt( sockfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof mreq ) == -1 )
+				perror("sync: join group");
+		}
+		// pings go out and pongs come back on a socket of our own
+		if( (pingfd = socket( AF_INET, SOCK_DGRAM, 0 )) == -1 ) {
+			perror("sync: socket");
+			close( sockfd );
+			return 1;
+		}
+	}
+
+	mode = m;
+	sample_rate = rate;
+	stopping = false;
+	if( pthread_create( &thread_id, NULL, thread, this ) ) {
+		perror("sync: pthread_create");
+		mode = SYNC_OFF;
+		return 1;
+	}
+	fprintf(stderr, "sync: %s on %s:%s\n", mode == SYNC_MASTER ? "master" : "follower", groupname, port);
+	return 0;
+}
+
+int TransportSync::stop() {
+
+	if( mode == SYNC_OFF ) return 0;
+	stopping = true;
+	pthread_join( thread_id, NULL );
+	close( sockfd );
+	if( pingfd >= 0 ) close( pingfd );
+	mode = SYNC_OFF;
+	return 0;
+}
+
+//
+// the position is shared with the process callback under a sequence count,
+// odd while it is being written. The reader gives up rather than spin
+//
+void TransportSync::store(struct sync_position *p) {
+
+	version++;
+	__sync_synchronize();
+	shared = *p;
+	__sync_synchronize();
+	version++;
+}
+
+bool TransportSync::load(struct sync_position *p) {
+
+	for( int tries = 0; tries < 4; tries++ ) {
+		unsigned int v = version;
+		if( v & 1 ) continue;
+		__sync_synchronize();
+		*p = shared;
+		__sync_synchronize();
+		if( version == v ) return true;
+	}
+	return false;
+}
+
+void TransportSync::publish(long long time, unsigned int framecount, int section, bool playing) {
+	//
+	// master, called from process with the time of the cycle start
+	//
+	struct sync_position p;
+
+	p.time = time;
+	p.framecount = framecount;
+	p.sample_rate = sample_rate;
+	p.section = section;
+	p.playing = playing;
+	store( &p );
+}
+
+bool TransportSync::target(long long time, unsigned int *framecount, int *section, bool *playing) {
+	//
+	// follower, called from process: where the master is at our time. The
+	// framecount may run past the end of the section
+	//
+	struct sync_position p;
+
+	if( !load( &p ) || p.time == 0 ) return false;
+
+	// the master has gone quiet, stay where we are
+	if( time - p.time > 1000000 ) return false;
+
+	*section = p.section;
+	*playing = p.playing;
+	*framecount = p.framecount;
+	if( p.playing && time > p.time )
+		*framecount += ((time - p.time) * p.sample_rate) / 1000000;
+	return true;
+}
+
+int TransportSync::slew(int error) {
+	//
+	// frames to add to this cycle's advance, a positive error means we are behind
+	//
+	integral += SYNC_KI * error;
+	if( integral > SYNC_SLEW_MAX ) integral = SYNC_SLEW_MAX;
+	if( integral < -SYNC_SLEW_MAX ) integral = -SYNC_SLEW_MAX;
+
+	double c = SYNC_KP * error + integral + carry;
+	if( c > SYNC_SLEW_MAX ) c = SYNC_SLEW_MAX;
+	if( c < -SYNC_SLEW_MAX ) c = -SYNC_SLEW_MAX;
+
+	int frames = (int)c;
+	carry = c - frames;
+	return frames;
+}
+
+void TransportSync::reset() {
+
+	integral = carry = 0.0;
+}
+
+void *TransportSync::thread(void *p) {
+
+	TransportSync *sync = (TransportSync *)p;
+
+	if( sync->mode == SYNC_MASTER ) sync->run_master();
+	else sync->run_follower();
+	return NULL;
+}
+
+void TransportSync::run_master() {
+
+	struct sync_packet packet;
+	struct sync_position p;
+	struct sockaddr_storage from;
+	socklen_t fromlen;
+	struct pollfd pfd;
+	long long now, next = 0;
+
+	pfd.fd = sockfd;
+	pfd.events = POLLIN;
+
+	while( !stopping ) {
+
+		now = jack_get_time();
+		int wait = next > now ? (next - now) / 1000 : 0;
+		if( poll( &pfd, 1, wait ) > 0 ) {
+			fromlen = sizeof from;
+			if( recvfrom( sockfd, &packet, sizeof packet, 0, (struct sockaddr *)&from, &fromlen ) == sizeof packet &&
+					packet.magic == SYNC_MAGIC && packet.type == SYNC_PING ) {
+				// answer with our time, the ping time goes back as it came
+				packet.type = SYNC_PONG;
+				packet.time2 = jack_get_time();
+				sendto( sockfd, &packet, sizeof packet, 0, (struct sockaddr *)&from, fromlen );
+			}
+		}
+
+		now = jack_get_time();
+		if( now < next ) continue;
+		next = now + SYNC_INTERVAL_MS * 1000;
+
+		if( !load( &p ) || p.time == 0 ) continue;
+		memset( &packet, 0, sizeof packet );
+		packet.magic = SYNC_MAGIC;
+		packet.version = SYNC_VERSION;
+		packet.type = SYNC_POSITION;
+		packet.sequence = ++sequence;
+		packet.time = p.time;
+		packet.framecount = p.framecount;
+		packet.sample_rate = p.sample_rate;
+		packet.current_section = p.section;
+		packet.playing = p.playing;
+		if( sendto( sockfd, &packet, sizeof packet, 0, (struct sockaddr *)&group, grouplen ) == -1 )
+			perror("sync: sendto");
+	}
+}
+
+void TransportSync::measure(struct sync_packet *packet, long long now) {
+	//
+	// a pong came back, keep the offset measured with the fastest round trip
+	//
+	int i, best = 0, n;
+
+	rtts[pings % SYNC_PINGS] = now - packet->time;
+	offsets[pings % SYNC_PINGS] = packet->time2 - (packet->time + (now - packet->time) / 2);
+	pings++;
+
+	n = pings < SYNC_PINGS ? pings : SYNC_PINGS;
+	for( i = 1; i < n; i++ )
+		if( rtts[i] < rtts[best] ) best = i;
+	offset = offsets[best];
+	have_offset = true;
+}
+
+void TransportSync::run_follower() {
+
+	struct sync_packet packet;
+	struct sync_position p;
+	struct sockaddr_storage from;
+	socklen_t fromlen;
+	struct pollfd pfd[2];
+	long long now, next_ping = 0;
+
+	pfd[0].fd = sockfd;
+	pfd[1].fd = pingfd;
+	pfd[0].events = pfd[1].events = POLLIN;
+
+	while( !stopping ) {
+
+		if( poll( pfd, 2, SYNC_INTERVAL_MS ) > 0 ) {
+			now = jack_get_time();
+
+			fromlen = sizeof from;
+			if( (pfd[0].revents & POLLIN) && 
+					recvfrom( sockfd, &packet, sizeof packet, 0, (struct sockaddr *)&from, &fromlen ) == sizeof packet &&
+					packet.magic == SYNC_MAGIC && packet.version == SYNC_VERSION && packet.type == SYNC_POSITION ) {
+				// the position message tells us where to send pings
+				memcpy( &master, &from, fromlen );
+				masterlen = fromlen;
+				have_master = true;
+				if( have_offset ) {
+					p.time = packet.time - offset;
+					p.framecount = packet.framecount;
+					p.sample_rate = packet.sample_rate;
+					p.section = packet.current_section;
+					p.playing = packet.playing;
+					store( &p );
+				}
+			}
+
+			if( (pfd[1].revents & POLLIN) && 
+					recv( pingfd, &packet, sizeof packet, 0 ) == sizeof packet &&
+					packet.magic == SYNC_MAGIC && packet.type == SYNC_PONG )
+				measure( &packet, now );
+		}
+
+		now = jack_get_time();
+		if( !have_master || now < next_ping ) continue;
+
+		// measure quickly at first, then just often enough to follow any drift
+		next_ping = now + (pings < SYNC_PINGS ? SYNC_INTERVAL_MS : SYNC_PING_MS) * 1000;
+		memset( &packet, 0, sizeof packet );
+		packet.magic = SYNC_MAGIC;
+		packet.version = SYNC_VERSION;
+		packet.type = SYNC_PING;
+		packet.sequence = ++sequence;
+		packet.time = now;
+		if( sendto( pingfd, &packet, sizeof packet, 0, (struct sockaddr *)&master, masterlen ) == -1 )
+			perror("sync: ping");
+	}
+}
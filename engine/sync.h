@@ -0,0 +1,99 @@
+/* MIT License
+
+Copyright (c) 2018 John D. Derry
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+//
+// TRANSPORTSYNC
+//
+// keeps the transport of several engines together. The master sends its
+// section and frame position with a timestamp to the sync group. A follower
+// measures the offset between its clock and the master's, works out where
+// the master is at the start of each process cycle, and slews its own
+// position toward it, jumping only when it is too far away to slew. A slew
+// plays a period's tracks a frame fast or slow, read between the frames,
+// so a correction changes the rate for a moment and never jumps.
+//
+#define SYNC_OFF			0
+#define SYNC_MASTER			1
+#define SYNC_FOLLOWER		2
+
+#define SYNC_MAGIC			0x6c53		// "lS"
+#define SYNC_VERSION		1
+
+#define SYNC_POSITION		1			// master to group: position at a time
+#define SYNC_PING			2			// follower to master: follower time
+#define SYNC_PONG			3			// master to follower: follower time, master time
+
+#define SYNC_INTERVAL_MS	100			// between position messages
+#define SYNC_PING_MS		1000		// between offset measurements
+#define SYNC_PINGS			8			// measurements kept, the fastest round trip wins
+#define SYNC_JUMP			8192		// frames, larger errors jump instead of slewing
+#define SYNC_SLEW_MAX		1			// most frames of correction in one cycle
+#define SYNC_SLIP_FRAMES	16			// fewest frames a correction is spread over
+#define SYNC_KP				0.05		// proportional and integral gains of the slew
+#define SYNC_KI				0.0005
+
+struct sync_packet {
+	unsigned short magic;
+	unsigned char version, type;
+	unsigned int sequence;
+	long long time, time2;				// usecs, see the message types
+	unsigned int framecount, sample_rate;
+	short current_section;
+	unsigned char playing;
+};
+
+class TransportSync {
+
+	struct sync_position {
+		long long time;					// master clock
+		unsigned int framecount, sample_rate;
+		int section;
+		bool playing;
+	} shared;
+	volatile unsigned int version;
+
+	int sockfd, pingfd, sample_rate;
+	unsigned int sequence;
+	struct sockaddr_storage group, master;
+	socklen_t grouplen, masterlen;
+	long long offset, rtts[SYNC_PINGS], offsets[SYNC_PINGS];
+	int pings;
+	bool have_master, have_offset;
+	double integral, carry;
+	pthread_t thread_id;
+	volatile bool stopping;
+
+	void store(struct sync_position *);
+	bool load(struct sync_position *);
+	void run_master(), run_follower(), measure(struct sync_packet *, long long);
+	static void *thread(void *);
+
+public:
+	int mode;
+
+	TransportSync();
+	int start(int, const char *, const char *, int), stop();
+	void publish(long long, unsigned int, int, bool);
+	bool target(long long, unsigned int *, int *, bool *);
+	int slew(int);
+	void reset();
+};
@@ -23,6 +23,8 @@ SOFTWARE.
 #include <stdio.h>
 #include <unistd.h> 
 #include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -42,15 +44,48 @@ SOFTWARE.
 #include "track.h"
 #include "config.h"
 #include "core.h"
+#include "service.h"
+#include "resampler.h"
+#include "stretch.h"
+#include "effects.h"
 
 Track::Track( ) {
 	head = tail = playback = NULL;
 	collcount = loadcount = 0;
+	pending_head = pending_tail = orig_head = orig_tail = NULL;
+	pending_count = orig_count = 0;
+	offset = position = length = pending_length = orig_length = 0;
+	swap_pending = busy = stretch = false;
+	// a track read in whole gets its effects from loaded()
+	effects = NULL;
+	bus = 0;
+	bus_next = mix_next = part_next = NULL;
+	mix_bus = part_order = 0;
+	mix_cost = 0;
+	reversed = pending_flipped = flip = upload = false;
+	part = bank = program = channel = 0;
+	use_left = use_right = use_midi = false;
+	mute = solo = remove = longtrack = start = false;
+	volume_left = volume_right = volume_midi = 1.0f;
+	peak_left = peak_right = peak_midi = 0;
+	next = prev = NULL;
+	name[0] = '\0';
+	unique_ident = left_complen = right_complen = 0;
 }
 
 Track::Track(int partnum, int nameseq ) {
 	head = tail = playback = NULL;
 	collcount = loadcount = 0;
+	pending_head = pending_tail = orig_head = orig_tail = NULL;
+	pending_count = orig_count = 0;
+	offset = position = length = pending_length = orig_length = 0;
+	swap_pending = busy = stretch = false;
+	effects = new EffectChain;
+	bus = 0;
+	bus_next = mix_next = part_next = NULL;
+	mix_bus = part_order = 0;
+	mix_cost = 0;
+	reversed = pending_flipped = flip = upload = false;
 	part = partnum;
 	bank = state.bank;
 	program = state.program;
@@ -98,29 +133,363 @@ Track::~Track() {
 			delete ptr;
 		}
 	}
+
+	// and the original recording of a stretched track
+	while( orig_head != head && orig_count-- && (ptr=orig_tail) ) {
+		orig_tail = ptr->get_prev();
+		delete ptr;
+	}
+	delete effects;
 }
 
-bool Track::advance( ) {
+void Track::turn( ) {
+	//
+	// a change of direction asked for by reverse(). The cursor stays on the
+	// same frame, now counted from the other end
+	//
+	reversed = !reversed;
+	flip = false;
+	if( playback ) {
+		offset = playback->get_nframes() - offset;
+		position = length - position;
+	}
+}
 
-	playback = playback->get_next();
+bool Track::advance( ) {
+	//
+	// move the cursor on to the next collection, wrapping a loop track to its start
+	//
+	offset = 0;
+	playback = reversed ? playback->get_prev() : playback->get_next();
 	if( playback == NULL && !longtrack ) {
-		playback = head;
+		rewind();
 		return true;
 	}
 	return false;
 }
 
-void Track::sum( FrameCollection *f, unsigned count ) {
-	sum( f, count, 1.0f, 1.0f, 1.0f );
+void Track::rewind( ) {
+	//
+	// back to the start of the track, which is the end of the last frame when
+	// reversed. Collections hold NFRAMES, the last one may be partly unused
+	//
+	if( flip ) {
+		reversed = !reversed;
+		flip = false;
+	}
+	if( length == 0 || length > (unsigned)collcount * NFRAMES ) 
+		length = collcount * NFRAMES;
+	position = 0;
+	playback = reversed ? tail : head;
+	offset = reversed ? collcount * NFRAMES - length : 0;
+}
+
+void Track::seek( unsigned int frames ) {
+	//
+	// put the cursor frames into the track
+	//
+	unsigned int n;
+
+	rewind();
+	if( !longtrack && length ) frames %= length;
+	while( frames && playback ) {
+		n = playback->get_nframes() - offset;
+		if( n > frames ) n = frames;
+		offset += n;
+		position += n;
+		frames -= n;
+		if( offset >= playback->get_nframes() ) 
+			advance();
+	}
+}
+
+void Track::skip( int frames ) {
+	//
+	// move the cursor a few frames on, or back when frames is negative. Used
+	// to slew a following engine onto its master
+	//
+	unsigned int n;
+
+	if( !playback ) return;
+	if( frames < 0 ) {
+		if( (unsigned)-frames > position ) {
+			seek( position + length + frames );
+			return;
+		}
+		frames = -frames;
+		while( frames && playback ) {
+			if( offset == 0 ) {
+				// the other way round from advance()
+				playback = reversed ? playback->get_next() : playback->get_prev();
+				if( !playback ) break;
+				offset = playback->get_nframes();
+			}
+			n = (unsigned)frames < offset ? frames : offset;
+			offset -= n;
+			position -= n;
+			frames -= n;
+		}
+		return;
+	}
+	while( frames && playback ) {
+		if( position >= length ) {
+			if( longtrack ) {
+				playback = NULL;
+				break;
+			}
+			rewind();
+		}
+		n = playback->get_nframes() - offset;
+		if( n > (unsigned)frames ) n = frames;
+		if( n > length - position ) n = length - position;
+		offset += n;
+		position += n;
+		frames -= n;
+		if( offset >= playback->get_nframes() ) 
+			advance();
+	}
+}
+
+void Track::loaded( ) {
+	//
+	// the track was just read back whole from disk or the server, so
+	// clear whatever belonged to the collections it had then
+	//
+	loadcount = 0;
+	pending_head = pending_tail = orig_head = orig_tail = NULL;
+	pending_count = orig_count = pending_length = orig_length = 0;
+	swap_pending = busy = flip = upload = pending_flipped = false;
+	offset = position = 0;
+
+	// nor are the effects or the mixing links the ones it had then
+	effects = new EffectChain;
+	bus_next = mix_next = part_next = NULL;
+	mix_cost = 0;
+}
+
+//
+// the Track as it was written whole before the track record, kept to read
+// old seq-state files and tracks already on a server
+//
+struct old_track {
+	void	*head, *tail, *playback;
+	int		collcount, loadcount, part, bank, program, channel;
+	bool	mute, solo, use_left, use_right, use_midi, remove, longtrack, start;
+	void	*next, *prev;
+	float	volume_left, volume_right, volume_midi;
+	int		peak_left, peak_right, peak_midi;
+	char	name[TRACK_NAME_MAX+1];
+	unsigned int unique_ident, left_complen, right_complen;
+};
+
+int Track::write_record( int fd ) {
+	//
+	// write what outlasts the run, return the bytes written or -1
+	//
+	struct track_record r;
+
+	memset( &r, 0, sizeof r );
+	r.magic = TRACK_RECORD_MAGIC;
+	r.version = TRACK_RECORD_VERSION;
+	r.size = sizeof r;
+	r.unique_ident = unique_ident;
+	r.left_complen = left_complen;
+	r.right_complen = right_complen;
+	r.length = length;
+	r.collcount = collcount;
+	r.part = part;
+	r.bank = bank;
+	r.program = program;
+	r.channel = channel;
+	r.bus = bus;
+	r.volume_left = volume_left;
+	r.volume_right = volume_right;
+	r.volume_midi = volume_midi;
+	r.mute = mute;
+	r.solo = solo;
+	r.use_left = use_left;
+	r.use_right = use_right;
+	r.use_midi = use_midi;
+	r.longtrack = longtrack;
+	r.stretch = stretch;
+	r.reversed = reversed;
+	strcpy( r.name, name );
+
+	if( write( fd, &r, sizeof r ) != (int)sizeof r ) {
+		perror("Track::write_record");
+		return -1;
+	}
+	return sizeof r;
 }
 
-void Track::sum( FrameCollection *f, unsigned count, float factor_left, float factor_right, float factor_midi ) {
+int Track::read_record( int fd ) {
+	//
+	// read a track record, or the whole Track an older version wrote, over
+	// a default-constructed track. Return the bytes taken or -1
 	//
-	//	Sum any audio frames and midi events from the framecollection at the playback pointer
-	//	into the collection passed to us, applying factors as we go
+	struct track_record r;
+	struct old_track o;
+	int head = 3 * sizeof(unsigned int), n;
+
+	memset( &r, 0, sizeof r );
+	if( read( fd, &r, head ) != head ) return -1;
+
+	if( r.magic != TRACK_RECORD_MAGIC ) {
+		// an old Track starts with a pointer, which never matches the magic
+		memcpy( &o, &r, head );
+		if( read( fd, (char *)&o + head, sizeof o - head ) != (int)(sizeof o - head) ) return -1;
+		collcount = o.collcount;
+		part = o.part;
+		bank = o.bank;
+		program = o.program;
+		channel = o.channel;
+		mute = o.mute;
+		solo = o.solo;
+		use_left = o.use_left;
+		use_right = o.use_right;
+		use_midi = o.use_midi;
+		longtrack = o.longtrack;
+		volume_left = o.volume_left;
+		volume_right = o.volume_right;
+		volume_midi = o.volume_midi;
+		memcpy( name, o.name, TRACK_NAME_MAX );
+		name[TRACK_NAME_MAX] = '\0';
+		unique_ident = o.unique_ident;
+		left_complen = o.left_complen;
+		right_complen = o.right_complen;
+		return sizeof o;
+	}
+
+	// take the fields we know, skip any a later version added
+	if( r.size < (unsigned)head ) return -1;
+	n = r.size < sizeof r ? r.size : sizeof r;
+	if( read( fd, (char *)&r + head, n - head ) != n - head ) return -1;
+	if( r.size > sizeof r && lseek( fd, r.size - sizeof r, SEEK_CUR ) < 0 ) return -1;
+
+	unique_ident = r.unique_ident;
+	left_complen = r.left_complen;
+	right_complen = r.right_complen;
+	length = r.length;
+	collcount = r.collcount;
+	part = r.part;
+	bank = r.bank;
+	program = r.program;
+	channel = r.channel;
+	bus = r.bus;
+	volume_left = r.volume_left;
+	volume_right = r.volume_right;
+	volume_midi = r.volume_midi;
+	mute = r.mute;
+	solo = r.solo;
+	use_left = r.use_left;
+	use_right = r.use_right;
+	use_midi = r.use_midi;
+	longtrack = r.longtrack;
+	stretch = r.stretch;
+	reversed = r.reversed;
+	memcpy( name, r.name, TRACK_NAME_MAX );
+	name[TRACK_NAME_MAX] = '\0';
+	return r.size;
+}
+
+static void reverse_event( jack_midi_event_t *e, jack_midi_data_t *data ) {
+	//
+	// the event as heard backwards. A note on becomes a note off and a
+	// note off a note on, at the velocity pair_notes() left in it
+	//
+	if( e->size != 3 ) return;
+
+	data[1] = e->buffer[1];
+	switch( e->buffer[0] & 0xf0 ) {
+		case 0x90:
+			if( e->buffer[2] ) {
+				data[0] = 0x80 | (e->buffer[0] & 0x0f);
+				data[2] = 0x40;
+				break;
+			}
+			// a note on at zero velocity is a note off
+		case 0x80:
+			data[0] = 0x90 | (e->buffer[0] & 0x0f);
+			data[2] = e->buffer[2] ? e->buffer[2] : 0x40;
+			break;
+		default:
+			return;
+	}
+	e->buffer = data;
+}
+
+static void pair_notes( FrameCollection *fc, int count ) {
 	//
-	//	count represents the desired frame count for summing, but that may not reflect the
-	//	actual frames in the audio sample
+	// give every note off the velocity of the note on it ends, so played
+	// backwards it can start the note the same way. Note ons at zero
+	// velocity become note offs, which means the same going forwards
+	//
+	unsigned char velocity[16][128];
+	jack_midi_event_t *e;
+	unsigned int n;
+
+	memset( velocity, 0x40, sizeof velocity );
+	for( ; fc && count--; fc = fc->get_next() ) 
+		for( n = 0, e = fc->get_events(); n < fc->get_nevents(); n++, e++ ) {
+			if( e->size != 3 || e->buffer[1] > 127 ) continue;
+			unsigned char status = e->buffer[0] & 0xf0, chan = e->buffer[0] & 0x0f;
+			if( status == 0x90 && e->buffer[2] ) 
+				velocity[chan][e->buffer[1]] = e->buffer[2];
+			else if( status == 0x90 || status == 0x80 ) {
+				e->buffer[2] = velocity[chan][e->buffer[1]];
+				e->buffer[0] = 0x80 | chan;
+			}
+		}
+}
+
+void Track::sum( FrameCollection *f, unsigned at, unsigned count, float factor_left, float factor_right, float factor_midi, FrameCollection *m ) {
+	//
+	//	Sum count frames from the cursor into the collection passed to us, starting
+	//	at frame at, and move the cursor on. The frames may span collections, and
+	//	a loop track wraps at its length. A period split at a section end or a
+	//	division calls this once for each piece. Midi goes to m when given, 
+	//	audio summed for the insert effects goes on to the main sum later
+	//
+	unsigned n;
+
+	if( flip ) turn();
+	while( count && playback ) {
+		if( position >= length ) {
+			if( longtrack ) {
+				playback = NULL;
+				break;
+			}
+			rewind();
+		}
+		n = playback->get_nframes() - offset;
+		if( n > count ) n = count;
+		if( n > length - position ) n = length - position;
+
+		mix( f, at, n, factor_left, factor_right, factor_midi, m ? m : f );
+
+		at += n;
+		count -= n;
+		offset += n;
+		position += n;
+		if( offset >= playback->get_nframes() ) 
+			advance();
+	}
+}
+
+void Track::mix( FrameCollection *f, unsigned at, unsigned count, float factor_left, float factor_right, float factor_midi, FrameCollection *m ) {
+	//
+	//	Sum any audio frames from the framecollection at the playback pointer into f
+	//	and midi events into m, applying factors as we go
+	//
+	//	count frames are taken from the cursor offset, which never runs past the end
+	//	of the collection, and are summed in from frame at. A reversed track reads
+	//	the collection from its last frame back. Peaks carry over the pieces of a period
+	
+	int step = reversed ? -1 : 1, start = reversed ? playback->get_nframes() - 1 - offset : offset;
+
+	// the frames read lie from lo on either way, a packed collection unpacks just those
+	int lo = reversed ? start + 1 - count : start;
+	float scratch_left[NFRAMES], scratch_right[NFRAMES];
 
 	if( use_left && use_right ) {
 	
@@ -129,24 +498,30 @@ void Track::sum( FrameCollection *f, unsigned count, float factor_left, float fa
 		int cnt = count;
 
 		// cast the frame buffers into floats so we can sum them
-		sumf_left = (float *) f->get_frames_left();
-		framef_left = (float *) playback->get_frames_left();
-		sumf_right = (float *) f->get_frames_right();
-		framef_right = (float *) playback->get_frames_right();
+		sumf_left = (float *) f->get_frames_left() + at;
+		framef_left = (float *) playback->peek_left( scratch_left, lo, count );
+		sumf_right = (float *) f->get_frames_right() + at;
+		framef_right = (float *) playback->peek_right( scratch_right, lo, count );
+		if( framef_left ) framef_left += start - lo;
+		if( framef_right ) framef_right += start - lo;
+		// nothing to add where both sides are silent
+		if( playback->silent_left() && playback->silent_right() ) 
+			framef_left = framef_right = NULL;
 
 		// sum all audio frames available while obtaining peak values
 		while( cnt-- && framef_left && framef_right ) {
 			if( *framef_left * volume_left > fpeak_left ) fpeak_left = *framef_left * volume_left; 
-			*sumf_left = *sumf_left + (*framef_left++) * volume_left * factor_left;
+			*sumf_left = *sumf_left + (*framef_left) * volume_left * factor_left;
 
 			if( *framef_right * volume_right > fpeak_right ) fpeak_right = *framef_right * volume_right; 
-			*sumf_right = *sumf_right + (*framef_right++) * volume_right * factor_right;
+			*sumf_right = *sumf_right + (*framef_right) * volume_right * factor_right;
 
 			sumf_right++; sumf_left++; 
+			framef_left += step; framef_right += step;
 			}
 
-		peak_left = (int) (fpeak_left * 100.0f);
-		peak_right = (int) (fpeak_right * 100.0f);
+		if( !at || (int) (fpeak_left * 100.0f) > peak_left ) peak_left = (int) (fpeak_left * 100.0f);
+		if( !at || (int) (fpeak_right * 100.0f) > peak_right ) peak_right = (int) (fpeak_right * 100.0f);
 	} 
 	else if( use_left ) {
 		// place channel in left/right according to levels
@@ -155,20 +530,22 @@ void Track::sum( FrameCollection *f, unsigned count, float factor_left, float fa
 		int cnt = count;
 
 		// cast the frame buffers into floats so we can sum them
-		sumf_left = (float *) f->get_frames_left();
-		sumf_right = (float *) f->get_frames_right();
-		framef_left = (float *) playback->get_frames_left();
+		sumf_left = (float *) f->get_frames_left() + at;
+		sumf_right = (float *) f->get_frames_right() + at;
+		framef_left = (float *) playback->peek_left( scratch_left, lo, count );
+		if( framef_left ) framef_left += start - lo;
+		if( playback->silent_left() ) framef_left = NULL;
 
 		// sum all audio frames available while obtaining peak values
 		while( cnt-- && framef_left ) {
 			if( *framef_left * volume_left > fpeak_left ) fpeak_left = *framef_left * volume_left; 
 			*sumf_left = *sumf_left + (*framef_left) * volume_left * factor_left;
-			*sumf_right = *sumf_right + (*framef_left++) * volume_right * factor_right;
+			*sumf_right = *sumf_right + (*framef_left) * volume_right * factor_right;
 
-			sumf_left++; sumf_right++;
+			sumf_left++; sumf_right++; framef_left += step;
 			}
 
-		peak_left = (int) (fpeak_left * 100.0f);
+		if( !at || (int) (fpeak_left * 100.0f) > peak_left ) peak_left = (int) (fpeak_left * 100.0f);
 	}
 	else if( use_right ) {
 	
@@ -177,38 +554,49 @@ void Track::sum( FrameCollection *f, unsigned count, float factor_left, float fa
 		int cnt = count;
 
 		// cast the frame buffers into floats so we can sum them
-		sumf_left = (float *) f->get_frames_left();
-		sumf_right = (float *) f->get_frames_right();
-		framef_right = (float *) playback->get_frames_right();
+		sumf_left = (float *) f->get_frames_left() + at;
+		sumf_right = (float *) f->get_frames_right() + at;
+		framef_right = (float *) playback->peek_right( scratch_right, lo, count );
+		if( framef_right ) framef_right += start - lo;
+		if( playback->silent_right() ) framef_right = NULL;
 
 		// sum all audio frames available while obtaining peak values
 		while( cnt-- && framef_right ) {
 			if( *framef_right * volume_right > fpeak_right ) fpeak_right = *framef_right * volume_right; 
 			*sumf_left = *sumf_left + (*framef_right) * volume_left * factor_left;
-			*sumf_right = *sumf_right + (*framef_right++) * volume_right * factor_right;
+			*sumf_right = *sumf_right + (*framef_right) * volume_right * factor_right;
 
-			sumf_left++; sumf_right++; 
+			sumf_left++; sumf_right++; framef_right += step;
 			}
 
-		peak_right = (int) (fpeak_right * 100.0f);
+		if( !at || (int) (fpeak_right * 100.0f) > peak_right ) peak_right = (int) (fpeak_right * 100.0f);
 	}
 	
 	if( use_midi ) {
 
 		int ipeak = 0;
 
-		// for all midi events at playback, insert them into passed collection
-		jack_nframes_t n, ncount = playback->get_nevents();
-		jack_midi_event_t *events = playback->get_events();
+		// for all midi events in our frames, insert them into passed collection
+		jack_nframes_t n, t, ncount = playback->get_nevents();
+		jack_midi_event_t *events = playback->get_events(), ev;
+		jack_midi_data_t data[3];
 		for( n = 0; n < ncount; n++ ) {
 
-			if( events[n].size >= 3 && ((events[n].buffer[0] & 0xf0) == 0x90 ))
-				if( events[n].buffer[2] > ipeak ) ipeak = events[n].buffer[2];
+			// reversed, the events come last first with notes on and off traded
+			ev = events[reversed ? ncount - 1 - n : n];
+			t = reversed ? playback->get_nframes() - 1 - ev.time : ev.time;
+			if( t < offset || t >= offset + count ) continue;
+			ev.time = at + t - offset;
+			if( reversed ) 
+				reverse_event( &ev, data );
+
+			if( ev.size >= 3 && ((ev.buffer[0] & 0xf0) == 0x90 ))
+				if( ev.buffer[2] > ipeak ) ipeak = ev.buffer[2];
 
 			// insert each event into collection, anding the channel and apply volume at that time
-			f->insert_midi_event( &events[n], channel, volume_midi * factor_midi );
+			m->insert_midi_event( &ev, channel, volume_midi * factor_midi );
 		}
-		peak_midi = ( ipeak * 100 ) / 128;
+		if( !at || ( ipeak * 100 ) / 128 > peak_midi ) peak_midi = ( ipeak * 100 ) / 128;
 	}
 }
 
@@ -388,7 +776,7 @@ int Track::write_midi( int fd ) {
 int Track::read_left( int fd, bool use_right ) {
 	// when reading into track, collcount has the count when we wrote it
 	// we will keep a load count while loading, then compare results
-	bool stream_error = false;
+	bool stream_error = false, stream_end = false;
 	int cmpcount, uncmpcount = 0;
 	int readcnt, cnt;
 	FrameCollection  *fc;
@@ -414,13 +802,16 @@ int Track::read_left( int fd, bool use_right ) {
 	if( loadcount == 0 ) {
 		// no collections yet, just read our samples until done
 		head = tail = NULL;
-		while( readcnt && loadcount < collcount && !stream_error ) {
+		// a silent stretch inflates from a few bytes, so keep on past the end of
+		// the file until the stream ends or every collection is there
+		while( loadcount < collcount && !stream_error && !stream_end ) {
 			//fprintf(stderr, "\nCollection %d: ", loadcount );
 			fc = new FrameCollection(NFRAMES, true, use_right);
 			fc->append( &head, &tail );
 			switch( fc->read_left( &s, NULL )) {
 				case  0: stream_error = true; break;
-				case  1: case 2:
+				case  2: stream_end = true;	// and it was read
+				case  1:
 					loadcount++; 
 					uncmpcount += NFRAMES * sizeof( jack_default_audio_sample_t );
 					break;
@@ -448,10 +839,11 @@ int Track::read_left( int fd, bool use_right ) {
 	else if( loadcount == collcount ) {
 		// all collections created, go thru the list and read our data
 		fc = head;
-		while( readcnt && fc && !stream_error ) {
+		while( fc && !stream_error && !stream_end ) {
 			switch( fc->read_left( &s, NULL )) {
 				case  0: stream_error = true; break;
-				case  1: case 2:
+				case  2: stream_end = true;	// and it was read
+				case  1:
 					fc = fc->get_next();
 					loadcount++; 
 					uncmpcount += NFRAMES * sizeof( jack_default_audio_sample_t );
@@ -491,7 +883,7 @@ int Track::read_left( int fd, bool use_right ) {
 int Track::read_right( int fd ) {
 	// when reading into track, collcount has the count when we wrote it
 	// we will keep a load count while loading, then compare results
-	bool stream_error = false;
+	bool stream_error = false, stream_end = false;
 	int cmpcount, uncmpcount = 0;
 	int readcnt, cnt;
 	FrameCollection  *fc;
@@ -517,13 +909,16 @@ int Track::read_right( int fd ) {
 	if( loadcount == 0 ) {
 		// no collections yet, just read our samples until done
 		head = tail = NULL;
-		while( readcnt && loadcount < collcount && !stream_error ) {
+		// a silent stretch inflates from a few bytes, so keep on past the end of
+		// the file until the stream ends or every collection is there
+		while( loadcount < collcount && !stream_error && !stream_end ) {
 			//fprintf(stderr, "\nCollection %d: ", loadcount );
 			fc = new FrameCollection(NFRAMES, false, true);
 			fc->append( &head, &tail );
 			switch( fc->read_right( &s, NULL )) {
 				case  0: stream_error = true; break;
-				case  1: case 2:
+				case  2: stream_end = true;	// and it was read
+				case  1:
 					loadcount++; 
 					uncmpcount += NFRAMES * sizeof( jack_default_audio_sample_t );
 					break;
@@ -551,10 +946,11 @@ int Track::read_right( int fd ) {
 	else if( loadcount == collcount ) {
 		// all collections created, go thru the list and read our data
 		fc = head;
-		while( readcnt && fc && !stream_error ) {
+		while( fc && !stream_error && !stream_end ) {
 			switch( fc->read_right( &s, NULL )) {
 				case  0: stream_error = true; break;
-				case  1: case 2:
+				case  2: stream_end = true;	// and it was read
+				case  1:
 					fc = fc->get_next();
 					loadcount++; 
 					uncmpcount += NFRAMES * sizeof( jack_default_audio_sample_t );
@@ -633,9 +1029,268 @@ int Track::read_midi( int fd ) {
 	return 0;
 }
 
+static float *gather( FrameCollection *fc, int count, int length, bool left ) {
+	//
+	// copy one channel of a collection list into a contiguous buffer
+	//
+	float *buf = new float[length], *p = buf;
+
+	for( ; fc && count--; fc = fc->get_next() ) {
+		if( left ) fc->copyout_left( p, fc->get_nframes() );
+		else fc->copyout_right( p, fc->get_nframes() );
+		p += fc->get_nframes();
+	}
+	return buf;
+}
+
+static void scatter( float *buf, FrameCollection *fc, bool left ) {
+	//
+	// and back into a list of NFRAMES collections
+	//
+	for( ; fc; fc = fc->get_next(), buf += NFRAMES )
+		memcpy( left ? fc->get_frames_left() : fc->get_frames_right(), buf, NFRAMES * sizeof(float) );
+}
+
+void Track::rebuild( FrameCollection *from, int count, unsigned int frames, int mode ) {
+	//
+	// build pending_length frames of new collections from the first frames of
+	// count collections at from, either resampled, time stretched or reversed, 
+	// with the midi events moved to match
+	//
+	FrameCollection *fc, *to, *newhead = NULL, *newtail = NULL;
+	bool left, right;
+	int n, k, total = 0, inlen, outlen = pending_length, outcount;
+	float ratio;
+
+	left = from->get_frames_left() != NULL;
+	right = from->get_frames_right() != NULL;
+
+	n = 0;
+	for( fc = from; fc && n < count; fc = fc->get_next(), n++ )
+		total += fc->get_nframes();
+	inlen = frames && (int)frames < total ? frames : total;
+	pending_count = outcount = COLLECTIONS( outlen );
+	ratio = (float)outlen / inlen;
+		
+	// every frame of the new collections is written below
+	for( n = 0; n < outcount; n++ ) {
+		fc = new FrameCollection( NFRAMES, left, right );
+		fc->append( &newhead, &newtail );
+	}
+
+	if( left || right ) {
+		float *in_left = NULL, *in_right = NULL, *out_left = NULL, *out_right = NULL;
+		// the end of the last collection past outlen stays silent
+		if( left ) {
+			in_left = gather( from, count, total, true );
+			out_left = new float[outcount * NFRAMES];
+			memset( out_left, 0, outcount * NFRAMES * sizeof(float) );
+		}
+		if( right ) {
+			in_right = gather( from, count, total, false );
+			out_right = new float[outcount * NFRAMES];
+			memset( out_right, 0, outcount * NFRAMES * sizeof(float) );
+		}
+
+		if( mode == REBUILD_STRETCH ) {
+			TimeStretch t;
+			t.run( in_left, in_right, inlen, out_left, out_right, outlen );
+		} else if( mode == REBUILD_REVERSE ) {
+			for( n = 0; n < inlen && n < outlen; n++ ) {
+				if( left ) out_left[n] = in_left[inlen - 1 - n];
+				if( right ) out_right[n] = in_right[inlen - 1 - n];
+			}
+		} else {
+			Resampler r( inlen, outlen );
+			r.run( in_left, in_right, inlen, out_left, out_right, outlen );
+		}
+
+		if( left ) scatter( out_left, newhead, true );
+		if( right ) scatter( out_right, newhead, false );
+		for( fc = newhead; fc; fc = fc->get_next() ) 
+			fc->squeeze();
+		delete[] in_left; delete[] in_right;
+		delete[] out_left; delete[] out_right;
+	}
+
+	// move midi events to their new positions
+	unsigned int pos = 0, at;
+	jack_midi_data_t data[3];
+	if( mode == REBUILD_REVERSE ) pair_notes( from, count );
+	n = 0;
+	for( fc = from; fc && n < count; fc = fc->get_next(), n++ ) {
+		jack_midi_event_t *e = fc->get_events();
+		for( unsigned int i = 0; i < fc->get_nevents(); i++ ) {
+			jack_midi_event_t ev = e[i];
+			if( pos + ev.time >= (unsigned)inlen ) continue;
+			if( mode == REBUILD_REVERSE ) {
+				at = inlen - 1 - (pos + ev.time);
+				reverse_event( &ev, data );
+			} else
+				at = (unsigned int)((pos + ev.time) * ratio);
+			if( at >= (unsigned)outlen ) at = outlen - 1;
+			for( to = newhead, k = at / NFRAMES; k--; to = to->get_next() );
+			ev.time = at % NFRAMES;
+			to->insert_midi_event( &ev, 0, 1.0f );
+		}
+		pos += fc->get_nframes();
+	}
+
+	fprintf(stderr, "%s %s from %d to %d frames\n", 
+		mode == REBUILD_STRETCH ? "stretched" : mode == REBUILD_REVERSE ? "reversed" : "resampled", 
+		name, inlen, outlen );
+
+	pending_head = newhead;
+	pending_tail = newtail;
+	pending_flipped = mode == REBUILD_REVERSE;
+}
+
+void Track::release() {
+	//
+	// once process has swapped, the pending list holds the collections it
+	// played before. Delete them unless they are the original recording
+	//
+	FrameCollection *fc;
+	int n = pending_count;
+
+	if( pending_head != orig_head ) 
+		while( n-- && (fc = pending_tail) ) {
+			pending_tail = fc->get_prev();
+			delete fc;
+		}
+	pending_head = pending_tail = NULL;
+	pending_count = 0;
+	busy = false;
+
+	// anything passed over while busy is looked at again
+	tracks_changed = true;
+}
+
+int Track::section_frames() {
+	//
+	// the length of the section we play in, prefering the current one
+	//
+	if( part != -1 && part != sections[state.current_section].part ) 
+		for( int s = 0; s < state.sections; s++ ) 
+			if( sections[s].part == part ) 
+				return sections[s].maxframes;
+	return sections[state.current_section].maxframes;
+}
+
+static void *resample_thread( void *arg ) {
+	//
+	// resample off the jack thread and wait for process to swap the result in
+	//
+	Track *track = (Track *) arg;
+
+	track->rebuild( track->head, track->collcount, track->length, REBUILD_RESAMPLE );
+	__sync_synchronize();
+	track->swap_pending = true;
+
+	while( track->swap_pending ) 
+		usleep( 10000 );
+	track->release();
+
+	return NULL;
+}
+
 void Track::resample( ) {
+	//
+	// stretch or shrink the track to the length of its section. The work is done
+	// on a thread of its own, process swaps the result in at the loop boundary
+	//
+	pthread_t thread_id;
+
+	// a time stretched track already follows its section
+	if( busy || longtrack || stretch || orig_head || !head || !collcount || loadcount != collcount ) 
+		return;
+
+	pending_length = section_frames();
+	if( pending_length == length ) 
+		return;
+
+	busy = true;
+	if( pthread_create( &thread_id, NULL, resample_thread, this ) ) {
+		fprintf(stderr, "can't start resample thread\n");
+		busy = false;
+		return;
+	}
+	pthread_detach( thread_id );
+}
+
+void Track::swap() {
+	//
+	// called from process at the loop boundary, exchange the playing collections
+	// for the pending ones. The thread that built them then calls release()
+	//
+	FrameCollection *h = head, *t = tail;
+	int c = collcount;
+	unsigned int l = length;
+
+	head = pending_head;
+	tail = pending_tail;
+	collcount = loadcount = pending_count;
+	length = pending_length;
+	if( pending_flipped ) reversed = !reversed;
+	rewind();
+
+	pending_head = h;
+	pending_tail = t;
+	pending_count = c;
+	pending_length = l;
+	pending_flipped = false;
+	__sync_synchronize();
+	swap_pending = false;
 }
 
 void Track::reverse() {
+	//
+	// play the track the other way, from the next period on. Nothing is
+	// copied, the collections are read from the other end
+	//
+	if( busy ) return;
+	pair_notes( head, collcount );
+	flip = !flip;
+}
+
+static void *materialize_thread( void *arg ) {
+
+	Track *track = (Track *) arg;
+
+	track->rebuild( track->head, track->collcount, track->length, REBUILD_REVERSE );
+	__sync_synchronize();
+	track->swap_pending = true;
+
+	while( track->swap_pending ) 
+		usleep( 10000 );
+	track->release();
+
+	if( track->upload ) {
+		track->upload = false;
+		service_upload_thread( track );
+	}
+	return NULL;
+}
+
+void Track::materialize( bool then_upload ) {
+	//
+	// write the collections out reversed, for upload to tracks that don't know
+	// about playing backwards. Swapped in at the loop boundary like a resample
+	//
+	pthread_t thread_id;
+
+	// a stretched track rebuilds from its original, which would lose the reversal
+	if( busy || !reversed || orig_head || !head || !collcount || loadcount != collcount ) 
+		return;
+
+	pending_length = length;
+	upload = then_upload;
+	busy = true;
+	if( pthread_create( &thread_id, NULL, materialize_thread, this ) ) {
+		fprintf(stderr, "can't start materialize thread\n");
+		busy = upload = false;
+		return;
+	}
+	pthread_detach( thread_id );
 }
 
@@ -23,12 +23,41 @@ SOFTWARE.
  
 #define  NFRAMES 1024
 
+// collections needed to hold a number of frames
+#define COLLECTIONS(frames)	(((frames) + NFRAMES - 1) / NFRAMES)
+
+// the ways Track::rebuild() makes a new version of the collections
+#define REBUILD_RESAMPLE	0
+#define REBUILD_STRETCH		1
+#define REBUILD_REVERSE		2
+
+class EffectChain;
+
+//
+// a track as kept in the seq-state file and at the head of an uploaded
+// payload, only what outlasts a run. size lets a later version add fields
+// at the end, and a file written before the record existed holds the old
+// Track itself, which read_record() still takes
+//
+#define TRACK_RECORD_MAGIC		0x6b725472	// "rTrk"
+#define TRACK_RECORD_VERSION	1
+
+struct track_record {
+	unsigned int magic, version, size;
+	unsigned int unique_ident, left_complen, right_complen, length;
+	int		collcount, part, bank, program, channel, bus;
+	float	volume_left, volume_right, volume_midi;
+	unsigned char mute, solo, use_left, use_right, use_midi, longtrack, stretch, reversed;
+	char	name[TRACK_NAME_MAX+1];
+};
+
 //
 //  Defines a track in the global track list
 //
 class Track {
 public:
 	FrameCollection *head, *tail, *playback;
+	unsigned int offset, position, length;		// the cursor within playback and the track, frames in the loop
 	int		collcount, loadcount, part, bank, program, channel;
 	bool	mute, solo, use_left, use_right, use_midi, remove, longtrack, start;
 	Track	*next, *prev;
@@ -37,16 +66,54 @@ public:
 	char	name[TRACK_NAME_MAX+1];
 	unsigned int unique_ident, left_complen, right_complen;
 
+	// a resampled copy of the collections, waiting for the loop boundary
+	FrameCollection *pending_head, *pending_tail;
+	int		pending_count;
+	unsigned int pending_length;
+	volatile bool swap_pending, busy;
+
+	// a stretched track follows the section length, keeping the recording it started from
+	FrameCollection *orig_head, *orig_tail;
+	int		orig_count;
+	unsigned int orig_length;
+	bool	stretch;
+
+	// a reversed track plays its collections tail to head, flip asks for a change of direction
+	// and pending_flipped says the pending collections are stored the other way round
+	bool	reversed, pending_flipped;
+	volatile bool flip, upload;		// upload once materialized
+
+	// the insert effects, summed through when any are in use
+	EffectChain *effects;
+
+	// the output bus, 0 for the main outputs, and the next track on it this period
+	int		bus;
+	Track	*bus_next;
+
+	// the next track heard in the same parts, and where it comes in bus order
+	Track	*part_next;
+	int		part_order;
+
+	// the next track mixed by the same thread this segment, the bus it goes
+	// to, and what it costs to mix on average
+	Track	*mix_next;
+	int		mix_bus;
+	long	mix_cost;
+
 	Track();
 	Track(int, int);
 	~Track();
 	bool advance();
-	void sum( FrameCollection *s, unsigned );
-	void sum( FrameCollection *s, unsigned, float, float, float );
+	void seek(unsigned int), skip(int), turn();
+	void sum( FrameCollection *s, unsigned, unsigned, float, float, float, FrameCollection *m = NULL );
+	void mix( FrameCollection *s, unsigned, unsigned, float, float, float, FrameCollection *m );
 	void send_notesoff_midi(), send_channel_midi();
 	int write_left(int), write_right(int), write_midi(int), 
-		read_left(int, bool), read_right(int), read_midi(int);
+		read_left(int, bool), read_right(int), read_midi(int),
+		write_record(int), read_record(int);
 	int nevents();
 	void resample();
-	void reverse();
+	void reverse(), materialize(bool), rewind(), loaded();
+	void rebuild(FrameCollection *, int, unsigned int, int), swap(), release();
+	int section_frames();
 };
@@ -28,6 +28,7 @@ SOFTWARE.
 #define INPORT   "4952"		// the default port 
 #define OUTPORT  "4953"		// the default port 
 #define PORTBUFSIZE  2048	// buffer size for port read and writes
+#define RENEW_SECONDS  2	// how often we renew our subscription to the engine
 #define IM_ARRAYSIZE(_ARR)  ((int)(sizeof(_ARR)/sizeof(*_ARR)))
 
 #include <ctype.h>
@@ -35,6 +36,7 @@ SOFTWARE.
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -43,9 +45,13 @@ SOFTWARE.
 
 #include "../../common/network.h"
 #include "../../common/udpstruct.h"
+#include "../../common/telemetry.h"
+#include "../../common/control.h"
 
 Network network;
 
+ControlEncoder control(&network);
+
 static void error_callback(int error, const char* description) {
     fprintf(stderr, "Error %d: %s\n", error, description);
 }
@@ -59,27 +65,25 @@ bool shHints = true;
 
 void show_transport(bool *p_open) {
 
-	char buf[TRACK_NAME_MAX+8];
-	
 	ImGui::Begin("Transport", p_open);
 
-	if( ImGui::Button("<<") ) network.talk("w"); ImGui::SameLine();
+	if( ImGui::Button("<<") ) control.add(CTL_REWIND); ImGui::SameLine();
 	if (shHints && ImGui::IsItemHovered())
 		ImGui::SetTooltip("Rewind");
 
-	if( ImGui::Button("<") ) network.talk("<"); ImGui::SameLine();
+	if( ImGui::Button("<") ) control.add(CTL_BACK); ImGui::SameLine();
 	if (shHints && ImGui::IsItemHovered())
 		ImGui::SetTooltip("Move Back one Section");
 
-	if( ImGui::Button(" . ") ) network.talk("."); ImGui::SameLine();
+	if( ImGui::Button(" . ") ) control.add(CTL_STOP); ImGui::SameLine();
 	if (shHints && ImGui::IsItemHovered())
 		ImGui::SetTooltip("Stop Sequencer");
 
-	if( ImGui::Button(">") ) network.talk(">"); ImGui::SameLine();
+	if( ImGui::Button(">") ) control.add(CTL_FORWARD); ImGui::SameLine();
 	if (shHints && ImGui::IsItemHovered())
 		ImGui::SetTooltip("Move Forward one Section");
 
-	if( ImGui::Button(">>") ) network.talk(","); ImGui::SameLine();
+	if( ImGui::Button(">>") ) control.add(CTL_PLAY); ImGui::SameLine();
 	if (shHints && ImGui::IsItemHovered())
 		ImGui::SetTooltip("Begin Playing");
 
@@ -89,10 +93,9 @@ void show_transport(bool *p_open) {
 
 	if( ImGui::Button("Rec") ) {
 		if( trackname[0] ) {
-			sprintf(buf, "n%s", trackname);
-			network.talk(buf);
+			control.add(CTL_NAME, trackname);
 		}
-		network.talk("r");
+		control.add(CTL_RECORD);
 	} ImGui::SameLine();
 	if (shHints && ImGui::IsItemHovered())
 		ImGui::SetTooltip("Record");
@@ -104,12 +107,11 @@ void show_transport(bool *p_open) {
 	if( long_recording != recording_long ) {
 		if( long_recording ) {
 			if( trackname[0] ) {
-				sprintf(buf, "n%s", trackname);
-				network.talk(buf);
+				control.add(CTL_NAME, trackname);
 			}
-			network.talk("R1");
+			control.add(CTL_LONG_RECORD, 1);
 		}
-		else network.talk("R0");
+		else control.add(CTL_LONG_RECORD, 0);
 	}
 
 	ImGui::PopStyleColor(3);
@@ -117,8 +119,7 @@ void show_transport(bool *p_open) {
 	bool track_click = click_track;
 	ImGui::Checkbox("Click", &click_track);	ImGui::SameLine();
 	if( click_track != track_click ) {
-		if( click_track ) network.talk("c1");
-		else			  network.talk("c0");
+		control.add(CTL_CLICK, click_track);
 	}
 	if (shHints && ImGui::IsItemHovered())
 		ImGui::SetTooltip("Toggle Click Track");
@@ -126,8 +127,7 @@ void show_transport(bool *p_open) {
 	bool sessions_couple = couple_sections;
 	ImGui::Checkbox("Couple", &couple_sections);	ImGui::SameLine();
 	if( couple_sections != sessions_couple ) {
-		if( couple_sections ) network.talk("C1");
-		else				  network.talk("C0");
+		control.add(CTL_COUPLE, couple_sections);
 	}
 	if (shHints && ImGui::IsItemHovered())
 		ImGui::SetTooltip("Toggle Section Coupling");
@@ -174,7 +174,6 @@ void show_program(bool *p_open) {
 		"Telephone Ring", "Helicopter", "Applause", "Gunshot" };
 
 	static int program_item  = 0;
-	char buf[64];
 
 	ImGui::Begin("Program", p_open);
 
@@ -183,8 +182,7 @@ void show_program(bool *p_open) {
 	ImGui::ListBox("", &program_item, program_list, IM_ARRAYSIZE(program_list), 20);
 	ImGui::PopItemWidth();
 	if( ImGui::Button("Accept") ) {
-		sprintf(buf, "g%d,%d", 0, program_item);
-		network.talk(buf);
+		control.add(CTL_PROGRAM, 0, program_item);
 		*p_open = false;
 	}
 	ImGui::SameLine();
@@ -196,6 +194,7 @@ void show_program(bool *p_open) {
 }
 
 Statebuf statebuffer;
+Statsbuf statsbuffer;
 
 bool running = true,
 	bpm_mode = true,
@@ -207,7 +206,8 @@ bool shTransport = true,
 	shPanel = true,
 	shPlaying = true,
 	shMixer = true,
-	shChat = true;
+	shChat = true,
+	shEngine = false;
 
 bool cinternal, autoupload, longtracks;
 
@@ -229,6 +229,7 @@ void show_controls(bool *p_open) {
 			ImGui::MenuItem("Playing", NULL, &shPlaying);
 			ImGui::MenuItem("Mixer", NULL, &shMixer);
 			ImGui::MenuItem("Chat", NULL, &shChat);
+			ImGui::MenuItem("Engine", NULL, &shEngine);
 			ImGui::MenuItem("Hints", NULL, &shHints);
 			ImGui::EndMenu();
 		}
@@ -250,28 +251,18 @@ void show_controls(bool *p_open) {
 	}
 	
 	if( bpm_mode != mode_bpm ) {
-		if( bpm_mode ) network.talk("M1");
-		else		   network.talk("M0");
+		control.add(CTL_BPM_MODE, bpm_mode);
 	}
 
 	if( cinternal != cinternal_old || autoupload != autoupload_old || longtracks != longtracks_old ) {
-		char com[8];
-		com[0] = '=';
-		if( cinternal ) com[1] = '1';
-		else com[1] = '0';
-		if( autoupload ) com[2] = '1';
-		else com[2] = '0';
-		if( longtracks ) com[3] = '1';
-		else com[3] = '0';
-		com[4] = '\0';
-		network.talk(com);
+		control.add(CTL_CONFIG, cinternal, autoupload, longtracks);
 	}
 	
 	ImGui::BeginGroup();
-	if( ImGui::Button("-##e") ) network.talk("e-"); ImGui::SameLine();
+	if( ImGui::Button("-##e") ) control.add(CTL_SECTIONS, 0); ImGui::SameLine();
 	sprintf(buf, "%d", statebuffer.sections );
 	ImGui::Text(buf); ImGui::SameLine();
-	if( ImGui::Button("+##e") ) network.talk("e+"); ImGui::SameLine();
+	if( ImGui::Button("+##e") ) control.add(CTL_SECTIONS, 1); ImGui::SameLine();
 	ImGui::Text("Sections"); //ImGui::SameLine();
 	ImGui::EndGroup(); ImGui::SameLine(0,20);
 	if (shHints && ImGui::IsItemHovered())
@@ -279,20 +270,20 @@ void show_controls(bool *p_open) {
 	
 
 	ImGui::BeginGroup();
-	if( ImGui::Button("-##d") ) network.talk("d-"); ImGui::SameLine();
+	if( ImGui::Button("-##d") ) control.add(CTL_DIVISIONS, 0); ImGui::SameLine();
 	sprintf(buf, "%d", statebuffer.divisions );
 	ImGui::Text(buf); ImGui::SameLine();
-	if( ImGui::Button("+##d") ) network.talk("d+"); ImGui::SameLine();
+	if( ImGui::Button("+##d") ) control.add(CTL_DIVISIONS, 1); ImGui::SameLine();
 	ImGui::Text("Divisions"); //ImGui::SameLine();
 	ImGui::EndGroup(); ImGui::SameLine(0,20);
 	if (shHints && ImGui::IsItemHovered())
 		ImGui::SetTooltip("Change Division Count");
 
 	ImGui::BeginGroup();
-	if( ImGui::Button("-##b") ) network.talk("b-"); ImGui::SameLine();
+	if( ImGui::Button("-##b") ) control.add(CTL_BEATS, 0); ImGui::SameLine();
 	sprintf(buf, "%d", statebuffer.beats );
 	ImGui::Text(buf); ImGui::SameLine();
-	if( ImGui::Button("+##b") ) network.talk("b+"); ImGui::SameLine();
+	if( ImGui::Button("+##b") ) control.add(CTL_BEATS, 1); ImGui::SameLine();
 	ImGui::Text("Beats"); //ImGui::SameLine();
 	ImGui::EndGroup(); ImGui::SameLine(0,20);
 	if (shHints && ImGui::IsItemHovered())
@@ -304,14 +295,13 @@ void show_controls(bool *p_open) {
 	ImGui::SliderInt("Tempo", &tempo, 0, 100, ""); ImGui::SameLine();
 	ImGui::PopItemWidth();
 	if( tempo != prev_tempo ) {
-		sprintf(buf, "t%3d", tempo);
-		network.talk(buf);
+		control.add(CTL_TEMPO_SET, tempo);
 	}
-	if( ImGui::Button("-##t") ) network.talk("t-"); ImGui::SameLine();
+	if( ImGui::Button("-##t") ) control.add(CTL_TEMPO_STEP, 0); ImGui::SameLine();
 	ImGui::PushItemWidth(60);
 	ImGui::InputText("##t", tempo_str, IM_ARRAYSIZE(tempo_str) ); ImGui::SameLine();
 	ImGui::PopItemWidth();
-	if( ImGui::Button("+##t") ) network.talk("t+"); //ImGui::SameLine();
+	if( ImGui::Button("+##t") ) control.add(CTL_TEMPO_STEP, 1); //ImGui::SameLine();
 	ImGui::EndGroup();  ImGui::SameLine();
 	if (shHints && ImGui::IsItemHovered())
 		ImGui::SetTooltip("Adjust the Tempo");
@@ -322,8 +312,7 @@ void show_controls(bool *p_open) {
 	if (shHints && ImGui::IsItemHovered())
 		ImGui::SetTooltip("Toggle between BPM and Framecount Modes");
 	if( bpm_mode != mode_bpm ) {
-		if( bpm_mode ) network.talk("M1");
-		else		   network.talk("M0");
+		control.add(CTL_BPM_MODE, bpm_mode);
 	}
 #endif
 	
@@ -333,20 +322,20 @@ void show_controls(bool *p_open) {
 	if (shHints && ImGui::IsItemHovered())
 		ImGui::SetTooltip("Popup a window to choose General Midi Program");
 
- 	if( ImGui::Button("Flush") ) network.talk("f"); ImGui::SameLine();
+ 	if( ImGui::Button("Flush") ) control.add(CTL_FLUSH); ImGui::SameLine();
 	if (shHints && ImGui::IsItemHovered())
 		ImGui::SetTooltip("Flush out sequencer files to disk and continue");
 
- 	if( ImGui::Button("Clear") ) network.talk("x"); ImGui::SameLine();
+ 	if( ImGui::Button("Clear") ) control.add(CTL_CLEAR); ImGui::SameLine();
 	if (shHints && ImGui::IsItemHovered())
 		ImGui::SetTooltip("Clear all sequencer data: WARNING! can not be undone");
 
- 	if( ImGui::Button("Reload") ) network.talk("L"); ImGui::SameLine();
+ 	if( ImGui::Button("Reload") ) control.add(CTL_LOAD); ImGui::SameLine();
 	if (shHints && ImGui::IsItemHovered())
 		ImGui::SetTooltip("Reload sequencer data from disk");
 
  	if( ImGui::Button("Exit") ) {
-		network.talk("q");
+		control.add(CTL_QUIT);
 		running = false;
 	}  ImGui::SameLine();
 	if (shHints && ImGui::IsItemHovered())
@@ -362,8 +351,6 @@ bool left_enable, right_enable, midi_enable;
 
 void show_mains(bool *p_open) {
 
-	char buf[64];
-
 	ImGui::Begin("Mains", p_open);
 
 	ImGui::PushItemWidth(105);
@@ -401,18 +388,15 @@ void show_mains(bool *p_open) {
 		ImGui::SetTooltip("Midi Channel Volume Control");
 
 	if( left_vol != vol_left ) {
-		sprintf(buf,"vl%3d", left_vol);
-		network.talk(buf);
+		control.add(CTL_VOLUME, 'l', left_vol);
 	}
 
 	if( right_vol != vol_right ) {
-		sprintf(buf,"vr%3d", right_vol);
-		network.talk(buf);
+		control.add(CTL_VOLUME, 'r', right_vol);
 	}
 
 	if( midi_vol != vol_midi ) {
-		sprintf(buf,"vm%3d", midi_vol);
-		network.talk(buf);
+		control.add(CTL_VOLUME, 'm', midi_vol);
 	}
 
 	bool enable_left = left_enable;
@@ -423,24 +407,21 @@ void show_mains(bool *p_open) {
 	if (shHints && ImGui::IsItemHovered())
 		ImGui::SetTooltip("Toggle Left Channel Enable");
 	if( left_enable != enable_left ) {
-		if( left_enable ) network.talk("l1");
-		else			  network.talk("l0");
+		control.add(CTL_REC_LEFT, left_enable);
 	}
 
 	ImGui::Checkbox("R", &right_enable); ImGui::SameLine();
 	if (shHints && ImGui::IsItemHovered())
 		ImGui::SetTooltip("Toggle Right Channel Enable");
 	if( right_enable != enable_right ) {
-		if( right_enable ) network.talk("a1");
-		else			  network.talk("a0");
+		control.add(CTL_REC_RIGHT, right_enable);
 	}
 
 	ImGui::Checkbox("M", &midi_enable);
 	if (shHints && ImGui::IsItemHovered())
 		ImGui::SetTooltip("Toggle Midi Channel Enable");
 	if( midi_enable != enable_midi ) {
-		if( midi_enable ) network.talk("m1");
-		else			  network.talk("m0");
+		control.add(CTL_REC_MIDI, midi_enable);
 	}
 
 	ImGui::Text("Control");
@@ -508,8 +489,7 @@ void show_panel(bool *p_open) {
 			for (int j = 0; j < statebuffer.sections && j < IM_ARRAYSIZE(partnames); j++)
 				if (ImGui::Selectable(partnames[j])) {
 					//sections[i] = j;
-					sprintf(buf, "%dA%d", i, j );
-					network.talk( buf );
+					control.add(CTL_SECTION_PART, i, j);
 				}
 			ImGui::EndPopup();
 		} ImGui::SameLine(); ImGui::Text(" "); 
@@ -543,7 +523,10 @@ void show_panel(bool *p_open) {
 	ImGui::End();
 }
 
-Trackbuf tracks[256];
+Trackbuf *tracks;
+
+// the tracks the engine has, its table can trail them for an update or so
+unsigned engine_trackcount = 0;
 
 void show_playing(bool *p_open) {
 	
@@ -554,6 +537,8 @@ void show_playing(bool *p_open) {
 	
 	ImGui::Begin("Playing", p_open);
 	
+	if( engine_trackcount > statebuffer.trackcount ) 
+		ImGui::Text("%u of %u tracks", statebuffer.trackcount, engine_trackcount);
 	while( indx < statebuffer.trackcount ) {
 		if( tracks[indx].longtrack || tracks[indx].part == -1 || tracks[indx].part == sections[statebuffer.current_section] ) {
 			// track is to be displayed
@@ -567,8 +552,7 @@ void show_playing(bool *p_open) {
 			if (shHints && ImGui::IsItemHovered())
 				ImGui::SetTooltip("Mute this track");
 			if( mute != tracks[indx].mute ) {
-				sprintf(buf, "%dm%d", indx, mute );
-				network.talk(buf);
+				control.add(CTL_TRACK_MUTE, indx, mute);
 			}
 			
 			solo = tracks[indx].solo;
@@ -577,8 +561,7 @@ void show_playing(bool *p_open) {
 			if (shHints && ImGui::IsItemHovered())
 				ImGui::SetTooltip("Solo this track");
 			if( solo != tracks[indx].solo ) {
-				sprintf(buf, "%ds%d", indx, solo );
-				network.talk(buf);
+				control.add(CTL_TRACK_SOLO, indx, solo);
 			}
 			
 			peak_left = tracks[indx].peak_left;
@@ -675,8 +658,7 @@ void show_mixer(bool *p_open) {
 		}
 
 		if( pan != lastpan || vol != lastvol ) {
-			sprintf(buf, "%dv%d,%d,%d", indx, (2*vol-pan)/2, (2*vol+pan)/2, tracks[indx].vol_midi );
-			network.talk(buf);
+			control.add(CTL_TRACK_VOLUME, indx, (2*vol-pan)/2, (2*vol+pan)/2, tracks[indx].vol_midi);
 		}
 
 		ImGui::NextColumn();
@@ -688,12 +670,15 @@ void show_mixer(bool *p_open) {
 }
 
 void show_detail(Trackbuf *track, bool *p_open) {
-	char buf[64];
 
 	ImGui::Begin("Detail", p_open);
 	ImGui::InputText("Name", track->name, IM_ARRAYSIZE(track->name));
 	ImGui::Checkbox("Mute", &track->mute); ImGui::SameLine();
 	ImGui::Checkbox("Solo", &track->solo);
+	if( !track->longtrack ) {
+		ImGui::SameLine();
+		ImGui::Checkbox("Stretch", &track->stretch);
+	}
 
 	ImGui::PushItemWidth(100);
 	int item = track->part + 1;
@@ -725,38 +710,36 @@ void show_detail(Trackbuf *track, bool *p_open) {
 	ImGui::VSliderInt("Midi", ImVec2(29,100), &item, 0, 120); 
 	track->vol_midi = item;
 	
-	ImGui::Button("Resample");  ImGui::SameLine();
-	ImGui::Button("Reverse");  ImGui::SameLine();
+	if( ImGui::Button("Resample") ) {
+		*p_open = false;
+		control.add(CTL_TRACK_RESAMPLE, track->number);
+	} ImGui::SameLine();
+	if( ImGui::Button(track->reversed ? "Forward" : "Reverse") ) {
+		*p_open = false;
+		control.add(CTL_TRACK_REVERSE, track->number);
+	} ImGui::SameLine();
 	if( ImGui::Button("Start") ) {
 		*p_open = false;
-		sprintf(buf, "%dS", track->number );
-		network.talk(buf);				
+		control.add(CTL_TRACK_START, track->number);
 	} ImGui::SameLine();
 					
 	if( ImGui::Button("Upload") ) {
 		*p_open = false;
-		sprintf(buf, "%du", track->number );
-		network.talk(buf);	
+		control.add(CTL_TRACK_UPLOAD, track->number);
 	}
 		
 	if( ImGui::Button("Save") ) {
 		*p_open = false;
-		sprintf( buf, "%dn%s", track->number, track->name ); 
-		network.talk(buf);
-		sprintf( buf, "%dv%d,%d,%d", track->number, track->vol_left, track->vol_right, track->vol_midi ); 
-		network.talk(buf);
-		sprintf( buf, "%dm%d", track->number, track->mute ); 
-		network.talk(buf);
-		sprintf( buf, "%ds%d", track->number, track->solo ); 
-		network.talk(buf);
+		control.add(CTL_TRACK_NAME, track->number, track->name);
+		control.add(CTL_TRACK_VOLUME, track->number, track->vol_left, track->vol_right, track->vol_midi);
+		control.add(CTL_TRACK_MUTE, track->number, track->mute);
+		control.add(CTL_TRACK_SOLO, track->number, track->solo);
 		if( !track->longtrack ) {
-			sprintf( buf, "%dp%d", track->number, track->part );
-			network.talk(buf);
-		} 
-		sprintf( buf, "%dc%d", track->number, track->channel ); 
-		network.talk(buf);			
-		sprintf( buf, "%db%d,%d", track->number, track->bank, track->program ); 
-		network.talk(buf);			
+			control.add(CTL_TRACK_PART, track->number, track->part);
+			control.add(CTL_TRACK_STRETCH, track->number, track->stretch);
+		}
+		control.add(CTL_TRACK_CHANNEL, track->number, track->channel);
+		control.add(CTL_TRACK_PROGRAM, track->number, track->bank, track->program);
 	} ImGui::SameLine();
 
 	if( ImGui::Button("Return") ) *p_open = false;
@@ -764,8 +747,7 @@ void show_detail(Trackbuf *track, bool *p_open) {
 
 	if( ImGui::Button("Delete") ) {
 		*p_open = false;
-		sprintf( buf, "%dd", track->number ); 
-		network.talk(buf);
+		control.add(CTL_TRACK_DELETE, track->number);
 	}
 	
 	ImGui::End();	
@@ -805,20 +787,71 @@ void show_chat(bool *p_open) {
 	
 }
 
+const char *stage_names[STATS_STAGES] = { 
+	"control", "record", "tracks", "mix", "effects", "click", "meters", "telemetry" };
+
+void show_engine(bool *p_open) {
+	//
+	// how well the engine keeps up with its periods
+	//
+	char buf[64];
+	float buckets[STATS_BUCKETS];
+	
+	ImGui::Begin("Engine", p_open);
+
+	sprintf(buf, "load %.1f%%  jack %.1f%%", statsbuffer.load, statsbuffer.jack_load);
+	ImGui::Text(buf);
+	if (shHints && ImGui::IsItemHovered())
+		ImGui::SetTooltip("How much of each period the engine takes, and what jack makes of all its clients");
+
+	sprintf(buf, "callback %u us, worst %u us of %u us", statsbuffer.average_nsecs / 1000, 
+		statsbuffer.worst_nsecs / 1000, statsbuffer.period_nsecs / 1000);
+	ImGui::Text(buf);
+
+	sprintf(buf, "xruns %u, the last %u us late", statsbuffer.xruns, statsbuffer.xrun_usecs);
+	ImGui::Text(buf);
+
+	for( int i = 0; i < STATS_BUCKETS; i++ ) 
+		buckets[i] = statsbuffer.histogram[i];
+	ImGui::PlotHistogram("##periods", buckets, STATS_BUCKETS, 0, "callbacks by tenth of the period", 
+		0.0f, FLT_MAX, ImVec2(0,60));
+	if (shHints && ImGui::IsItemHovered())
+		ImGui::SetTooltip("The last bar is the callbacks that ran over their period");
+
+	ImGui::Columns(2, "stages");
+	ImGui::Separator();
+	for( int i = 0; i < STATS_STAGES; i++ ) {
+		ImGui::Text(stage_names[i]); ImGui::NextColumn();
+		sprintf(buf, "%.1f us", statsbuffer.stage_nsecs[i] / 1000.0f);
+		ImGui::Text(buf); ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
+	ImGui::Separator();
+
+	sprintf(buf, "track audio %u chunks, %u huge, %u blocks", statsbuffer.chunks, 
+		statsbuffer.huge_chunks, statsbuffer.blocks);
+	ImGui::Text(buf);
+	sprintf(buf, "page faults %u minor, %u major", statsbuffer.minor_faults, statsbuffer.major_faults);
+	ImGui::Text(buf);
+	if (shHints && ImGui::IsItemHovered())
+		ImGui::SetTooltip("Taken on the engine's process thread");
+
+	ImGui::End();
+}
+
 unsigned char largebuff[PORTBUFSIZE];
 
-int main(int argc, char **argv) {
+TelemetryDecoder telemetry;
 
-	Trackbuf trackbuffer;
+int main(int argc, char **argv) {
 
 	chat_buffer = new char[1];
 	chat_buffer[0] = '\0';
 
 	// establish connection ports
-	if( argc > 1 ) 
-		network.listener_init(argv[1]);
-	else
-		network.listener_init(INPORT);
+	const char *listen_port = argc > 1 ? argv[1] : INPORT;
+	network.listener_init(listen_port);
+	network.listener_timeout(1000);
 		
 	if( argc > 2 ) 
 		network.talker_init("127.0.0.1", argv[2]);
@@ -834,20 +867,33 @@ int main(int argc, char **argv) {
     // Setup ImGui binding
     ImGui_ImplGlfw_Init(window, true);
 
-	unsigned char *lptr;
-	int indx, last_div = -1, tc;
+	int last_div = -1;
+	time_t renewed = 0;
     ImVec4 clear_color = ImColor(114, 144, 154);
 
     // Main loop
     while (running && !glfwWindowShouldClose(window))
     {
-		// wait on listen for packet
-		network.listen(largebuff, PORTBUFSIZE);
+		// wait on listen for packets until an update is complete,
+		// keeping our subscription to the engine alive
+		int numbytes;
+		do {
+			if( time(NULL) - renewed >= RENEW_SECONDS ) {
+				control.add(CTL_SUBSCRIBE, atoi(listen_port), 0, TELE_FIELD_ALL);
+				control.flush();
+				renewed = time(NULL);
+			}
+			numbytes = network.listen(largebuff, PORTBUFSIZE);
+		} while( numbytes < 0 || !telemetry.receive(largebuff, numbytes) );
+
+		// collect acknowledgements for the commands we sent and resend the lost
+		while( (numbytes = network.hear(largebuff, PORTBUFSIZE)) > 0 )
+			control.acknowledge(largebuff, numbytes);
+		control.resend();
 
 		// decode statebuffer
-		lptr = largebuff;
-		memcpy( &statebuffer, lptr, sizeof(Statebuf) );
-		lptr = lptr + sizeof(Statebuf);
+		statebuffer = telemetry.image.state;
+		statsbuffer = telemetry.image.stats;
 		
 		// update config values
 		cinternal = statebuffer.cinternal;
@@ -855,18 +901,12 @@ int main(int argc, char **argv) {
 		longtracks = statebuffer.longtracks;
 	
 		// copy section definitionss
-		memcpy( sections, lptr, sizeof(int) * statebuffer.sections );
-		lptr = lptr + sizeof(int) * statebuffer.sections ;
-
-		// process the tracks.  read each track from the packet
-		tc = statebuffer.trackcount;
-		indx = 0;
-		while(tc--) {
-			// copy track data into buffer and track array
-			memcpy(&trackbuffer, lptr, sizeof(Trackbuf) );
-			tracks[indx++] = trackbuffer;
-			lptr = lptr + sizeof(Trackbuf);
-		}
+		memcpy( sections, telemetry.image.parts, sizeof(int) * statebuffer.sections );
+
+		// the tracks are kept in the decoder image
+		tracks = telemetry.image.tracks;
+		engine_trackcount = statebuffer.trackcount;
+		statebuffer.trackcount = telemetry.image.trackcount;
 
 		// determine the present division
 		current_div = (statebuffer.divisions * statebuffer.framecount) / statebuffer.maxframes;
@@ -875,18 +915,16 @@ int main(int argc, char **argv) {
 		glfwPollEvents();
 
 		// check keyboard for any cheet codes
-		char buf[64];
 		ImGuiIO& io = ImGui::GetIO();
 		for (int i = 0; i < IM_ARRAYSIZE(io.KeysDown); i++) {
 			//if (ImGui::IsKeyPressed(i)) fprintf(stderr, "key=%d\n", i);
 			if (ImGui::IsKeyPressed(i)) switch( i ) {
-				case '.': if( io.KeyShift ) network.talk(">"); else network.talk("."); break; 
-				case ',': if( io.KeyShift ) network.talk("<"); else network.talk(","); break;
-				case ' ': case 'r': network.talk("r"); break;
-				case 'w': case 'W': network.talk("w"); break;
+				case '.': if( io.KeyShift ) control.add(CTL_FORWARD); else control.add(CTL_STOP); break;
+				case ',': if( io.KeyShift ) control.add(CTL_BACK); else control.add(CTL_PLAY); break;
+				case ' ': case 'r': control.add(CTL_RECORD); break;
+				case 'w': case 'W': control.add(CTL_REWIND); break;
 				case 'x': case 'X':
-					sprintf(buf, "%dd", statebuffer.trackcount -1 );
-					network.talk(buf);
+					control.add(CTL_TRACK_DELETE, engine_trackcount -1);
 					break;
 				case '/': shTransport = shControls = shMains = shPanel = shPlaying = shMixer = shChat = true; break;
 			}
@@ -939,6 +977,7 @@ int main(int argc, char **argv) {
 		if( shMixer ) show_mixer(&shMixer);
 		if( shProgram ) show_program(&shProgram);
 		if( shChat ) show_chat(&shChat);
+		if( shEngine ) show_engine(&shEngine);
 		
 		// display any detail windows
 		DetailStruct *lptr = NULL, *dptr = detail_head;
@@ -980,12 +1019,18 @@ int main(int argc, char **argv) {
         glClear(GL_COLOR_BUFFER_BIT);
         ImGui::Render();
         glfwSwapBuffers(window);
+
+		// send this frame's commands as one datagram
+		control.flush();
     }
 
     // Cleanup
     ImGui_ImplGlfw_Shutdown();
     glfwTerminate();
 
+	control.add(CTL_UNSUBSCRIBE, atoi(listen_port));
+	control.flush();
+
 	network.listener_close();
 	network.talker_close();
 
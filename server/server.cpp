@@ -28,6 +28,8 @@ SOFTWARE.
 #include <errno.h>
 #include <string.h>
 #include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -37,6 +39,9 @@ SOFTWARE.
 
 #include "../common/udpstruct.h"
 #include "../common/request.h"
+#include "../common/chunkstore.h"
+#include "../common/network.h"
+#include "../common/logger.h"
 
 #define UPLOAD_PORT		"4952"
 #define DOWNLOAD_PORT	"4953"
@@ -45,6 +50,8 @@ SOFTWARE.
 
 unsigned char buffer[BUFFER_SIZE];
 
+ChunkStore store(CHUNK_DIR);
+
 int init_socket(const char *portname, int *sock) {
 	
 	struct addrinfo hints, *servinfo, *p;
@@ -88,13 +95,104 @@ int init_socket(const char *portname, int *sock) {
 	return 0;
 }
 
+int write_manifest(unsigned id, struct chunk_ref *refs, int count, long int length) {
+	//
+	// write a track manifest as 'id.done', by way of a temporary name
+	//
+	struct chunk_manifest manifest;
+	char filename[64], newname[64];
+	int fd;
+
+	manifest.magic = MANIFEST_MAGIC;
+	manifest.count = count;
+	manifest.length = length;
+
+	sprintf(filename, "%d.man", id);
+	fd = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0777 );
+	if( fd < 0 ) {
+		logger.put( LOG_ERROR, "failure to create manifest '%s'\n", filename );
+		return -1;
+	}
+	write( fd, &manifest, sizeof manifest );
+	write( fd, refs, sizeof( struct chunk_ref ) * count );
+	close( fd );
+
+	sprintf(newname, "%d.done", id);
+	if( rename( filename, newname ) < 0 ) {
+		logger.put( LOG_ERROR, "rename failure\n" );
+		return -1;
+	}
+	return 0;
+}
+
+int read_manifest(unsigned id, struct chunk_manifest *manifest, struct chunk_ref **refs) {
+	//
+	// read the chunk list for a track. A track stored whole by an older server
+	// is moved into the chunk store here and its file replaced by a manifest
+	//
+	int fd, count;
+	char filename[64];
+
+	sprintf(filename, "%d.done", id);
+	fd = open(filename, O_RDONLY );
+	if( fd < 0 ) return -1;
+
+	if( read_complete( fd, manifest, sizeof *manifest ) == sizeof *manifest && 
+		manifest->magic == MANIFEST_MAGIC ) {
+		if( manifest->count > (unsigned)CHUNK_COUNT_MAX ) {
+			logger.put( LOG_ERROR, "manifest of track %d has %u chunks\n", id, manifest->count );
+			close( fd );
+			return -1;
+		}
+		*refs = new struct chunk_ref[manifest->count];
+		if( read_complete( fd, *refs, sizeof( struct chunk_ref ) * manifest->count ) < 
+				(int)( sizeof( struct chunk_ref ) * manifest->count ) ) {
+			logger.put( LOG_ERROR, "manifest of track %d is cut short\n", id );
+			delete[] *refs;
+			*refs = NULL;
+			close( fd );
+			return -1;
+		}
+		close( fd );
+		return manifest->count;
+	}
+
+	lseek( fd, 0, SEEK_SET );
+	count = store.split( fd, refs, true );
+	manifest->length = lseek( fd, 0, SEEK_END );
+	close( fd );
+	if( count < 0 ) return -1;
+
+	manifest->magic = MANIFEST_MAGIC;
+	manifest->count = count;
+	write_manifest( id, *refs, count, manifest->length );
+	logger.put( LOG_INFO, "moved track %d into chunk store, %d chunks\n", id, count );
+	return count;
+}
+
 int writefromident(int sockfd, unsigned id, int type ) {
 	
 	int fd, readcount;
 	long int len;
 	char filename[64];
-	if( type ) sprintf(filename, "%d.done", id);
-	else		sprintf(filename, "%d.chat", id);
+
+	if( type ) {
+		// tracks are assembled from the chunk store
+		struct chunk_manifest manifest;
+		struct chunk_ref *refs;
+		if( read_manifest( id, &manifest, &refs ) < 0 ) {
+			len = 0;
+			write( sockfd, &len, sizeof( len ) );
+			return -1;
+		}
+		len = manifest.length;
+		write( sockfd, &len, sizeof( len ) );
+		readcount = store.assemble( refs, manifest.count, sockfd );
+		delete[] refs;
+		return readcount < 0 ? -2 : 0;
+	}
+
+	sprintf(filename, "%d.chat", id);
 	fd = open(filename, O_RDONLY );
 	if( fd < 0 ) {
 		// not found, send length 0
@@ -166,11 +264,11 @@ int process_download_connect(int sockfd) {
 	while( !request.close ) {
 		readcount = read( sockfd, &request, sizeof( request ) );
 		if( readcount < (int) sizeof( request )) {
-			fprintf(stderr, "(download) invalid read size of %d\n", readcount );
+			logger.put( LOG_ERROR, "(download) invalid read size of %d\n", readcount );
 			return -1;
 		}
 		// decode the address in the request
-		fprintf(stderr, "(download) request: close=%d type=%d ident=%x\n", 
+		logger.put( LOG_DEBUG, "(download) request: close=%d type=%d ident=%x\n", 
 			request.close, request.type, request.ident );
 		if( request.close ) continue;
 		
@@ -189,7 +287,7 @@ int process_download_connect(int sockfd) {
 				write( sockfd, buffer, len );
 				delete buffer;
 			} else
-				fprintf(stderr, "(download) failure to read STATE\n");			
+				logger.put( LOG_ERROR, "(download) failure to read STATE\n");			
 		}
 		else if( request.type == REQ_SECTIONS ) { 
 			int fd = open("SECTIONS", O_RDONLY );
@@ -202,12 +300,40 @@ int process_download_connect(int sockfd) {
 				write( sockfd, buffer, len );
 				delete buffer;
 			} else
-				fprintf(stderr, "(download) failure to read SECTIONS\n");			
+				logger.put( LOG_ERROR, "(download) failure to read SECTIONS\n");			
 		}
 		else if( request.type == REQ_TRACK )
-			writefromident( sockfd, request.ident, 0 );
-		else if( request.type == REQ_CHAT )
 			writefromident( sockfd, request.ident, 1 );
+		else if( request.type == REQ_CHAT )
+			writefromident( sockfd, request.ident, 0 );
+		else if( request.type == REQ_MANIFEST ) {
+			struct chunk_manifest manifest;
+			struct chunk_ref *refs = NULL;
+			if( read_manifest( request.ident, &manifest, &refs ) < 0 ) {
+				// not found, send an empty manifest
+				manifest.magic = MANIFEST_MAGIC;
+				manifest.count = 0;
+				manifest.length = 0;
+			}
+			write( sockfd, &manifest, sizeof manifest );
+			if( manifest.count )
+				write( sockfd, refs, sizeof( struct chunk_ref ) * manifest.count );
+			delete[] refs;
+		}
+		else if( request.type == REQ_CHUNK ) {
+			struct chunk_ref ref;
+			unsigned int length;
+			unsigned char *chunk = new unsigned char[CHUNK_MAX];
+			memcpy( ref.digest, request.digest, CHUNK_DIGEST_LEN );
+			if( store.fetch( &ref, chunk ) < 0 ) {
+				logger.put( LOG_ERROR, "(download) chunk not found\n" );
+				ref.length = 0;
+			}
+			length = ref.length;
+			write( sockfd, &length, sizeof length );
+			write( sockfd, chunk, length );
+			delete[] chunk;
+		}
 			
 	}
 	return 0;
@@ -234,11 +360,11 @@ int process_upload_connect(int sockfd) {
 	while( !request.close ) {
 		readcount = read( sockfd, &request, sizeof( request ) );
 		if( readcount < (int) sizeof( request )) {
-			fprintf(stderr, "(upload) invalid read size of %d\n", readcount );
+			logger.put( LOG_ERROR, "(upload) invalid read size of %d\n", readcount );
 			return -1;
 		}
 		// decode the the request
-		fprintf(stderr, "(upload) request: close=%d type=%d bytecount=%d\n", 
+		logger.put( LOG_DEBUG, "(upload) request: close=%d type=%d bytecount=%d\n", 
 			request.close, request.type, (int)request.bytecount );
 		if( request.close ) continue;
 		
@@ -262,31 +388,120 @@ int process_upload_connect(int sockfd) {
 			continue;
 		}
 		
+		if( request.type == REQ_HAVE ) {
+			// tell the engine which of its chunks we already hold
+			int count = request.bytecount;
+			if( count < 0 || count > CHUNK_COUNT_MAX ) {
+				logger.put( LOG_ERROR, "(upload) bad chunk count %d\n", count );
+				return -1;
+			}
+			struct chunk_ref *refs = new struct chunk_ref[count];
+			unsigned char *flags = new unsigned char[count];
+			if( read_complete( sockfd, refs, sizeof( struct chunk_ref ) * count ) < 
+					(int)sizeof( struct chunk_ref ) * count ) {
+				logger.put( LOG_ERROR, "(upload) short chunk list\n" );
+				delete[] refs;
+				delete[] flags;
+				return -1;
+			}
+			for( int i = 0; i < count; i++ )
+				flags[i] = store.have( &refs[i] );
+			write( sockfd, flags, count );
+			delete[] refs;
+			delete[] flags;
+			continue;
+		}
+
+		if( request.type == REQ_CHUNKTRACK ) {
+			// a chunk list, then the bytes of each chunk flagged as following
+			int count = request.bytecount, stored = 0;
+			long int length = 0;
+			bool failed = false;
+			if( count < 0 || count > CHUNK_COUNT_MAX ) {
+				logger.put( LOG_ERROR, "(upload) bad chunk count %d\n", count );
+				return -1;
+			}
+			struct chunk_ref *refs = new struct chunk_ref[count];
+			unsigned char *flags = new unsigned char[count];
+			unsigned char *chunk = new unsigned char[CHUNK_MAX];
+			if( read_complete( sockfd, refs, sizeof( struct chunk_ref ) * count ) < 
+					(int)sizeof( struct chunk_ref ) * count ||
+				read_complete( sockfd, flags, count ) < count ) {
+				logger.put( LOG_ERROR, "(upload) short chunk list\n" );
+				delete[] refs;
+				delete[] flags;
+				delete[] chunk;
+				return -1;
+			}
+			for( int i = 0; i < count; i++ ) {
+				length += refs[i].length;
+				if( !flags[i] ) continue;
+				if( refs[i].length > CHUNK_MAX || 
+					read_complete( sockfd, chunk, refs[i].length ) < (int)refs[i].length ) {
+					logger.put( LOG_ERROR, "(upload) short chunk %d\n", i );
+					delete[] refs;
+					delete[] flags;
+					delete[] chunk;
+					return -1;
+				}
+				if( !store.verify( &refs[i], chunk ) || store.store( &refs[i], chunk ) ) 
+					failed = true;
+				stored++;
+			}
+			for( int i = 0; i < count && !failed; i++ )
+				if( !store.have( &refs[i] ) ) failed = true;
+
+			id = 0;
+			if( failed ) 
+				logger.put( LOG_ERROR, "(upload) chunked track rejected\n" );
+			else if( write_manifest( (id = uniquetrackid()), refs, count, length ) < 0 )
+				id = 0;
+			logger.put( LOG_INFO, "(upload) chunked track %d: %d chunks, %d new, sending ident: %d\n", 
+				id, count, stored, id );
+			write( sockfd, &id, sizeof( id ));
+			delete[] refs;
+			delete[] flags;
+			delete[] chunk;
+			continue;
+		}
+
 		// now transfer these bytes from socket to a file with name of id
 		// using bytecount given in request
 		// determine the unique id at this time
 		sprintf(filename, "%d.part", (id = uniquetrackid()) );
 		fd = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0777  );
 		if( fd < 0 ) {
-			fprintf(stderr, "(upload) failure to create file '%s'\n", filename );
+			logger.put( LOG_ERROR, "(upload) failure to create file '%s'\n", filename );
 			return -1;
 		}
 		long int count = request.bytecount;
 		while( count > 0 ) {
-			readcount = read( sockfd, buffer, BUFFER_SIZE );
+			readcount = read( sockfd, ::buffer, BUFFER_SIZE );
+			if( readcount <= 0 ) break;
 			count -= readcount;
-			write( fd, buffer, readcount );
+			write( fd, ::buffer, readcount );
 		}
 		close(fd);
-		fprintf(stderr, "(upload) transfer complete, sending ident: %d\n", id );
+		logger.put( LOG_INFO, "(upload) transfer complete, sending ident: %d\n", id );
 		
 		// send unique id back to client
 		write( sockfd, &id, sizeof( id ));
 		
-		// rename the file to the correct name
-		sprintf(newname, "%d.done", id);
-		int ret = rename( filename, newname );
-		if( ret < 0 ) fprintf(stderr, "rename failure");
+		// move the payload into the chunk store and keep only its manifest
+		struct chunk_ref *refs;
+		fd = open(filename, O_RDONLY );
+		int chunks = store.split( fd, &refs, true );
+		long int length = lseek( fd, 0, SEEK_END );
+		close( fd );
+		if( chunks >= 0 && write_manifest( id, refs, chunks, length ) == 0 ) {
+			unlink( filename );
+			delete[] refs;
+		} else {
+			// rename the file to the correct name
+			sprintf(newname, "%d.done", id);
+			int ret = rename( filename, newname );
+			if( ret < 0 ) logger.put( LOG_ERROR, "rename failure\n" );
+		}
 	}
 	return 0;
 }
@@ -297,6 +512,10 @@ int main (int argc, char *argv[]) {
 	const char *port, *pname;
 	int tmpfd, socket_fd, conn_fd, pid;
 	
+	// no writer thread to survive the forks, each process writes its own
+	// messages out as it logs them, all of them as the server always has
+	logger.level = LOG_DEBUG;
+
 	// figure out where to start unique id's at
 	maxids(&track_uid, &chat_uid);
 	fprintf(stderr, "Last unique trackid = %d, chatid = %d\nDetecting other files: ", track_uid, chat_uid );
@@ -323,35 +542,35 @@ int main (int argc, char *argv[]) {
 	if( init_socket(port, &socket_fd) ) return 1;
 	
 	listen( socket_fd, 10 );
-	fprintf(stderr, "(%s) listening on port %s\n", pname, port );
+	logger.put( LOG_INFO, "(%s) listening on port %s\n", pname, port );
 	
 	if( mainpid ) // download port
 		while( 1 ) {
 			
 			conn_fd = accept(socket_fd, (struct sockaddr*)NULL, NULL); 
-			fprintf(stderr,"(%s) return from accept, forking...\n", pname);
+			logger.put( LOG_DEBUG, "(%s) return from accept, forking...\n", pname);
 			if( (pid = fork()) == 0 ) {
 
-				fprintf(stderr,"(%s) child processing connect on %s\n", pname, port);
+				logger.put( LOG_DEBUG, "(%s) child processing connect on %s\n", pname, port);
 				if( mainpid ) process_download_connect(conn_fd);
 				else		  process_upload_connect(conn_fd);
 				
 				close( conn_fd );
-				fprintf(stderr,"(%s) child complete\n", pname);
+				logger.put( LOG_DEBUG, "(%s) child complete\n", pname);
 				break;
 				
 			} else {
-				fprintf(stderr, "(%s) created child pid %d. Looping to call accept.\n", pname, pid);
+				logger.put( LOG_DEBUG, "(%s) created child pid %d. Looping to call accept.\n", pname, pid);
 				close( conn_fd );
 			}
 		}
 	else	// upload port
 		while( 1 ) {
 			conn_fd = accept(socket_fd, (struct sockaddr*)NULL, NULL); 
-			fprintf(stderr,"(%s) return from accept, processing connect on %s\n", pname, port);
+			logger.put( LOG_DEBUG, "(%s) return from accept, processing connect on %s\n", pname, port);
 			process_upload_connect(conn_fd);
 			close( conn_fd );
-			fprintf(stderr,"(%s) connect complete, calling accept\n", pname);
+			logger.put( LOG_DEBUG, "(%s) connect complete, calling accept\n", pname);
 		}
 	
 	close( socket_fd );